@@ -27,7 +27,8 @@ int main(int argc, char** argv)
         return 0;
     }
 
-    const GltfModel      model(argv[1]);
+    // The textures are never sampled, so their images are not decoded.
+    const GltfModel      model = GltfModel::withDeferredTextures(argv[1]);
     const FlattenedModel flattenedModel(model);
     const Bvh            bvh = buildBvh(flattenedModel.positions);
     const auto           triangles =
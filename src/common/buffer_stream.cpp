@@ -1,18 +1,58 @@
 #include "assert.hpp"
 #include "buffer_stream.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
 namespace nlrs
 {
+BufferStream::BufferStream(std::vector<std::byte> bytes)
+    : mBuffer(std::move(bytes)),
+      mReadOffset(0)
+{
+}
+
 std::size_t BufferStream::read(char* data, std::size_t numBytes)
 {
-    mBufferStream.read(data, numBytes);
-    const auto bytesRead = mBufferStream.gcount();
-    NLRS_ASSERT(bytesRead >= 0);
-    return static_cast<std::size_t>(bytesRead);
+    const std::span<const std::byte> bytes = readSpan(numBytes);
+    if (!bytes.empty())
+    {
+        std::memcpy(data, bytes.data(), bytes.size());
+    }
+    return bytes.size();
 }
 
 void BufferStream::write(const char* data, std::size_t numBytes)
 {
-    mBufferStream.write(data, numBytes);
+    if (mReadOffset == mBuffer.size())
+    {
+        // Everything has been read, so the buffer can be reused from the start.
+        mBuffer.clear();
+        mReadOffset = 0;
+    }
+    const auto* const bytes = reinterpret_cast<const std::byte*>(data);
+    mBuffer.insert(mBuffer.end(), bytes, bytes + numBytes);
+}
+
+std::span<const std::byte> BufferStream::readSpan(const std::size_t numBytes) noexcept
+{
+    const std::size_t numRead = std::min(numBytes, numUnreadBytes());
+    const std::span<const std::byte> bytes = std::span(mBuffer).subspan(mReadOffset, numRead);
+    mReadOffset += numRead;
+    NLRS_ASSERT(mReadOffset <= mBuffer.size());
+    return bytes;
+}
+
+void BufferStream::reserve(const std::size_t numBytes)
+{
+    mBuffer.reserve(mReadOffset + numBytes);
+}
+
+std::vector<std::byte> BufferStream::release()
+{
+    mBuffer.erase(mBuffer.begin(), mBuffer.begin() + static_cast<std::ptrdiff_t>(mReadOffset));
+    mReadOffset = 0;
+    return std::exchange(mBuffer, {});
 }
 } // namespace nlrs
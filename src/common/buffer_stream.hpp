@@ -1,21 +1,48 @@
+#pragma once
+
 #include "stream.hpp"
 
 #include <cstddef>
-#include <sstream>
+#include <span>
+#include <vector>
 
 namespace nlrs
 {
+// A contiguous, growable byte buffer. Writes append to the end of the buffer, and reads consume
+// bytes from the front. The unread bytes can also be accessed in place with `readSpan` and
+// `unreadBytes`, and the buffer can be adopted from and released to a vector, e.g. to hand a
+// serialized scene from one component to another without copying it.
 class BufferStream : public InputStream, public OutputStream
 {
 public:
     BufferStream() = default;
+    explicit BufferStream(std::vector<std::byte> bytes);
     virtual ~BufferStream() = default;
 
     virtual std::size_t read(char* data, std::size_t numBytes) override;
 
     virtual void write(const char* data, std::size_t numBytes) override;
 
+    // Consumes up to `numBytes` bytes, and returns them without copying. The span is invalidated
+    // by the next write.
+    std::span<const std::byte> readSpan(std::size_t numBytes) noexcept;
+
+    std::span<const std::byte> unreadBytes() const noexcept
+    {
+        return std::span(mBuffer).subspan(mReadOffset);
+    }
+    std::size_t numUnreadBytes() const noexcept { return mBuffer.size() - mReadOffset; }
+
+    // Reserves space for `numBytes` unread bytes in total, so that writing them does not
+    // reallocate the buffer.
+    void        reserve(std::size_t numBytes);
+    std::size_t capacity() const noexcept { return mBuffer.capacity() - mReadOffset; }
+
+    // Returns the unread bytes, and leaves the stream empty.
+    std::vector<std::byte> release();
+
 private:
-    std::basic_stringstream<char> mBufferStream;
+    std::vector<std::byte> mBuffer;
+    std::size_t            mReadOffset = 0;
 };
 } // namespace nlrs
@@ -0,0 +1,165 @@
+#include "assert.hpp"
+#include "deferred_texture.hpp"
+#include "hash.hpp"
+
+#include <fmt/core.h>
+#include <stb_image.h>
+
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace nlrs
+{
+TextureResidencyCache::TextureResidencyCache(const std::size_t maxNumBytes)
+    : mMutex(),
+      mEntries(),
+      mLookup(),
+      mMaxNumBytes(maxNumBytes),
+      mStats{.residentNumBytes = 0, .numHits = 0, .numMisses = 0, .numEvictions = 0}
+{
+}
+
+std::shared_ptr<const Texture> TextureResidencyCache::acquire(
+    const std::uint64_t             key,
+    const std::function<Texture()>& decode)
+{
+    std::promise<std::shared_ptr<const Texture>> promise;
+    std::list<Entry>::iterator                   entry;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (const auto lookup = mLookup.find(key); lookup != mLookup.end())
+        {
+            mEntries.splice(mEntries.begin(), mEntries, lookup->second);
+            mStats.numHits += 1;
+            // Copy the future, so that waiting for it does not hold the lock.
+            const std::shared_future<std::shared_ptr<const Texture>> texture =
+                lookup->second->texture;
+            lock.unlock();
+            return texture.get();
+        }
+
+        mStats.numMisses += 1;
+        mEntries.push_front(Entry{
+            .key = key,
+            .texture = promise.get_future().share(),
+            .numBytes = 0,
+            .isDecoded = false});
+        entry = mEntries.begin();
+        mLookup.emplace(key, entry);
+    }
+
+    // Decode outside of the lock, so that other textures can be acquired in the meantime.
+    std::shared_ptr<const Texture> texture;
+    try
+    {
+        texture = std::make_shared<const Texture>(decode());
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mMutex);
+        mLookup.erase(key);
+        mEntries.erase(entry);
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    promise.set_value(texture);
+    entry->numBytes = texture->mipChain().size_bytes();
+    entry->isDecoded = true;
+    mStats.residentNumBytes += entry->numBytes;
+    evict(entry);
+    return texture;
+}
+
+TextureResidencyStats TextureResidencyCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+void TextureResidencyCache::evict(const std::list<Entry>::const_iterator keep)
+{
+    auto it = mEntries.end();
+    while (mStats.residentNumBytes > mMaxNumBytes && it != mEntries.begin())
+    {
+        --it;
+        if (it == keep || !it->isDecoded)
+        {
+            continue;
+        }
+        NLRS_ASSERT(mStats.residentNumBytes >= it->numBytes);
+        mStats.residentNumBytes -= it->numBytes;
+        mStats.numEvictions += 1;
+        mLookup.erase(it->key);
+        it = mEntries.erase(it);
+    }
+}
+
+std::uint64_t encodedImageKey(const std::span<const std::uint8_t> encodedImage) noexcept
+{
+    return fnv1a(encodedImage.data(), encodedImage.size());
+}
+
+DeferredTexture::DeferredTexture(std::vector<std::uint8_t> encodedImage)
+    : mState(std::make_unique<State>()),
+      mDimensions{0, 0},
+      mKey(encodedImageKey(encodedImage))
+{
+    int width;
+    int height;
+    int numChannels;
+    if (stbi_info_from_memory(
+            encodedImage.data(),
+            static_cast<int>(encodedImage.size()),
+            &width,
+            &height,
+            &numChannels) == 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "Failed to read the header of an encoded image of {} bytes.", encodedImage.size()));
+    }
+    mDimensions = Texture::Dimensions{
+        static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)};
+    mState->encodedImage = std::move(encodedImage);
+}
+
+DeferredTexture::DeferredTexture(Texture texture)
+    : mState(std::make_unique<State>()),
+      mDimensions(texture.dimensions()),
+      mKey(0)
+{
+    mState->texture = std::make_shared<const Texture>(std::move(texture));
+}
+
+std::size_t DeferredTexture::encodedNumBytes() const
+{
+    const std::lock_guard lock(mState->mutex);
+    return mState->encodedImage.size();
+}
+
+const Texture& DeferredTexture::texture() const
+{
+    const std::lock_guard lock(mState->mutex);
+    if (mState->texture == nullptr)
+    {
+        mState->texture =
+            std::make_shared<const Texture>(Texture::fromMemory(mState->encodedImage));
+        mState->encodedImage = std::vector<std::uint8_t>();
+    }
+    return *mState->texture;
+}
+
+std::shared_ptr<const Texture> DeferredTexture::texture(TextureResidencyCache& cache) const
+{
+    // Held while decoding, so that texture() does not release the encoded image meanwhile.
+    const std::lock_guard lock(mState->mutex);
+    if (mState->texture != nullptr)
+    {
+        return mState->texture;
+    }
+    return cache.acquire(
+        mKey, [this]() -> Texture { return Texture::fromMemory(mState->encodedImage); });
+}
+} // namespace nlrs
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "texture.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace nlrs
+{
+struct TextureResidencyStats
+{
+    std::size_t   residentNumBytes;
+    std::uint64_t numHits;
+    std::uint64_t numMisses;
+    std::uint64_t numEvictions;
+};
+
+// Keeps the most recently used decoded textures resident, up to a budget of bytes. The least
+// recently used textures are evicted when the budget is exceeded. A texture which is still
+// referenced stays alive after its eviction, so the budget bounds the memory held by the cache, not
+// the memory held by its users. Safe to use from several threads.
+class TextureResidencyCache
+{
+public:
+    explicit TextureResidencyCache(std::size_t maxNumBytes);
+
+    TextureResidencyCache(const TextureResidencyCache&) = delete;
+    TextureResidencyCache& operator=(const TextureResidencyCache&) = delete;
+
+    TextureResidencyCache(TextureResidencyCache&&) = delete;
+    TextureResidencyCache& operator=(TextureResidencyCache&&) = delete;
+
+    // Returns the texture with `key`, and calls `decode` to create it if it is not resident. The
+    // texture is decoded once even if several threads acquire it at the same time: the other
+    // threads wait for the decoded texture instead of decoding it again. If `decode` throws, the
+    // exception is rethrown to each waiting thread, and the texture is not cached.
+    std::shared_ptr<const Texture> acquire(
+        std::uint64_t                   key,
+        const std::function<Texture()>& decode);
+
+    TextureResidencyStats stats() const;
+
+private:
+    struct Entry
+    {
+        std::uint64_t                                      key;
+        std::shared_future<std::shared_ptr<const Texture>> texture;
+        std::size_t                                        numBytes;
+        // Entries which are being decoded are not evicted.
+        bool                                               isDecoded;
+    };
+
+    // Evicts the least recently used entries until the resident textures fit in the budget, or
+    // only `keep` remains.
+    void evict(std::list<Entry>::const_iterator keep);
+
+    mutable std::mutex                                            mMutex;
+    // The most recently used entry first.
+    std::list<Entry>                                              mEntries;
+    std::unordered_map<std::uint64_t, std::list<Entry>::iterator> mLookup;
+    std::size_t                                                   mMaxNumBytes;
+    TextureResidencyStats                                         mStats;
+};
+
+// The key of an encoded image in a TextureResidencyCache. Identical images have the same key, so
+// that they are decoded once.
+std::uint64_t encodedImageKey(std::span<const std::uint8_t> encodedImage) noexcept;
+
+// A texture whose encoded image, e.g. a PNG or JPEG file, is decoded on first access, so that tools
+// which never sample the textures do not pay for decoding them. The texture is either decoded once
+// and kept, after which the encoded image is released, or decoded into a TextureResidencyCache,
+// which keeps it within the cache's budget. The encoded image is then kept, so that the texture can
+// be decoded again once the cache has evicted it.
+class DeferredTexture
+{
+public:
+    // `encodedImage` is decoded with Texture::fromMemory.
+    explicit DeferredTexture(std::vector<std::uint8_t> encodedImage);
+    // A texture which is already decoded, e.g. from a constant color. It does not occupy the
+    // residency caches.
+    explicit DeferredTexture(Texture texture);
+
+    DeferredTexture(const DeferredTexture&) = delete;
+    DeferredTexture& operator=(const DeferredTexture&) = delete;
+
+    DeferredTexture(DeferredTexture&&) = default;
+    DeferredTexture& operator=(DeferredTexture&&) = default;
+
+    // Read from the image header, without decoding the image.
+    Texture::Dimensions dimensions() const noexcept { return mDimensions; }
+
+    // The size of the encoded image, which is 0 once texture() has decoded it.
+    std::size_t encodedNumBytes() const;
+
+    // Returns the decoded texture, decoding the image on the first call and releasing the encoded
+    // image. Safe to call from several threads: the image is decoded once, and the other threads
+    // wait for it. If decoding throws, the next call decodes the image again.
+    const Texture& texture() const;
+
+    // Returns the decoded texture from `cache`, decoding the image if it is not resident. Returns
+    // the kept texture instead if texture() has already decoded it.
+    std::shared_ptr<const Texture> texture(TextureResidencyCache& cache) const;
+
+private:
+    struct State
+    {
+        std::mutex                     mutex;
+        // Empty once `texture` is set.
+        std::vector<std::uint8_t>      encodedImage;
+        std::shared_ptr<const Texture> texture;
+    };
+
+    // Behind a pointer, so that the DeferredTexture can be moved.
+    std::unique_ptr<State> mState;
+    Texture::Dimensions    mDimensions;
+    std::uint64_t          mKey;
+};
+} // namespace nlrs
@@ -1,39 +1,524 @@
 #include "assert.hpp"
 #include "file_stream.hpp"
+#include "thread_pool.hpp"
 
 #include <fmt/format.h>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <new>
 #include <stdexcept>
+#include <utility>
 
 namespace nlrs
 {
-InputFileStream::InputFileStream(const std::filesystem::path file)
+namespace
+{
+FileBlockPtr allocateBlock(const std::size_t numBytes)
+{
+    return FileBlockPtr(static_cast<std::byte*>(
+        ::operator new[](numBytes, std::align_val_t(FILE_BLOCK_ALIGNMENT))));
+}
+
+bool isAligned(const void* const data)
+{
+    return reinterpret_cast<std::uintptr_t>(data) % FILE_BLOCK_ALIGNMENT == 0;
+}
+
+std::size_t alignUp(const std::size_t numBytes)
+{
+    return (numBytes + FILE_BLOCK_ALIGNMENT - 1) / FILE_BLOCK_ALIGNMENT * FILE_BLOCK_ALIGNMENT;
+}
+
+[[noreturn]] void throwReadError(const std::filesystem::path& path)
+{
+    throw std::runtime_error(fmt::format("Failed to read file: {}", path.string()));
+}
+
+[[noreturn]] void throwWriteError(const std::filesystem::path& path)
+{
+    throw std::runtime_error(fmt::format("Failed to write file: {}", path.string()));
+}
+
+#if defined(_WIN32)
+// ReadFile and WriteFile take the size as a DWORD.
+constexpr std::size_t MAX_TRANSFER_SIZE = 1 << 30;
+
+OVERLAPPED overlappedAt(const std::uint64_t offset)
+{
+    OVERLAPPED overlapped{};
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    return overlapped;
+}
+
+// Returns the number of bytes read, which is less than `numBytes` at the end of the file.
+std::size_t readAt(
+    void* const                  handle,
+    const std::filesystem::path& path,
+    const std::uint64_t          offset,
+    std::byte* const             data,
+    const std::size_t            numBytes)
+{
+    std::size_t numRead = 0;
+    while (numRead < numBytes)
+    {
+        OVERLAPPED  overlapped = overlappedAt(offset + numRead);
+        const DWORD size = static_cast<DWORD>(std::min(numBytes - numRead, MAX_TRANSFER_SIZE));
+        DWORD       n = 0;
+        if (!ReadFile(handle, data + numRead, size, &n, &overlapped))
+        {
+            if (GetLastError() == ERROR_HANDLE_EOF)
+            {
+                break;
+            }
+            throwReadError(path);
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        numRead += n;
+    }
+    return numRead;
+}
+
+void writeAt(
+    void* const                  handle,
+    const std::filesystem::path& path,
+    const std::uint64_t          offset,
+    const std::byte* const       data,
+    const std::size_t            numBytes)
+{
+    std::size_t numWritten = 0;
+    while (numWritten < numBytes)
+    {
+        OVERLAPPED  overlapped = overlappedAt(offset + numWritten);
+        const DWORD size = static_cast<DWORD>(std::min(numBytes - numWritten, MAX_TRANSFER_SIZE));
+        DWORD       n = 0;
+        if (!WriteFile(handle, data + numWritten, size, &n, &overlapped) || n == 0)
+        {
+            throwWriteError(path);
+        }
+        numWritten += n;
+    }
+}
+#else
+// Returns the number of bytes read, which is less than `numBytes` at the end of the file.
+std::size_t readAt(
+    const int                    fd,
+    const std::filesystem::path& path,
+    const std::uint64_t          offset,
+    std::byte* const             data,
+    const std::size_t            numBytes)
+{
+    std::size_t numRead = 0;
+    while (numRead < numBytes)
+    {
+        const ssize_t n = pread(
+            fd, data + numRead, numBytes - numRead, static_cast<off_t>(offset + numRead));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throwReadError(path);
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        numRead += static_cast<std::size_t>(n);
+    }
+    return numRead;
+}
+
+void writeAt(
+    const int                    fd,
+    const std::filesystem::path& path,
+    const std::uint64_t          offset,
+    const std::byte* const       data,
+    const std::size_t            numBytes)
+{
+    std::size_t numWritten = 0;
+    while (numWritten < numBytes)
+    {
+        const ssize_t n = pwrite(
+            fd, data + numWritten, numBytes - numWritten, static_cast<off_t>(offset + numWritten));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throwWriteError(path);
+        }
+        numWritten += static_cast<std::size_t>(n);
+    }
+}
+
+// Opens the file with O_DIRECT if `directIo` is set and the file system supports it, and clears
+// `directIo` otherwise.
+int openFile(const std::filesystem::path& path, const int flags, bool& directIo)
+{
+#if defined(O_DIRECT)
+    if (directIo)
+    {
+        const int fd = open(path.c_str(), flags | O_DIRECT, 0666);
+        if (fd >= 0 || errno != EINVAL)
+        {
+            return fd;
+        }
+    }
+#endif
+    const int fd = open(path.c_str(), flags, 0666);
+#if defined(__APPLE__)
+    if (fd >= 0 && directIo)
+    {
+        directIo = fcntl(fd, F_NOCACHE, 1) == 0;
+    }
+#else
+    directIo = false;
+#endif
+    return fd;
+}
+#endif
+} // namespace
+
+void FileBlockDeleter::operator()(std::byte* const block) const noexcept
+{
+    ::operator delete[](block, std::align_val_t(FILE_BLOCK_ALIGNMENT));
+}
+
+InputFileStream::InputFileStream(const std::filesystem::path& file, const FileStreamOptions options)
+    : mPath(file),
+      mOptions(options),
+#if defined(_WIN32)
+      mHandle(INVALID_HANDLE_VALUE),
+#else
+      mFd(-1),
+#endif
+      mFileSize(0),
+      mFileOffset(0),
+      mBuffer(allocateBlock(options.blockSize)),
+      mBufferBegin(0),
+      mBufferEnd(0),
+      mThreadPool(options.numThreads > 1 ? std::make_unique<ThreadPool>(options.numThreads - 1)
+                                         : nullptr)
 {
-    mFileStream.open(file, std::ios::binary | std::ios::in);
-    if (!mFileStream.is_open())
+    NLRS_ASSERT(mOptions.blockSize > 0 && mOptions.blockSize % FILE_BLOCK_ALIGNMENT == 0);
+#if defined(_WIN32)
+    // Unbuffered reads require sector aligned sizes, which the stream does not guarantee.
+    mOptions.directIo = false;
+    mHandle = CreateFileW(
+        file.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if (mHandle == INVALID_HANDLE_VALUE)
     {
         throw std::runtime_error(fmt::format("Failed to open file: {}", file.string()));
     }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(mHandle, &fileSize))
+    {
+        CloseHandle(mHandle);
+        throw std::runtime_error(fmt::format("Failed to get the size of file: {}", file.string()));
+    }
+    mFileSize = static_cast<std::uint64_t>(fileSize.QuadPart);
+#else
+    mFd = openFile(file, O_RDONLY | O_CLOEXEC, mOptions.directIo);
+    if (mFd < 0)
+    {
+        throw std::runtime_error(fmt::format("Failed to open file: {}", file.string()));
+    }
+    struct stat fileStat;
+    if (fstat(mFd, &fileStat) != 0)
+    {
+        ::close(mFd);
+        throw std::runtime_error(fmt::format("Failed to get the size of file: {}", file.string()));
+    }
+    mFileSize = static_cast<std::uint64_t>(fileStat.st_size);
+#if defined(__linux__)
+    posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(__APPLE__)
+    fcntl(mFd, F_RDAHEAD, 1);
+#endif
+#endif
 }
-std::size_t InputFileStream::read(char* data, std::size_t numBytes)
+
+InputFileStream::~InputFileStream()
 {
-    mFileStream.read(data, numBytes);
-    const auto bytesRead = mFileStream.gcount();
-    NLRS_ASSERT(bytesRead >= 0);
-    return static_cast<std::size_t>(bytesRead);
+#if defined(_WIN32)
+    CloseHandle(mHandle);
+#else
+    ::close(mFd);
+#endif
 }
 
-OutputFileStream::OutputFileStream(const std::filesystem::path file)
+std::size_t InputFileStream::read(char* const data, const std::size_t numBytes)
 {
-    mFileStream.open(file, std::ios::binary | std::ios::out);
-    if (!mFileStream.is_open())
+    std::byte* const bytes = reinterpret_cast<std::byte*>(data);
+    const std::size_t blockSize = mOptions.blockSize;
+
+    std::size_t numRead = 0;
+    while (numRead < numBytes)
+    {
+        if (mBufferBegin == mBufferEnd)
+        {
+            const std::uint64_t fileRemaining = mFileSize - mFileOffset;
+            if (fileRemaining == 0)
+            {
+                break;
+            }
+
+            // Whole blocks are read straight into the destination. Direct I/O additionally
+            // requires the destination to be aligned.
+            const std::size_t numBlockBytes = static_cast<std::size_t>(
+                std::min<std::uint64_t>(numBytes - numRead, fileRemaining) / blockSize * blockSize);
+            if (numBlockBytes > 0 && (!mOptions.directIo || isAligned(bytes + numRead)))
+            {
+                readBlocks(mFileOffset, bytes + numRead, numBlockBytes);
+                mFileOffset += numBlockBytes;
+                numRead += numBlockBytes;
+                continue;
+            }
+
+            mBufferBegin = 0;
+            mBufferEnd =
+                static_cast<std::size_t>(std::min<std::uint64_t>(blockSize, fileRemaining));
+            readBlocks(mFileOffset, mBuffer.get(), mBufferEnd);
+            mFileOffset += mBufferEnd;
+        }
+
+        const std::size_t n = std::min(numBytes - numRead, mBufferEnd - mBufferBegin);
+        std::memcpy(bytes + numRead, mBuffer.get() + mBufferBegin, n);
+        mBufferBegin += n;
+        numRead += n;
+    }
+    return numRead;
+}
+
+void InputFileStream::readBlocks(
+    const std::uint64_t offset,
+    std::byte* const    data,
+    const std::size_t   numBytes)
+{
+    const auto readBlock = [this, offset, data](const std::size_t begin, const std::size_t size) {
+        // Direct I/O reads whole blocks, so the end of the file is read with a larger size.
+        const std::size_t requestSize = mOptions.directIo ? alignUp(size) : size;
+#if defined(_WIN32)
+        void* const handle = mHandle;
+#else
+        const int handle = mFd;
+#endif
+        if (readAt(handle, mPath, offset + begin, data + begin, requestSize) < size)
+        {
+            // The file was truncated while it was being read.
+            throwReadError(mPath);
+        }
+    };
+
+    const std::size_t blockSize = mOptions.blockSize;
+    if (mThreadPool == nullptr || numBytes <= blockSize)
+    {
+        readBlock(0, numBytes);
+        return;
+    }
+    for (std::size_t begin = 0; begin < numBytes; begin += blockSize)
+    {
+        mThreadPool->push([&readBlock, begin, size = std::min(blockSize, numBytes - begin)]() {
+            readBlock(begin, size);
+        });
+    }
+    mThreadPool->wait();
+}
+
+OutputFileStream::OutputFileStream(
+    const std::filesystem::path& file,
+    const FileStreamOptions      options)
+    : mPath(file),
+      mOptions(options),
+#if defined(_WIN32)
+      mHandle(INVALID_HANDLE_VALUE),
+#else
+      mFd(-1),
+#endif
+      mFileOffset(0),
+      mBuffer(allocateBlock(options.blockSize)),
+      mBufferSize(0)
+{
+    NLRS_ASSERT(mOptions.blockSize > 0 && mOptions.blockSize % FILE_BLOCK_ALIGNMENT == 0);
+#if defined(_WIN32)
+    // Unbuffered writes require sector aligned sizes, which the stream does not guarantee.
+    mOptions.directIo = false;
+    mHandle = CreateFileW(
+        file.c_str(),
+        GENERIC_WRITE,
+        0,
+        nullptr,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+    if (mHandle == INVALID_HANDLE_VALUE)
     {
         throw std::runtime_error(fmt::format("Failed to open file: {}", file.string()));
     }
+#else
+    mFd = openFile(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mOptions.directIo);
+    if (mFd < 0)
+    {
+        throw std::runtime_error(fmt::format("Failed to open file: {}", file.string()));
+    }
+#endif
 }
 
-void OutputFileStream::write(const char* data, std::size_t numBytes)
+OutputFileStream::~OutputFileStream()
 {
-    mFileStream.write(data, numBytes);
+    try
+    {
+        close();
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+}
+
+void OutputFileStream::write(const char* const data, const std::size_t numBytes)
+{
+    const std::byte*  bytes = reinterpret_cast<const std::byte*>(data);
+    const std::size_t blockSize = mOptions.blockSize;
+
+    std::size_t numWritten = 0;
+    while (numWritten < numBytes)
+    {
+        // Whole blocks are written straight from the source. Direct I/O additionally requires the
+        // source to be aligned.
+        const std::size_t numBlockBytes = (numBytes - numWritten) / blockSize * blockSize;
+        if (mBufferSize == 0 && numBlockBytes > 0 &&
+            (!mOptions.directIo || isAligned(bytes + numWritten)))
+        {
+            writeBlocks(bytes + numWritten, numBlockBytes);
+            numWritten += numBlockBytes;
+            continue;
+        }
+
+        const std::size_t n = std::min(numBytes - numWritten, blockSize - mBufferSize);
+        std::memcpy(mBuffer.get() + mBufferSize, bytes + numWritten, n);
+        mBufferSize += n;
+        numWritten += n;
+        if (mBufferSize == blockSize)
+        {
+            mBufferSize = 0;
+            writeBlocks(mBuffer.get(), blockSize);
+        }
+    }
+}
+
+void OutputFileStream::overwrite(
+    const std::uint64_t offset,
+    const char* const   data,
+    const std::size_t   numBytes)
+{
+    NLRS_ASSERT(offset + numBytes <= mFileOffset + mBufferSize);
+    const std::byte* bytes = reinterpret_cast<const std::byte*>(data);
+
+    // The bytes which are still in the buffer are replaced there.
+    const std::size_t numFileBytes =
+        offset < mFileOffset
+            ? static_cast<std::size_t>(std::min<std::uint64_t>(numBytes, mFileOffset - offset))
+            : 0;
+    if (numFileBytes < numBytes)
+    {
+        std::memcpy(
+            mBuffer.get() + (offset + numFileBytes - mFileOffset),
+            bytes + numFileBytes,
+            numBytes - numFileBytes);
+    }
+
+    if (numFileBytes > 0)
+    {
+        disableDirectIo();
+#if defined(_WIN32)
+        writeAt(mHandle, mPath, offset, bytes, numFileBytes);
+#else
+        writeAt(mFd, mPath, offset, bytes, numFileBytes);
+#endif
+    }
+}
+
+void OutputFileStream::close()
+{
+#if defined(_WIN32)
+    if (mHandle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+#else
+    if (mFd < 0)
+    {
+        return;
+    }
+#endif
+
+    // If writing fails, the destructor still closes the file.
+    if (const std::size_t numBytes = std::exchange(mBufferSize, 0); numBytes > 0)
+    {
+        // The end of the file is not a whole block, so it is written through the page cache.
+        if (numBytes % FILE_BLOCK_ALIGNMENT != 0)
+        {
+            disableDirectIo();
+        }
+        writeBlocks(mBuffer.get(), numBytes);
+    }
+
+#if defined(_WIN32)
+    if (!CloseHandle(std::exchange(mHandle, INVALID_HANDLE_VALUE)))
+#else
+    if (::close(std::exchange(mFd, -1)) != 0)
+#endif
+    {
+        throwWriteError(mPath);
+    }
+}
+
+void OutputFileStream::writeBlocks(const std::byte* const data, const std::size_t numBytes)
+{
+#if defined(_WIN32)
+    writeAt(mHandle, mPath, mFileOffset, data, numBytes);
+#else
+    writeAt(mFd, mPath, mFileOffset, data, numBytes);
+#endif
+    mFileOffset += numBytes;
+}
+
+void OutputFileStream::disableDirectIo()
+{
+#if defined(O_DIRECT)
+    if (mOptions.directIo)
+    {
+        const int flags = fcntl(mFd, F_GETFL);
+        if (flags < 0 || fcntl(mFd, F_SETFL, flags & ~O_DIRECT) != 0)
+        {
+            throwWriteError(mPath);
+        }
+    }
+#endif
+    mOptions.directIo = false;
 }
 } // namespace nlrs
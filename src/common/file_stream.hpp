@@ -2,32 +2,106 @@
 
 #include "stream.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
-#include <fstream>
+#include <memory>
 
 namespace nlrs
 {
+class ThreadPool;
+
+struct FileStreamOptions
+{
+    // The file is read and written in blocks of this many bytes. Must be a multiple of
+    // FILE_BLOCK_ALIGNMENT.
+    std::size_t blockSize = 1 << 20;
+    // Bypasses the operating system's page cache where the platform and the file system support it
+    // (O_DIRECT on Linux, F_NOCACHE on macOS). Falls back to cached I/O otherwise.
+    bool directIo = false;
+    // Reads spanning several blocks read the blocks concurrently on this many threads.
+    std::uint32_t numThreads = 1;
+};
+
+// The alignment of the blocks in memory and in the file, as required by direct I/O.
+inline constexpr std::size_t FILE_BLOCK_ALIGNMENT = 4096;
+
+struct FileBlockDeleter
+{
+    void operator()(std::byte* block) const noexcept;
+};
+using FileBlockPtr = std::unique_ptr<std::byte[], FileBlockDeleter>;
+
+// Reads a file in large blocks, with positioned reads on the file descriptor. Reads of whole blocks
+// go straight to the caller's memory, and smaller reads are served from a buffer of one block. The
+// operating system is told that the file is read sequentially, so that it reads ahead.
 class InputFileStream : public InputStream
 {
 public:
-    InputFileStream(std::filesystem::path);
-    virtual ~InputFileStream() = default;
+    explicit InputFileStream(const std::filesystem::path& file, FileStreamOptions options = {});
+    virtual ~InputFileStream();
+
+    InputFileStream(const InputFileStream&) = delete;
+    InputFileStream& operator=(const InputFileStream&) = delete;
 
     virtual std::size_t read(char* data, std::size_t numBytes) override;
 
 private:
-    std::ifstream mFileStream;
+    // Reads `numBytes` bytes at `offset`, which must not extend past the end of the file. With
+    // direct I/O, `numBytes` is rounded up to whole blocks, and `data` must have room for them.
+    void readBlocks(std::uint64_t offset, std::byte* data, std::size_t numBytes);
+
+    std::filesystem::path       mPath;
+    FileStreamOptions           mOptions;
+#if defined(_WIN32)
+    void* mHandle;
+#else
+    int mFd;
+#endif
+    std::uint64_t               mFileSize;
+    std::uint64_t               mFileOffset;
+    FileBlockPtr                mBuffer;
+    std::size_t                 mBufferBegin;
+    std::size_t                 mBufferEnd;
+    std::unique_ptr<ThreadPool> mThreadPool;
 };
 
+// Writes a file in large blocks. Writes are collected in a buffer of one block, and writes of whole
+// blocks go straight from the caller's memory to the file. Throws if writing fails.
 class OutputFileStream : public OutputStream
 {
 public:
-    OutputFileStream(std::filesystem::path);
-    virtual ~OutputFileStream() = default;
+    explicit OutputFileStream(const std::filesystem::path& file, FileStreamOptions options = {});
+    // Closes the file, ignoring errors. Call `close` to find out whether the file was written.
+    virtual ~OutputFileStream();
+
+    OutputFileStream(const OutputFileStream&) = delete;
+    OutputFileStream& operator=(const OutputFileStream&) = delete;
 
     virtual void write(const char* data, std::size_t numBytes) override;
 
+    // Replaces `numBytes` bytes at `offset`, which must already have been written, e.g. a header
+    // whose contents are known only at the end. With direct I/O, the bytes which are already in
+    // the file, and the rest of the file, are written through the page cache.
+    void overwrite(std::uint64_t offset, const char* data, std::size_t numBytes);
+
+    // Writes the buffered bytes and closes the file.
+    void close();
+
 private:
-    std::ofstream mFileStream;
+    void writeBlocks(const std::byte* data, std::size_t numBytes);
+    // Writes the following blocks through the page cache, for writes which are not whole blocks.
+    void disableDirectIo();
+
+    std::filesystem::path mPath;
+    FileStreamOptions     mOptions;
+#if defined(_WIN32)
+    void* mHandle;
+#else
+    int mFd;
+#endif
+    std::uint64_t mFileOffset;
+    FileBlockPtr  mBuffer;
+    std::size_t   mBufferSize;
 };
 } // namespace nlrs
@@ -1,6 +1,9 @@
 #include "assert.hpp"
+#include "deferred_texture.hpp"
 #include "gltf_model.hpp"
+#include "hash.hpp"
 #include "texture.hpp"
+#include "thread_pool.hpp"
 
 #include <cgltf.h>
 #include <fmt/core.h>
@@ -17,8 +20,12 @@
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <numeric>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -71,7 +78,15 @@ void traverseNodeHierarchy(
     }
 }
 
-Texture textureFromGltfImage(const cgltf_image* const image, const fs::path& gltfPath)
+// The encoded bytes of an image, which are either embedded in the glTF buffers, or read from an
+// external file into `fileData`.
+struct EncodedImage
+{
+    std::vector<std::uint8_t>     fileData;
+    std::span<const std::uint8_t> bytes;
+};
+
+EncodedImage readEncodedImage(const cgltf_image* const image, const fs::path& gltfPath)
 {
     if (image->buffer_view)
     {
@@ -97,7 +112,7 @@ Texture textureFromGltfImage(const cgltf_image* const image, const fs::path& glt
 
             return std::span(bufferPtr + bufferOffset, byteLength);
         }();
-        return Texture::fromMemory(pixelData);
+        return EncodedImage{.fileData = {}, .bytes = pixelData};
     }
     else
     {
@@ -114,38 +129,27 @@ Texture textureFromGltfImage(const cgltf_image* const image, const fs::path& glt
         std::ifstream file(imagePath, std::ios::binary);
         NLRS_ASSERT(file.is_open());
 
-        std::vector<std::uint8_t> fileData(fileSize, 0);
-        file.read(reinterpret_cast<char*>(fileData.data()), fileSize);
-        return Texture::fromMemory(std::span<const std::uint8_t>(fileData));
-    }
-}
-
-std::uint32_t fnv1a(const void* data, std::size_t size)
-{
-    const std::uint32_t  fnvPrime = 16777619;
-    const std::uint32_t  fnvOffsetBasis = 2166136261;
-    const unsigned char* ptr = static_cast<const unsigned char*>(data);
-    std::uint32_t        hash = fnvOffsetBasis;
-    for (std::size_t i = 0; i < size; ++i)
-    {
-        hash ^= ptr[i];
-        hash *= fnvPrime;
+        EncodedImage encodedImage{.fileData = std::vector<std::uint8_t>(fileSize, 0), .bytes = {}};
+        file.read(reinterpret_cast<char*>(encodedImage.fileData.data()), fileSize);
+        encodedImage.bytes = encodedImage.fileData;
+        return encodedImage;
     }
-    return hash;
-}
-
-template<std::size_t N>
-std::uint32_t fnv1a(const float (&data)[N])
-{
-    return fnv1a(data, N * sizeof(float));
 }
 
 class BaseColorTextureBuilder
 {
 public:
-    BaseColorTextureBuilder(const fs::path gltfPath, const std::span<const cgltf_image> gltfImages)
+    BaseColorTextureBuilder(
+        const fs::path                     gltfPath,
+        const std::span<const cgltf_image> gltfImages,
+        const ImageDecoder&                decodeImage,
+        const bool                         deferDecoding,
+        const std::uint32_t                numThreads)
         : mGltfPath(gltfPath),
           mImages(gltfImages),
+          mDecodeImage(decodeImage),
+          mDeferDecoding(deferDecoding),
+          mNumThreads(numThreads),
           mTextures(),
           mImageLookups(),
           mBaseColorFactorLookups(),
@@ -160,11 +164,142 @@ public:
     BaseColorTextureBuilder(BaseColorTextureBuilder&&) = delete;
     BaseColorTextureBuilder& operator=(BaseColorTextureBuilder&&) = delete;
 
-    std::tuple<std::vector<std::size_t>, std::vector<Texture>> build()
+    // Reads the images and decodes them on up to `numThreads` threads. Each image is decoded into
+    // the slot which addBaseColor reserved for it, so the texture order does not depend on the
+    // scheduling. An image whose encoded bytes are identical to an earlier image is not decoded,
+    // and its meshes refer to the earlier image's texture instead. If decoding is deferred, the
+    // textures are returned as deferred textures which keep the encoded images instead.
+    std::tuple<
+        std::vector<std::size_t>,
+        std::vector<Texture>,
+        std::vector<DeferredTexture>,
+        GltfDeduplication>
+    build()
     {
+        // The calling thread reads and decodes images too, while it waits.
+        const std::size_t numImages = mImageLookups.size();
+        const std::size_t numThreads =
+            std::min<std::size_t>(mNumThreads, std::max<std::size_t>(numImages, 1));
+        ThreadPool threadPool(static_cast<std::uint32_t>(numThreads - 1));
+
+        std::vector<EncodedImage>  encodedImages(numImages);
+        std::vector<std::uint64_t> imageHashes(numImages, 0);
+        for (std::size_t i = 0; i < numImages; ++i)
+        {
+            threadPool.push([this, i, &encodedImages, &imageHashes]() -> void {
+                EncodedImage& encodedImage = encodedImages[i];
+                encodedImage =
+                    readEncodedImage(&mImages[mImageLookups[i].gltfImageIndex], mGltfPath);
+                imageHashes[i] = fnv1a(encodedImage.bytes.data(), encodedImage.bytes.size());
+            });
+        }
+        threadPool.wait();
+
+        // Each texture index refers to itself, or to the texture of an earlier identical image.
+        std::vector<std::size_t> originalTextureIndices(mTextures.size());
+        std::iota(originalTextureIndices.begin(), originalTextureIndices.end(), std::size_t{0});
+        {
+            std::unordered_map<std::uint64_t, std::vector<std::size_t>> imagesByHash;
+            for (std::size_t i = 0; i < numImages; ++i)
+            {
+                std::vector<std::size_t>& candidates = imagesByHash[imageHashes[i]];
+                const auto original = std::find_if(
+                    candidates.begin(), candidates.end(), [&encodedImages, i](const std::size_t j) {
+                        return std::ranges::equal(encodedImages[j].bytes, encodedImages[i].bytes);
+                    });
+                if (original == candidates.end())
+                {
+                    candidates.push_back(i);
+                }
+                else
+                {
+                    originalTextureIndices[mImageLookups[i].textureIndex] =
+                        mImageLookups[*original].textureIndex;
+                    encodedImages[i] = EncodedImage{};
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < numImages; ++i)
+        {
+            const std::size_t textureIdx = mImageLookups[i].textureIndex;
+            if (!mDeferDecoding && originalTextureIndices[textureIdx] == textureIdx)
+            {
+                threadPool.push([this, textureIdx, &encodedImage = encodedImages[i]]() -> void {
+                    mTextures[textureIdx] = mDecodeImage(encodedImage.bytes);
+                    encodedImage = EncodedImage{};
+                });
+            }
+        }
+        threadPool.wait();
+
+        // Remove the duplicate textures, and renumber the textures which remain. An image's
+        // original always has a smaller texture index than the image.
+        std::vector<EncodedImage*> textureEncodedImages(mTextures.size(), nullptr);
+        for (std::size_t i = 0; i < numImages; ++i)
+        {
+            textureEncodedImages[mImageLookups[i].textureIndex] = &encodedImages[i];
+        }
+
+        GltfDeduplication            deduplication;
+        std::vector<Texture>         textures;
+        std::vector<DeferredTexture> deferredTextures;
+        std::vector<std::size_t>     newTextureIndices(mTextures.size());
+        for (std::size_t textureIdx = 0; textureIdx < mTextures.size(); ++textureIdx)
+        {
+            const std::size_t originalIdx = originalTextureIndices[textureIdx];
+            NLRS_ASSERT(originalIdx <= textureIdx);
+            if (originalIdx == textureIdx)
+            {
+                if (!mDeferDecoding)
+                {
+                    newTextureIndices[textureIdx] = textures.size();
+                    textures.push_back(std::move(mTextures[textureIdx]));
+                }
+                else
+                {
+                    newTextureIndices[textureIdx] = deferredTextures.size();
+                    EncodedImage* const encodedImage = textureEncodedImages[textureIdx];
+                    if (encodedImage == nullptr)
+                    {
+                        deferredTextures.emplace_back(std::move(mTextures[textureIdx]));
+                    }
+                    else if (!encodedImage->fileData.empty())
+                    {
+                        deferredTextures.emplace_back(std::move(encodedImage->fileData));
+                    }
+                    else
+                    {
+                        deferredTextures.emplace_back(std::vector<std::uint8_t>(
+                            encodedImage->bytes.begin(), encodedImage->bytes.end()));
+                    }
+                }
+            }
+            else
+            {
+                const std::size_t         newIdx = newTextureIndices[originalIdx];
+                const Texture::Dimensions dimensions = mDeferDecoding
+                                                           ? deferredTextures[newIdx].dimensions()
+                                                           : textures[newIdx].dimensions();
+                newTextureIndices[textureIdx] = newIdx;
+                deduplication.numDuplicateImages += 1;
+                deduplication.duplicateTextureBytes +=
+                    Texture::mipChainSize(dimensions, 1) * sizeof(Texture::Pixel);
+            }
+        }
+        for (std::size_t& textureIdx : mMeshTextureIndices)
+        {
+            textureIdx = newTextureIndices[textureIdx];
+        }
+
+        mTextures.clear();
         mImageLookups.clear();
         mBaseColorFactorLookups.clear();
-        return std::make_tuple(std::move(mMeshTextureIndices), std::move(mTextures));
+        return std::make_tuple(
+            std::move(mMeshTextureIndices),
+            std::move(textures),
+            std::move(deferredTextures),
+            deduplication);
     }
 
     void addBaseColor(const cgltf_pbr_metallic_roughness& pbrMetallicRoughness)
@@ -203,8 +338,9 @@ public:
                 if (imageLookup == mImageLookups.end())
                 {
                     const std::size_t textureIdx = mTextures.size();
+                    // The image is read and decoded in build().
                     mImageLookups.push_back({imageIndex, textureIdx});
-                    mTextures.emplace_back(textureFromGltfImage(baseColorImage, mGltfPath));
+                    mTextures.emplace_back();
                     return textureIdx;
                 }
                 else
@@ -214,7 +350,9 @@ public:
             }
             else
             {
-                const std::uint32_t hash = fnv1a(pbrMetallicRoughness.base_color_factor);
+                const std::uint64_t hash = fnv1a(
+                    pbrMetallicRoughness.base_color_factor,
+                    sizeof(pbrMetallicRoughness.base_color_factor));
                 const auto          colorLookup = std::find_if(
                     mBaseColorFactorLookups.begin(),
                     mBaseColorFactorLookups.end(),
@@ -251,11 +389,14 @@ private:
 
     struct BaseColorFactorLookup
     {
-        std::uint32_t hash;
+        std::uint64_t hash;
         std::size_t   textureIndex;
     };
     fs::path                           mGltfPath;
     std::span<const cgltf_image>       mImages;
+    const ImageDecoder&                mDecodeImage;
+    bool                               mDeferDecoding;
+    std::uint32_t                      mNumThreads;
     std::vector<Texture>               mTextures;
     std::vector<ImageLookup>           mImageLookups;
     std::vector<BaseColorFactorLookup> mBaseColorFactorLookups;
@@ -264,8 +405,42 @@ private:
 } // namespace
 
 GltfModel::GltfModel(const fs::path gltfPath)
+    : GltfModel(gltfPath, [](const std::span<const std::uint8_t> data) -> Texture {
+          return Texture::fromMemory(data);
+      })
+{
+}
+
+GltfModel::GltfModel(
+    const fs::path      gltfPath,
+    const ImageDecoder& decodeImage,
+    const std::uint32_t numThreads)
+    : GltfModel(gltfPath, decodeImage, false, numThreads)
+{
+}
+
+GltfModel GltfModel::withDeferredTextures(const fs::path gltfPath)
+{
+    // The images are not decoded, so the decoder is never called.
+    return GltfModel(
+        gltfPath,
+        [](const std::span<const std::uint8_t>) -> Texture {
+            NLRS_ASSERT(!"Images are not decoded when the textures are deferred");
+            return Texture();
+        },
+        true,
+        0);
+}
+
+GltfModel::GltfModel(
+    const fs::path      gltfPath,
+    const ImageDecoder& decodeImage,
+    const bool          deferTextureDecoding,
+    const std::uint32_t numThreads)
     : meshes(),
-      baseColorTextures()
+      baseColorTextures(),
+      deferredBaseColorTextures(),
+      deduplication()
 {
     if (!fs::exists(gltfPath))
     {
@@ -314,7 +489,11 @@ GltfModel::GltfModel(const fs::path gltfPath)
     std::vector<std::vector<std::uint32_t>> meshIndices;
 
     BaseColorTextureBuilder baseColorTextureBuilder{
-        gltfPath, std::span<const cgltf_image>(data->images, data->images_count)};
+        gltfPath,
+        std::span<const cgltf_image>(data->images, data->images_count),
+        decodeImage,
+        deferTextureDecoding,
+        numThreads > 0 ? numThreads : std::max(std::thread::hardware_concurrency(), 1u)};
 
     const std::size_t meshCount = data->meshes_count;
     for (std::size_t meshIdx = 0; meshIdx < meshCount; ++meshIdx)
@@ -439,8 +618,11 @@ GltfModel::GltfModel(const fs::path gltfPath)
         }
     }
 
-    auto [meshBaseColorTextureIndices, textures] = baseColorTextureBuilder.build();
+    auto [meshBaseColorTextureIndices, textures, deferredTextures, imageDeduplication] =
+        baseColorTextureBuilder.build();
     baseColorTextures = std::move(textures);
+    deferredBaseColorTextures = std::move(deferredTextures);
+    deduplication = imageDeduplication;
 
     NLRS_ASSERT(meshPositions.size() == meshNormals.size());
     NLRS_ASSERT(meshPositions.size() == meshTexCoords.size());
@@ -459,6 +641,8 @@ GltfModel::GltfModel(const fs::path gltfPath)
 
     cgltf_free(data);
 
+    removeDuplicateMeshes(meshes, deduplication);
+
     std::sort(meshes.begin(), meshes.end(), [](const GltfMesh& a, const GltfMesh& b) -> bool {
         return a.baseColorTextureIndex < b.baseColorTextureIndex;
     });
@@ -466,7 +650,114 @@ GltfModel::GltfModel(const fs::path gltfPath)
 
 GltfModel::GltfModel(std::vector<GltfMesh> meshes, std::vector<Texture> baseColorTextures)
     : meshes(std::move(meshes)),
-      baseColorTextures(std::move(baseColorTextures))
+      baseColorTextures(std::move(baseColorTextures)),
+      deferredBaseColorTextures(),
+      deduplication()
 {
 }
+
+void removeDuplicateMeshes(std::vector<GltfMesh>& meshes, GltfDeduplication& deduplication)
+{
+    // Only meshes with the same numbers of vertices and indices, and the same texture, can be
+    // identical. The contents of the other meshes are neither hashed nor compared.
+    const auto meshSignature = [](const GltfMesh& mesh) -> std::uint64_t {
+        const std::size_t values[] = {
+            mesh.positions.size(), mesh.indices.size(), mesh.baseColorTextureIndex};
+        return fnv1a(values, sizeof(values));
+    };
+    const auto meshHash = [](const GltfMesh& mesh) -> std::uint64_t {
+        std::uint64_t hash =
+            fnv1a(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+        hash = fnv1a(mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3), hash);
+        hash = fnv1a(mesh.texCoords.data(), mesh.texCoords.size() * sizeof(glm::vec2), hash);
+        return fnv1a(mesh.indices.data(), mesh.indices.size() * sizeof(std::uint32_t), hash);
+    };
+    const auto isIdentical = [](const GltfMesh& a, const GltfMesh& b) -> bool {
+        return a.baseColorTextureIndex == b.baseColorTextureIndex && a.indices == b.indices &&
+               a.positions == b.positions && a.normals == b.normals && a.texCoords == b.texCoords;
+    };
+
+    std::unordered_map<std::uint64_t, std::size_t> numMeshesBySignature;
+    for (const GltfMesh& mesh : meshes)
+    {
+        ++numMeshesBySignature[meshSignature(mesh)];
+    }
+
+    std::unordered_map<std::uint64_t, std::vector<std::size_t>> meshesByHash;
+    std::vector<bool>                                           isDuplicate(meshes.size(), false);
+    for (std::size_t i = 0; i < meshes.size(); ++i)
+    {
+        const GltfMesh& mesh = meshes[i];
+        if (numMeshesBySignature[meshSignature(mesh)] < 2)
+        {
+            continue;
+        }
+        std::vector<std::size_t>& candidates = meshesByHash[meshHash(mesh)];
+        if (std::any_of(candidates.begin(), candidates.end(), [&](const std::size_t j) -> bool {
+                return isIdentical(meshes[j], mesh);
+            }))
+        {
+            isDuplicate[i] = true;
+            deduplication.numDuplicateMeshes += 1;
+            deduplication.duplicateMeshBytes +=
+                mesh.positions.size() * sizeof(glm::vec3) +
+                mesh.normals.size() * sizeof(glm::vec3) +
+                mesh.texCoords.size() * sizeof(glm::vec2) +
+                mesh.indices.size() * sizeof(std::uint32_t);
+        }
+        else
+        {
+            candidates.push_back(i);
+        }
+    }
+
+    std::size_t numKept = 0;
+    for (std::size_t i = 0; i < meshes.size(); ++i)
+    {
+        if (!isDuplicate[i])
+        {
+            if (numKept != i)
+            {
+                meshes[numKept] = std::move(meshes[i]);
+            }
+            ++numKept;
+        }
+    }
+    meshes.erase(meshes.begin() + static_cast<std::ptrdiff_t>(numKept), meshes.end());
+}
+
+std::vector<fs::path> gltfDependencies(const fs::path& gltfPath)
+{
+    cgltf_options options = {};
+    cgltf_data*   data = nullptr;
+    if (cgltf_parse_file(&options, gltfPath.string().c_str(), &data) != cgltf_result_success)
+    {
+        cgltf_free(data);
+        throw std::runtime_error(fmt::format("Failed to parse gltf file {}.", gltfPath.string()));
+    }
+    NLRS_ASSERT(data != nullptr);
+
+    // Embedded buffers and images have no URI, or a data URI.
+    const auto isExternal = [](const char* const uri) -> bool {
+        return uri != nullptr && std::strncmp(uri, "data:", 5) != 0;
+    };
+    std::vector<fs::path> dependencies;
+    for (std::size_t i = 0; i < data->buffers_count; ++i)
+    {
+        if (isExternal(data->buffers[i].uri))
+        {
+            dependencies.push_back(gltfPath.parent_path() / data->buffers[i].uri);
+        }
+    }
+    for (std::size_t i = 0; i < data->images_count; ++i)
+    {
+        if (isExternal(data->images[i].uri))
+        {
+            dependencies.push_back(gltfPath.parent_path() / data->images[i].uri);
+        }
+    }
+
+    cgltf_free(data);
+    return dependencies;
+}
 } // namespace nlrs
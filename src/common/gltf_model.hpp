@@ -1,11 +1,13 @@
 #pragma once
 
+#include "deferred_texture.hpp"
 #include "texture.hpp"
 
 #include <glm/glm.hpp>
 
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <span>
 #include <vector>
 
@@ -40,20 +42,72 @@ struct GltfMesh
     std::size_t                baseColorTextureIndex;
 };
 
+// The duplicates which were removed when importing a glTF file, and the bytes which were saved by
+// storing them once.
+struct GltfDeduplication
+{
+    // Images whose encoded bytes are identical to an earlier image. They are decoded once, and
+    // refer to the same texture.
+    std::size_t   numDuplicateImages = 0;
+    std::uint64_t duplicateTextureBytes = 0;
+    // Meshes whose transformed vertices, indices and texture are identical to an earlier mesh.
+    // See removeDuplicateMeshes.
+    std::size_t   numDuplicateMeshes = 0;
+    std::uint64_t duplicateMeshBytes = 0;
+};
+
+// Decodes an encoded image, e.g. a PNG or JPEG file, into a texture.
+using ImageDecoder = std::function<Texture(std::span<const std::uint8_t>)>;
+
 struct GltfModel
 {
 public:
     GltfModel() = default;
     GltfModel(std::filesystem::path gltfPath);
+    // Decodes the images with `decodeImage` instead of Texture::fromMemory, e.g. to look up
+    // previously decoded images in a cache. The images are decoded on `numThreads` threads, 0 means
+    // the number of hardware threads, so `decodeImage` must be safe to call from several threads.
+    GltfModel(
+        std::filesystem::path gltfPath,
+        const ImageDecoder&   decodeImage,
+        std::uint32_t         numThreads = 0);
     GltfModel(std::vector<GltfMesh> meshes, std::vector<Texture> baseColorTextures);
 
+    // Keeps the encoded images in deferredBaseColorTextures instead of decoding them, e.g. for
+    // tools which do not sample the textures. The images are decoded on first access instead.
+    static GltfModel withDeferredTextures(std::filesystem::path gltfPath);
+
     GltfModel(const GltfModel&) = delete;
     GltfModel& operator=(const GltfModel&) = delete;
 
     GltfModel(GltfModel&&) = default;
     GltfModel& operator=(GltfModel&&) = default;
 
-    std::vector<GltfMesh> meshes;
-    std::vector<Texture>  baseColorTextures;
+    std::vector<GltfMesh>        meshes;
+    // Empty if the model was loaded with deferred textures.
+    std::vector<Texture>         baseColorTextures;
+    // Only filled if the model was loaded with deferred textures, in the same order as
+    // baseColorTextures would be.
+    std::vector<DeferredTexture> deferredBaseColorTextures;
+    GltfDeduplication            deduplication;
+
+private:
+    GltfModel(
+        std::filesystem::path gltfPath,
+        const ImageDecoder&   decodeImage,
+        bool                  deferTextureDecoding,
+        std::uint32_t         numThreads);
 };
+
+// Removes the meshes which are identical to an earlier mesh, and counts them in `deduplication`.
+// Loading a glTF file does this after the meshes have been transformed, so only copies of a mesh in
+// the same place are removed, e.g. a mesh which an exporter wrote twice. This is not instancing:
+// meshes with the same geometry and different transforms are kept. A glTF mesh which several nodes
+// refer to is loaded once, with the transform of the last of those nodes, so such a mesh is never
+// counted as a duplicate.
+void removeDuplicateMeshes(std::vector<GltfMesh>& meshes, GltfDeduplication& deduplication);
+
+// Returns the external files referenced by a glTF file, i.e. its buffers and images which are not
+// embedded in the file.
+std::vector<std::filesystem::path> gltfDependencies(const std::filesystem::path& gltfPath);
 } // namespace nlrs
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nlrs
+{
+inline constexpr std::uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+
+// 64-bit FNV-1a, continuing from `hash`.
+inline std::uint64_t fnv1a(
+    const void* const   data,
+    const std::size_t   numBytes,
+    const std::uint64_t hash = FNV_OFFSET_BASIS)
+{
+    const auto* const bytes = static_cast<const unsigned char*>(data);
+    std::uint64_t     result = hash;
+    for (std::size_t i = 0; i < numBytes; ++i)
+    {
+        result = (result ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return result;
+}
+} // namespace nlrs
@@ -0,0 +1,163 @@
+#include "mapped_file.hpp"
+
+#include <fmt/format.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+#include <utility>
+
+namespace nlrs
+{
+#if defined(_WIN32)
+MappedFile::MappedFile(const std::filesystem::path& path)
+    : mData(nullptr),
+      mSize(0),
+      mMappingHandle(nullptr)
+{
+    const HANDLE file = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error(fmt::format("Failed to open file: {}", path.string()));
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        throw std::runtime_error(fmt::format("Failed to get the size of file: {}", path.string()));
+    }
+    mSize = static_cast<std::size_t>(fileSize.QuadPart);
+
+    // Empty files can't be mapped, and are represented by an empty span.
+    if (mSize > 0)
+    {
+        mMappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMappingHandle != nullptr)
+        {
+            mData = static_cast<const std::byte*>(
+                MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+    CloseHandle(file);
+
+    if (mSize > 0 && mData == nullptr)
+    {
+        unmap();
+        throw std::runtime_error(fmt::format("Failed to map file: {}", path.string()));
+    }
+}
+
+void MappedFile::unmap() noexcept
+{
+    if (mData != nullptr)
+    {
+        UnmapViewOfFile(mData);
+        mData = nullptr;
+    }
+    if (mMappingHandle != nullptr)
+    {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = nullptr;
+    }
+    mSize = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mData(std::exchange(other.mData, nullptr)),
+      mSize(std::exchange(other.mSize, 0)),
+      mMappingHandle(std::exchange(other.mMappingHandle, nullptr))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        mData = std::exchange(other.mData, nullptr);
+        mSize = std::exchange(other.mSize, 0);
+        mMappingHandle = std::exchange(other.mMappingHandle, nullptr);
+    }
+    return *this;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path)
+    : mData(nullptr),
+      mSize(0)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error(fmt::format("Failed to open file: {}", path.string()));
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        close(fd);
+        throw std::runtime_error(fmt::format("Failed to get the size of file: {}", path.string()));
+    }
+    mSize = static_cast<std::size_t>(fileStat.st_size);
+
+    // Empty files can't be mapped, and are represented by an empty span.
+    if (mSize > 0)
+    {
+        void* const data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error(fmt::format("Failed to map file: {}", path.string()));
+        }
+        mData = static_cast<const std::byte*>(data);
+    }
+    // The mapping stays valid after the file descriptor is closed.
+    close(fd);
+}
+
+void MappedFile::unmap() noexcept
+{
+    if (mData != nullptr)
+    {
+        munmap(const_cast<std::byte*>(mData), mSize);
+        mData = nullptr;
+    }
+    mSize = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : mData(std::exchange(other.mData, nullptr)),
+      mSize(std::exchange(other.mSize, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        mData = std::exchange(other.mData, nullptr);
+        mSize = std::exchange(other.mSize, 0);
+    }
+    return *this;
+}
+#endif
+
+MappedFile::~MappedFile() { unmap(); }
+} // namespace nlrs
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace nlrs
+{
+// A read-only memory mapping of a whole file. The operating system pages the contents in on first
+// access, so only the parts of the file which are actually read become resident.
+class MappedFile
+{
+public:
+    MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&&) noexcept;
+    MappedFile& operator=(MappedFile&&) noexcept;
+
+    // The mapping is aligned to the page size.
+    std::span<const std::byte> bytes() const noexcept { return {mData, mSize}; }
+
+private:
+    void unmap() noexcept;
+
+    const std::byte* mData;
+    std::size_t      mSize;
+#if defined(_WIN32)
+    void* mMappingHandle;
+#endif
+};
+} // namespace nlrs
@@ -81,6 +81,7 @@ bool rayIntersectTriangle(
         const glm::vec3 n = glm::normalize(glm::cross(e1, e2));
         intersect.p = offsetRay(p, n);
         intersect.t = t;
+        intersect.b = glm::vec3(1.0f - u - v, u, v);
         return true;
     }
     else
@@ -170,6 +171,8 @@ bool rayIntersectBvh(
                     if (rayIntersectTriangle(ray, triangle, rayTMax, intersect))
                     {
                         rayTMax = intersect.t;
+                        intersect.triangleIdx =
+                            static_cast<std::uint32_t>(node.trianglesOffset + idx);
                         didIntersect = true;
                     }
                 }
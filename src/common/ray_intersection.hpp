@@ -4,6 +4,7 @@
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <span>
 
 namespace nlrs
@@ -14,8 +15,10 @@ struct Positions;
 
 struct Intersection
 {
-    glm::vec3 p;
-    float     t;
+    glm::vec3     p;
+    float         t;
+    glm::vec3     b;           // barycentric coordinates of the hit point
+    std::uint32_t triangleIdx; // set by `rayIntersectBvh`
 };
 
 bool rayIntersectTriangle(
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+namespace nlrs
+{
+struct SamplingParams
+{
+    std::uint32_t numSamplesPerPixel = 128;
+    std::uint32_t numBounces = 4;
+    // Terminate paths early with Russian roulette, with a survival probability based on the path
+    // throughput. Paths always scatter at least `minBounces` times before they are eligible for
+    // termination. `numBounces` remains the upper limit of the path length.
+    bool          russianRoulette = true;
+    std::uint32_t minBounces = 2;
+
+    bool operator==(const SamplingParams&) const noexcept = default;
+};
+} // namespace nlrs
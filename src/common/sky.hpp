@@ -0,0 +1,32 @@
+#pragma once
+
+#include "units/angle.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cmath>
+
+namespace nlrs
+{
+struct Sky
+{
+    float                turbidity = 1.0f;
+    std::array<float, 3> albedo = {1.0f, 1.0f, 1.0f};
+    float                sunZenithDegrees = 30.0f;
+    float                sunAzimuthDegrees = 0.0f;
+
+    bool operator==(const Sky&) const noexcept = default;
+};
+
+inline glm::vec3 sunDirection(const Sky& sky)
+{
+    const float sunZenith = Angle::degrees(sky.sunZenithDegrees).asRadians();
+    const float sunAzimuth = Angle::degrees(sky.sunAzimuthDegrees).asRadians();
+
+    return glm::normalize(glm::vec3(
+        std::sin(sunZenith) * std::cos(sunAzimuth),
+        std::cos(sunZenith),
+        -std::sin(sunZenith) * std::sin(sunAzimuth)));
+}
+} // namespace nlrs
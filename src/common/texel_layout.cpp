@@ -0,0 +1,15 @@
+#include "texel_layout.hpp"
+
+namespace nlrs
+{
+std::size_t texelLayoutSize(const TexelLayout layout, const Texture::Dimensions dimensions) noexcept
+{
+    if (layout == TexelLayout::RowMajor)
+    {
+        return static_cast<std::size_t>(dimensions.width) * dimensions.height;
+    }
+    const std::size_t tilesPerRow = (dimensions.width + TEXEL_TILE_SIZE - 1) / TEXEL_TILE_SIZE;
+    const std::size_t tilesPerColumn = (dimensions.height + TEXEL_TILE_SIZE - 1) / TEXEL_TILE_SIZE;
+    return tilesPerRow * tilesPerColumn * TEXEL_TILE_SIZE * TEXEL_TILE_SIZE;
+}
+} // namespace nlrs
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "texture.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nlrs
+{
+// The order in which the texels of an image are stored in a flat buffer.
+enum class TexelLayout : std::uint32_t
+{
+    // Rows one after another.
+    RowMajor,
+    // Square tiles of TEXEL_TILE_SIZE texels in row-major order, with the texels of each tile in
+    // Morton order. A texel's vertical neighbours are usually in the same tile, instead of a whole
+    // row apart. Images are padded to whole tiles.
+    Tiled,
+};
+
+inline constexpr std::uint32_t TEXEL_TILE_SIZE = 8;
+
+// Interleaves the bits of `x` and `y`, which are less than TEXEL_TILE_SIZE.
+inline std::uint32_t tileTexelIndex(const std::uint32_t x, const std::uint32_t y) noexcept
+{
+    const auto spreadBits = [](std::uint32_t v) -> std::uint32_t {
+        v = (v | (v << 2)) & 0x33u;
+        return (v | (v << 1)) & 0x55u;
+    };
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// The index of texel (`x`, `y`) of an image of `dimensions` stored in `layout`.
+inline std::size_t texelIndex(
+    const TexelLayout         layout,
+    const Texture::Dimensions dimensions,
+    const std::uint32_t       x,
+    const std::uint32_t       y) noexcept
+{
+    if (layout == TexelLayout::RowMajor)
+    {
+        return static_cast<std::size_t>(y) * dimensions.width + x;
+    }
+    const std::size_t tilesPerRow = (dimensions.width + TEXEL_TILE_SIZE - 1) / TEXEL_TILE_SIZE;
+    const std::size_t tileIdx = (y / TEXEL_TILE_SIZE) * tilesPerRow + x / TEXEL_TILE_SIZE;
+    return tileIdx * TEXEL_TILE_SIZE * TEXEL_TILE_SIZE +
+           tileTexelIndex(x % TEXEL_TILE_SIZE, y % TEXEL_TILE_SIZE);
+}
+
+// The number of texels, including padding, which an image of `dimensions` occupies in `layout`.
+std::size_t texelLayoutSize(TexelLayout layout, Texture::Dimensions dimensions) noexcept;
+} // namespace nlrs
@@ -1,15 +1,409 @@
 #include "texture.hpp"
+#include "texture_sampling.hpp"
+#include "thread_pool.hpp"
 
 #include <stb_image.h>
 
-#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
-#include <cstring>
-#include <iterator>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace nlrs
 {
-Texture Texture::fromMemory(std::span<const std::uint8_t> data)
+namespace
+{
+// Each pixel becomes (pixel & keep) | ((pixel >> 16) & move) | ((pixel & move) << 16) | alpha.
+// Swapping the red and blue channels moves the first and the third byte, and keeps the others.
+struct SwizzleMasks
+{
+    std::uint32_t keep;
+    std::uint32_t move;
+    std::uint32_t alpha;
+};
+
+std::uint32_t swizzle(const std::uint32_t pixel, const SwizzleMasks& masks) noexcept
+{
+    return (pixel & masks.keep) | ((pixel >> 16) & masks.move) | ((pixel & masks.move) << 16) |
+           masks.alpha;
+}
+
+// Mip levels are filtered in linear space, with four floats per pixel in the order of the pixel's
+// bytes. The first three bytes are sRGB encoded color channels, decoded with srgbToLinearTable like
+// the texture samplers do, and the last byte is linear alpha. Filtered values in [0, 1] are
+// quantized to LINEAR_TO_SRGB_TABLE_SIZE steps by truncation, which rounds identically on every
+// platform, and leaves no multiply-add for the compiler to fuse.
+constexpr std::size_t LINEAR_TO_SRGB_TABLE_SIZE = 1 << 14;
+
+struct SrgbTables
+{
+    const std::array<float, 256>& toLinear;
+    // The linear value halfway between the decoded values of each byte and the next byte.
+    std::array<float, 255>        thresholds;
+    // A lower bound of the encoded color of the values of each step.
+    std::array<std::uint8_t, LINEAR_TO_SRGB_TABLE_SIZE> toSrgb;
+    std::array<std::uint8_t, LINEAR_TO_SRGB_TABLE_SIZE> toAlpha;
+};
+
+// Encodes a linear color channel in [0, 1] as the byte whose decoded value is nearest, starting
+// from the lower bound of the value's step. The gamma curve is steep near zero, so a step may span
+// several bytes.
+std::uint8_t encodeSrgb(const float linear, const std::int32_t step, const SrgbTables& tables)
+    noexcept
+{
+    std::uint32_t byte = tables.toSrgb[step];
+    while (byte < tables.thresholds.size() && linear >= tables.thresholds[byte])
+    {
+        ++byte;
+    }
+    return static_cast<std::uint8_t>(byte);
+}
+
+const SrgbTables& srgbTables()
+{
+    static const SrgbTables tables = [] {
+        SrgbTables t{
+            .toLinear = srgbToLinearTable(), .thresholds = {}, .toSrgb = {}, .toAlpha = {}};
+        for (std::size_t i = 0; i < t.thresholds.size(); ++i)
+        {
+            t.thresholds[i] = 0.5f * (t.toLinear[i] + t.toLinear[i + 1]);
+        }
+        const float scale = static_cast<float>(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+        for (std::size_t i = 0; i < t.toSrgb.size(); ++i)
+        {
+            // The values which truncate to step i are at least (i - 1) / scale, whatever the
+            // rounding of the product.
+            const float lowerBound = static_cast<float>(std::max<std::size_t>(i, 1) - 1) / scale;
+            std::uint32_t byte = 0;
+            while (byte < t.thresholds.size() && lowerBound >= t.thresholds[byte])
+            {
+                ++byte;
+            }
+            t.toSrgb[i] = static_cast<std::uint8_t>(byte);
+            t.toAlpha[i] = static_cast<std::uint8_t>(
+                std::lround(std::min((static_cast<float>(i) + 0.5f) / scale, 1.0f) * 255.0f));
+        }
+        return t;
+    }();
+    return tables;
+}
+
+void decodeRow(
+    const std::span<const Texture::Pixel> pixels,
+    float* const                          linear,
+    const SrgbTables&                     tables) noexcept
+{
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        const Texture::Pixel px = pixels[i];
+        linear[4 * i + 0] = tables.toLinear[px & 0xffu];
+        linear[4 * i + 1] = tables.toLinear[(px >> 8) & 0xffu];
+        linear[4 * i + 2] = tables.toLinear[(px >> 16) & 0xffu];
+        linear[4 * i + 3] = static_cast<float>(px >> 24) / 255.0f;
+    }
+}
+
+// The number of source rows or columns which pixel `i` of a level of `dstSize` pixels averages.
+// Each pixel covers two, but the last pixel also covers the last source row or column of a source
+// of odd size, and a source of size one is covered by a single pixel.
+std::uint32_t footprintSize(
+    const std::uint32_t i,
+    const std::uint32_t srcSize,
+    const std::uint32_t dstSize) noexcept
+{
+    return i + 1 == dstSize ? srcSize - 2 * i : 2;
+}
+
+// Averages the footprints of the pixels of a destination row of `dstWidth` pixels in the linear
+// source rows `rows`, which are the rows of the destination row's footprint. The row is stored both
+// in linear space and as pixels. The SIMD and scalar paths add the footprint in the same order, so
+// that every platform generates the same pixels.
+void filterRow(
+    const std::span<const float* const> rows,
+    const std::uint32_t                 srcWidth,
+    float* const                        dstLinear,
+    Texture::Pixel* const               dstPixels,
+    const std::uint32_t                 dstWidth,
+    const SrgbTables&                   tables) noexcept
+{
+    const float quantizationScale = static_cast<float>(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+    for (std::uint32_t x = 0; x < dstWidth; ++x)
+    {
+        const std::size_t   x0 = 4 * static_cast<std::size_t>(2 * x);
+        const std::uint32_t numColumns = footprintSize(x, srcWidth, dstWidth);
+        const float         weight = 1.0f / static_cast<float>(numColumns * rows.size());
+        float* const        dst = dstLinear + 4 * static_cast<std::size_t>(x);
+        alignas(16) std::int32_t indices[4];
+
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128 sum = _mm_setzero_ps();
+        for (const float* const row : rows)
+        {
+            for (std::uint32_t i = 0; i < numColumns; ++i)
+            {
+                sum = _mm_add_ps(sum, _mm_loadu_ps(row + x0 + 4 * i));
+            }
+        }
+        const __m128 average = _mm_mul_ps(sum, _mm_set1_ps(weight));
+        _mm_storeu_ps(dst, average);
+        const __m128 clamped =
+            _mm_min_ps(_mm_max_ps(average, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        _mm_store_si128(
+            reinterpret_cast<__m128i*>(indices),
+            _mm_cvttps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(quantizationScale))));
+#elif defined(__ARM_NEON)
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        for (const float* const row : rows)
+        {
+            for (std::uint32_t i = 0; i < numColumns; ++i)
+            {
+                sum = vaddq_f32(sum, vld1q_f32(row + x0 + 4 * i));
+            }
+        }
+        const float32x4_t average = vmulq_n_f32(sum, weight);
+        vst1q_f32(dst, average);
+        const float32x4_t clamped =
+            vminq_f32(vmaxq_f32(average, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+        vst1q_s32(indices, vcvtq_s32_f32(vmulq_n_f32(clamped, quantizationScale)));
+#else
+        for (std::size_t c = 0; c < 4; ++c)
+        {
+            float sum = 0.0f;
+            for (const float* const row : rows)
+            {
+                for (std::uint32_t i = 0; i < numColumns; ++i)
+                {
+                    sum += row[x0 + 4 * i + c];
+                }
+            }
+            dst[c] = sum * weight;
+            indices[c] = static_cast<std::int32_t>(
+                std::min(std::max(dst[c], 0.0f), 1.0f) * quantizationScale);
+        }
+#endif
+
+        const auto channel = [&](const std::size_t c) -> Texture::Pixel {
+            return encodeSrgb(std::min(std::max(dst[c], 0.0f), 1.0f), indices[c], tables);
+        };
+        dstPixels[x] = channel(0) | (channel(1) << 8) | (channel(2) << 16) |
+                       (static_cast<Texture::Pixel>(tables.toAlpha[indices[3]]) << 24);
+    }
+}
+} // namespace
+
+void swizzlePixels(
+    const std::span<Texture::Pixel> pixels,
+    const Texture::ChannelOrder     from,
+    const Texture::ChannelOrder     to,
+    const bool                      makeOpaque) noexcept
+{
+    const bool swapRedBlue = from != to;
+    if (!swapRedBlue && !makeOpaque)
+    {
+        return;
+    }
+
+    const SwizzleMasks masks{
+        .keep = swapRedBlue ? 0xff00ff00u : 0xffffffffu,
+        .move = swapRedBlue ? 0x000000ffu : 0u,
+        .alpha = makeOpaque ? 0xff000000u : 0u};
+
+    Texture::Pixel* const data = pixels.data();
+    const std::size_t     count = pixels.size();
+    std::size_t           i = 0;
+
+#if defined(__AVX2__)
+    {
+        const __m256i keep = _mm256_set1_epi32(static_cast<int>(masks.keep));
+        const __m256i move = _mm256_set1_epi32(static_cast<int>(masks.move));
+        const __m256i alpha = _mm256_set1_epi32(static_cast<int>(masks.alpha));
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i* const ptr = reinterpret_cast<__m256i*>(data + i);
+            const __m256i  px = _mm256_loadu_si256(ptr);
+            const __m256i  kept = _mm256_or_si256(_mm256_and_si256(px, keep), alpha);
+            const __m256i  moved = _mm256_or_si256(
+                _mm256_and_si256(_mm256_srli_epi32(px, 16), move),
+                _mm256_slli_epi32(_mm256_and_si256(px, move), 16));
+            _mm256_storeu_si256(ptr, _mm256_or_si256(kept, moved));
+        }
+    }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    {
+        const __m128i keep = _mm_set1_epi32(static_cast<int>(masks.keep));
+        const __m128i move = _mm_set1_epi32(static_cast<int>(masks.move));
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(masks.alpha));
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i* const ptr = reinterpret_cast<__m128i*>(data + i);
+            const __m128i  px = _mm_loadu_si128(ptr);
+            const __m128i  kept = _mm_or_si128(_mm_and_si128(px, keep), alpha);
+            const __m128i  moved = _mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(px, 16), move),
+                _mm_slli_epi32(_mm_and_si128(px, move), 16));
+            _mm_storeu_si128(ptr, _mm_or_si128(kept, moved));
+        }
+    }
+#elif defined(__ARM_NEON)
+    {
+        const uint32x4_t keep = vdupq_n_u32(masks.keep);
+        const uint32x4_t move = vdupq_n_u32(masks.move);
+        const uint32x4_t alpha = vdupq_n_u32(masks.alpha);
+        for (; i + 4 <= count; i += 4)
+        {
+            const uint32x4_t px = vld1q_u32(data + i);
+            const uint32x4_t kept = vorrq_u32(vandq_u32(px, keep), alpha);
+            const uint32x4_t moved = vorrq_u32(
+                vandq_u32(vshrq_n_u32(px, 16), move), vshlq_n_u32(vandq_u32(px, move), 16));
+            vst1q_u32(data + i, vorrq_u32(kept, moved));
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        data[i] = swizzle(data[i], masks);
+    }
+}
+
+void Texture::DecodedPixelsDeleter::operator()(Pixel* const pixels) const noexcept
+{
+    stbi_image_free(pixels);
+}
+
+std::span<const Texture::Pixel> Texture::mipLevel(const std::uint32_t level) const noexcept
+{
+    assert(level < mNumMipLevels);
+    const Dimensions dimensions = mipLevelDimensions(level);
+    return mPixels.subspan(
+        mipChainSize(mDimensions, level),
+        static_cast<std::size_t>(dimensions.width) * dimensions.height);
+}
+
+Texture Texture::withChannelOrder(const ChannelOrder channelOrder) const
+{
+    std::vector<Pixel> pixels(mPixels.begin(), mPixels.end());
+    swizzlePixels(pixels, mChannelOrder, channelOrder, false);
+    return Texture(std::move(pixels), mDimensions, channelOrder, mNumMipLevels);
+}
+
+Texture Texture::withMipmaps(ThreadPool& threadPool) const
+{
+    const std::uint32_t numMipLevels = maxMipLevels(mDimensions);
+    std::vector<Pixel>  chain(mipChainSize(mDimensions, numMipLevels));
+    std::ranges::copy(pixels(), chain.begin());
+
+    const SrgbTables& tables = srgbTables();
+    // The previous level in linear space. Level 0 is the largest level, and is decoded a couple of
+    // rows at a time instead.
+    std::vector<float> srcLinear;
+    std::size_t        srcOffset = 0;
+
+    for (std::uint32_t level = 1; level < numMipLevels; ++level)
+    {
+        const Dimensions   srcDims = mipLevelDimensions(level - 1);
+        const Dimensions   dstDims = mipLevelDimensions(level);
+        const std::size_t  dstOffset = srcOffset + std::size_t{srcDims.width} * srcDims.height;
+        std::vector<float> dstLinear(4 * std::size_t{dstDims.width} * dstDims.height);
+
+        const std::uint32_t numTasks = std::min(dstDims.height, 4 * (threadPool.numThreads() + 1));
+        const std::uint32_t rowsPerTask = (dstDims.height + numTasks - 1) / numTasks;
+        for (std::uint32_t rowBegin = 0; rowBegin < dstDims.height; rowBegin += rowsPerTask)
+        {
+            const std::uint32_t rowEnd = std::min(rowBegin + rowsPerTask, dstDims.height);
+            threadPool.push([&, level, srcDims, dstDims, srcOffset, dstOffset, rowBegin, rowEnd]() {
+                const std::size_t  srcRowSize = 4 * std::size_t{srcDims.width};
+                // A footprint is at most three rows high.
+                std::vector<float> decodedRows(level == 1 ? 3 * srcRowSize : 0);
+                std::array<const float*, 3> rows;
+                for (std::uint32_t y = rowBegin; y < rowEnd; ++y)
+                {
+                    const std::uint32_t numRows = footprintSize(y, srcDims.height, dstDims.height);
+                    for (std::uint32_t i = 0; i < numRows; ++i)
+                    {
+                        const std::size_t srcRow = 2 * std::size_t{y} + i;
+                        if (level == 1)
+                        {
+                            float* const decoded = decodedRows.data() + i * srcRowSize;
+                            decodeRow(
+                                std::span<const Pixel>(chain).subspan(
+                                    srcRow * srcDims.width, srcDims.width),
+                                decoded,
+                                tables);
+                            rows[i] = decoded;
+                        }
+                        else
+                        {
+                            rows[i] = srcLinear.data() + srcRow * srcRowSize;
+                        }
+                    }
+                    const std::size_t dstRow = y * std::size_t{dstDims.width};
+                    filterRow(
+                        std::span(rows).first(numRows),
+                        srcDims.width,
+                        dstLinear.data() + 4 * dstRow,
+                        chain.data() + dstOffset + dstRow,
+                        dstDims.width,
+                        tables);
+                }
+            });
+        }
+        threadPool.wait();
+
+        srcLinear = std::move(dstLinear);
+        srcOffset = dstOffset;
+    }
+
+    return Texture(std::move(chain), mDimensions, mChannelOrder, numMipLevels);
+}
+
+Texture::Dimensions Texture::mipLevelDimensions(
+    const Dimensions    dimensions,
+    const std::uint32_t level) noexcept
+{
+    if (level == 0)
+    {
+        return dimensions;
+    }
+    return Dimensions{
+        std::max(dimensions.width >> level, 1u), std::max(dimensions.height >> level, 1u)};
+}
+
+std::uint32_t Texture::maxMipLevels(const Dimensions dimensions) noexcept
+{
+    return std::max(
+        static_cast<std::uint32_t>(std::bit_width(std::max(dimensions.width, dimensions.height))),
+        1u);
+}
+
+std::size_t Texture::mipChainSize(
+    const Dimensions    dimensions,
+    const std::uint32_t numMipLevels) noexcept
+{
+    std::size_t size = 0;
+    for (std::uint32_t level = 0; level < numMipLevels; ++level)
+    {
+        const Dimensions levelDims = mipLevelDimensions(dimensions, level);
+        size += static_cast<std::size_t>(levelDims.width) * levelDims.height;
+    }
+    return size;
+}
+
+Texture Texture::fromMemory(
+    const std::span<const std::uint8_t> data,
+    const ChannelOrder                  channelOrder)
 {
     int width;
     int height;
@@ -30,27 +424,19 @@ Texture Texture::fromMemory(std::span<const std::uint8_t> data)
     assert(sourceChannels == 3 || sourceChannels == 4);
     assert(pixelPtr != nullptr);
 
-    const auto numPixels = static_cast<std::size_t>(width * height);
-    const auto pixelData =
-        std::span<const std::uint32_t>(reinterpret_cast<const std::uint32_t*>(pixelPtr), numPixels);
-    std::vector<BgraPixel> pixels;
-    pixels.reserve(numPixels);
-    std::transform(
-        pixelData.begin(),
-        pixelData.end(),
-        std::back_inserter(pixels),
-        [](const std::uint32_t& px) -> BgraPixel {
-            const std::uint32_t r = px & 0xffu;
-            const std::uint32_t g = (px >> 8) & 0xffu;
-            const std::uint32_t b = (px >> 16) & 0xffu;
-            return b | (g << 8) | (r << 16) | (255 << 24);
-        });
-
-    stbi_image_free(pixelPtr);
+    // The texture takes ownership of stb_image's buffer, and the pixels are converted in place.
+    Texture texture;
+    texture.mDecodedStorage.reset(reinterpret_cast<Pixel*>(pixelPtr));
 
-    return Texture(
-        std::move(pixels),
-        Dimensions{static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)});
+    const auto             numPixels = static_cast<std::size_t>(width * height);
+    const std::span<Pixel> pixels(texture.mDecodedStorage.get(), numPixels);
+    swizzlePixels(pixels, ChannelOrder::Rgba, channelOrder, true);
+
+    texture.mPixels = pixels;
+    texture.mDimensions =
+        Dimensions{static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)};
+    texture.mChannelOrder = channelOrder;
+    return texture;
 }
 
 Texture Texture::fromPixel(float r, float g, float b, float a)
@@ -63,4 +449,18 @@ Texture Texture::fromPixel(float r, float g, float b, float a)
     return Texture(
         std::vector<BgraPixel>{b8 | (g8 << 8) | (r8 << 16) | (a8 << 24)}, Dimensions{1, 1});
 }
+
+Texture Texture::fromBorrowedPixels(
+    const std::span<const BgraPixel> pixels,
+    const Dimensions                 dimensions,
+    const std::uint32_t              numMipLevels)
+{
+    assert(pixels.size() == mipChainSize(dimensions, numMipLevels));
+
+    Texture texture;
+    texture.mPixels = pixels;
+    texture.mDimensions = dimensions;
+    texture.mNumMipLevels = numMipLevels;
+    return texture;
+}
 } // namespace nlrs
@@ -1,15 +1,29 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <span>
 #include <vector>
 
 namespace nlrs
 {
+class ThreadPool;
+
 class Texture
 {
 public:
-    using BgraPixel = std::uint32_t;
+    // A pixel with 8 bits per channel, in the texture's channel order.
+    using Pixel = std::uint32_t;
+    using BgraPixel = Pixel;
+
+    // The order of the channels from the least significant byte of a pixel to the most significant.
+    enum class ChannelOrder : std::uint8_t
+    {
+        Bgra,
+        Rgba,
+    };
 
     struct Dimensions
     {
@@ -19,30 +33,115 @@ public:
         bool operator==(const Dimensions&) const = default;
     };
 
-    Texture() = default;
-    Texture(std::vector<BgraPixel>&& pixels, Dimensions dimensions)
-        : mPixels(std::move(pixels)),
-          mDimensions(dimensions)
+    Texture()
+        : mStorage(),
+          mDecodedStorage(),
+          mPixels(),
+          mDimensions{0, 0},
+          mChannelOrder(ChannelOrder::Bgra),
+          mNumMipLevels(1)
+    {
+    }
+    // `pixels` contains `numMipLevels` mip levels, level 0 first.
+    Texture(
+        std::vector<Pixel>&& pixels,
+        Dimensions           dimensions,
+        ChannelOrder         channelOrder = ChannelOrder::Bgra,
+        std::uint32_t        numMipLevels = 1)
+        : mStorage(std::move(pixels)),
+          mDecodedStorage(),
+          mPixels(mStorage),
+          mDimensions(dimensions),
+          mChannelOrder(channelOrder),
+          mNumMipLevels(numMipLevels)
     {
     }
 
     Texture(const Texture&) = delete;
     Texture& operator=(const Texture&) = delete;
 
+    // Moving the storage keeps its buffer, so `mPixels` remains valid.
     Texture(Texture&&) = default;
     Texture& operator=(Texture&&) = default;
 
-    bool operator==(const Texture&) const = default;
+    bool operator==(const Texture& other) const noexcept
+    {
+        return mDimensions == other.mDimensions && mChannelOrder == other.mChannelOrder &&
+               mNumMipLevels == other.mNumMipLevels && std::ranges::equal(mPixels, other.mPixels);
+    }
+
+    // The pixels of mip level 0.
+    std::span<const Pixel> pixels() const noexcept
+    {
+        return mPixels.first(static_cast<std::size_t>(mDimensions.width) * mDimensions.height);
+    }
+    Dimensions    dimensions() const noexcept { return mDimensions; }
+    ChannelOrder  channelOrder() const noexcept { return mChannelOrder; }
+    std::uint32_t numMipLevels() const noexcept { return mNumMipLevels; }
+
+    // The pixels of every mip level, level 0 first, as laid out in storage.
+    std::span<const Pixel> mipChain() const noexcept { return mPixels; }
+    std::span<const Pixel> mipLevel(std::uint32_t level) const noexcept;
+    Dimensions             mipLevelDimensions(std::uint32_t level) const noexcept
+    {
+        return mipLevelDimensions(mDimensions, level);
+    }
+
+    // Returns a copy of the texture with its pixels in `channelOrder`.
+    Texture withChannelOrder(ChannelOrder channelOrder) const;
 
-    std::span<const BgraPixel> pixels() const noexcept { return mPixels; }
-    Dimensions                 dimensions() const noexcept { return mDimensions; }
+    // Returns a copy of the texture with a full mip chain, down to a single pixel. Each level is a
+    // 2x2 box filtered copy of the previous level, averaged in linear space: the color channels are
+    // sRGB encoded, decoded with srgbToLinearTable like the texture samplers do, and the alpha
+    // channel is linear. The last row and column of a level of odd size
+    // are folded into the last row and column of the next level, which average 3 texels instead of
+    // 2 in that direction. The rows of each level are filtered on `threadPool`, and the result is
+    // the same on every platform.
+    Texture withMipmaps(ThreadPool& threadPool) const;
 
-    // `data` is expected to be in RGBA or RGB format, with each component 8 bits.
-    static Texture fromMemory(std::span<const std::uint8_t> data);
+    // Each mip level halves the dimensions of the previous level, rounding down, and stopping at
+    // one.
+    static Dimensions    mipLevelDimensions(Dimensions dimensions, std::uint32_t level) noexcept;
+    // The number of levels in a full mip chain, including level 0.
+    static std::uint32_t maxMipLevels(Dimensions dimensions) noexcept;
+    // The total number of pixels in the first `numMipLevels` mip levels.
+    static std::size_t   mipChainSize(Dimensions dimensions, std::uint32_t numMipLevels) noexcept;
+
+    // `data` is expected to be in RGBA or RGB format, with each component 8 bits. The image is
+    // decoded into the texture's own storage and converted to `channelOrder` in place. The alpha
+    // channel is opaque.
+    static Texture fromMemory(
+        std::span<const std::uint8_t> data,
+        ChannelOrder                  channelOrder = ChannelOrder::Bgra);
     static Texture fromPixel(float r, float g, float b, float a);
+    // Creates a texture which refers to `pixels` without copying them, e.g. in a memory mapped
+    // file. The pixels must outlive the texture, and contain `numMipLevels` mip levels.
+    static Texture fromBorrowedPixels(
+        std::span<const BgraPixel> pixels,
+        Dimensions                 dimensions,
+        std::uint32_t              numMipLevels = 1);
 
 private:
-    std::vector<BgraPixel> mPixels;
-    Dimensions             mDimensions;
+    // Frees pixels which were allocated by stb_image.
+    struct DecodedPixelsDeleter
+    {
+        void operator()(Pixel* pixels) const noexcept;
+    };
+
+    std::vector<Pixel>                             mStorage;
+    std::unique_ptr<Pixel[], DecodedPixelsDeleter> mDecodedStorage;
+    std::span<const Pixel>                         mPixels;
+    Dimensions                                     mDimensions;
+    ChannelOrder                                   mChannelOrder;
+    std::uint32_t                                  mNumMipLevels;
 };
+
+// Converts pixels with 8 bits per channel from the `from` channel order to the `to` channel order
+// in place, and makes them opaque if `makeOpaque` is set. Processes several pixels at a time with
+// AVX2, SSE2 or NEON where the target supports them.
+void swizzlePixels(
+    std::span<Texture::Pixel> pixels,
+    Texture::ChannelOrder     from,
+    Texture::ChannelOrder     to,
+    bool                      makeOpaque) noexcept;
 } // namespace nlrs
@@ -0,0 +1,337 @@
+#include "texture_atlas.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace nlrs
+{
+namespace
+{
+struct RegionOrigin
+{
+    std::uint32_t x;
+    std::uint32_t y;
+};
+
+struct SkylinePacking
+{
+    std::vector<RegionOrigin> origins;
+    Texture::Dimensions       dimensions;
+};
+
+// A horizontal segment of the skyline, the top edge of the packed regions.
+struct SkylineSegment
+{
+    std::uint32_t x;
+    std::uint32_t y;
+    std::uint32_t width;
+};
+
+std::uint32_t alignToTile(const std::uint32_t size) noexcept
+{
+    return (size + TEXEL_TILE_SIZE - 1) / TEXEL_TILE_SIZE * TEXEL_TILE_SIZE;
+}
+
+// Packs the regions bottom-left into an atlas whose width is a power of two, placing the tallest
+// regions first. The region sizes must be multiples of TEXEL_TILE_SIZE.
+SkylinePacking packSkyline(const std::span<const Texture::Dimensions> regionSizes)
+{
+    std::size_t   area = 0;
+    std::uint32_t maxWidth = TEXEL_TILE_SIZE;
+    for (const Texture::Dimensions size : regionSizes)
+    {
+        area += static_cast<std::size_t>(size.width) * size.height;
+        maxWidth = std::max(maxWidth, size.width);
+    }
+    const auto atlasWidth = std::bit_ceil(std::max(
+        maxWidth, static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<double>(area))))));
+
+    std::vector<std::size_t> order(regionSizes.size());
+    std::iota(order.begin(), order.end(), std::size_t{0});
+    std::stable_sort(order.begin(), order.end(), [regionSizes](std::size_t lhs, std::size_t rhs) {
+        const Texture::Dimensions l = regionSizes[lhs];
+        const Texture::Dimensions r = regionSizes[rhs];
+        return l.height != r.height ? l.height > r.height : l.width > r.width;
+    });
+
+    SkylinePacking packing{
+        .origins = std::vector<RegionOrigin>(regionSizes.size()),
+        .dimensions = Texture::Dimensions{atlasWidth, 0}};
+    std::vector<SkylineSegment> skyline{SkylineSegment{0, 0, atlasWidth}};
+    for (const std::size_t regionIdx : order)
+    {
+        const Texture::Dimensions size = regionSizes[regionIdx];
+
+        // Find the segment at which the region rests lowest, leftmost on ties.
+        std::size_t   bestSegmentIdx = 0;
+        std::uint32_t bestY = std::numeric_limits<std::uint32_t>::max();
+        for (std::size_t i = 0; i < skyline.size(); ++i)
+        {
+            if (skyline[i].x + size.width > atlasWidth)
+            {
+                break;
+            }
+            std::uint32_t y = 0;
+            std::uint32_t remainingWidth = size.width;
+            for (std::size_t j = i; remainingWidth > 0; ++j)
+            {
+                assert(j < skyline.size());
+                y = std::max(y, skyline[j].y);
+                remainingWidth -= std::min(remainingWidth, skyline[j].width);
+            }
+            if (y < bestY)
+            {
+                bestY = y;
+                bestSegmentIdx = i;
+            }
+        }
+        assert(bestY != std::numeric_limits<std::uint32_t>::max());
+
+        const std::uint32_t x = skyline[bestSegmentIdx].x;
+        packing.origins[regionIdx] = RegionOrigin{x, bestY};
+        packing.dimensions.height = std::max(packing.dimensions.height, bestY + size.height);
+
+        // Raise the skyline under the region.
+        skyline.insert(
+            skyline.begin() + static_cast<std::ptrdiff_t>(bestSegmentIdx),
+            SkylineSegment{x, bestY + size.height, size.width});
+        const std::uint32_t regionEnd = x + size.width;
+        for (std::size_t i = bestSegmentIdx + 1; i < skyline.size();)
+        {
+            SkylineSegment& segment = skyline[i];
+            if (segment.x >= regionEnd)
+            {
+                break;
+            }
+            const std::uint32_t segmentEnd = segment.x + segment.width;
+            if (segmentEnd <= regionEnd)
+            {
+                skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+                continue;
+            }
+            segment.x = regionEnd;
+            segment.width = segmentEnd - regionEnd;
+            break;
+        }
+        for (std::size_t i = 1; i < skyline.size();)
+        {
+            if (skyline[i - 1].y == skyline[i].y)
+            {
+                skyline[i - 1].width += skyline[i].width;
+                skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    return packing;
+}
+} // namespace
+
+Texture::Dimensions textureAtlasRegionDimensions(
+    const Texture::Dimensions dimensions,
+    const std::uint32_t       numMipLevels) noexcept
+{
+    Texture::Dimensions region = dimensions;
+    std::uint32_t       columnHeight = 0;
+    for (std::uint32_t level = 1; level < numMipLevels; ++level)
+    {
+        const Texture::Dimensions levelDimensions = Texture::mipLevelDimensions(dimensions, level);
+        if (level == 1)
+        {
+            region.width += levelDimensions.width;
+        }
+        columnHeight += levelDimensions.height;
+    }
+    region.height = std::max(region.height, columnHeight);
+    return region;
+}
+
+TextureAtlas buildTextureAtlas(
+    const std::span<const Texture> textures,
+    const TexelLayout              layout,
+    const std::size_t              maxNumBytes)
+{
+    const std::size_t maxNumTexels = maxNumBytes / sizeof(Texture::BgraPixel);
+
+    // The mip level of each texture which becomes level 0 in the atlas.
+    std::vector<std::uint32_t> baseLevels(textures.size(), 0);
+    bool                       packMipChains = true;
+    const auto                 numPackedMipLevels = [&](const std::size_t textureIdx) {
+        return packMipChains ? textures[textureIdx].numMipLevels() - baseLevels[textureIdx] : 1;
+    };
+
+    std::vector<Texture::Dimensions> regionSizes(textures.size());
+    SkylinePacking                   packing;
+    while (true)
+    {
+        std::size_t area = 0;
+        for (std::size_t i = 0; i < textures.size(); ++i)
+        {
+            const Texture::Dimensions region = textureAtlasRegionDimensions(
+                textures[i].mipLevelDimensions(baseLevels[i]), numPackedMipLevels(i));
+            regionSizes[i] =
+                Texture::Dimensions{alignToTile(region.width), alignToTile(region.height)};
+            area += static_cast<std::size_t>(regionSizes[i].width) * regionSizes[i].height;
+        }
+        // Packing is skipped while the regions alone exceed the budget.
+        if (area <= maxNumTexels)
+        {
+            packing = packSkyline(regionSizes);
+            if (texelLayoutSize(layout, packing.dimensions) <= maxNumTexels)
+            {
+                break;
+            }
+        }
+
+        if (packMipChains)
+        {
+            packMipChains = false;
+            continue;
+        }
+
+        std::size_t downscaleIdx = textures.size();
+        std::size_t downscaleArea = 0;
+        for (std::size_t i = 0; i < textures.size(); ++i)
+        {
+            const std::size_t regionArea =
+                static_cast<std::size_t>(regionSizes[i].width) * regionSizes[i].height;
+            if (baseLevels[i] + 1 < textures[i].numMipLevels() && regionArea > downscaleArea)
+            {
+                downscaleIdx = i;
+                downscaleArea = regionArea;
+            }
+        }
+        if (downscaleIdx == textures.size())
+        {
+            throw std::runtime_error(fmt::format(
+                "The textures do not fit in a texture atlas of {} bytes.", maxNumBytes));
+        }
+        ++baseLevels[downscaleIdx];
+    }
+
+    TextureAtlas atlas;
+    atlas.descriptors.reserve(textures.size());
+    atlas.texels.resize(texelLayoutSize(layout, packing.dimensions));
+    assert(atlas.texels.size() <= std::numeric_limits<std::uint32_t>::max());
+
+    std::size_t                 numTextureTexels = 0;
+    std::vector<Texture::Pixel> row;
+    for (std::size_t i = 0; i < textures.size(); ++i)
+    {
+        const Texture&      texture = textures[i];
+        const RegionOrigin  origin = packing.origins[i];
+        const std::uint32_t numMipLevels = numPackedMipLevels(i);
+
+        std::uint32_t levelX = origin.x;
+        std::uint32_t levelY = origin.y;
+        for (std::uint32_t level = 0; level < numMipLevels; ++level)
+        {
+            const Texture::Dimensions dimensions =
+                texture.mipLevelDimensions(baseLevels[i] + level);
+            const std::span<const Texture::Pixel> pixels = texture.mipLevel(baseLevels[i] + level);
+            for (std::uint32_t y = 0; y < dimensions.height; ++y)
+            {
+                const auto rowPixels = pixels.subspan(
+                    static_cast<std::size_t>(y) * dimensions.width, dimensions.width);
+                row.assign(rowPixels.begin(), rowPixels.end());
+                swizzlePixels(row, texture.channelOrder(), Texture::ChannelOrder::Bgra, false);
+
+                if (layout == TexelLayout::RowMajor)
+                {
+                    const std::size_t rowStart =
+                        texelIndex(layout, packing.dimensions, levelX, levelY + y);
+                    std::copy(
+                        row.begin(),
+                        row.end(),
+                        atlas.texels.begin() + static_cast<std::ptrdiff_t>(rowStart));
+                    continue;
+                }
+                for (std::uint32_t x = 0; x < dimensions.width; ++x)
+                {
+                    atlas.texels[texelIndex(layout, packing.dimensions, levelX + x, levelY + y)] =
+                        row[x];
+                }
+            }
+            numTextureTexels += static_cast<std::size_t>(dimensions.width) * dimensions.height;
+
+            if (level == 0)
+            {
+                levelX += dimensions.width;
+            }
+            else
+            {
+                levelY += dimensions.height;
+            }
+        }
+
+        const Texture::Dimensions dimensions = texture.mipLevelDimensions(baseLevels[i]);
+        atlas.descriptors.push_back(TextureAtlasDescriptor{
+            .x = origin.x,
+            .y = origin.y,
+            .width = dimensions.width,
+            .height = dimensions.height,
+            .numMipLevels = numMipLevels,
+            .atlasWidth = packing.dimensions.width,
+            .layout = layout});
+    }
+
+    atlas.stats = TextureAtlasStats{
+        .dimensions = packing.dimensions,
+        .occupancy = atlas.texels.empty() ? 0.0f
+                                          : static_cast<float>(numTextureTexels) /
+                                                static_cast<float>(atlas.texels.size()),
+        .numDownscaledTextures = static_cast<std::uint32_t>(
+            std::count_if(baseLevels.begin(), baseLevels.end(), [](std::uint32_t baseLevel) {
+                return baseLevel > 0;
+            })),
+        .hasMipChains = packMipChains};
+
+    return atlas;
+}
+
+Texture::BgraPixel sampleTextureAtlas(
+    const std::span<const Texture::BgraPixel> texels,
+    const TextureAtlasDescriptor&             descriptor,
+    const glm::vec2                           uv,
+    const float                               lod) noexcept
+{
+    const auto level = static_cast<std::uint32_t>(std::clamp(
+        std::floor(lod + 0.5f), 0.0f, static_cast<float>(descriptor.numMipLevels - 1)));
+
+    std::uint32_t       levelX = descriptor.x;
+    std::uint32_t       levelY = descriptor.y;
+    Texture::Dimensions dimensions{descriptor.width, descriptor.height};
+    for (std::uint32_t l = 0; l < level; ++l)
+    {
+        if (l == 0)
+        {
+            levelX += dimensions.width;
+        }
+        else
+        {
+            levelY += dimensions.height;
+        }
+        dimensions = Texture::mipLevelDimensions(dimensions, 1);
+    }
+
+    const float u = uv.x - std::floor(uv.x);
+    const float v = uv.y - std::floor(uv.y);
+
+    const std::uint32_t x =
+        std::min(static_cast<std::uint32_t>(u * dimensions.width), dimensions.width - 1);
+    const std::uint32_t y =
+        std::min(static_cast<std::uint32_t>(v * dimensions.height), dimensions.height - 1);
+
+    const Texture::Dimensions atlasDimensions{descriptor.atlasWidth, 0};
+    return texels[texelIndex(descriptor.layout, atlasDimensions, levelX + x, levelY + y)];
+}
+} // namespace nlrs
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "texel_layout.hpp"
+#include "texture.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nlrs
+{
+// Ensure matches layout of `TextureDescriptor` definition in the shaders. Level 0 of the texture
+// is at (`x`, `y`) in the atlas, and the other mip levels are stacked in a column to its right,
+// level 1 at the top.
+struct TextureAtlasDescriptor
+{
+    std::uint32_t x;
+    std::uint32_t y;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t numMipLevels;
+    std::uint32_t atlasWidth;
+    TexelLayout   layout;
+};
+
+struct TextureAtlasStats
+{
+    Texture::Dimensions dimensions;
+    // The fraction of the atlas's texels which are texture texels.
+    float               occupancy;
+    // The number of textures whose level 0 is a lower mip level of the source texture.
+    std::uint32_t       numDownscaledTextures;
+    bool                hasMipChains;
+};
+
+struct TextureAtlas
+{
+    // In the order of the source textures.
+    std::vector<TextureAtlasDescriptor> descriptors;
+    // BGRA texels of the atlas, stored in the descriptors' layout.
+    std::vector<Texture::BgraPixel>     texels;
+    TextureAtlasStats                   stats;
+};
+
+// The extent of the atlas region of a texture with `dimensions` and `numMipLevels`, including the
+// mip levels to its right.
+Texture::Dimensions textureAtlasRegionDimensions(
+    Texture::Dimensions dimensions,
+    std::uint32_t       numMipLevels) noexcept;
+
+// Packs the textures into one atlas with a skyline packer. Regions are aligned to TEXEL_TILE_SIZE.
+// The mip chains are packed if the atlas fits in `maxNumBytes`, and only level 0 otherwise. If the
+// atlas still does not fit, the largest textures are replaced by their next mip level one at a
+// time. Throws if the textures do not fit even at their smallest mip levels.
+TextureAtlas buildTextureAtlas(
+    std::span<const Texture> textures,
+    TexelLayout              layout,
+    std::size_t              maxNumBytes);
+
+// Returns the nearest texel of the mip level nearest to `lod`, with the texture repeating outside
+// of [0, 1]. A reference for `textureLookup` in the shaders.
+Texture::BgraPixel sampleTextureAtlas(
+    std::span<const Texture::BgraPixel> texels,
+    const TextureAtlasDescriptor&       descriptor,
+    glm::vec2                           uv,
+    float                               lod) noexcept;
+} // namespace nlrs
@@ -0,0 +1,848 @@
+#include "texture_compression.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <utility>
+
+namespace nlrs
+{
+namespace
+{
+// The channels of a texel in RGBA order, in [0, 255].
+using Color = std::array<float, 4>;
+
+// A pair of endpoint colors, before they are quantized.
+struct Endpoints
+{
+    Color e0;
+    Color e1;
+};
+
+// The weights of the second endpoint of BC7's 4-bit indices, out of 64.
+constexpr std::array<std::uint32_t, 16> BC7_WEIGHTS{
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// The weights of the second endpoint of BC1's indices in 4-color mode.
+constexpr std::array<float, 4> BC1_WEIGHTS{0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+Color texelColor(const Texture::BgraPixel texel) noexcept
+{
+    return Color{
+        static_cast<float>((texel >> 16) & 0xffu),
+        static_cast<float>((texel >> 8) & 0xffu),
+        static_cast<float>(texel & 0xffu),
+        static_cast<float>(texel >> 24)};
+}
+
+Texture::BgraPixel bgraPixel(
+    const std::uint32_t r,
+    const std::uint32_t g,
+    const std::uint32_t b,
+    const std::uint32_t a) noexcept
+{
+    return b | (g << 8) | (r << 16) | (a << 24);
+}
+
+float squaredDistance(const Color& lhs, const Color& rhs, const std::size_t numChannels) noexcept
+{
+    float distance = 0.0f;
+    for (std::size_t ch = 0; ch < numChannels; ++ch)
+    {
+        const float d = lhs[ch] - rhs[ch];
+        distance += d * d;
+    }
+    return distance;
+}
+
+// Channels past `numChannels` are not encoded, and are set to opaque.
+void clampEndpoints(Endpoints& endpoints, const std::size_t numChannels) noexcept
+{
+    for (std::size_t ch = 0; ch < 4; ++ch)
+    {
+        const bool encoded = ch < numChannels;
+        endpoints.e0[ch] = encoded ? std::clamp(endpoints.e0[ch], 0.0f, 255.0f) : 255.0f;
+        endpoints.e1[ch] = encoded ? std::clamp(endpoints.e1[ch], 0.0f, 255.0f) : 255.0f;
+    }
+}
+
+// Fits the endpoints to the diagonal of the bounding box of the block's colors which best follows
+// them, moved inwards by `inset` of the box's extent so that the interpolated colors cover the
+// interior of the box more evenly.
+Endpoints boundingBoxEndpoints(
+    const TextureBlock& texels,
+    const std::size_t   numChannels,
+    const float         inset) noexcept
+{
+    std::array<Color, 16> colors;
+    Color                 mean{0.0f, 0.0f, 0.0f, 0.0f};
+    Color                 lo{255.0f, 255.0f, 255.0f, 255.0f};
+    Color                 hi{0.0f, 0.0f, 0.0f, 0.0f};
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        colors[i] = texelColor(texels[i]);
+        for (std::size_t ch = 0; ch < numChannels; ++ch)
+        {
+            mean[ch] += colors[i][ch] / static_cast<float>(texels.size());
+            lo[ch] = std::min(lo[ch], colors[i][ch]);
+            hi[ch] = std::max(hi[ch], colors[i][ch]);
+        }
+    }
+
+    // The main diagonal runs from `lo` to `hi`. Channels which decrease as the channel with the
+    // largest extent increases run along the opposite direction.
+    std::size_t majorCh = 0;
+    for (std::size_t ch = 1; ch < numChannels; ++ch)
+    {
+        if (hi[ch] - lo[ch] > hi[majorCh] - lo[majorCh])
+        {
+            majorCh = ch;
+        }
+    }
+    Endpoints endpoints{hi, lo};
+    for (std::size_t ch = 0; ch < numChannels; ++ch)
+    {
+        float covariance = 0.0f;
+        for (const Color& color : colors)
+        {
+            covariance += (color[majorCh] - mean[majorCh]) * (color[ch] - mean[ch]);
+        }
+        if (covariance < 0.0f)
+        {
+            std::swap(endpoints.e0[ch], endpoints.e1[ch]);
+        }
+
+        const float d = (endpoints.e0[ch] - endpoints.e1[ch]) * inset;
+        endpoints.e0[ch] -= d;
+        endpoints.e1[ch] += d;
+    }
+    clampEndpoints(endpoints, numChannels);
+    return endpoints;
+}
+
+// Fits the endpoints to the extent of the block's colors along their principal axis.
+Endpoints principalAxisEndpoints(const TextureBlock& texels, const std::size_t numChannels) noexcept
+{
+    std::array<Color, 16> colors;
+    Color                 mean{0.0f, 0.0f, 0.0f, 0.0f};
+    Color                 lo{255.0f, 255.0f, 255.0f, 255.0f};
+    Color                 hi{0.0f, 0.0f, 0.0f, 0.0f};
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        colors[i] = texelColor(texels[i]);
+        for (std::size_t ch = 0; ch < numChannels; ++ch)
+        {
+            mean[ch] += colors[i][ch] / static_cast<float>(texels.size());
+            lo[ch] = std::min(lo[ch], colors[i][ch]);
+            hi[ch] = std::max(hi[ch], colors[i][ch]);
+        }
+    }
+
+    std::array<Color, 4> covariance{};
+    for (const Color& color : colors)
+    {
+        for (std::size_t i = 0; i < numChannels; ++i)
+        {
+            for (std::size_t j = 0; j < numChannels; ++j)
+            {
+                covariance[i][j] += (color[i] - mean[i]) * (color[j] - mean[j]);
+            }
+        }
+    }
+
+    // Power iteration, starting from the diagonal of the bounding box, which is usually close to
+    // the principal axis already.
+    Color axis{0.0f, 0.0f, 0.0f, 0.0f};
+    for (std::size_t ch = 0; ch < numChannels; ++ch)
+    {
+        axis[ch] = hi[ch] - lo[ch];
+    }
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        Color next{0.0f, 0.0f, 0.0f, 0.0f};
+        float maxComponent = 0.0f;
+        for (std::size_t i = 0; i < numChannels; ++i)
+        {
+            for (std::size_t j = 0; j < numChannels; ++j)
+            {
+                next[i] += covariance[i][j] * axis[j];
+            }
+            maxComponent = std::max(maxComponent, std::abs(next[i]));
+        }
+        if (maxComponent == 0.0f)
+        {
+            break;
+        }
+        for (std::size_t ch = 0; ch < numChannels; ++ch)
+        {
+            axis[ch] = next[ch] / maxComponent;
+        }
+    }
+
+    const float length = std::sqrt(squaredDistance(axis, Color{}, numChannels));
+    Endpoints   endpoints{mean, mean};
+    if (length > 0.0f)
+    {
+        float minT = std::numeric_limits<float>::max();
+        float maxT = std::numeric_limits<float>::lowest();
+        for (const Color& color : colors)
+        {
+            float t = 0.0f;
+            for (std::size_t ch = 0; ch < numChannels; ++ch)
+            {
+                t += (color[ch] - mean[ch]) * axis[ch] / length;
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        for (std::size_t ch = 0; ch < numChannels; ++ch)
+        {
+            endpoints.e0[ch] = mean[ch] + axis[ch] / length * maxT;
+            endpoints.e1[ch] = mean[ch] + axis[ch] / length * minT;
+        }
+    }
+    clampEndpoints(endpoints, numChannels);
+    return endpoints;
+}
+
+// Solves for the endpoints which minimize the squared error of the block's colors, when each
+// texel is interpolated with the weight of the second endpoint in `weights`. There is no solution
+// if all the weights are equal.
+std::optional<Endpoints> leastSquaresEndpoints(
+    const TextureBlock&          texels,
+    const std::array<float, 16>& weights,
+    const std::size_t            numChannels) noexcept
+{
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    Color ax{0.0f, 0.0f, 0.0f, 0.0f};
+    Color bx{0.0f, 0.0f, 0.0f, 0.0f};
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        const float t = weights[i];
+        const float s = 1.0f - t;
+        const Color color = texelColor(texels[i]);
+        aa += s * s;
+        ab += s * t;
+        bb += t * t;
+        for (std::size_t ch = 0; ch < numChannels; ++ch)
+        {
+            ax[ch] += s * color[ch];
+            bx[ch] += t * color[ch];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+    {
+        return std::nullopt;
+    }
+    Endpoints endpoints;
+    for (std::size_t ch = 0; ch < numChannels; ++ch)
+    {
+        endpoints.e0[ch] = (bb * ax[ch] - ab * bx[ch]) / determinant;
+        endpoints.e1[ch] = (aa * bx[ch] - ab * ax[ch]) / determinant;
+    }
+    clampEndpoints(endpoints, numChannels);
+    return endpoints;
+}
+
+std::uint16_t rgb565(const Color& color) noexcept
+{
+    const auto quantize = [](const float value, const float maxValue) {
+        return static_cast<std::uint16_t>(std::lround(value * maxValue / 255.0f));
+    };
+    return static_cast<std::uint16_t>(
+        (quantize(color[0], 31.0f) << 11) | (quantize(color[1], 63.0f) << 5) |
+        quantize(color[2], 31.0f));
+}
+
+std::array<std::uint32_t, 3> expandRgb565(const std::uint16_t color) noexcept
+{
+    const std::uint32_t r = color >> 11;
+    const std::uint32_t g = (color >> 5) & 0x3fu;
+    const std::uint32_t b = color & 0x1fu;
+    return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+// The colors which a BC1 block's indices refer to. The block is in 4-color mode if `c0 > c1`, and
+// in 3-color mode with transparent black as the fourth color otherwise.
+std::array<Texture::BgraPixel, 4> bc1Palette(
+    const std::uint16_t c0,
+    const std::uint16_t c1) noexcept
+{
+    const std::array<std::uint32_t, 3> p0 = expandRgb565(c0);
+    const std::array<std::uint32_t, 3> p1 = expandRgb565(c1);
+
+    std::array<Texture::BgraPixel, 4> palette;
+    palette[0] = bgraPixel(p0[0], p0[1], p0[2], 255);
+    palette[1] = bgraPixel(p1[0], p1[1], p1[2], 255);
+    if (c0 > c1)
+    {
+        palette[2] = bgraPixel(
+            (2 * p0[0] + p1[0] + 1) / 3,
+            (2 * p0[1] + p1[1] + 1) / 3,
+            (2 * p0[2] + p1[2] + 1) / 3,
+            255);
+        palette[3] = bgraPixel(
+            (p0[0] + 2 * p1[0] + 1) / 3,
+            (p0[1] + 2 * p1[1] + 1) / 3,
+            (p0[2] + 2 * p1[2] + 1) / 3,
+            255);
+    }
+    else
+    {
+        palette[2] = bgraPixel(
+            (p0[0] + p1[0] + 1) / 2, (p0[1] + p1[1] + 1) / 2, (p0[2] + p1[2] + 1) / 2, 255);
+        palette[3] = 0;
+    }
+    return palette;
+}
+
+struct Bc1Fit
+{
+    std::uint16_t c0;
+    std::uint16_t c1;
+    std::uint32_t indices;
+    float         error;
+};
+
+// Quantizes the endpoints and picks the nearest palette color for each texel. The encoder only
+// produces blocks in 4-color mode, or blocks with a single color.
+Bc1Fit fitBc1(const TextureBlock& texels, const Endpoints& endpoints) noexcept
+{
+    std::uint16_t c0 = rgb565(endpoints.e0);
+    std::uint16_t c1 = rgb565(endpoints.e1);
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+    }
+
+    const std::array<Texture::BgraPixel, 4> palette = bc1Palette(c0, c1);
+    const std::uint32_t                     numColors = c0 > c1 ? 4 : 1;
+
+    Bc1Fit fit{.c0 = c0, .c1 = c1, .indices = 0, .error = 0.0f};
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        const Color   color = texelColor(texels[i]);
+        std::uint32_t bestIndex = 0;
+        float         bestError = std::numeric_limits<float>::max();
+        for (std::uint32_t index = 0; index < numColors; ++index)
+        {
+            const float error = squaredDistance(color, texelColor(palette[index]), 3);
+            if (error < bestError)
+            {
+                bestIndex = index;
+                bestError = error;
+            }
+        }
+        fit.indices |= bestIndex << (2 * i);
+        fit.error += bestError;
+    }
+    return fit;
+}
+
+// Refits the endpoints to the indices of `fit` by least squares, and returns the better fit.
+Bc1Fit refineBc1(const TextureBlock& texels, const Bc1Fit& fit) noexcept
+{
+    if (fit.c0 == fit.c1)
+    {
+        return fit;
+    }
+    std::array<float, 16> weights;
+    for (std::size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = BC1_WEIGHTS[(fit.indices >> (2 * i)) & 0x3u];
+    }
+    const std::optional<Endpoints> endpoints = leastSquaresEndpoints(texels, weights, 3);
+    if (!endpoints)
+    {
+        return fit;
+    }
+    const Bc1Fit refined = fitBc1(texels, *endpoints);
+    return refined.error < fit.error ? refined : fit;
+}
+
+// An endpoint of a BC7 mode 6 block: 7 bits per channel, followed by the shared p-bit.
+using Bc7Endpoint = std::array<std::uint32_t, 4>;
+
+// Quantizes the color with the p-bit `p`.
+Bc7Endpoint quantizeBc7Endpoint(const Color& color, const std::uint32_t p) noexcept
+{
+    Bc7Endpoint endpoint;
+    for (std::size_t ch = 0; ch < 4; ++ch)
+    {
+        const auto c7 = static_cast<std::uint32_t>(
+            std::clamp(std::lround((color[ch] - static_cast<float>(p)) / 2.0f), 0l, 127l));
+        endpoint[ch] = (c7 << 1) | p;
+    }
+    return endpoint;
+}
+
+// The p-bit with which the color quantizes with the smallest error.
+std::uint32_t nearestBc7PBit(const Color& color) noexcept
+{
+    std::array<float, 2> errors{0.0f, 0.0f};
+    for (std::uint32_t p = 0; p < 2; ++p)
+    {
+        const Bc7Endpoint endpoint = quantizeBc7Endpoint(color, p);
+        for (std::size_t ch = 0; ch < 4; ++ch)
+        {
+            const float d = static_cast<float>(endpoint[ch]) - color[ch];
+            errors[p] += d * d;
+        }
+    }
+    return errors[1] < errors[0] ? 1 : 0;
+}
+
+std::array<Texture::BgraPixel, 16> bc7Palette(const Bc7Endpoint& e0, const Bc7Endpoint& e1) noexcept
+{
+    std::array<Texture::BgraPixel, 16> palette;
+    for (std::size_t i = 0; i < palette.size(); ++i)
+    {
+        const std::uint32_t          w = BC7_WEIGHTS[i];
+        std::array<std::uint32_t, 4> color;
+        for (std::size_t ch = 0; ch < 4; ++ch)
+        {
+            color[ch] = ((64 - w) * e0[ch] + w * e1[ch] + 32) >> 6;
+        }
+        palette[i] = bgraPixel(color[0], color[1], color[2], color[3]);
+    }
+    return palette;
+}
+
+struct Bc7Fit
+{
+    Bc7Endpoint                   e0;
+    Bc7Endpoint                   e1;
+    std::array<std::uint32_t, 16> indices;
+    float                         error;
+};
+
+// Picks the nearest palette color for each texel. The first texel's index is stored with one bit
+// less, so the endpoints are swapped if its most significant bit is set.
+Bc7Fit fitBc7Indices(
+    const TextureBlock& texels,
+    const Bc7Endpoint&  e0,
+    const Bc7Endpoint&  e1) noexcept
+{
+    Bc7Fit fit{.e0 = e0, .e1 = e1, .indices = {}, .error = 0.0f};
+
+    std::array<Color, 16> palette;
+    std::ranges::transform(bc7Palette(fit.e0, fit.e1), palette.begin(), texelColor);
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        const Color color = texelColor(texels[i]);
+        float       bestError = std::numeric_limits<float>::max();
+        for (std::uint32_t index = 0; index < palette.size(); ++index)
+        {
+            const float error = squaredDistance(color, palette[index], 4);
+            if (error < bestError)
+            {
+                fit.indices[i] = index;
+                bestError = error;
+            }
+        }
+        fit.error += bestError;
+    }
+
+    if (fit.indices[0] >= 8)
+    {
+        // The weights are symmetric, so swapping the endpoints and inverting the indices yields the
+        // same colors.
+        std::swap(fit.e0, fit.e1);
+        for (std::uint32_t& index : fit.indices)
+        {
+            index = 15 - index;
+        }
+    }
+    return fit;
+}
+
+// Quantizes the endpoints. The fast fit picks the nearest p-bit of each endpoint, and the high
+// quality fit tries every pair of p-bits and keeps the one with the smallest error.
+Bc7Fit fitBc7(
+    const TextureBlock&             texels,
+    const Endpoints&                endpoints,
+    const TextureCompressionQuality quality) noexcept
+{
+    if (quality == TextureCompressionQuality::Fast)
+    {
+        return fitBc7Indices(
+            texels,
+            quantizeBc7Endpoint(endpoints.e0, nearestBc7PBit(endpoints.e0)),
+            quantizeBc7Endpoint(endpoints.e1, nearestBc7PBit(endpoints.e1)));
+    }
+
+    Bc7Fit best{.e0 = {}, .e1 = {}, .indices = {}, .error = std::numeric_limits<float>::max()};
+    for (std::uint32_t p0 = 0; p0 < 2; ++p0)
+    {
+        for (std::uint32_t p1 = 0; p1 < 2; ++p1)
+        {
+            const Bc7Fit fit = fitBc7Indices(
+                texels,
+                quantizeBc7Endpoint(endpoints.e0, p0),
+                quantizeBc7Endpoint(endpoints.e1, p1));
+            if (fit.error < best.error)
+            {
+                best = fit;
+            }
+        }
+    }
+    return best;
+}
+
+// Refits the endpoints to the indices of `fit` by least squares, and returns the better fit.
+Bc7Fit refineBc7(const TextureBlock& texels, const Bc7Fit& fit) noexcept
+{
+    std::array<float, 16> weights;
+    for (std::size_t i = 0; i < weights.size(); ++i)
+    {
+        weights[i] = static_cast<float>(BC7_WEIGHTS[fit.indices[i]]) / 64.0f;
+    }
+    const std::optional<Endpoints> endpoints = leastSquaresEndpoints(texels, weights, 4);
+    if (!endpoints)
+    {
+        return fit;
+    }
+    const Bc7Fit refined = fitBc7(texels, *endpoints, TextureCompressionQuality::High);
+    return refined.error < fit.error ? refined : fit;
+}
+
+// BC7 fields are packed from the least significant bit of the first byte.
+void writeBits(
+    const std::span<std::uint8_t, 16> block,
+    std::uint32_t&                    offset,
+    const std::uint32_t               value,
+    const std::uint32_t               numBits) noexcept
+{
+    for (std::uint32_t i = 0; i < numBits; ++i, ++offset)
+    {
+        if ((value >> i) & 1u)
+        {
+            block[offset / 8] |= static_cast<std::uint8_t>(1u << (offset % 8));
+        }
+    }
+}
+
+std::uint32_t readBits(
+    const std::span<const std::uint8_t, 16> block,
+    std::uint32_t&                          offset,
+    const std::uint32_t                     numBits) noexcept
+{
+    std::uint32_t value = 0;
+    for (std::uint32_t i = 0; i < numBits; ++i, ++offset)
+    {
+        value |= static_cast<std::uint32_t>((block[offset / 8] >> (offset % 8)) & 1u) << i;
+    }
+    return value;
+}
+} // namespace
+
+std::size_t compressedBlockNumBytes(const TextureCompression compression) noexcept
+{
+    switch (compression)
+    {
+    case TextureCompression::Bc1:
+        return 8;
+    case TextureCompression::Bc7:
+        return 16;
+    case TextureCompression::None:
+        break;
+    }
+    assert(!"Unknown TextureCompression");
+    return 0;
+}
+
+std::span<const std::uint8_t> CompressedTexture::mipLevel(const std::uint32_t level) const noexcept
+{
+    assert(level < mNumMipLevels);
+    const Texture::Dimensions blocks = blockDimensions(mipLevelDimensions(level));
+    return mBlocks.subspan(
+        mipChainNumBytes(mDimensions, mCompression, level),
+        static_cast<std::size_t>(blocks.width) * blocks.height *
+            compressedBlockNumBytes(mCompression));
+}
+
+Texture CompressedTexture::decompress() const
+{
+    std::vector<Texture::BgraPixel> pixels(Texture::mipChainSize(mDimensions, mNumMipLevels));
+    const std::size_t               blockNumBytes = compressedBlockNumBytes(mCompression);
+
+    std::size_t levelOffset = 0;
+    for (std::uint32_t level = 0; level < mNumMipLevels; ++level)
+    {
+        const Texture::Dimensions           dimensions = mipLevelDimensions(level);
+        const Texture::Dimensions           blocks = blockDimensions(dimensions);
+        const std::span<const std::uint8_t> levelBlocks = mipLevel(level);
+        for (std::uint32_t blockY = 0; blockY < blocks.height; ++blockY)
+        {
+            for (std::uint32_t blockX = 0; blockX < blocks.width; ++blockX)
+            {
+                const std::size_t blockOffset =
+                    (static_cast<std::size_t>(blockY) * blocks.width + blockX) * blockNumBytes;
+                const TextureBlock texels =
+                    mCompression == TextureCompression::Bc1
+                        ? decodeBc1Block(levelBlocks.subspan(blockOffset).first<8>())
+                        : decodeBc7Block(levelBlocks.subspan(blockOffset).first<16>());
+
+                for (std::uint32_t y = 0; y < TEXTURE_BLOCK_SIZE; ++y)
+                {
+                    for (std::uint32_t x = 0; x < TEXTURE_BLOCK_SIZE; ++x)
+                    {
+                        const std::uint32_t texelX = blockX * TEXTURE_BLOCK_SIZE + x;
+                        const std::uint32_t texelY = blockY * TEXTURE_BLOCK_SIZE + y;
+                        if (texelX < dimensions.width && texelY < dimensions.height)
+                        {
+                            pixels
+                                [levelOffset + static_cast<std::size_t>(texelY) * dimensions.width +
+                                 texelX] = texels[y * TEXTURE_BLOCK_SIZE + x];
+                        }
+                    }
+                }
+            }
+        }
+        levelOffset += static_cast<std::size_t>(dimensions.width) * dimensions.height;
+    }
+
+    return Texture(std::move(pixels), mDimensions, Texture::ChannelOrder::Bgra, mNumMipLevels);
+}
+
+Texture::Dimensions CompressedTexture::blockDimensions(
+    const Texture::Dimensions dimensions) noexcept
+{
+    return Texture::Dimensions{
+        (dimensions.width + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE,
+        (dimensions.height + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE};
+}
+
+std::size_t CompressedTexture::mipChainNumBytes(
+    const Texture::Dimensions dimensions,
+    const TextureCompression  compression,
+    const std::uint32_t       numMipLevels) noexcept
+{
+    std::size_t numBlocks = 0;
+    for (std::uint32_t level = 0; level < numMipLevels; ++level)
+    {
+        const Texture::Dimensions blocks =
+            blockDimensions(Texture::mipLevelDimensions(dimensions, level));
+        numBlocks += static_cast<std::size_t>(blocks.width) * blocks.height;
+    }
+    return numBlocks * compressedBlockNumBytes(compression);
+}
+
+CompressedTexture CompressedTexture::fromBorrowedBlocks(
+    const std::span<const std::uint8_t> blocks,
+    const Texture::Dimensions           dimensions,
+    const TextureCompression            compression,
+    const std::uint32_t                 numMipLevels)
+{
+    assert(blocks.size() == mipChainNumBytes(dimensions, compression, numMipLevels));
+
+    CompressedTexture texture;
+    texture.mBlocks = blocks;
+    texture.mDimensions = dimensions;
+    texture.mCompression = compression;
+    texture.mNumMipLevels = numMipLevels;
+    return texture;
+}
+
+CompressedTexture compressTexture(
+    const Texture&                  texture,
+    const TextureCompression        compression,
+    const TextureCompressionQuality quality,
+    ThreadPool&                     threadPool)
+{
+    assert(compression != TextureCompression::None);
+
+    Texture        bgraTexture;
+    const Texture* source = &texture;
+    if (texture.channelOrder() != Texture::ChannelOrder::Bgra)
+    {
+        bgraTexture = texture.withChannelOrder(Texture::ChannelOrder::Bgra);
+        source = &bgraTexture;
+    }
+
+    const Texture::Dimensions dimensions = source->dimensions();
+    const std::uint32_t       numMipLevels = source->numMipLevels();
+    const std::size_t         blockNumBytes = compressedBlockNumBytes(compression);
+    std::vector<std::uint8_t> blocks(
+        CompressedTexture::mipChainNumBytes(dimensions, compression, numMipLevels));
+
+    std::size_t levelOffset = 0;
+    for (std::uint32_t level = 0; level < numMipLevels; ++level)
+    {
+        const Texture::Dimensions levelDims = source->mipLevelDimensions(level);
+        const Texture::Dimensions blockDims = CompressedTexture::blockDimensions(levelDims);
+
+        const std::uint32_t numTasks =
+            std::min(blockDims.height, 4 * (threadPool.numThreads() + 1));
+        const std::uint32_t rowsPerTask = (blockDims.height + numTasks - 1) / numTasks;
+        for (std::uint32_t rowBegin = 0; rowBegin < blockDims.height; rowBegin += rowsPerTask)
+        {
+            const std::uint32_t rowEnd = std::min(rowBegin + rowsPerTask, blockDims.height);
+            threadPool.push([&, level, levelDims, blockDims, levelOffset, rowBegin, rowEnd]() {
+                const std::span<const Texture::Pixel> pixels = source->mipLevel(level);
+                for (std::uint32_t blockY = rowBegin; blockY < rowEnd; ++blockY)
+                {
+                    for (std::uint32_t blockX = 0; blockX < blockDims.width; ++blockX)
+                    {
+                        TextureBlock texels;
+                        for (std::uint32_t y = 0; y < TEXTURE_BLOCK_SIZE; ++y)
+                        {
+                            const std::uint32_t texelY =
+                                std::min(blockY * TEXTURE_BLOCK_SIZE + y, levelDims.height - 1);
+                            for (std::uint32_t x = 0; x < TEXTURE_BLOCK_SIZE; ++x)
+                            {
+                                const std::uint32_t texelX =
+                                    std::min(blockX * TEXTURE_BLOCK_SIZE + x, levelDims.width - 1);
+                                texels[y * TEXTURE_BLOCK_SIZE + x] =
+                                    pixels[static_cast<std::size_t>(texelY) * levelDims.width +
+                                           texelX];
+                            }
+                        }
+
+                        const std::size_t blockOffset =
+                            levelOffset +
+                            (static_cast<std::size_t>(blockY) * blockDims.width + blockX) *
+                                blockNumBytes;
+                        const std::span<std::uint8_t> block =
+                            std::span(blocks).subspan(blockOffset, blockNumBytes);
+                        if (compression == TextureCompression::Bc1)
+                        {
+                            encodeBc1Block(texels, quality, block.first<8>());
+                        }
+                        else
+                        {
+                            encodeBc7Block(texels, quality, block.first<16>());
+                        }
+                    }
+                }
+            });
+        }
+        levelOffset +=
+            static_cast<std::size_t>(blockDims.width) * blockDims.height * blockNumBytes;
+    }
+    threadPool.wait();
+
+    return CompressedTexture(std::move(blocks), dimensions, compression, numMipLevels);
+}
+
+void encodeBc1Block(
+    const TextureBlock&              texels,
+    const TextureCompressionQuality  quality,
+    const std::span<std::uint8_t, 8> block) noexcept
+{
+    Bc1Fit fit = fitBc1(texels, boundingBoxEndpoints(texels, 3, 1.0f / 16.0f));
+    if (quality == TextureCompressionQuality::High)
+    {
+        fit = refineBc1(texels, fit);
+        const Bc1Fit principalAxisFit =
+            refineBc1(texels, fitBc1(texels, principalAxisEndpoints(texels, 3)));
+        if (principalAxisFit.error < fit.error)
+        {
+            fit = principalAxisFit;
+        }
+    }
+
+    block[0] = static_cast<std::uint8_t>(fit.c0 & 0xffu);
+    block[1] = static_cast<std::uint8_t>(fit.c0 >> 8);
+    block[2] = static_cast<std::uint8_t>(fit.c1 & 0xffu);
+    block[3] = static_cast<std::uint8_t>(fit.c1 >> 8);
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        block[4 + i] = static_cast<std::uint8_t>((fit.indices >> (8 * i)) & 0xffu);
+    }
+}
+
+TextureBlock decodeBc1Block(const std::span<const std::uint8_t, 8> block) noexcept
+{
+    const auto c0 = static_cast<std::uint16_t>(block[0] | (block[1] << 8));
+    const auto c1 = static_cast<std::uint16_t>(block[2] | (block[3] << 8));
+    const std::uint32_t indices = static_cast<std::uint32_t>(block[4]) |
+                                  (static_cast<std::uint32_t>(block[5]) << 8) |
+                                  (static_cast<std::uint32_t>(block[6]) << 16) |
+                                  (static_cast<std::uint32_t>(block[7]) << 24);
+
+    const std::array<Texture::BgraPixel, 4> palette = bc1Palette(c0, c1);
+    TextureBlock                            texels;
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        texels[i] = palette[(indices >> (2 * i)) & 0x3u];
+    }
+    return texels;
+}
+
+void encodeBc7Block(
+    const TextureBlock&               texels,
+    const TextureCompressionQuality   quality,
+    const std::span<std::uint8_t, 16> block) noexcept
+{
+    Bc7Fit fit = fitBc7(texels, boundingBoxEndpoints(texels, 4, 1.0f / 32.0f), quality);
+    if (quality == TextureCompressionQuality::High)
+    {
+        fit = refineBc7(texels, fit);
+        const Bc7Fit principalAxisFit =
+            refineBc7(texels, fitBc7(texels, principalAxisEndpoints(texels, 4), quality));
+        if (principalAxisFit.error < fit.error)
+        {
+            fit = principalAxisFit;
+        }
+    }
+
+    std::ranges::fill(block, std::uint8_t{0});
+    std::uint32_t offset = 0;
+    writeBits(block, offset, 1u << 6, 7);
+    for (std::size_t ch = 0; ch < 4; ++ch)
+    {
+        writeBits(block, offset, fit.e0[ch] >> 1, 7);
+        writeBits(block, offset, fit.e1[ch] >> 1, 7);
+    }
+    writeBits(block, offset, fit.e0[0] & 1u, 1);
+    writeBits(block, offset, fit.e1[0] & 1u, 1);
+    for (std::size_t i = 0; i < fit.indices.size(); ++i)
+    {
+        writeBits(block, offset, fit.indices[i], i == 0 ? 3 : 4);
+    }
+    assert(offset == 128);
+}
+
+TextureBlock decodeBc7Block(const std::span<const std::uint8_t, 16> block) noexcept
+{
+    // The mode is the number of zero bits before the first set bit.
+    if ((block[0] & 0x7fu) != 0x40u)
+    {
+        TextureBlock texels;
+        texels.fill(0);
+        return texels;
+    }
+
+    std::uint32_t offset = 7;
+    Bc7Endpoint   e0;
+    Bc7Endpoint   e1;
+    for (std::size_t ch = 0; ch < 4; ++ch)
+    {
+        e0[ch] = readBits(block, offset, 7) << 1;
+        e1[ch] = readBits(block, offset, 7) << 1;
+    }
+    const std::uint32_t p0 = readBits(block, offset, 1);
+    const std::uint32_t p1 = readBits(block, offset, 1);
+    for (std::size_t ch = 0; ch < 4; ++ch)
+    {
+        e0[ch] |= p0;
+        e1[ch] |= p1;
+    }
+
+    const std::array<Texture::BgraPixel, 16> palette = bc7Palette(e0, e1);
+    TextureBlock                             texels;
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        texels[i] = palette[readBits(block, offset, i == 0 ? 3 : 4)];
+    }
+    return texels;
+}
+} // namespace nlrs
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "texture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nlrs
+{
+class ThreadPool;
+
+// Block compression formats, which store 4x4 texel blocks. Ensure matches the formats stored in
+// .pt files.
+enum class TextureCompression : std::uint32_t
+{
+    None = 0,
+    // 8 bytes per block: two RGB565 endpoints and a 2-bit index per texel. The texels are opaque.
+    Bc1 = 1,
+    // 16 bytes per block. Encoded in mode 6: two RGBA endpoints with 7 bits per channel and a
+    // shared least significant bit per endpoint, and a 4-bit index per texel.
+    Bc7 = 2,
+};
+
+enum class TextureCompressionQuality : std::uint32_t
+{
+    // Fits the endpoints to the bounding box of the block's colors.
+    Fast,
+    // Also fits the endpoints to the principal axis of the block's colors, refines both fits by
+    // least squares, and keeps the fit with the smallest error.
+    High,
+};
+
+inline constexpr std::uint32_t TEXTURE_BLOCK_SIZE = 4;
+
+// The BGRA texels of a block in row-major order.
+using TextureBlock = std::array<Texture::BgraPixel, TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE>;
+
+// The number of bytes of a block in `compression`, which must not be None.
+std::size_t compressedBlockNumBytes(TextureCompression compression) noexcept;
+
+class CompressedTexture
+{
+public:
+    CompressedTexture()
+        : mStorage(),
+          mBlocks(),
+          mDimensions{0, 0},
+          mCompression(TextureCompression::Bc1),
+          mNumMipLevels(1)
+    {
+    }
+    // `blocks` contains `numMipLevels` mip levels, level 0 first, each with its blocks in row-major
+    // order.
+    CompressedTexture(
+        std::vector<std::uint8_t>&& blocks,
+        Texture::Dimensions         dimensions,
+        TextureCompression          compression,
+        std::uint32_t               numMipLevels)
+        : mStorage(std::move(blocks)),
+          mBlocks(mStorage),
+          mDimensions(dimensions),
+          mCompression(compression),
+          mNumMipLevels(numMipLevels)
+    {
+    }
+
+    CompressedTexture(const CompressedTexture&) = delete;
+    CompressedTexture& operator=(const CompressedTexture&) = delete;
+
+    // Moving the storage keeps its buffer, so `mBlocks` remains valid.
+    CompressedTexture(CompressedTexture&&) = default;
+    CompressedTexture& operator=(CompressedTexture&&) = default;
+
+    bool operator==(const CompressedTexture& other) const noexcept
+    {
+        return mDimensions == other.mDimensions && mCompression == other.mCompression &&
+               mNumMipLevels == other.mNumMipLevels && std::ranges::equal(mBlocks, other.mBlocks);
+    }
+
+    Texture::Dimensions dimensions() const noexcept { return mDimensions; }
+    TextureCompression  compression() const noexcept { return mCompression; }
+    std::uint32_t       numMipLevels() const noexcept { return mNumMipLevels; }
+
+    // The blocks of every mip level, level 0 first, as laid out in storage.
+    std::span<const std::uint8_t> mipChain() const noexcept { return mBlocks; }
+    std::span<const std::uint8_t> mipLevel(std::uint32_t level) const noexcept;
+    Texture::Dimensions           mipLevelDimensions(std::uint32_t level) const noexcept
+    {
+        return Texture::mipLevelDimensions(mDimensions, level);
+    }
+
+    // Decodes every mip level into a texture with BGRA pixels.
+    Texture decompress() const;
+
+    // The number of blocks in each row and column of an image of `dimensions`.
+    static Texture::Dimensions blockDimensions(Texture::Dimensions dimensions) noexcept;
+
+    // The total number of bytes of the blocks of the first `numMipLevels` mip levels.
+    static std::size_t mipChainNumBytes(
+        Texture::Dimensions dimensions,
+        TextureCompression  compression,
+        std::uint32_t       numMipLevels) noexcept;
+
+    // Creates a texture which refers to `blocks` without copying them, e.g. in a memory mapped
+    // file. The blocks must outlive the texture, and contain `numMipLevels` mip levels.
+    static CompressedTexture fromBorrowedBlocks(
+        std::span<const std::uint8_t> blocks,
+        Texture::Dimensions           dimensions,
+        TextureCompression            compression,
+        std::uint32_t                 numMipLevels);
+
+private:
+    std::vector<std::uint8_t>     mStorage;
+    std::span<const std::uint8_t> mBlocks;
+    Texture::Dimensions           mDimensions;
+    TextureCompression            mCompression;
+    std::uint32_t                 mNumMipLevels;
+};
+
+// Compresses every mip level of `texture` in `compression`, which must not be None. The rows of
+// blocks are encoded on `threadPool`. Blocks which extend past the edges of a level repeat the edge
+// texels.
+CompressedTexture compressTexture(
+    const Texture&            texture,
+    TextureCompression        compression,
+    TextureCompressionQuality quality,
+    ThreadPool&               threadPool);
+
+void encodeBc1Block(
+    const TextureBlock&        texels,
+    TextureCompressionQuality  quality,
+    std::span<std::uint8_t, 8> block) noexcept;
+TextureBlock decodeBc1Block(std::span<const std::uint8_t, 8> block) noexcept;
+
+void encodeBc7Block(
+    const TextureBlock&         texels,
+    TextureCompressionQuality   quality,
+    std::span<std::uint8_t, 16> block) noexcept;
+// Decodes a block in mode 6, the only mode which encodeBc7Block produces. Blocks in other modes
+// decode to transparent black.
+TextureBlock decodeBc7Block(std::span<const std::uint8_t, 16> block) noexcept;
+} // namespace nlrs
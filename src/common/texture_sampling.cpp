@@ -0,0 +1,370 @@
+#include "assert.hpp"
+#include "texture_sampling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace nlrs
+{
+namespace
+{
+// The mip levels which a lookup samples, and the weight of the second level.
+struct LevelSelection
+{
+    std::uint32_t level0;
+    std::uint32_t level1;
+    float         weight;
+};
+
+LevelSelection selectLevels(
+    const std::uint32_t numMipLevels,
+    const float         lod,
+    const TextureFilter filter) noexcept
+{
+    const float maxLevel = static_cast<float>(numMipLevels - 1);
+    if (filter == TextureFilter::Trilinear)
+    {
+        const float         clampedLod = std::clamp(lod, 0.0f, maxLevel);
+        const float         floorLod = std::floor(clampedLod);
+        const std::uint32_t level0 = static_cast<std::uint32_t>(floorLod);
+        return LevelSelection{
+            .level0 = level0,
+            .level1 = std::min(level0 + 1, numMipLevels - 1),
+            .weight = clampedLod - floorLod};
+    }
+    const std::uint32_t level =
+        static_cast<std::uint32_t>(std::clamp(std::floor(lod + 0.5f), 0.0f, maxLevel));
+    return LevelSelection{.level0 = level, .level1 = level, .weight = 0.0f};
+}
+
+// The filter with which each selected mip level is sampled.
+TextureFilter levelFilter(const TextureFilter filter) noexcept
+{
+    return filter == TextureFilter::Nearest ? TextureFilter::Nearest : TextureFilter::Bilinear;
+}
+
+// Maps a texture coordinate to [0, 1].
+float wrapCoordinate(const float u, const TextureWrap wrap) noexcept
+{
+    switch (wrap)
+    {
+    case TextureWrap::Repeat:
+        return u - std::floor(u);
+    case TextureWrap::ClampToEdge:
+        return std::clamp(u, 0.0f, 1.0f);
+    case TextureWrap::MirroredRepeat:
+    {
+        const float t = u - 2.0f * std::floor(0.5f * u);
+        return t <= 1.0f ? t : 2.0f - t;
+    }
+    }
+    NLRS_ASSERT(false);
+    return u;
+}
+
+// Wraps a texel index in [-1, size], which the taps of a bilinear sample of a wrapped coordinate
+// are in. Mirroring repeats the edge texel, like clamping does.
+std::int32_t wrapTexelIndex(const std::int32_t i, const std::int32_t size, const TextureWrap wrap)
+    noexcept
+{
+    if (wrap == TextureWrap::Repeat)
+    {
+        return i < 0 ? size - 1 : (i >= size ? 0 : i);
+    }
+    return std::clamp(i, 0, size - 1);
+}
+
+glm::vec3 lerp(const glm::vec3& a, const glm::vec3& b, const float t) noexcept
+{
+    return a + (b - a) * t;
+}
+
+// Samples a mip level with TextureFilter::Nearest or TextureFilter::Bilinear at a wrapped uv.
+glm::vec3 sampleLevel(
+    const Texture&      texture,
+    const std::uint32_t level,
+    const glm::vec2     uv,
+    const TextureFilter filter,
+    const TextureWrap   wrap) noexcept
+{
+    const Texture::Dimensions             dims = texture.mipLevelDimensions(level);
+    const std::span<const Texture::Pixel> texels = texture.mipLevel(level);
+
+    if (filter == TextureFilter::Nearest)
+    {
+        const std::uint32_t j = std::min(
+            static_cast<std::uint32_t>(uv.x * static_cast<float>(dims.width)), dims.width - 1);
+        const std::uint32_t i = std::min(
+            static_cast<std::uint32_t>(uv.y * static_cast<float>(dims.height)), dims.height - 1);
+        return decodeTexel(texels[static_cast<std::size_t>(i) * dims.width + j]);
+    }
+
+    // Texel centers are at half-integer coordinates.
+    const std::int32_t width = static_cast<std::int32_t>(dims.width);
+    const std::int32_t height = static_cast<std::int32_t>(dims.height);
+    const float        x = uv.x * static_cast<float>(width) - 0.5f;
+    const float        y = uv.y * static_cast<float>(height) - 0.5f;
+    const float        x0 = std::floor(x);
+    const float        y0 = std::floor(y);
+    const float        fx = x - x0;
+    const float        fy = y - y0;
+
+    const std::int32_t j0 = wrapTexelIndex(static_cast<std::int32_t>(x0), width, wrap);
+    const std::int32_t j1 = wrapTexelIndex(static_cast<std::int32_t>(x0) + 1, width, wrap);
+    const std::int32_t i0 = wrapTexelIndex(static_cast<std::int32_t>(y0), height, wrap);
+    const std::int32_t i1 = wrapTexelIndex(static_cast<std::int32_t>(y0) + 1, height, wrap);
+
+    const auto texel = [&](const std::int32_t i, const std::int32_t j) -> glm::vec3 {
+        return decodeTexel(texels[static_cast<std::size_t>(i * width + j)]);
+    };
+    const glm::vec3 top = lerp(texel(i0, j0), texel(i0, j1), fx);
+    const glm::vec3 bottom = lerp(texel(i1, j0), texel(i1, j1), fx);
+    return lerp(top, bottom, fy);
+}
+
+#if defined(__AVX2__)
+// The mip level which each lane of a batch samples.
+struct LevelBatch
+{
+    std::array<const Texture::Pixel*, TEXTURE_SAMPLE_BATCH_SIZE> texels;
+    std::array<std::int32_t, TEXTURE_SAMPLE_BATCH_SIZE>          widths;
+    std::array<std::int32_t, TEXTURE_SAMPLE_BATCH_SIZE>          heights;
+};
+
+struct LinearColors
+{
+    __m256 r;
+    __m256 g;
+    __m256 b;
+};
+
+__m256 lerp(const __m256 a, const __m256 b, const __m256 t) noexcept
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+LinearColors lerp(const LinearColors& a, const LinearColors& b, const __m256 t) noexcept
+{
+    return LinearColors{.r = lerp(a.r, b.r, t), .g = lerp(a.g, b.g, t), .b = lerp(a.b, b.b, t)};
+}
+
+// Like wrapCoordinate.
+__m256 wrapCoordinates(const __m256 u, const TextureWrap wrap) noexcept
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    switch (wrap)
+    {
+    case TextureWrap::Repeat:
+        return _mm256_sub_ps(u, _mm256_floor_ps(u));
+    case TextureWrap::ClampToEdge:
+        return _mm256_min_ps(_mm256_max_ps(u, _mm256_setzero_ps()), one);
+    case TextureWrap::MirroredRepeat:
+    {
+        const __m256 two = _mm256_set1_ps(2.0f);
+        const __m256 t = _mm256_sub_ps(
+            u, _mm256_mul_ps(two, _mm256_floor_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), u))));
+        return _mm256_blendv_ps(_mm256_sub_ps(two, t), t, _mm256_cmp_ps(t, one, _CMP_LE_OQ));
+    }
+    }
+    NLRS_ASSERT(false);
+    return u;
+}
+
+// Like wrapTexelIndex.
+__m256i wrapTexelIndices(const __m256i i, const __m256i size, const TextureWrap wrap) noexcept
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i last = _mm256_sub_epi32(size, _mm256_set1_epi32(1));
+    if (wrap == TextureWrap::Repeat)
+    {
+        const __m256i below = _mm256_cmpgt_epi32(zero, i);
+        const __m256i above = _mm256_cmpgt_epi32(i, last);
+        return _mm256_andnot_si256(above, _mm256_blendv_epi8(i, last, below));
+    }
+    return _mm256_min_epi32(_mm256_max_epi32(i, zero), last);
+}
+
+// The levels of a batch may belong to different textures, so the texels are fetched one lane at a
+// time.
+__m256i fetchTexels(const LevelBatch& level, const __m256i offsets) noexcept
+{
+    alignas(32) std::array<std::int32_t, TEXTURE_SAMPLE_BATCH_SIZE> laneOffsets;
+    alignas(32) std::array<Texture::Pixel, TEXTURE_SAMPLE_BATCH_SIZE> texels;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneOffsets.data()), offsets);
+    for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+    {
+        texels[lane] = level.texels[lane][laneOffsets[lane]];
+    }
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(texels.data()));
+}
+
+LinearColors decodeTexels(const __m256i texels) noexcept
+{
+    const float*  table = srgbToLinearTable().data();
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    return LinearColors{
+        .r = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(texels, 16), mask), 4),
+        .g = _mm256_i32gather_ps(table, _mm256_and_si256(_mm256_srli_epi32(texels, 8), mask), 4),
+        .b = _mm256_i32gather_ps(table, _mm256_and_si256(texels, mask), 4)};
+}
+
+// Like sampleLevel.
+LinearColors sampleLevelBatch(
+    const LevelBatch&   level,
+    const __m256        u,
+    const __m256        v,
+    const TextureFilter filter,
+    const TextureWrap   wrap) noexcept
+{
+    const __m256i widths =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(level.widths.data()));
+    const __m256i heights =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(level.heights.data()));
+    const __m256  w = _mm256_cvtepi32_ps(widths);
+    const __m256  h = _mm256_cvtepi32_ps(heights);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    if (filter == TextureFilter::Nearest)
+    {
+        const __m256i j = _mm256_min_epi32(
+            _mm256_cvttps_epi32(_mm256_mul_ps(u, w)), _mm256_sub_epi32(widths, one));
+        const __m256i i = _mm256_min_epi32(
+            _mm256_cvttps_epi32(_mm256_mul_ps(v, h)), _mm256_sub_epi32(heights, one));
+        return decodeTexels(
+            fetchTexels(level, _mm256_add_epi32(_mm256_mullo_epi32(i, widths), j)));
+    }
+
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 x = _mm256_sub_ps(_mm256_mul_ps(u, w), half);
+    const __m256 y = _mm256_sub_ps(_mm256_mul_ps(v, h), half);
+    const __m256 x0 = _mm256_floor_ps(x);
+    const __m256 y0 = _mm256_floor_ps(y);
+    const __m256 fx = _mm256_sub_ps(x, x0);
+    const __m256 fy = _mm256_sub_ps(y, y0);
+
+    const __m256i x0i = _mm256_cvttps_epi32(x0);
+    const __m256i y0i = _mm256_cvttps_epi32(y0);
+    const __m256i j0 = wrapTexelIndices(x0i, widths, wrap);
+    const __m256i j1 = wrapTexelIndices(_mm256_add_epi32(x0i, one), widths, wrap);
+    const __m256i row0 = _mm256_mullo_epi32(wrapTexelIndices(y0i, heights, wrap), widths);
+    const __m256i row1 =
+        _mm256_mullo_epi32(wrapTexelIndices(_mm256_add_epi32(y0i, one), heights, wrap), widths);
+
+    const auto texels = [&](const __m256i row, const __m256i j) -> LinearColors {
+        return decodeTexels(fetchTexels(level, _mm256_add_epi32(row, j)));
+    };
+    const LinearColors top = lerp(texels(row0, j0), texels(row0, j1), fx);
+    const LinearColors bottom = lerp(texels(row1, j0), texels(row1, j1), fx);
+    return lerp(top, bottom, fy);
+}
+#endif
+} // namespace
+
+const std::array<float, 256>& srgbToLinearTable() noexcept
+{
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> values;
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = std::pow(static_cast<float>(i) / 255.0f, SRGB_GAMMA);
+        }
+        return values;
+    }();
+    return table;
+}
+
+glm::vec3 decodeTexel(const Texture::BgraPixel texel) noexcept
+{
+    const std::array<float, 256>& table = srgbToLinearTable();
+    return glm::vec3(
+        table[(texel >> 16) & 0xffu], table[(texel >> 8) & 0xffu], table[texel & 0xffu]);
+}
+
+glm::vec3 sampleTexture(
+    const Texture&       texture,
+    const glm::vec2      uv,
+    const float          lod,
+    const TextureSampler sampler) noexcept
+{
+    NLRS_ASSERT(texture.channelOrder() == Texture::ChannelOrder::Bgra);
+    const glm::vec2      wrappedUv{
+        wrapCoordinate(uv.x, sampler.wrap), wrapCoordinate(uv.y, sampler.wrap)};
+    const LevelSelection levels = selectLevels(texture.numMipLevels(), lod, sampler.filter);
+    const TextureFilter  filter = levelFilter(sampler.filter);
+
+    const glm::vec3 color = sampleLevel(texture, levels.level0, wrappedUv, filter, sampler.wrap);
+    if (sampler.filter != TextureFilter::Trilinear)
+    {
+        return color;
+    }
+    return lerp(
+        color,
+        sampleLevel(texture, levels.level1, wrappedUv, filter, sampler.wrap),
+        levels.weight);
+}
+
+LinearColorBatch sampleTextureBatch(
+    const std::span<const Texture> textures,
+    const TextureSampleBatch&      batch,
+    const TextureSampler           sampler) noexcept
+{
+    LinearColorBatch result;
+#if defined(__AVX2__)
+    // Selecting the mip levels branches on the number of levels of each texture, and is done one
+    // lane at a time.
+    std::array<LevelBatch, 2>                    levels;
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE> levelWeights;
+    for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+    {
+        NLRS_ASSERT(batch.textureIndices[lane] < textures.size());
+        const Texture& texture = textures[batch.textureIndices[lane]];
+        NLRS_ASSERT(texture.channelOrder() == Texture::ChannelOrder::Bgra);
+        const LevelSelection selection =
+            selectLevels(texture.numMipLevels(), batch.lod[lane], sampler.filter);
+        const std::array<std::uint32_t, 2> selectedLevels{selection.level0, selection.level1};
+        for (std::size_t k = 0; k < levels.size(); ++k)
+        {
+            const Texture::Dimensions dims = texture.mipLevelDimensions(selectedLevels[k]);
+            levels[k].texels[lane] = texture.mipLevel(selectedLevels[k]).data();
+            levels[k].widths[lane] = static_cast<std::int32_t>(dims.width);
+            levels[k].heights[lane] = static_cast<std::int32_t>(dims.height);
+        }
+        levelWeights[lane] = selection.weight;
+    }
+
+    const __m256        u = wrapCoordinates(_mm256_loadu_ps(batch.u.data()), sampler.wrap);
+    const __m256        v = wrapCoordinates(_mm256_loadu_ps(batch.v.data()), sampler.wrap);
+    const TextureFilter filter = levelFilter(sampler.filter);
+
+    LinearColors colors = sampleLevelBatch(levels[0], u, v, filter, sampler.wrap);
+    if (sampler.filter == TextureFilter::Trilinear)
+    {
+        colors = lerp(
+            colors,
+            sampleLevelBatch(levels[1], u, v, filter, sampler.wrap),
+            _mm256_loadu_ps(levelWeights.data()));
+    }
+    _mm256_storeu_ps(result.r.data(), colors.r);
+    _mm256_storeu_ps(result.g.data(), colors.g);
+    _mm256_storeu_ps(result.b.data(), colors.b);
+#else
+    for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+    {
+        NLRS_ASSERT(batch.textureIndices[lane] < textures.size());
+        const glm::vec3 color = sampleTexture(
+            textures[batch.textureIndices[lane]],
+            glm::vec2{batch.u[lane], batch.v[lane]},
+            batch.lod[lane],
+            sampler);
+        result.r[lane] = color.r;
+        result.g[lane] = color.g;
+        result.b[lane] = color.b;
+    }
+#endif
+    return result;
+}
+} // namespace nlrs
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "texture.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace nlrs
+{
+enum class TextureFilter : std::uint8_t
+{
+    // The nearest texel of the mip level nearest to the lod, like `textureLookup` in the shaders.
+    Nearest,
+    // The four texels around the uv of the mip level nearest to the lod, weighted by distance.
+    Bilinear,
+    // Bilinear samples of the two mip levels around the lod, weighted by the fraction of the lod.
+    Trilinear,
+};
+
+// How uvs outside of [0, 1] map to the texture.
+enum class TextureWrap : std::uint8_t
+{
+    Repeat,
+    ClampToEdge,
+    MirroredRepeat,
+};
+
+struct TextureSampler
+{
+    TextureFilter filter = TextureFilter::Nearest;
+    TextureWrap   wrap = TextureWrap::Repeat;
+};
+
+// The gamma of the curve between sRGB encoded and linear color. The shaders decode textures with
+// the same curve, and Texture::withMipmaps filters the mip levels in the same linear space.
+inline constexpr float SRGB_GAMMA = 2.2f;
+
+// The linear value of each sRGB encoded byte, so that a table lookup replaces a `pow` per channel.
+const std::array<float, 256>& srgbToLinearTable() noexcept;
+
+// The linear RGB color of a BGRA texel. The alpha channel is ignored.
+glm::vec3 decodeTexel(Texture::BgraPixel texel) noexcept;
+
+// Samples a BGRA texture at `uv`. The texels are decoded to linear color before they are filtered.
+glm::vec3 sampleTexture(
+    const Texture& texture,
+    glm::vec2      uv,
+    float          lod,
+    TextureSampler sampler) noexcept;
+
+inline constexpr std::size_t TEXTURE_SAMPLE_BATCH_SIZE = 8;
+
+// A batch of texture lookups in a structure of arrays, e.g. the hits of a packet of rays. Each
+// lookup may sample a different texture.
+struct TextureSampleBatch
+{
+    std::array<std::uint32_t, TEXTURE_SAMPLE_BATCH_SIZE> textureIndices;
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE>         u;
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE>         v;
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE>         lod;
+};
+
+struct LinearColorBatch
+{
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE> r;
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE> g;
+    std::array<float, TEXTURE_SAMPLE_BATCH_SIZE> b;
+};
+
+// Samples each lookup of `batch` like sampleTexture. With AVX2, the wrapped coordinates, texel
+// offsets, filter weights and table lookups of the whole batch are computed eight lanes at a time.
+LinearColorBatch sampleTextureBatch(
+    std::span<const Texture>  textures,
+    const TextureSampleBatch& batch,
+    TextureSampler            sampler) noexcept;
+} // namespace nlrs
@@ -0,0 +1,111 @@
+#include "thread_pool.hpp"
+
+#include <utility>
+
+namespace nlrs
+{
+ThreadPool::ThreadPool(const std::uint32_t numThreads)
+    : mMutex(),
+      mTaskPushed(),
+      mTaskFinished(),
+      mTasks(),
+      mNumRunningTasks(0),
+      mException(nullptr),
+      mThreads()
+{
+    mThreads.reserve(numThreads);
+    for (std::uint32_t i = 0; i < numThreads; ++i)
+    {
+        mThreads.emplace_back([this](std::stop_token stopToken) { runTasks(stopToken); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock lock(mMutex);
+        while (!mTasks.empty() || mNumRunningTasks > 0)
+        {
+            if (!mTasks.empty())
+            {
+                runTask(lock);
+            }
+            else
+            {
+                mTaskFinished.wait(lock);
+            }
+        }
+    }
+    // The jthreads request stop and join when mThreads is destroyed.
+}
+
+void ThreadPool::push(std::function<void()> task)
+{
+    {
+        const std::lock_guard lock(mMutex);
+        mTasks.push_back(std::move(task));
+    }
+    mTaskPushed.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock lock(mMutex);
+    // Running tasks may push more tasks.
+    while (!mTasks.empty() || mNumRunningTasks > 0)
+    {
+        if (!mTasks.empty())
+        {
+            runTask(lock);
+        }
+        else
+        {
+            mTaskFinished.wait(lock);
+        }
+    }
+
+    if (mException)
+    {
+        std::rethrow_exception(std::exchange(mException, nullptr));
+    }
+}
+
+void ThreadPool::runTasks(const std::stop_token stopToken)
+{
+    std::unique_lock lock(mMutex);
+    while (mTaskPushed.wait(lock, stopToken, [this]() { return !mTasks.empty(); }))
+    {
+        runTask(lock);
+    }
+}
+
+void ThreadPool::runTask(std::unique_lock<std::mutex>& lock)
+{
+    std::function<void()> task = std::move(mTasks.front());
+    mTasks.pop_front();
+    ++mNumRunningTasks;
+    lock.unlock();
+
+    std::exception_ptr exception = nullptr;
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        exception = std::current_exception();
+    }
+
+    lock.lock();
+    --mNumRunningTasks;
+    if (exception)
+    {
+        if (!mException)
+        {
+            mException = exception;
+        }
+        mTasks.clear();
+    }
+    mTaskFinished.notify_all();
+}
+} // namespace nlrs
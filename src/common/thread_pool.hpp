@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nlrs
+{
+// Runs tasks on a fixed set of worker threads, in the order in which they are pushed.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(std::uint32_t numThreads);
+    // Waits for the queued tasks to finish, running them on the calling thread like `wait` does, so
+    // that a pool without threads does not block forever. Exceptions thrown by the tasks are
+    // discarded.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    void push(std::function<void()> task);
+
+    // Blocks until every pushed task has finished, running queued tasks on the calling thread in
+    // the meantime. If a task threw, the remaining queued tasks are discarded and the first
+    // exception is rethrown.
+    void wait();
+
+    std::uint32_t numThreads() const noexcept
+    {
+        return static_cast<std::uint32_t>(mThreads.size());
+    }
+
+private:
+    void runTasks(std::stop_token stopToken);
+    void runTask(std::unique_lock<std::mutex>& lock);
+
+    std::mutex                        mMutex;
+    std::condition_variable_any       mTaskPushed;
+    std::condition_variable           mTaskFinished;
+    std::deque<std::function<void()>> mTasks;
+    std::size_t                       mNumRunningTasks;
+    std::exception_ptr                mException;
+    // Declared last, so that the threads are joined before the other members are destroyed.
+    std::vector<std::jthread> mThreads;
+};
+} // namespace nlrs
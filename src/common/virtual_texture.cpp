@@ -0,0 +1,353 @@
+#include "assert.hpp"
+#include "texel_layout.hpp"
+#include "thread_pool.hpp"
+#include "virtual_texture.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace nlrs
+{
+namespace
+{
+constexpr Texture::Dimensions PAGE_DIMENSIONS{VIRTUAL_TEXTURE_PAGE_SIZE, VIRTUAL_TEXTURE_PAGE_SIZE};
+
+// The index of the page of `descriptor` which holds texel (`x`, `y`) of mip level `level`.
+std::uint32_t pageIndex(
+    const VirtualTextureDescriptor& descriptor,
+    const std::uint32_t             level,
+    const std::uint32_t             x,
+    const std::uint32_t             y) noexcept
+{
+    const Texture::Dimensions dimensions{descriptor.width, descriptor.height};
+    const Texture::Dimensions grid =
+        virtualTexturePageGrid(Texture::mipLevelDimensions(dimensions, level));
+    return descriptor.firstPage + virtualTextureNumPages(dimensions, level) +
+           (y / VIRTUAL_TEXTURE_PAGE_SIZE) * grid.width + x / VIRTUAL_TEXTURE_PAGE_SIZE;
+}
+
+// The index of texel (`x`, `y`) of a mip level in its page.
+std::size_t pageTexelIndex(const std::uint32_t x, const std::uint32_t y) noexcept
+{
+    return texelIndex(
+        TexelLayout::Tiled,
+        PAGE_DIMENSIONS,
+        x % VIRTUAL_TEXTURE_PAGE_SIZE,
+        y % VIRTUAL_TEXTURE_PAGE_SIZE);
+}
+} // namespace
+
+Texture::Dimensions virtualTexturePageGrid(const Texture::Dimensions levelDimensions) noexcept
+{
+    return Texture::Dimensions{
+        (levelDimensions.width + VIRTUAL_TEXTURE_PAGE_SIZE - 1) / VIRTUAL_TEXTURE_PAGE_SIZE,
+        (levelDimensions.height + VIRTUAL_TEXTURE_PAGE_SIZE - 1) / VIRTUAL_TEXTURE_PAGE_SIZE};
+}
+
+std::uint32_t virtualTextureNumPages(
+    const Texture::Dimensions dimensions,
+    const std::uint32_t       numMipLevels) noexcept
+{
+    std::uint32_t numPages = 0;
+    for (std::uint32_t level = 0; level < numMipLevels; ++level)
+    {
+        const Texture::Dimensions grid =
+            virtualTexturePageGrid(Texture::mipLevelDimensions(dimensions, level));
+        numPages += grid.width * grid.height;
+    }
+    return numPages;
+}
+
+PagedTextures pageTextures(const std::span<const Texture> textures, ThreadPool& threadPool)
+{
+    PagedTextures paged;
+    std::uint32_t numPages = 0;
+    for (const Texture& texture : textures)
+    {
+        paged.descriptors.push_back(VirtualTextureDescriptor{
+            .width = texture.dimensions().width,
+            .height = texture.dimensions().height,
+            .numMipLevels = texture.numMipLevels(),
+            .firstPage = numPages});
+        numPages += virtualTextureNumPages(texture.dimensions(), texture.numMipLevels());
+    }
+    paged.pages.resize(static_cast<std::size_t>(numPages) * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS);
+
+    for (std::size_t textureIdx = 0; textureIdx < textures.size(); ++textureIdx)
+    {
+        Texture        bgraTexture;
+        const Texture* source = &textures[textureIdx];
+        if (source->channelOrder() != Texture::ChannelOrder::Bgra)
+        {
+            bgraTexture = source->withChannelOrder(Texture::ChannelOrder::Bgra);
+            source = &bgraTexture;
+        }
+
+        const VirtualTextureDescriptor& descriptor = paged.descriptors[textureIdx];
+        for (std::uint32_t level = 0; level < descriptor.numMipLevels; ++level)
+        {
+            const Texture::Dimensions levelDims = source->mipLevelDimensions(level);
+            const Texture::Dimensions grid = virtualTexturePageGrid(levelDims);
+
+            const std::uint32_t numTasks = std::min(grid.height, 4 * (threadPool.numThreads() + 1));
+            const std::uint32_t rowsPerTask = (grid.height + numTasks - 1) / numTasks;
+            for (std::uint32_t rowBegin = 0; rowBegin < grid.height; rowBegin += rowsPerTask)
+            {
+                const std::uint32_t rowEnd = std::min(rowBegin + rowsPerTask, grid.height);
+                threadPool.push([&, level, levelDims, grid, rowBegin, rowEnd]() {
+                    const std::span<const Texture::Pixel> pixels = source->mipLevel(level);
+                    const std::uint32_t paddedWidth = grid.width * VIRTUAL_TEXTURE_PAGE_SIZE;
+                    // Rows and columns past the edges of the level repeat the edge texels.
+                    for (std::uint32_t y = rowBegin * VIRTUAL_TEXTURE_PAGE_SIZE;
+                         y < rowEnd * VIRTUAL_TEXTURE_PAGE_SIZE;
+                         ++y)
+                    {
+                        const std::uint32_t sourceY = std::min(y, levelDims.height - 1);
+                        for (std::uint32_t x = 0; x < paddedWidth; ++x)
+                        {
+                            const std::uint32_t sourceX = std::min(x, levelDims.width - 1);
+                            const std::size_t   page = pageIndex(descriptor, level, x, y);
+                            paged.pages[page * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS +
+                                        pageTexelIndex(x, y)] =
+                                pixels[static_cast<std::size_t>(sourceY) * levelDims.width +
+                                       sourceX];
+                        }
+                    }
+                });
+            }
+        }
+        // The tasks refer to the converted texture.
+        threadPool.wait();
+    }
+    return paged;
+}
+
+std::vector<Texture> unpageTextures(const VirtualTexturePages pages)
+{
+    std::vector<Texture> textures;
+    textures.reserve(pages.descriptors.size());
+    for (const VirtualTextureDescriptor& descriptor : pages.descriptors)
+    {
+        const Texture::Dimensions  dimensions{descriptor.width, descriptor.height};
+        std::vector<Texture::Pixel> pixels;
+        pixels.reserve(Texture::mipChainSize(dimensions, descriptor.numMipLevels));
+        for (std::uint32_t level = 0; level < descriptor.numMipLevels; ++level)
+        {
+            const Texture::Dimensions levelDims = Texture::mipLevelDimensions(dimensions, level);
+            for (std::uint32_t y = 0; y < levelDims.height; ++y)
+            {
+                for (std::uint32_t x = 0; x < levelDims.width; ++x)
+                {
+                    const std::size_t page = pageIndex(descriptor, level, x, y);
+                    pixels.push_back(
+                        pages.pages[page * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS + pageTexelIndex(x, y)]);
+                }
+            }
+        }
+        textures.emplace_back(
+            std::move(pixels), dimensions, Texture::ChannelOrder::Bgra, descriptor.numMipLevels);
+    }
+    return textures;
+}
+
+VirtualTextureCache::VirtualTextureCache(
+    const VirtualTexturePages pages,
+    const std::uint32_t       numPhysicalPages)
+    : mPages(pages),
+      mPageTable(pages.pages.size() / VIRTUAL_TEXTURE_PAGE_NUM_TEXELS, NOT_RESIDENT),
+      mPhysicalPageOwners(numPhysicalPages, NOT_RESIDENT),
+      mPhysicalPageLastUse(numPhysicalPages, 0),
+      mPhysicalPages(static_cast<std::size_t>(numPhysicalPages) * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS),
+      mFeedback(pages.pages.size() / VIRTUAL_TEXTURE_PAGE_NUM_TEXELS),
+      mNumUpdates(0)
+{
+    // The least detailed level of each texture is always resident, so that every sample finds a
+    // resident page.
+    std::uint32_t numPinnedPages = 0;
+    for (const VirtualTextureDescriptor& descriptor : mPages.descriptors)
+    {
+        NLRS_ASSERT(descriptor.numMipLevels > 0);
+        const Texture::Dimensions dimensions{descriptor.width, descriptor.height};
+        const std::uint32_t       lastLevel = descriptor.numMipLevels - 1;
+        const std::uint32_t       levelBegin =
+            descriptor.firstPage + virtualTextureNumPages(dimensions, lastLevel);
+        const std::uint32_t levelEnd =
+            descriptor.firstPage + virtualTextureNumPages(dimensions, descriptor.numMipLevels);
+        NLRS_ASSERT(levelEnd <= mPageTable.size());
+        for (std::uint32_t page = levelBegin; page < levelEnd; ++page)
+        {
+            if (numPinnedPages == numPhysicalPages)
+            {
+                throw std::runtime_error(fmt::format(
+                    "The least detailed mip levels of {} textures do not fit in {} physical "
+                    "pages.",
+                    mPages.descriptors.size(),
+                    numPhysicalPages));
+            }
+            const std::uint32_t physicalPage = numPinnedPages++;
+            mPageTable[page] = physicalPage;
+            mPhysicalPageOwners[physicalPage] = page;
+            mPhysicalPageLastUse[physicalPage] = std::numeric_limits<std::uint64_t>::max();
+            std::memcpy(
+                mPhysicalPages.data() + physicalPage * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS,
+                mPages.pages.data() + page * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS,
+                VIRTUAL_TEXTURE_PAGE_NUM_TEXELS * sizeof(Texture::BgraPixel));
+        }
+    }
+}
+
+Texture::BgraPixel VirtualTextureCache::sample(
+    const std::uint32_t textureIdx,
+    const glm::vec2     uv,
+    const float         lod) const noexcept
+{
+    NLRS_ASSERT(textureIdx < mPages.descriptors.size());
+    const VirtualTextureDescriptor& descriptor = mPages.descriptors[textureIdx];
+    const Texture::Dimensions       dimensions{descriptor.width, descriptor.height};
+
+    const float u = uv.x - std::floor(uv.x);
+    const float v = uv.y - std::floor(uv.y);
+
+    std::uint32_t level = static_cast<std::uint32_t>(std::clamp(
+        std::floor(lod + 0.5f), 0.0f, static_cast<float>(descriptor.numMipLevels - 1)));
+    while (true)
+    {
+        const Texture::Dimensions levelDims = Texture::mipLevelDimensions(dimensions, level);
+        const std::uint32_t       x =
+            std::min(static_cast<std::uint32_t>(u * levelDims.width), levelDims.width - 1);
+        const std::uint32_t y =
+            std::min(static_cast<std::uint32_t>(v * levelDims.height), levelDims.height - 1);
+
+        const std::uint32_t page = pageIndex(descriptor, level, x, y);
+        const std::uint32_t physicalPage = mPageTable[page];
+        if (physicalPage != NOT_RESIDENT)
+        {
+            recordFeedback(page, PageFeedback::Touched);
+            return mPhysicalPages
+                [physicalPage * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS + pageTexelIndex(x, y)];
+        }
+        recordFeedback(page, PageFeedback::Requested);
+        // The least detailed level is always resident.
+        NLRS_ASSERT(level + 1 < descriptor.numMipLevels);
+        ++level;
+    }
+}
+
+VirtualTextureUpdate VirtualTextureCache::update(ThreadPool& threadPool)
+{
+    ++mNumUpdates;
+    VirtualTextureUpdate result{
+        .numTouchedPages = 0, .numRequestedPages = 0, .numLoadedPages = 0, .numEvictedPages = 0};
+
+    // The requested pages and their mip levels.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> requests;
+    for (const VirtualTextureDescriptor& descriptor : mPages.descriptors)
+    {
+        const Texture::Dimensions dimensions{descriptor.width, descriptor.height};
+        std::uint32_t             page = descriptor.firstPage;
+        for (std::uint32_t level = 0; level < descriptor.numMipLevels; ++level)
+        {
+            const Texture::Dimensions grid =
+                virtualTexturePageGrid(Texture::mipLevelDimensions(dimensions, level));
+            const std::uint32_t levelEnd = page + grid.width * grid.height;
+            for (; page < levelEnd; ++page)
+            {
+                const PageFeedback feedback =
+                    mFeedback[page].exchange(PageFeedback::None, std::memory_order_relaxed);
+                if (feedback == PageFeedback::None)
+                {
+                    continue;
+                }
+                ++result.numTouchedPages;
+                if (mPageTable[page] != NOT_RESIDENT)
+                {
+                    std::uint64_t& lastUse = mPhysicalPageLastUse[mPageTable[page]];
+                    lastUse = std::max(lastUse, mNumUpdates);
+                }
+                else
+                {
+                    requests.emplace_back(page, level);
+                }
+            }
+        }
+    }
+    result.numRequestedPages = requests.size();
+
+    // The least detailed levels are loaded first, since the more detailed levels fall back to them.
+    std::stable_sort(requests.begin(), requests.end(), [](const auto& a, const auto& b) -> bool {
+        return a.second > b.second;
+    });
+
+    // Free physical pages first, then the least recently used pages. Pages which were sampled
+    // since the previous update, and the least detailed levels, are not evicted.
+    std::vector<std::uint32_t> candidates(mPhysicalPageLastUse.size());
+    std::iota(candidates.begin(), candidates.end(), 0u);
+    std::erase_if(candidates, [this](const std::uint32_t physicalPage) -> bool {
+        return mPhysicalPageLastUse[physicalPage] >= mNumUpdates;
+    });
+    std::stable_sort(
+        candidates.begin(),
+        candidates.end(),
+        [this](const std::uint32_t a, const std::uint32_t b) -> bool {
+            return mPhysicalPageLastUse[a] < mPhysicalPageLastUse[b];
+        });
+
+    const std::size_t numLoads = std::min(requests.size(), candidates.size());
+    for (std::size_t i = 0; i < numLoads; ++i)
+    {
+        const std::uint32_t page = requests[i].first;
+        const std::uint32_t physicalPage = candidates[i];
+        const std::uint32_t evictedPage = mPhysicalPageOwners[physicalPage];
+        if (evictedPage != NOT_RESIDENT)
+        {
+            mPageTable[evictedPage] = NOT_RESIDENT;
+            ++result.numEvictedPages;
+        }
+        mPageTable[page] = physicalPage;
+        mPhysicalPageOwners[physicalPage] = page;
+        mPhysicalPageLastUse[physicalPage] = mNumUpdates;
+    }
+    result.numLoadedPages = numLoads;
+
+    // Reading the backing pages may wait for the operating system to read them from disk, so the
+    // pages are copied in parallel.
+    const std::size_t numTasks =
+        std::min<std::size_t>(numLoads, 4 * (threadPool.numThreads() + 1));
+    const std::size_t loadsPerTask = numTasks > 0 ? (numLoads + numTasks - 1) / numTasks : 0;
+    for (std::size_t loadBegin = 0; loadBegin < numLoads; loadBegin += loadsPerTask)
+    {
+        const std::size_t loadEnd = std::min(loadBegin + loadsPerTask, numLoads);
+        threadPool.push([this, &requests, &candidates, loadBegin, loadEnd]() {
+            for (std::size_t i = loadBegin; i < loadEnd; ++i)
+            {
+                std::memcpy(
+                    mPhysicalPages.data() + candidates[i] * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS,
+                    mPages.pages.data() + requests[i].first * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS,
+                    VIRTUAL_TEXTURE_PAGE_NUM_TEXELS * sizeof(Texture::BgraPixel));
+            }
+        });
+    }
+    threadPool.wait();
+
+    return result;
+}
+
+void VirtualTextureCache::recordFeedback(
+    const std::uint32_t page,
+    const PageFeedback  feedback) const noexcept
+{
+    // Most samples touch pages which have already been recorded. Only storing changes keeps the
+    // cache lines of the feedback buffer shared between the threads.
+    std::atomic<PageFeedback>& entry = mFeedback[page];
+    if (entry.load(std::memory_order_relaxed) != feedback)
+    {
+        entry.store(feedback, std::memory_order_relaxed);
+    }
+}
+} // namespace nlrs
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "texture.hpp"
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nlrs
+{
+class ThreadPool;
+
+// The width and height of a page in texels. A multiple of TEXEL_TILE_SIZE, so that each page holds
+// whole tiles.
+inline constexpr std::uint32_t VIRTUAL_TEXTURE_PAGE_SIZE = 64;
+inline constexpr std::size_t   VIRTUAL_TEXTURE_PAGE_NUM_TEXELS =
+    static_cast<std::size_t>(VIRTUAL_TEXTURE_PAGE_SIZE) * VIRTUAL_TEXTURE_PAGE_SIZE;
+
+// Ensure matches the descriptors stored in the PagedBaseColorTextures section of .pt files. Each
+// mip level of a texture is split into square pages of VIRTUAL_TEXTURE_PAGE_SIZE texels. The pages
+// of level 0 come first in row-major order, followed by the pages of each other level.
+struct VirtualTextureDescriptor
+{
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t numMipLevels;
+    // The index of the texture's first page among the pages of every texture.
+    std::uint32_t firstPage;
+};
+
+// The number of pages in each row and column of a mip level of `levelDimensions`.
+Texture::Dimensions virtualTexturePageGrid(Texture::Dimensions levelDimensions) noexcept;
+
+// The total number of pages of the first `numMipLevels` mip levels of a texture of `dimensions`.
+std::uint32_t virtualTextureNumPages(
+    Texture::Dimensions dimensions,
+    std::uint32_t       numMipLevels) noexcept;
+
+// Textures split into pages, as stored in .pt files.
+struct PagedTextures
+{
+    // In the order of the source textures.
+    std::vector<VirtualTextureDescriptor> descriptors;
+    // VIRTUAL_TEXTURE_PAGE_NUM_TEXELS BGRA texels per page, stored in TexelLayout::Tiled. Texels
+    // past the edges of a level repeat the edge texels.
+    std::vector<Texture::BgraPixel>       pages;
+};
+
+// The pages of a set of textures, e.g. in a memory mapped .pt file.
+struct VirtualTexturePages
+{
+    std::span<const VirtualTextureDescriptor> descriptors;
+    std::span<const Texture::BgraPixel>       pages;
+};
+
+// Splits every mip level of the textures into pages. The rows of pages are copied on `threadPool`.
+PagedTextures pageTextures(std::span<const Texture> textures, ThreadPool& threadPool);
+
+// Reassembles BGRA textures with the mip levels of the descriptors from their pages.
+std::vector<Texture> unpageTextures(VirtualTexturePages pages);
+
+// What VirtualTextureCache::update did with the feedback since the previous update.
+struct VirtualTextureUpdate
+{
+    // The pages which were sampled, including the requested pages.
+    std::size_t numTouchedPages;
+    // The pages which were sampled, but were not resident.
+    std::size_t numRequestedPages;
+    std::size_t numLoadedPages;
+    std::size_t numEvictedPages;
+};
+
+// Samples textures which are too large to be kept in memory at once. Only a fixed number of pages,
+// the physical pages, are resident at a time. Each texture has a page table, which maps its pages
+// to physical pages. Sampling records which pages were touched, and which of them were not
+// resident, in a feedback buffer. A non-resident page is replaced by the nearest resident page of a
+// less detailed mip level, and the least detailed level of each texture is always resident.
+// Between frames or passes, `update` streams the requested pages in from the backing pages, e.g. a
+// memory mapped .pt file whose pages the operating system reads on demand. The page table and the
+// physical pages are flat arrays, so that they can be bound as storage buffers in the shaders.
+class VirtualTextureCache
+{
+public:
+    // The page table entry of a page which is not resident.
+    static constexpr std::uint32_t NOT_RESIDENT = 0xffffffffu;
+
+    // `pages` must outlive the cache. Throws if the least detailed mip levels of the textures do
+    // not fit in `numPhysicalPages`.
+    VirtualTextureCache(VirtualTexturePages pages, std::uint32_t numPhysicalPages);
+
+    VirtualTextureCache(const VirtualTextureCache&) = delete;
+    VirtualTextureCache& operator=(const VirtualTextureCache&) = delete;
+
+    VirtualTextureCache(VirtualTextureCache&&) = delete;
+    VirtualTextureCache& operator=(VirtualTextureCache&&) = delete;
+
+    std::size_t         numTextures() const noexcept { return mPages.descriptors.size(); }
+    Texture::Dimensions dimensions(std::uint32_t textureIdx) const noexcept
+    {
+        const VirtualTextureDescriptor& descriptor = mPages.descriptors[textureIdx];
+        return Texture::Dimensions{descriptor.width, descriptor.height};
+    }
+
+    // Returns the nearest texel of the mip level nearest to `lod`, with the texture repeating
+    // outside of [0, 1], like sampleTextureAtlas. Safe to call from several threads, but not at the
+    // same time as `update`.
+    Texture::BgraPixel sample(std::uint32_t textureIdx, glm::vec2 uv, float lod) const noexcept;
+
+    // Marks the pages which were sampled since the previous update as used, and copies the
+    // requested pages into physical pages on `threadPool`, the least detailed levels first. The
+    // least recently used pages are evicted to make room, but pages which were sampled since the
+    // previous update are not. Requests which do not fit are dropped, and are made again if the
+    // pages are sampled again. Must not be called at the same time as `sample`.
+    VirtualTextureUpdate update(ThreadPool& threadPool);
+
+    // The physical page of each page of every texture, or NOT_RESIDENT. A texture's page table is
+    // the range of its pages.
+    std::span<const std::uint32_t> pageTable() const noexcept { return mPageTable; }
+    std::uint32_t                  numPhysicalPages() const noexcept
+    {
+        return static_cast<std::uint32_t>(mPhysicalPageLastUse.size());
+    }
+
+private:
+    // The values of the feedback buffer.
+    enum class PageFeedback : std::uint8_t
+    {
+        None,
+        Touched,
+        Requested,
+    };
+
+    void recordFeedback(std::uint32_t page, PageFeedback feedback) const noexcept;
+
+    VirtualTexturePages                            mPages;
+    std::vector<std::uint32_t>                     mPageTable;
+    // The page held by each physical page, or NOT_RESIDENT.
+    std::vector<std::uint32_t>                     mPhysicalPageOwners;
+    // The update in which each physical page was last sampled. Zero for free physical pages, and
+    // the maximum value for the least detailed levels, which are never evicted.
+    std::vector<std::uint64_t>                     mPhysicalPageLastUse;
+    std::vector<Texture::BgraPixel>                mPhysicalPages;
+    // A PageFeedback per page. Written by `sample`, which is const and may run on several threads.
+    mutable std::vector<std::atomic<PageFeedback>> mFeedback;
+    std::uint64_t                                  mNumUpdates;
+};
+} // namespace nlrs
@@ -0,0 +1,417 @@
+#include "accumulation.hpp"
+
+#include <common/assert.hpp>
+#include <common/file_stream.hpp>
+#include <common/stream.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <regex>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace nlrs
+{
+namespace
+{
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+
+std::uint32_t tileCountAlong(const std::uint32_t length, const std::uint32_t tileSize)
+{
+    return (length + tileSize - 1) / tileSize;
+}
+
+// True if each tile's sample ranges in `lhs` and `rhs` follow each other in either order.
+bool areAdjacent(const Accumulation& lhs, const Accumulation& rhs)
+{
+    for (std::uint32_t tileIdx = 0; tileIdx < lhs.tileCount(); ++tileIdx)
+    {
+        const bool isEmpty = lhs.tileSampleCount(tileIdx) == 0 || rhs.tileSampleCount(tileIdx) == 0;
+        const bool isAdjacent = lhs.tileSampleEnd(tileIdx) == rhs.tileSampleBegin(tileIdx) ||
+                                rhs.tileSampleEnd(tileIdx) == lhs.tileSampleBegin(tileIdx);
+        if (!isEmpty && !isAdjacent)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t tileCountOf(const Extent2u& imageSize, const std::uint32_t tileSize)
+{
+    return static_cast<std::size_t>(tileCountAlong(imageSize.x, tileSize)) *
+           static_cast<std::size_t>(tileCountAlong(imageSize.y, tileSize));
+}
+
+void write(OutputStream& stream, const std::uint32_t value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(std::uint32_t));
+}
+
+template<typename T>
+void write(OutputStream& stream, const std::span<const T> data)
+{
+    const std::uint64_t numElements = static_cast<std::uint64_t>(data.size());
+    stream.write(reinterpret_cast<const char*>(&numElements), sizeof(std::uint64_t));
+    stream.write(reinterpret_cast<const char*>(data.data()), sizeof(T) * data.size());
+}
+
+// Checkpoints may be truncated if a job was terminated while writing one, so short reads are
+// reported as errors instead of asserted on.
+void readExactly(InputStream& stream, char* const data, const std::size_t numBytes)
+{
+    if (stream.read(data, numBytes) != numBytes)
+    {
+        throw std::runtime_error("Unexpected end of accumulation file.");
+    }
+}
+
+void read(InputStream& stream, std::uint32_t& value)
+{
+    readExactly(stream, reinterpret_cast<char*>(&value), sizeof(std::uint32_t));
+}
+
+template<typename T>
+void read(InputStream& stream, std::vector<T>& data)
+{
+    std::uint64_t numElements;
+    readExactly(stream, reinterpret_cast<char*>(&numElements), sizeof(std::uint64_t));
+    data.resize(static_cast<std::size_t>(numElements));
+    readExactly(stream, reinterpret_cast<char*>(data.data()), sizeof(T) * data.size());
+}
+
+constexpr std::string_view MAGIC_BYTES = "PTACCUM1";
+} // namespace
+
+Accumulation::Accumulation(
+    const Extent2u      imageSize,
+    const std::uint32_t tileSize,
+    std::string         renderSettings,
+    const std::uint32_t firstSampleIdx)
+    : Accumulation(
+          imageSize,
+          tileSize,
+          std::move(renderSettings),
+          std::vector<std::uint32_t>(tileCountOf(imageSize, tileSize), firstSampleIdx),
+          std::vector<std::uint32_t>(tileCountOf(imageSize, tileSize), 0),
+          std::vector<glm::vec3>(area(imageSize), glm::vec3(0.0f)))
+{
+}
+
+Accumulation::Accumulation(
+    const Extent2u               imageSize,
+    const std::uint32_t          tileSize,
+    std::string                  renderSettings,
+    std::vector<std::uint32_t>&& tileSampleBegins,
+    std::vector<std::uint32_t>&& tileSampleCounts,
+    std::vector<glm::vec3>&&     radianceSums)
+    : mImageSize(imageSize),
+      mTileSize(tileSize),
+      mRenderSettings(std::move(renderSettings)),
+      mTileSampleBegins(std::move(tileSampleBegins)),
+      mTileSampleCounts(std::move(tileSampleCounts)),
+      mRadianceSums(std::move(radianceSums))
+{
+    if (mTileSize == 0)
+    {
+        throw std::runtime_error("Accumulation tile size must be greater than zero.");
+    }
+
+    const std::size_t numTiles = tileCountOf(mImageSize, mTileSize);
+    if (mTileSampleBegins.size() != numTiles || mTileSampleCounts.size() != numTiles)
+    {
+        throw std::runtime_error(fmt::format(
+            "Accumulation tile count mismatch: expected {} tiles, got {} sample ranges.",
+            numTiles,
+            std::min(mTileSampleBegins.size(), mTileSampleCounts.size())));
+    }
+
+    if (mRadianceSums.size() != static_cast<std::size_t>(area(mImageSize)))
+    {
+        throw std::runtime_error(fmt::format(
+            "Accumulation pixel count mismatch: expected {} pixels, got {}.",
+            area(mImageSize),
+            mRadianceSums.size()));
+    }
+}
+
+TileBounds Accumulation::tileBounds(const std::uint32_t tileIdx) const
+{
+    NLRS_ASSERT(tileIdx < tileCount());
+    const std::uint32_t numTilesX = tileCountAlong(mImageSize.x, mTileSize);
+    const std::uint32_t x = (tileIdx % numTilesX) * mTileSize;
+    const std::uint32_t y = (tileIdx / numTilesX) * mTileSize;
+    return TileBounds{
+        .origin = Extent2u(x, y),
+        .size = Extent2u(
+            std::min(mTileSize, mImageSize.x - x), std::min(mTileSize, mImageSize.y - y))};
+}
+
+std::uint32_t Accumulation::tileSampleBegin(const std::uint32_t tileIdx) const
+{
+    NLRS_ASSERT(tileIdx < tileCount());
+    return mTileSampleBegins[tileIdx];
+}
+
+std::uint32_t Accumulation::tileSampleEnd(const std::uint32_t tileIdx) const
+{
+    NLRS_ASSERT(tileIdx < tileCount());
+    return mTileSampleBegins[tileIdx] + mTileSampleCounts[tileIdx];
+}
+
+std::uint32_t Accumulation::tileSampleCount(const std::uint32_t tileIdx) const
+{
+    NLRS_ASSERT(tileIdx < tileCount());
+    return mTileSampleCounts[tileIdx];
+}
+
+TileAccumulation Accumulation::tile(const std::uint32_t tileIdx) const
+{
+    const TileBounds       bounds = tileBounds(tileIdx);
+    std::vector<glm::vec3> radianceSums;
+    radianceSums.reserve(area(bounds.size));
+    for (std::uint32_t y = bounds.origin.y; y < bounds.origin.y + bounds.size.y; ++y)
+    {
+        const auto row = mRadianceSums.begin() + y * mImageSize.x + bounds.origin.x;
+        radianceSums.insert(radianceSums.end(), row, row + bounds.size.x);
+    }
+    return TileAccumulation{
+        .sampleBegin = mTileSampleBegins[tileIdx],
+        .sampleCount = mTileSampleCounts[tileIdx],
+        .radianceSums = std::move(radianceSums)};
+}
+
+void Accumulation::setTile(const std::uint32_t tileIdx, const TileAccumulation& tile)
+{
+    const TileBounds bounds = tileBounds(tileIdx);
+    if (tile.radianceSums.size() != area(bounds.size))
+    {
+        throw std::runtime_error(fmt::format(
+            "Tile {} has {} pixels, got {}.",
+            tileIdx,
+            area(bounds.size),
+            tile.radianceSums.size()));
+    }
+
+    for (std::uint32_t y = 0; y < bounds.size.y; ++y)
+    {
+        const auto row = tile.radianceSums.begin() + y * bounds.size.x;
+        std::copy(
+            row,
+            row + bounds.size.x,
+            mRadianceSums.begin() + (bounds.origin.y + y) * mImageSize.x + bounds.origin.x);
+    }
+    mTileSampleBegins[tileIdx] = tile.sampleBegin;
+    mTileSampleCounts[tileIdx] = tile.sampleCount;
+}
+
+std::vector<glm::vec3> Accumulation::resolve() const
+{
+    std::vector<glm::vec3> estimate(mRadianceSums.size(), glm::vec3(0.0f));
+    for (std::uint32_t tileIdx = 0; tileIdx < tileCount(); ++tileIdx)
+    {
+        const std::uint32_t sampleCount = mTileSampleCounts[tileIdx];
+        if (sampleCount == 0)
+        {
+            continue;
+        }
+
+        const TileBounds bounds = tileBounds(tileIdx);
+        const float      invSampleCount = 1.0f / static_cast<float>(sampleCount);
+        for (std::uint32_t y = bounds.origin.y; y < bounds.origin.y + bounds.size.y; ++y)
+        {
+            for (std::uint32_t x = bounds.origin.x; x < bounds.origin.x + bounds.size.x; ++x)
+            {
+                const std::size_t idx = y * mImageSize.x + x;
+                estimate[idx] = mRadianceSums[idx] * invSampleCount;
+            }
+        }
+    }
+    return estimate;
+}
+
+Accumulation merge(const Accumulation& lhs, const Accumulation& rhs)
+{
+    if (lhs.imageSize() != rhs.imageSize() || lhs.tileSize() != rhs.tileSize())
+    {
+        throw std::runtime_error(fmt::format(
+            "Cannot merge accumulations with different image layouts: {}x{} (tile size {}) and "
+            "{}x{} (tile size {}).",
+            lhs.imageSize().x,
+            lhs.imageSize().y,
+            lhs.tileSize(),
+            rhs.imageSize().x,
+            rhs.imageSize().y,
+            rhs.tileSize()));
+    }
+
+    if (lhs.renderSettings() != rhs.renderSettings())
+    {
+        throw std::runtime_error(fmt::format(
+            "Cannot merge accumulations with different render settings: '{}' and '{}'.",
+            lhs.renderSettings(),
+            rhs.renderSettings()));
+    }
+
+    std::vector<std::uint32_t> tileSampleBegins(lhs.tileCount());
+    std::vector<std::uint32_t> tileSampleCounts(lhs.tileCount());
+    for (std::uint32_t tileIdx = 0; tileIdx < lhs.tileCount(); ++tileIdx)
+    {
+        const std::uint32_t lhsBegin = lhs.tileSampleBegin(tileIdx);
+        const std::uint32_t lhsEnd = lhs.tileSampleEnd(tileIdx);
+        const std::uint32_t rhsBegin = rhs.tileSampleBegin(tileIdx);
+        const std::uint32_t rhsEnd = rhs.tileSampleEnd(tileIdx);
+
+        if (lhsBegin == lhsEnd)
+        {
+            tileSampleBegins[tileIdx] = rhsBegin;
+        }
+        else if (rhsBegin == rhsEnd || lhsEnd == rhsBegin)
+        {
+            tileSampleBegins[tileIdx] = lhsBegin;
+        }
+        else if (rhsEnd == lhsBegin)
+        {
+            tileSampleBegins[tileIdx] = rhsBegin;
+        }
+        else
+        {
+            throw std::runtime_error(fmt::format(
+                "Cannot merge tile {}: sample ranges [{}, {}) and [{}, {}) are not adjacent.",
+                tileIdx,
+                lhsBegin,
+                lhsEnd,
+                rhsBegin,
+                rhsEnd));
+        }
+        tileSampleCounts[tileIdx] = lhs.tileSampleCount(tileIdx) + rhs.tileSampleCount(tileIdx);
+    }
+
+    const auto             lhsSums = lhs.radianceSums();
+    const auto             rhsSums = rhs.radianceSums();
+    std::vector<glm::vec3> radianceSums(lhsSums.size());
+    std::transform(
+        lhsSums.begin(), lhsSums.end(), rhsSums.begin(), radianceSums.begin(), std::plus<>{});
+
+    return Accumulation{
+        lhs.imageSize(),
+        lhs.tileSize(),
+        lhs.renderSettings(),
+        std::move(tileSampleBegins),
+        std::move(tileSampleCounts),
+        std::move(radianceSums)};
+}
+
+Accumulation mergeAccumulationFiles(const std::span<const std::filesystem::path> paths)
+{
+    NLRS_ASSERT(!paths.empty());
+
+    std::vector<Accumulation> accumulations;
+    for (const std::filesystem::path& path : paths)
+    {
+        Accumulation    accumulation;
+        InputFileStream file(path);
+        deserialize(file, accumulation);
+        const Accumulation& first = accumulations.empty() ? accumulation : accumulations.front();
+        if (accumulation.renderSettings() != first.renderSettings() ||
+            accumulation.imageSize() != first.imageSize() ||
+            accumulation.tileSize() != first.tileSize())
+        {
+            throw std::runtime_error(fmt::format(
+                "{} is not an accumulation of the same render as {}.",
+                path.string(),
+                paths.front().string()));
+        }
+        accumulations.push_back(std::move(accumulation));
+    }
+
+    // Merge any two adjacent accumulations until a single one remains.
+    while (accumulations.size() > 1)
+    {
+        bool merged = false;
+        for (std::size_t i = 0; i < accumulations.size() && !merged; ++i)
+        {
+            for (std::size_t j = i + 1; j < accumulations.size() && !merged; ++j)
+            {
+                if (areAdjacent(accumulations[i], accumulations[j]))
+                {
+                    accumulations[i] = merge(accumulations[i], accumulations[j]);
+                    accumulations.erase(accumulations.begin() + static_cast<std::ptrdiff_t>(j));
+                    merged = true;
+                }
+            }
+        }
+
+        if (!merged)
+        {
+            throw std::runtime_error(
+                "The remaining accumulations do not have adjacent sample ranges.");
+        }
+    }
+    return std::move(accumulations.front());
+}
+
+void serialize(OutputStream& stream, const Accumulation& accumulation)
+{
+    stream.write(MAGIC_BYTES.data(), MAGIC_BYTES.size());
+
+    write(stream, accumulation.imageSize().x);
+    write(stream, accumulation.imageSize().y);
+    write(stream, accumulation.tileSize());
+    write(stream, std::span<const char>(accumulation.renderSettings()));
+    write(stream, accumulation.tileSampleBegins());
+    write(stream, accumulation.tileSampleCounts());
+    write(stream, accumulation.radianceSums());
+}
+
+void deserialize(InputStream& stream, Accumulation& accumulation)
+{
+    std::string magicBytes;
+    magicBytes.resize(MAGIC_BYTES.size());
+    if (stream.read(magicBytes.data(), magicBytes.size()) != magicBytes.size() ||
+        magicBytes != MAGIC_BYTES)
+    {
+        const std::regex pattern("PTACCUM\\d");
+        if (std::regex_search(magicBytes, pattern))
+        {
+            throw std::runtime_error(fmt::format(
+                "Mismatching accumulation file version. Invalid version in magic bytes: expected "
+                "'{}', got '{}'.",
+                MAGIC_BYTES,
+                magicBytes));
+        }
+        else
+        {
+            throw std::runtime_error("Invalid file format: expected accumulation file.");
+        }
+    }
+
+    Extent2u      imageSize;
+    std::uint32_t tileSize;
+    read(stream, imageSize.x);
+    read(stream, imageSize.y);
+    read(stream, tileSize);
+
+    std::vector<char> renderSettings;
+    read(stream, renderSettings);
+
+    std::vector<std::uint32_t> tileSampleBegins;
+    std::vector<std::uint32_t> tileSampleCounts;
+    std::vector<glm::vec3>     radianceSums;
+    read(stream, tileSampleBegins);
+    read(stream, tileSampleCounts);
+    read(stream, radianceSums);
+
+    accumulation = Accumulation{
+        imageSize,
+        tileSize,
+        std::string(renderSettings.begin(), renderSettings.end()),
+        std::move(tileSampleBegins),
+        std::move(tileSampleCounts),
+        std::move(radianceSums)};
+}
+} // namespace nlrs
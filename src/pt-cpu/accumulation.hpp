@@ -0,0 +1,113 @@
+#pragma once
+
+#include <common/extent.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace nlrs
+{
+class InputStream;
+class OutputStream;
+
+struct TileBounds
+{
+    Extent2u origin;
+    Extent2u size;
+};
+
+// The accumulated state of a single tile. `radianceSums` contains the tile's pixels in row-major
+// order.
+struct TileAccumulation
+{
+    std::uint32_t          sampleBegin;
+    std::uint32_t          sampleCount;
+    std::vector<glm::vec3> radianceSums;
+};
+
+// The accumulated radiance of a render in progress. The image is divided into square tiles, and
+// every pixel of a tile has been rendered with the same contiguous range of sample indices. Since
+// samples are reproducible from their pixel and sample index, an accumulation can be written to
+// disk, and the render resumed later from the next sample index of each tile.
+class Accumulation
+{
+public:
+    Accumulation() = default;
+    // `renderSettings` identifies the scene, camera and sampling parameters which produced the
+    // accumulation. Only accumulations with identical settings can be merged or resumed. The
+    // accumulation is empty, and the first sample to be rendered for each tile is `firstSampleIdx`.
+    Accumulation(
+        Extent2u      imageSize,
+        std::uint32_t tileSize,
+        std::string   renderSettings,
+        std::uint32_t firstSampleIdx);
+    Accumulation(
+        Extent2u                     imageSize,
+        std::uint32_t                tileSize,
+        std::string                  renderSettings,
+        std::vector<std::uint32_t>&& tileSampleBegins,
+        std::vector<std::uint32_t>&& tileSampleCounts,
+        std::vector<glm::vec3>&&     radianceSums);
+
+    Accumulation(const Accumulation&) = delete;
+    Accumulation& operator=(const Accumulation&) = delete;
+
+    Accumulation(Accumulation&&) = default;
+    Accumulation& operator=(Accumulation&&) = default;
+
+    bool operator==(const Accumulation&) const = default;
+
+    Extent2u           imageSize() const noexcept { return mImageSize; }
+    std::uint32_t      tileSize() const noexcept { return mTileSize; }
+    const std::string& renderSettings() const noexcept { return mRenderSettings; }
+
+    std::uint32_t tileCount() const noexcept
+    {
+        return static_cast<std::uint32_t>(mTileSampleCounts.size());
+    }
+    TileBounds tileBounds(std::uint32_t tileIdx) const;
+
+    // The samples [tileSampleBegin, tileSampleEnd) have been accumulated for each pixel of the
+    // tile.
+    std::uint32_t tileSampleBegin(std::uint32_t tileIdx) const;
+    std::uint32_t tileSampleEnd(std::uint32_t tileIdx) const;
+    std::uint32_t tileSampleCount(std::uint32_t tileIdx) const;
+
+    // Copies the state of a tile out of, or into, the accumulation. Tiles are rendered outside of
+    // the accumulation, so that they can be handed to other threads and processes.
+    TileAccumulation tile(std::uint32_t tileIdx) const;
+    void             setTile(std::uint32_t tileIdx, const TileAccumulation& tile);
+
+    // The estimate of each pixel in row-major order. Pixels without samples are black.
+    std::vector<glm::vec3> resolve() const;
+
+    std::span<const std::uint32_t> tileSampleBegins() const noexcept { return mTileSampleBegins; }
+    std::span<const std::uint32_t> tileSampleCounts() const noexcept { return mTileSampleCounts; }
+    std::span<const glm::vec3>     radianceSums() const noexcept { return mRadianceSums; }
+
+private:
+    Extent2u                   mImageSize;
+    std::uint32_t              mTileSize = 0;
+    std::string                mRenderSettings;
+    std::vector<std::uint32_t> mTileSampleBegins;
+    std::vector<std::uint32_t> mTileSampleCounts;
+    std::vector<glm::vec3>     mRadianceSums;
+};
+
+// Combines two accumulations of the same render. For each tile, the sample ranges of `lhs` and
+// `rhs` must be adjacent, so that the merged tile again covers a contiguous range of samples.
+Accumulation merge(const Accumulation& lhs, const Accumulation& rhs);
+
+// Merges the accumulations stored in `paths`, e.g. checkpoints of pt-render runs with different
+// --first-sample and --spp values, given in any order. Throws if a file is not an accumulation of
+// the same render as the first one, or if the sample ranges do not combine into one.
+Accumulation mergeAccumulationFiles(std::span<const std::filesystem::path> paths);
+
+void serialize(OutputStream&, const Accumulation&);
+void deserialize(InputStream&, Accumulation&);
+} // namespace nlrs
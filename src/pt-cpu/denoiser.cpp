@@ -0,0 +1,462 @@
+#include "denoiser.hpp"
+#include "path_tracer.hpp"
+
+#include <common/assert.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace nlrs
+{
+namespace
+{
+// The B3 spline kernel of the à-trous transform.
+constexpr float KERNEL[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+// Keeps the illumination finite for black texels. The same value is used for demodulation and
+// remodulation, so such pixels are still filtered consistently.
+constexpr float MIN_ALBEDO = 1e-3f;
+
+// The number of pixels of a row which are filtered together.
+constexpr std::size_t NUM_LANES = 8;
+
+// The values of NUM_LANES consecutive pixels. Only the arithmetic the filter needs is defined.
+#if defined(__AVX2__)
+struct Lanes
+{
+    __m256 v;
+};
+
+Lanes load(const float* const p) { return {_mm256_loadu_ps(p)}; }
+void  store(float* const p, const Lanes a) { _mm256_storeu_ps(p, a.v); }
+Lanes broadcast(const float f) { return {_mm256_set1_ps(f)}; }
+Lanes operator+(const Lanes a, const Lanes b) { return {_mm256_add_ps(a.v, b.v)}; }
+Lanes operator-(const Lanes a, const Lanes b) { return {_mm256_sub_ps(a.v, b.v)}; }
+Lanes operator*(const Lanes a, const Lanes b) { return {_mm256_mul_ps(a.v, b.v)}; }
+Lanes operator/(const Lanes a, const Lanes b) { return {_mm256_div_ps(a.v, b.v)}; }
+Lanes max(const Lanes a, const Lanes b) { return {_mm256_max_ps(a.v, b.v)}; }
+Lanes roundToNearest(const Lanes a)
+{
+    return {_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)};
+}
+// 2^n, for integral n in [-126, 127].
+Lanes exp2Integral(const Lanes n)
+{
+    const __m256i exponent = _mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127));
+    return {_mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23))};
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+struct Lanes
+{
+    __m128 lo;
+    __m128 hi;
+};
+
+Lanes load(const float* const p) { return {_mm_loadu_ps(p), _mm_loadu_ps(p + 4)}; }
+void  store(float* const p, const Lanes a)
+{
+    _mm_storeu_ps(p, a.lo);
+    _mm_storeu_ps(p + 4, a.hi);
+}
+Lanes broadcast(const float f) { return {_mm_set1_ps(f), _mm_set1_ps(f)}; }
+Lanes operator+(const Lanes a, const Lanes b)
+{
+    return {_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)};
+}
+Lanes operator-(const Lanes a, const Lanes b)
+{
+    return {_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)};
+}
+Lanes operator*(const Lanes a, const Lanes b)
+{
+    return {_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)};
+}
+Lanes operator/(const Lanes a, const Lanes b)
+{
+    return {_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)};
+}
+Lanes max(const Lanes a, const Lanes b)
+{
+    return {_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)};
+}
+// Relies on the default rounding mode of the conversion, which is to nearest.
+Lanes roundToNearest(const Lanes a)
+{
+    return {
+        _mm_cvtepi32_ps(_mm_cvtps_epi32(a.lo)), _mm_cvtepi32_ps(_mm_cvtps_epi32(a.hi))};
+}
+// 2^n, for integral n in [-126, 127].
+Lanes exp2Integral(const Lanes n)
+{
+    const __m128i bias = _mm_set1_epi32(127);
+    return {
+        _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.lo), bias), 23)),
+        _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.hi), bias), 23))};
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// The division and rounding instructions are only available on AArch64.
+struct Lanes
+{
+    float32x4_t lo;
+    float32x4_t hi;
+};
+
+Lanes load(const float* const p) { return {vld1q_f32(p), vld1q_f32(p + 4)}; }
+void  store(float* const p, const Lanes a)
+{
+    vst1q_f32(p, a.lo);
+    vst1q_f32(p + 4, a.hi);
+}
+Lanes broadcast(const float f) { return {vdupq_n_f32(f), vdupq_n_f32(f)}; }
+Lanes operator+(const Lanes a, const Lanes b)
+{
+    return {vaddq_f32(a.lo, b.lo), vaddq_f32(a.hi, b.hi)};
+}
+Lanes operator-(const Lanes a, const Lanes b)
+{
+    return {vsubq_f32(a.lo, b.lo), vsubq_f32(a.hi, b.hi)};
+}
+Lanes operator*(const Lanes a, const Lanes b)
+{
+    return {vmulq_f32(a.lo, b.lo), vmulq_f32(a.hi, b.hi)};
+}
+Lanes operator/(const Lanes a, const Lanes b)
+{
+    return {vdivq_f32(a.lo, b.lo), vdivq_f32(a.hi, b.hi)};
+}
+Lanes max(const Lanes a, const Lanes b)
+{
+    return {vmaxq_f32(a.lo, b.lo), vmaxq_f32(a.hi, b.hi)};
+}
+Lanes roundToNearest(const Lanes a) { return {vrndnq_f32(a.lo), vrndnq_f32(a.hi)}; }
+// 2^n, for integral n in [-126, 127].
+Lanes exp2Integral(const Lanes n)
+{
+    const int32x4_t bias = vdupq_n_s32(127);
+    return {
+        vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n.lo), bias), 23)),
+        vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n.hi), bias), 23))};
+}
+#else
+struct Lanes
+{
+    std::array<float, NUM_LANES> v;
+};
+
+template<typename F>
+Lanes map(const Lanes a, const Lanes b, const F& f)
+{
+    Lanes result;
+    for (std::size_t i = 0; i < NUM_LANES; ++i)
+    {
+        result.v[i] = f(a.v[i], b.v[i]);
+    }
+    return result;
+}
+
+Lanes load(const float* const p)
+{
+    Lanes result;
+    std::copy(p, p + NUM_LANES, result.v.begin());
+    return result;
+}
+void  store(float* const p, const Lanes a) { std::ranges::copy(a.v, p); }
+Lanes broadcast(const float f)
+{
+    Lanes result;
+    result.v.fill(f);
+    return result;
+}
+Lanes operator+(const Lanes a, const Lanes b) { return map(a, b, std::plus<float>()); }
+Lanes operator-(const Lanes a, const Lanes b) { return map(a, b, std::minus<float>()); }
+Lanes operator*(const Lanes a, const Lanes b) { return map(a, b, std::multiplies<float>()); }
+Lanes operator/(const Lanes a, const Lanes b) { return map(a, b, std::divides<float>()); }
+Lanes max(const Lanes a, const Lanes b)
+{
+    return map(a, b, [](const float x, const float y) -> float { return std::max(x, y); });
+}
+Lanes roundToNearest(const Lanes a)
+{
+    return map(a, a, [](const float x, float) -> float { return std::nearbyint(x); });
+}
+// 2^n, for integral n in [-126, 127].
+Lanes exp2Integral(const Lanes n)
+{
+    return map(n, n, [](const float x, float) -> float {
+        return std::ldexp(1.0f, static_cast<int>(x));
+    });
+}
+#endif
+
+Lanes abs(const Lanes a) { return max(a, broadcast(0.0f) - a); }
+
+// e^x for x <= 0, with a relative error of a few ulp, as in Cephes' expf. Arguments below -40
+// return e^-40 instead. Such weights are negligible next to the weight of the center pixel, and
+// keep the weighted colors away from denormal floats, which are very slow to compute with.
+Lanes exp(Lanes x)
+{
+    x = max(x, broadcast(-40.0f));
+    // x = n ln(2) + r, with |r| <= ln(2) / 2, where ln(2) is split in two so that n ln(2) is exact.
+    const Lanes n = roundToNearest(x * broadcast(1.44269504088896341f));
+    const Lanes r = x - n * broadcast(0.693359375f) - n * broadcast(-2.12194440e-4f);
+    Lanes       p = broadcast(1.9875691500e-4f);
+    p = p * r + broadcast(1.3981999507e-3f);
+    p = p * r + broadcast(8.3334519073e-3f);
+    p = p * r + broadcast(4.1665795894e-2f);
+    p = p * r + broadcast(1.6666665459e-1f);
+    p = p * r + broadcast(5.0000001201e-1f);
+    return (p * r * r + r + broadcast(1.0f)) * exp2Integral(n);
+}
+
+Lanes luminance(const std::array<Lanes, 3>& c)
+{
+    return c[0] * broadcast(0.2126f) + c[1] * broadcast(0.7152f) + c[2] * broadcast(0.0722f);
+}
+
+Lanes dot(const std::array<Lanes, 3>& a, const std::array<Lanes, 3>& b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+std::array<Lanes, 3> operator-(const std::array<Lanes, 3>& a, const std::array<Lanes, 3>& b)
+{
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+// The image and its features in planes of one channel each, so that the channels of NUM_LANES
+// consecutive pixels are loaded at once. Each row is padded with `margin` pixels on both sides,
+// and to a multiple of NUM_LANES pixels, so that the taps of every pixel can be loaded without
+// bounds checks. The padding has kind 0, and is never filtered with the pixels of the image.
+struct Planes
+{
+    Planes(const Extent2u& imageSize, const std::size_t margin)
+        : margin(margin),
+          stride(margin + (imageSize.x + NUM_LANES - 1) / NUM_LANES * NUM_LANES + margin),
+          color(),
+          albedo(),
+          normal(),
+          depth(stride * imageSize.y, 0.0f),
+          kind(stride * imageSize.y, 0.0f)
+    {
+        for (std::vector<float>* const plane :
+             {&color[0], &color[1], &color[2], &albedo[0], &albedo[1], &albedo[2], &normal[0],
+              &normal[1], &normal[2]})
+        {
+            plane->resize(stride * imageSize.y, 0.0f);
+        }
+    }
+
+    std::size_t index(const std::uint32_t x, const std::uint32_t y) const noexcept
+    {
+        return y * stride + margin + x;
+    }
+
+    std::size_t                       margin;
+    std::size_t                       stride;
+    std::array<std::vector<float>, 3> color;
+    std::array<std::vector<float>, 3> albedo;
+    std::array<std::vector<float>, 3> normal;
+    // 0 for the sky, so that the depth distance between sky pixels is 0.
+    std::vector<float>                depth;
+    // 1 for surfaces and 2 for the sky. Pixels are only filtered with pixels of the same kind.
+    std::vector<float>                kind;
+};
+
+std::array<Lanes, 3> loadChannels(
+    const std::array<std::vector<float>, 3>& planes,
+    const std::size_t                        i)
+{
+    return {load(planes[0].data() + i), load(planes[1].data() + i), load(planes[2].data() + i)};
+}
+
+template<typename Func>
+void parallelForRows(
+    const std::uint32_t numRows,
+    const std::uint32_t numThreads,
+    const Func&         func)
+{
+    std::atomic<std::uint32_t> nextRow = 0;
+    auto                       filterRows = [&]() -> void {
+        for (std::uint32_t y = nextRow++; y < numRows; y = nextRow++)
+        {
+            func(y);
+        }
+    };
+
+    std::vector<std::jthread> threads;
+    for (std::uint32_t i = 1; i < numThreads; ++i)
+    {
+        threads.emplace_back(filterRows);
+    }
+    filterRows();
+}
+} // namespace
+
+std::vector<glm::vec3> denoise(
+    const Extent2u&                      imageSize,
+    const std::span<const glm::vec3>     radiance,
+    const std::span<const PixelFeatures> features,
+    const DenoiserParams&                params,
+    const std::uint32_t                  numThreads)
+{
+    NLRS_ASSERT(radiance.size() == area(imageSize));
+    NLRS_ASSERT(features.size() == area(imageSize));
+
+    const int height = static_cast<int>(imageSize.y);
+
+    const Lanes invAlbedoSigma2 = broadcast(1.0f / (params.albedoSigma * params.albedoSigma));
+    const Lanes invNormalSigma2 = broadcast(1.0f / (params.normalSigma * params.normalSigma));
+    const Lanes depthSigma = broadcast(params.depthSigma);
+
+    // The taps of the last iteration reach twice its step from the center pixel.
+    const std::size_t margin =
+        params.numIterations > 0 ? std::size_t{2} << (params.numIterations - 1) : 0;
+    Planes current(imageSize, margin);
+    for (std::uint32_t y = 0; y < imageSize.y; ++y)
+    {
+        for (std::uint32_t x = 0; x < imageSize.x; ++x)
+        {
+            const std::size_t    i = static_cast<std::size_t>(y) * imageSize.x + x;
+            const std::size_t    p = current.index(x, y);
+            const PixelFeatures& f = features[i];
+            const bool           isSky = std::isinf(f.depth);
+            const glm::vec3      c = radiance[i] / glm::max(f.albedo, glm::vec3(MIN_ALBEDO));
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                const std::size_t plane = static_cast<std::size_t>(channel);
+                current.color[plane][p] = c[channel];
+                current.albedo[plane][p] = f.albedo[channel];
+                current.normal[plane][p] = f.normal[channel];
+            }
+            current.depth[p] = isSky ? 0.0f : f.depth;
+            current.kind[p] = isSky ? 2.0f : 1.0f;
+        }
+    }
+    // Only the colors are written by each iteration, and the padding remains black.
+    std::array<std::vector<float>, 3> next = current.color;
+
+    for (std::uint32_t iteration = 0; iteration < params.numIterations; ++iteration)
+    {
+        const int step = 1 << iteration;
+        // The color sigma is halved each iteration, since the noise is reduced by the previous
+        // iterations.
+        const float colorSigma = params.colorSigma / static_cast<float>(step);
+        const Lanes invColorSigma2 = broadcast(1.0f / (colorSigma * colorSigma));
+
+        float tapDistances[5][5];
+        for (int j = -2; j <= 2; ++j)
+        {
+            for (int i = -2; i <= 2; ++i)
+            {
+                tapDistances[j + 2][i + 2] =
+                    static_cast<float>(step) * std::sqrt(static_cast<float>(i * i + j * j));
+            }
+        }
+
+        parallelForRows(imageSize.y, std::max(numThreads, 1u), [&](const std::uint32_t row) {
+            const int y = static_cast<int>(row);
+            for (std::uint32_t x = 0; x < imageSize.x; x += NUM_LANES)
+            {
+                const std::size_t          p = current.index(x, row);
+                const std::array<Lanes, 3> cp = loadChannels(current.color, p);
+                const Lanes                lp = luminance(cp);
+                const std::array<Lanes, 3> ap = loadChannels(current.albedo, p);
+                const std::array<Lanes, 3> np = loadChannels(current.normal, p);
+                const Lanes                dp = load(current.depth.data() + p);
+                const Lanes                kp = load(current.kind.data() + p);
+
+                std::array<Lanes, 3> sum{broadcast(0.0f), broadcast(0.0f), broadcast(0.0f)};
+                Lanes                weightSum = broadcast(0.0f);
+                for (int j = -2; j <= 2; ++j)
+                {
+                    const int qy = y + j * step;
+                    if (qy < 0 || qy >= height)
+                    {
+                        continue;
+                    }
+
+                    for (int i = -2; i <= 2; ++i)
+                    {
+                        const std::size_t q = static_cast<std::size_t>(
+                            static_cast<std::ptrdiff_t>(p) +
+                            static_cast<std::ptrdiff_t>(j * step) *
+                                static_cast<std::ptrdiff_t>(current.stride) +
+                            i * step);
+                        const std::array<Lanes, 3> cq = loadChannels(current.color, q);
+
+                        // Sky pixels are only filtered with other sky pixels, and the padding
+                        // with neither. The kinds differ by at least 1 otherwise.
+                        const Lanes isSameKind = max(
+                            broadcast(0.0f),
+                            broadcast(1.0f) - abs(kp - load(current.kind.data() + q)));
+
+                        const std::array<Lanes, 3> dc = cp - cq;
+                        const Lanes meanLuminance = broadcast(0.5f) * (lp + luminance(cq));
+                        const Lanes colorDistance =
+                            dot(dc, dc) * invColorSigma2 /
+                            max(meanLuminance * meanLuminance, broadcast(1e-6f));
+
+                        const std::array<Lanes, 3> da = ap - loadChannels(current.albedo, q);
+                        const std::array<Lanes, 3> dn = np - loadChannels(current.normal, q);
+
+                        const Lanes depthDistance =
+                            abs(dp - load(current.depth.data() + q)) /
+                            (depthSigma * dp * broadcast(tapDistances[j + 2][i + 2]) +
+                             broadcast(1e-6f));
+
+                        const Lanes weight =
+                            isSameKind * broadcast(KERNEL[i + 2] * KERNEL[j + 2]) *
+                            exp(broadcast(0.0f) - colorDistance - dot(da, da) * invAlbedoSigma2 -
+                                dot(dn, dn) * invNormalSigma2 - depthDistance);
+                        sum[0] = sum[0] + weight * cq[0];
+                        sum[1] = sum[1] + weight * cq[1];
+                        sum[2] = sum[2] + weight * cq[2];
+                        weightSum = weightSum + weight;
+                    }
+                }
+
+                // The center pixel always has a positive weight. The lanes past the end of the row
+                // are not written, so that the padding remains black.
+                alignas(32) float filtered[3][NUM_LANES];
+                const std::size_t numPixels = std::min<std::size_t>(NUM_LANES, imageSize.x - x);
+                for (std::size_t channel = 0; channel < 3; ++channel)
+                {
+                    store(filtered[channel], sum[channel] / weightSum);
+                    std::copy_n(filtered[channel], numPixels, next[channel].begin() + p);
+                }
+            }
+        });
+
+        std::swap(current.color, next);
+    }
+
+    std::vector<glm::vec3> result(radiance.size());
+    for (std::uint32_t y = 0; y < imageSize.y; ++y)
+    {
+        for (std::uint32_t x = 0; x < imageSize.x; ++x)
+        {
+            const std::size_t i = static_cast<std::size_t>(y) * imageSize.x + x;
+            const std::size_t p = current.index(x, y);
+            result[i] =
+                glm::vec3(current.color[0][p], current.color[1][p], current.color[2][p]) *
+                glm::max(features[i].albedo, glm::vec3(MIN_ALBEDO));
+        }
+    }
+    return result;
+}
+} // namespace nlrs
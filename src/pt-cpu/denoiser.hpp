@@ -0,0 +1,40 @@
+#pragma once
+
+#include <common/extent.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nlrs
+{
+struct PixelFeatures;
+
+struct DenoiserParams
+{
+    // The filter footprint doubles with each iteration, and covers 4 * 2^numIterations - 3 pixels
+    // across after the last one.
+    std::uint32_t numIterations = 5;
+    // Edge-stopping sensitivities. Smaller values preserve more edges, and remove less noise. The
+    // color sigma is relative to the luminance of the pixels being compared, and the depth sigma
+    // relative to the depth of the center pixel per pixel of distance.
+    float colorSigma = 1.0f;
+    float albedoSigma = 0.1f;
+    float normalSigma = 0.3f;
+    float depthSigma = 0.05f;
+};
+
+// Removes noise from `radiance` with the edge-avoiding à-trous wavelet filter of Dammertz et al.,
+// guided by the albedo, normal and depth of each pixel. The radiance is divided by the albedo
+// before filtering, so that texture detail is not blurred. `radiance` and `features` are in
+// row-major order. Rows are filtered on `numThreads` threads, eight pixels at a time with the SIMD
+// instructions the compiler targets.
+std::vector<glm::vec3> denoise(
+    const Extent2u&                imageSize,
+    std::span<const glm::vec3>     radiance,
+    std::span<const PixelFeatures> features,
+    const DenoiserParams&          params,
+    std::uint32_t                  numThreads);
+} // namespace nlrs
@@ -0,0 +1,421 @@
+#include "image_writer.hpp"
+
+#include <common/assert.hpp>
+#include <common/stream.hpp>
+
+#include <fmt/core.h>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace nlrs
+{
+namespace
+{
+glm::vec3 acesFilmic(const glm::vec3& x)
+{
+    const float a = 2.51f;
+    const float b = 0.03f;
+    const float c = 2.43f;
+    const float d = 0.59f;
+    const float e = 0.14f;
+    return glm::clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0f, 1.0f);
+}
+
+float exposureFromStops(const int exposureStops)
+{
+    return 1.0f / std::exp2(static_cast<float>(exposureStops));
+}
+
+// Matches the tonemapping of the reference path tracer.
+std::array<std::uint8_t, 3> tonemapToSrgb(const glm::vec3& radiance, const float exposure)
+{
+    const glm::vec3 srgb = glm::pow(acesFilmic(exposure * radiance), glm::vec3(1.0f / 2.2f));
+    return {
+        static_cast<std::uint8_t>(srgb.r * 255.0f + 0.5f),
+        static_cast<std::uint8_t>(srgb.g * 255.0f + 0.5f),
+        static_cast<std::uint8_t>(srgb.b * 255.0f + 0.5f)};
+}
+
+// The same conversion as stb_image_write's.
+std::array<std::uint8_t, 4> toRgbe(const glm::vec3& radiance)
+{
+    const float maxComponent = std::max(radiance.r, std::max(radiance.g, radiance.b));
+    if (maxComponent < 1e-32f)
+    {
+        return {0, 0, 0, 0};
+    }
+
+    int         exponent;
+    const float normalize = std::frexp(maxComponent, &exponent) * 256.0f / maxComponent;
+    return {
+        static_cast<std::uint8_t>(radiance.r * normalize),
+        static_cast<std::uint8_t>(radiance.g * normalize),
+        static_cast<std::uint8_t>(radiance.b * normalize),
+        static_cast<std::uint8_t>(exponent + 128)};
+}
+
+// Appends `data` in the run-length encoding of a single channel of an HDR scanline. Runs are at
+// most 127 bytes long, and literal sequences at most 128 bytes long.
+void appendRunLengthEncoded(
+    std::vector<std::uint8_t>&          out,
+    const std::span<const std::uint8_t> data)
+{
+    constexpr std::size_t MIN_RUN_LENGTH = 4;
+    auto                  runLengthAt = [&data](const std::size_t begin) -> std::size_t {
+        std::size_t length = 1;
+        while (begin + length < data.size() && length < 127 && data[begin + length] == data[begin])
+        {
+            ++length;
+        }
+        return length;
+    };
+
+    std::size_t i = 0;
+    while (i < data.size())
+    {
+        const std::size_t runLength = runLengthAt(i);
+        if (runLength >= MIN_RUN_LENGTH)
+        {
+            out.push_back(static_cast<std::uint8_t>(128 + runLength));
+            out.push_back(data[i]);
+            i += runLength;
+            continue;
+        }
+
+        std::size_t end = i + 1;
+        while (end < data.size() && end - i < 128 && runLengthAt(end) < MIN_RUN_LENGTH)
+        {
+            ++end;
+        }
+        out.push_back(static_cast<std::uint8_t>(end - i));
+        out.insert(out.end(), data.begin() + i, data.begin() + end);
+        i = end;
+    }
+}
+
+constexpr std::array<std::uint32_t, 256> makeCrcTable()
+{
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t n = 0; n < 256; ++n)
+    {
+        std::uint32_t c = n;
+        for (int k = 0; k < 8; ++k)
+        {
+            c = (c & 1u) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}
+
+constexpr std::array<std::uint32_t, 256> CRC_TABLE = makeCrcTable();
+
+std::uint32_t updateCrc32(std::uint32_t crc, const std::span<const std::uint8_t> data)
+{
+    for (const std::uint8_t byte : data)
+    {
+        crc = CRC_TABLE[(crc ^ byte) & 0xffu] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+std::uint32_t updateAdler32(const std::uint32_t adler, const std::span<const std::uint8_t> data)
+{
+    constexpr std::uint32_t MOD_ADLER = 65521;
+    // The sums fit in 32 bits for this many bytes before they need to be reduced.
+    constexpr std::size_t MAX_BLOCK_SIZE = 5552;
+
+    std::uint32_t a = adler & 0xffffu;
+    std::uint32_t b = adler >> 16;
+    for (std::size_t begin = 0; begin < data.size(); begin += MAX_BLOCK_SIZE)
+    {
+        const std::size_t end = std::min(begin + MAX_BLOCK_SIZE, data.size());
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= MOD_ADLER;
+        b %= MOD_ADLER;
+    }
+    return (b << 16) | a;
+}
+
+void appendBigEndian(std::vector<std::uint8_t>& out, const std::uint32_t value)
+{
+    out.push_back(static_cast<std::uint8_t>(value >> 24));
+    out.push_back(static_cast<std::uint8_t>(value >> 16));
+    out.push_back(static_cast<std::uint8_t>(value >> 8));
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+void writeBytes(OutputStream& stream, const std::span<const std::uint8_t> bytes)
+{
+    stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+void writePngChunk(
+    OutputStream&                       stream,
+    const std::string_view              type,
+    const std::span<const std::uint8_t> data)
+{
+    NLRS_ASSERT(type.size() == 4);
+    const auto typeBytes = std::span<const std::uint8_t>(
+        reinterpret_cast<const std::uint8_t*>(type.data()), type.size());
+
+    std::vector<std::uint8_t> header;
+    appendBigEndian(header, static_cast<std::uint32_t>(data.size()));
+    header.insert(header.end(), typeBytes.begin(), typeBytes.end());
+    writeBytes(stream, header);
+    writeBytes(stream, data);
+
+    const std::uint32_t crc = updateCrc32(updateCrc32(0xffffffffu, typeBytes), data) ^ 0xffffffffu;
+    std::vector<std::uint8_t> footer;
+    appendBigEndian(footer, crc);
+    writeBytes(stream, footer);
+}
+
+// IDAT chunks are flushed once they reach this size.
+constexpr std::size_t PNG_CHUNK_SIZE = 1 << 20;
+// The maximum length of an uncompressed deflate block.
+constexpr std::size_t DEFLATE_STORED_BLOCK_SIZE = 65535;
+} // namespace
+
+ImageFormat imageFormatFromPath(const std::filesystem::path& path)
+{
+    if (path.extension() == ".hdr")
+    {
+        return ImageFormat::Hdr;
+    }
+    else if (path.extension() == ".png")
+    {
+        return ImageFormat::Png;
+    }
+    throw std::runtime_error(fmt::format(
+        "Unsupported output image format {}. Expected .hdr or .png.", path.extension().string()));
+}
+
+void writeImage(
+    const std::filesystem::path&     path,
+    const Extent2u&                  imageSize,
+    const std::span<const glm::vec3> estimate,
+    const int                        exposureStops)
+{
+    NLRS_ASSERT(estimate.size() == area(imageSize));
+
+    const int width = static_cast<int>(imageSize.x);
+    const int height = static_cast<int>(imageSize.y);
+
+    int result = 0;
+    switch (imageFormatFromPath(path))
+    {
+    case ImageFormat::Hdr:
+        result = stbi_write_hdr(
+            path.string().c_str(),
+            width,
+            height,
+            3,
+            reinterpret_cast<const float*>(estimate.data()));
+        break;
+    case ImageFormat::Png:
+    {
+        const float               exposure = exposureFromStops(exposureStops);
+        std::vector<std::uint8_t> pixels;
+        pixels.reserve(3 * estimate.size());
+        for (const glm::vec3& radiance : estimate)
+        {
+            const auto srgb = tonemapToSrgb(radiance, exposure);
+            pixels.insert(pixels.end(), srgb.begin(), srgb.end());
+        }
+        result = stbi_write_png(path.string().c_str(), width, height, 3, pixels.data(), 3 * width);
+        break;
+    }
+    }
+
+    if (result == 0)
+    {
+        throw std::runtime_error(fmt::format("Failed to write image {}.", path.string()));
+    }
+}
+
+ScanlineImageWriter::ScanlineImageWriter(
+    OutputStream&     stream,
+    const ImageFormat format,
+    const Extent2u&   imageSize,
+    const int         exposureStops)
+    : mStream(stream),
+      mFormat(format),
+      mImageSize(imageSize),
+      mExposure(exposureFromStops(exposureStops)),
+      mNumRowsWritten(0),
+      mAdler32(1),
+      mBuffer()
+{
+    NLRS_ASSERT(area(imageSize) > 0);
+
+    switch (mFormat)
+    {
+    case ImageFormat::Hdr:
+    {
+        const std::string header = fmt::format(
+            "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y {} +X {}\n", mImageSize.y, mImageSize.x);
+        mStream.write(header.data(), header.size());
+        break;
+    }
+    case ImageFormat::Png:
+    {
+        constexpr std::array<std::uint8_t, 8> signature = {
+            0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        writeBytes(mStream, signature);
+
+        std::vector<std::uint8_t> ihdr;
+        appendBigEndian(ihdr, mImageSize.x);
+        appendBigEndian(ihdr, mImageSize.y);
+        // 8 bits per channel, RGB, default compression and filter methods, no interlacing.
+        ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});
+        writePngChunk(mStream, "IHDR", ihdr);
+
+        // The zlib stream header: deflate with a 32K window, no preset dictionary.
+        mBuffer.insert(mBuffer.end(), {0x78, 0x01});
+        break;
+    }
+    }
+}
+
+void ScanlineImageWriter::writeRows(const std::span<const glm::vec3> rows)
+{
+    NLRS_ASSERT(rows.size() % mImageSize.x == 0);
+    const std::size_t numRows = rows.size() / mImageSize.x;
+    NLRS_ASSERT(mNumRowsWritten + numRows <= mImageSize.y);
+
+    for (std::size_t rowIdx = 0; rowIdx < numRows; ++rowIdx)
+    {
+        const auto row = rows.subspan(rowIdx * mImageSize.x, mImageSize.x);
+        switch (mFormat)
+        {
+        case ImageFormat::Hdr:
+            writeHdrRow(row);
+            break;
+        case ImageFormat::Png:
+            writePngRow(row);
+            break;
+        }
+        ++mNumRowsWritten;
+    }
+
+    if (mFormat == ImageFormat::Png)
+    {
+        flushPngData();
+    }
+}
+
+void ScanlineImageWriter::finish()
+{
+    if (mNumRowsWritten != mImageSize.y)
+    {
+        throw std::runtime_error(fmt::format(
+            "Image is incomplete: {} of {} rows were written.", mNumRowsWritten, mImageSize.y));
+    }
+
+    if (mFormat == ImageFormat::Png)
+    {
+        // An empty final block ends the deflate stream, followed by the zlib checksum.
+        mBuffer.insert(mBuffer.end(), {0x01, 0x00, 0x00, 0xff, 0xff});
+        appendBigEndian(mBuffer, mAdler32);
+        flushPngData();
+        writePngChunk(mStream, "IEND", {});
+    }
+}
+
+void ScanlineImageWriter::writeHdrRow(const std::span<const glm::vec3> row)
+{
+    mBuffer.clear();
+
+    // Run-length encoding is only defined for scanlines of 8 to 32767 pixels.
+    const std::uint32_t width = mImageSize.x;
+    if (width < 8 || width > 0x7fff)
+    {
+        for (const glm::vec3& radiance : row)
+        {
+            const auto rgbe = toRgbe(radiance);
+            mBuffer.insert(mBuffer.end(), rgbe.begin(), rgbe.end());
+        }
+    }
+    else
+    {
+        std::array<std::vector<std::uint8_t>, 4> channels;
+        for (auto& channel : channels)
+        {
+            channel.reserve(width);
+        }
+        for (const glm::vec3& radiance : row)
+        {
+            const auto rgbe = toRgbe(radiance);
+            for (std::size_t c = 0; c < 4; ++c)
+            {
+                channels[c].push_back(rgbe[c]);
+            }
+        }
+
+        mBuffer.insert(
+            mBuffer.end(),
+            {2, 2, static_cast<std::uint8_t>(width >> 8), static_cast<std::uint8_t>(width & 0xff)});
+        for (const auto& channel : channels)
+        {
+            appendRunLengthEncoded(mBuffer, channel);
+        }
+    }
+
+    writeBytes(mStream, mBuffer);
+}
+
+void ScanlineImageWriter::writePngRow(const std::span<const glm::vec3> row)
+{
+    // Each row starts with its filter type, which is 0 for no filtering.
+    std::vector<std::uint8_t> rowBytes;
+    rowBytes.reserve(1 + 3 * row.size());
+    rowBytes.push_back(0);
+    for (const glm::vec3& radiance : row)
+    {
+        const auto srgb = tonemapToSrgb(radiance, mExposure);
+        rowBytes.insert(rowBytes.end(), srgb.begin(), srgb.end());
+    }
+    mAdler32 = updateAdler32(mAdler32, rowBytes);
+
+    for (std::size_t begin = 0; begin < rowBytes.size(); begin += DEFLATE_STORED_BLOCK_SIZE)
+    {
+        const std::size_t   end = std::min(begin + DEFLATE_STORED_BLOCK_SIZE, rowBytes.size());
+        const std::uint16_t length = static_cast<std::uint16_t>(end - begin);
+        const std::uint16_t lengthComplement = static_cast<std::uint16_t>(~length);
+        mBuffer.insert(
+            mBuffer.end(),
+            {0x00,
+             static_cast<std::uint8_t>(length & 0xff),
+             static_cast<std::uint8_t>(length >> 8),
+             static_cast<std::uint8_t>(lengthComplement & 0xff),
+             static_cast<std::uint8_t>(lengthComplement >> 8)});
+        mBuffer.insert(mBuffer.end(), rowBytes.begin() + begin, rowBytes.begin() + end);
+    }
+
+    if (mBuffer.size() >= PNG_CHUNK_SIZE)
+    {
+        flushPngData();
+    }
+}
+
+void ScanlineImageWriter::flushPngData()
+{
+    if (!mBuffer.empty())
+    {
+        writePngChunk(mStream, "IDAT", mBuffer);
+        mBuffer.clear();
+    }
+}
+} // namespace nlrs
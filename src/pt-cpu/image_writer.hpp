@@ -0,0 +1,71 @@
+#pragma once
+
+#include <common/extent.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace nlrs
+{
+class OutputStream;
+
+// Radiance HDR (.hdr) stores the radiance as is, and PNG (.png) stores it tonemapped with the same
+// curve as the reference path tracer.
+enum class ImageFormat
+{
+    Hdr,
+    Png,
+};
+
+// Chooses the format by the file extension. Throws for unsupported extensions.
+ImageFormat imageFormatFromPath(const std::filesystem::path& path);
+
+// Writes `estimate`, the radiance of each pixel in row-major order, to an image file.
+void writeImage(
+    const std::filesystem::path& path,
+    const Extent2u&              imageSize,
+    std::span<const glm::vec3>   estimate,
+    int                          exposureStops);
+
+// Writes an image a few rows at a time, so that the whole image never has to be in memory. HDR
+// scanlines are run-length encoded as usual. PNG data is written in uncompressed deflate blocks,
+// since stb_image_write can only compress whole images.
+class ScanlineImageWriter
+{
+public:
+    ScanlineImageWriter(
+        OutputStream&   stream,
+        ImageFormat     format,
+        const Extent2u& imageSize,
+        int             exposureStops);
+
+    ScanlineImageWriter(const ScanlineImageWriter&) = delete;
+    ScanlineImageWriter& operator=(const ScanlineImageWriter&) = delete;
+
+    // Appends the next rows of the image. `rows` contains the radiance of one or more whole rows in
+    // row-major order.
+    void writeRows(std::span<const glm::vec3> rows);
+
+    // Writes the end of the file. Throws if fewer rows than the image height have been written.
+    void finish();
+
+    std::uint32_t numRowsWritten() const noexcept { return mNumRowsWritten; }
+
+private:
+    void writeHdrRow(std::span<const glm::vec3> row);
+    void writePngRow(std::span<const glm::vec3> row);
+    void flushPngData();
+
+    OutputStream&             mStream;
+    ImageFormat               mFormat;
+    Extent2u                  mImageSize;
+    float                     mExposure;
+    std::uint32_t             mNumRowsWritten;
+    std::uint32_t             mAdler32;
+    std::vector<std::uint8_t> mBuffer;
+};
+} // namespace nlrs
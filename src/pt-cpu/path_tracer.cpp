@@ -0,0 +1,460 @@
+#include "accumulation.hpp"
+#include "path_tracer.hpp"
+
+#include <common/assert.hpp>
+#include <common/ray.hpp>
+#include <common/ray_intersection.hpp>
+#include <common/virtual_texture.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+namespace nlrs
+{
+namespace
+{
+constexpr float PI = std::numbers::pi_v<float>;
+constexpr float FRAC_1_PI = std::numbers::inv_pi_v<float>;
+
+constexpr float T_MAX = 10000.0f;
+
+constexpr float DEGREES_TO_RADIANS = PI / 180.0f;
+constexpr float TERRESTRIAL_SOLAR_RADIUS = 0.255f * DEGREES_TO_RADIANS;
+
+const float SOLAR_COS_THETA_MAX = std::cos(TERRESTRIAL_SOLAR_RADIUS);
+const float SOLAR_INV_PDF = 2.0f * PI * (1.0f - SOLAR_COS_THETA_MAX);
+
+glm::mat3 pixarOnb(const glm::vec3& n)
+{
+    // https://www.jcgt.org/published/0006/01/01/paper-lowres.pdf
+    const float     s = n.z >= 0.0f ? 1.0f : -1.0f;
+    const float     a = -1.0f / (s + n.z);
+    const float     b = n.x * n.y * a;
+    const glm::vec3 u = glm::vec3(1.0f + s * n.x * n.x * a, s * b, -s * n.x);
+    const glm::vec3 v = glm::vec3(b, s + n.y * n.y * a, -n.y);
+
+    return glm::mat3(u, v, n);
+}
+
+// `u` and `v` are random numbers in [0, 1].
+glm::vec3 directionInCone(const float u, const float v, const float cosThetaMax)
+{
+    const float cosTheta = 1.0f - u * (1.0f - cosThetaMax);
+    const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+    const float phi = 2.0f * PI * v;
+
+    return glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+}
+
+// `u` and `v` are random numbers in [0, 1].
+glm::vec3 directionInCosineWeightedHemisphere(const float u, const float v)
+{
+    const float phi = 2.0f * PI * v;
+    const float sinTheta = std::sqrt(1.0f - u);
+
+    return glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, std::sqrt(u));
+}
+
+// `u` and `v` are random numbers in [0, 1].
+glm::vec2 pointInUnitDisk(const float u, const float v)
+{
+    const float r = std::sqrt(u);
+    const float theta = 2.0f * PI * v;
+    return glm::vec2(r * std::cos(theta), r * std::sin(theta));
+}
+
+// The angle subtended by a pixel at the camera, by which the width of a ray cone through the pixel
+// grows per unit of distance.
+float pixelSpreadAngle(const Camera& camera, const Extent2u& framebufferSize)
+{
+    const glm::vec3 focusPlaneCenter =
+        camera.lowerLeftCorner + 0.5f * camera.horizontal + 0.5f * camera.vertical;
+    return glm::length(camera.vertical) /
+           (static_cast<float>(framebufferSize.y) * glm::length(focusPlaneCenter - camera.origin));
+}
+} // namespace
+
+float rayConeTextureLod(
+    const Positions&          positions,
+    const VertexAttributes&   attributes,
+    const Texture::Dimensions textureDimensions,
+    const glm::vec3&          rayDirection,
+    const float               coneWidth)
+{
+    const glm::vec3 normal = glm::cross(positions.v1 - positions.v0, positions.v2 - positions.v0);
+    const glm::vec2 duv1 = attributes.uv1 - attributes.uv0;
+    const glm::vec2 duv2 = attributes.uv2 - attributes.uv0;
+
+    const float worldArea = glm::length(normal);
+    const float texelArea = std::abs(duv1.x * duv2.y - duv2.x * duv1.y) *
+                            static_cast<float>(textureDimensions.width) *
+                            static_cast<float>(textureDimensions.height);
+    const float cosTheta = worldArea > 0.0f ? std::abs(glm::dot(normal, rayDirection)) / worldArea
+                                            : 0.0f;
+    if (coneWidth <= 0.0f || texelArea <= 0.0f || cosTheta <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    // The cone's footprint grows as the ray grazes the triangle, and the triangle's texel density
+    // is the ratio of its area in texels to its area in world space.
+    return std::log2(coneWidth) + 0.5f * std::log2(texelArea / worldArea) - std::log2(cosTheta);
+}
+
+float russianRouletteSurvivalProbability(const glm::vec3& throughput)
+{
+    return std::clamp(std::max(throughput.r, std::max(throughput.g, throughput.b)), 0.05f, 0.95f);
+}
+
+CpuPathTracer::CpuPathTracer(const CpuScene scene, const Sky& sky)
+    : mScene(scene),
+      mSkyState(),
+      mSunDirection(sunDirection(sky))
+{
+    const float      sunZenith = Angle::degrees(sky.sunZenithDegrees).asRadians();
+    const sky_params skyParams{
+        .elevation = 0.5f * PI - sunZenith,
+        .turbidity = sky.turbidity,
+        .albedo = {sky.albedo[0], sky.albedo[1], sky.albedo[2]}};
+    NLRS_ASSERT(sky_state_new(&skyParams, &mSkyState) == sky_state_result_success);
+}
+
+glm::vec3 CpuPathTracer::rayColor(
+    const Ray&            primaryRay,
+    const SamplingParams& samplingParams,
+    Rng&                  rng) const
+{
+    return rayColor(primaryRay, 0.0f, samplingParams, rng);
+}
+
+glm::vec3 CpuPathTracer::rayColor(
+    const Ray&            primaryRay,
+    const float           spreadAngle,
+    const SamplingParams& samplingParams,
+    Rng&                  rng) const
+{
+    Ray       ray = primaryRay;
+    glm::vec3 radiance = glm::vec3(0.0f);
+    glm::vec3 throughput = glm::vec3(1.0f);
+    // The distance travelled along the path, which determines the width of the ray cone. The
+    // spread angle of the cone is not widened by the bounces.
+    float     pathLength = 0.0f;
+
+    const glm::vec3 solarRadiance = glm::vec3(
+        mSkyState.solar_radiances[channel_r],
+        mSkyState.solar_radiances[channel_g],
+        mSkyState.solar_radiances[channel_b]);
+
+    for (std::uint32_t bounce = 1;; ++bounce)
+    {
+        Intersection hit;
+        if (!rayIntersectBvh(ray, mScene.bvhNodes, mScene.positions, T_MAX, hit))
+        {
+            radiance += throughput * skyRadiance(ray.direction);
+            break;
+        }
+
+        pathLength += hit.t;
+
+        const VertexAttributes& vert = mScene.vertexAttributes[hit.triangleIdx];
+        const glm::vec3         n =
+            glm::normalize(hit.b[0] * vert.n0 + hit.b[1] * vert.n1 + hit.b[2] * vert.n2);
+        const glm::vec2 uv = hit.b[0] * vert.uv0 + hit.b[1] * vert.uv1 + hit.b[2] * vert.uv2;
+        const float     lod = textureLod(hit.triangleIdx, ray.direction, spreadAngle * pathLength);
+        const glm::vec3 albedo = evalTexture(vert.textureIdx, uv, lod);
+        const glm::vec3 p = hit.p;
+
+        {
+            const float     u = rng.nextFloat();
+            const float     v = rng.nextFloat();
+            const glm::vec3 lightDirection =
+                pixarOnb(mSunDirection) * directionInCone(u, v, SOLAR_COS_THETA_MAX);
+            const float cosTheta = glm::dot(n, lightDirection);
+            if (cosTheta > 0.0f)
+            {
+                Intersection shadowHit;
+                if (!rayIntersectBvh(
+                        Ray{p, lightDirection},
+                        mScene.bvhNodes,
+                        mScene.positions,
+                        T_MAX,
+                        shadowHit))
+                {
+                    const glm::vec3 brdf = albedo * FRAC_1_PI;
+                    radiance += throughput * solarRadiance * brdf * cosTheta * SOLAR_INV_PDF;
+                }
+            }
+        }
+
+        if (bounce >= samplingParams.numBounces)
+        {
+            break;
+        }
+
+        {
+            const float     u = rng.nextFloat();
+            const float     v = rng.nextFloat();
+            const glm::vec3 wi = pixarOnb(n) * directionInCosineWeightedHemisphere(u, v);
+            ray = Ray{p, wi};
+            throughput *= albedo;
+        }
+
+        if (samplingParams.russianRoulette && bounce >= samplingParams.minBounces)
+        {
+            const float survivalProbability = russianRouletteSurvivalProbability(throughput);
+            if (rng.nextFloat() >= survivalProbability)
+            {
+                break;
+            }
+            throughput /= survivalProbability;
+        }
+    }
+
+    return radiance;
+}
+
+glm::vec3 CpuPathTracer::samplePixel(
+    const Camera&         camera,
+    const Extent2u&       framebufferSize,
+    const std::uint32_t   x,
+    const std::uint32_t   y,
+    const std::uint32_t   sampleIdx,
+    const SamplingParams& samplingParams) const
+{
+    NLRS_ASSERT(x < framebufferSize.x);
+    NLRS_ASSERT(y < framebufferSize.y);
+
+    Rng rng = Rng::forSample(y * framebufferSize.x + x, sampleIdx);
+
+    const float u =
+        (static_cast<float>(x) + rng.nextFloat()) / static_cast<float>(framebufferSize.x);
+    const float v =
+        1.0f - (static_cast<float>(y) + rng.nextFloat()) / static_cast<float>(framebufferSize.y);
+
+    const glm::vec2 pointInLens =
+        camera.lensRadius * pointInUnitDisk(rng.nextFloat(), rng.nextFloat());
+    const glm::vec3 lensOffset = pointInLens.x * camera.right + pointInLens.y * camera.up;
+
+    const glm::vec3 origin = camera.origin + lensOffset;
+    const glm::vec3 direction = glm::normalize(
+        camera.lowerLeftCorner + u * camera.horizontal + v * camera.vertical - origin);
+
+    return rayColor(
+        Ray{origin, direction}, pixelSpreadAngle(camera, framebufferSize), samplingParams, rng);
+}
+
+PixelFeatures CpuPathTracer::pixelFeatures(
+    const Camera&       camera,
+    const Extent2u&     framebufferSize,
+    const std::uint32_t x,
+    const std::uint32_t y) const
+{
+    PixelFeatures features;
+    if (const std::optional<TextureLookup> lookup =
+            pixelSurface(camera, framebufferSize, x, y, features))
+    {
+        features.albedo = evalTexture(lookup->textureIdx, lookup->uv, lookup->lod);
+    }
+    return features;
+}
+
+void CpuPathTracer::pixelFeatures(
+    const Camera&                  camera,
+    const Extent2u&                framebufferSize,
+    const std::uint32_t            y,
+    const std::span<PixelFeatures> row) const
+{
+    NLRS_ASSERT(row.size() == framebufferSize.x);
+    if (mScene.virtualBaseColorTextures != nullptr)
+    {
+        for (std::uint32_t x = 0; x < framebufferSize.x; ++x)
+        {
+            row[x] = pixelFeatures(camera, framebufferSize, x, y);
+        }
+        return;
+    }
+
+    TextureSampleBatch                                  batch;
+    std::array<std::uint32_t, TEXTURE_SAMPLE_BATCH_SIZE> batchPixels;
+    std::size_t                                         batchSize = 0;
+    const auto                                          sampleBatch = [&]() -> void {
+        // The unused lanes of the last batch repeat the first lookup.
+        for (std::size_t lane = batchSize; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+        {
+            batch.textureIndices[lane] = batch.textureIndices[0];
+            batch.u[lane] = batch.u[0];
+            batch.v[lane] = batch.v[0];
+            batch.lod[lane] = batch.lod[0];
+        }
+        const LinearColorBatch colors =
+            sampleTextureBatch(mScene.baseColorTextures, batch, mScene.baseColorSampler);
+        for (std::size_t lane = 0; lane < batchSize; ++lane)
+        {
+            row[batchPixels[lane]].albedo =
+                glm::vec3(colors.r[lane], colors.g[lane], colors.b[lane]);
+        }
+        batchSize = 0;
+    };
+
+    for (std::uint32_t x = 0; x < framebufferSize.x; ++x)
+    {
+        if (const std::optional<TextureLookup> lookup =
+                pixelSurface(camera, framebufferSize, x, y, row[x]))
+        {
+            NLRS_ASSERT(lookup->textureIdx < mScene.baseColorTextures.size());
+            batch.textureIndices[batchSize] = lookup->textureIdx;
+            batch.u[batchSize] = lookup->uv.x;
+            batch.v[batchSize] = lookup->uv.y;
+            batch.lod[batchSize] = lookup->lod;
+            batchPixels[batchSize] = x;
+            if (++batchSize == TEXTURE_SAMPLE_BATCH_SIZE)
+            {
+                sampleBatch();
+            }
+        }
+    }
+    if (batchSize > 0)
+    {
+        sampleBatch();
+    }
+}
+
+std::optional<CpuPathTracer::TextureLookup> CpuPathTracer::pixelSurface(
+    const Camera&       camera,
+    const Extent2u&     framebufferSize,
+    const std::uint32_t x,
+    const std::uint32_t y,
+    PixelFeatures&      features) const
+{
+    NLRS_ASSERT(x < framebufferSize.x);
+    NLRS_ASSERT(y < framebufferSize.y);
+
+    const float u = (static_cast<float>(x) + 0.5f) / static_cast<float>(framebufferSize.x);
+    const float v = 1.0f - (static_cast<float>(y) + 0.5f) / static_cast<float>(framebufferSize.y);
+    const Ray   ray{
+        camera.origin,
+        glm::normalize(
+            camera.lowerLeftCorner + u * camera.horizontal + v * camera.vertical - camera.origin)};
+
+    Intersection hit;
+    if (!rayIntersectBvh(ray, mScene.bvhNodes, mScene.positions, T_MAX, hit))
+    {
+        features = PixelFeatures{
+            .albedo = glm::vec3(1.0f),
+            .normal = glm::vec3(0.0f),
+            .depth = std::numeric_limits<float>::infinity()};
+        return std::nullopt;
+    }
+
+    const VertexAttributes& vert = mScene.vertexAttributes[hit.triangleIdx];
+    const glm::vec3         n =
+        glm::normalize(hit.b[0] * vert.n0 + hit.b[1] * vert.n1 + hit.b[2] * vert.n2);
+    const glm::vec2 uv = hit.b[0] * vert.uv0 + hit.b[1] * vert.uv1 + hit.b[2] * vert.uv2;
+    const float     lod = textureLod(
+        hit.triangleIdx, ray.direction, pixelSpreadAngle(camera, framebufferSize) * hit.t);
+    features = PixelFeatures{.albedo = glm::vec3(0.0f), .normal = n, .depth = hit.t};
+    return TextureLookup{.textureIdx = vert.textureIdx, .uv = uv, .lod = lod};
+}
+
+void CpuPathTracer::accumulateTile(
+    const Camera&         camera,
+    const Extent2u&       framebufferSize,
+    const SamplingParams& samplingParams,
+    const TileBounds&     bounds,
+    const std::uint32_t   numSamples,
+    TileAccumulation&     tile) const
+{
+    NLRS_ASSERT(tile.radianceSums.size() == area(bounds.size));
+
+    for (std::uint32_t i = 0; i < numSamples; ++i)
+    {
+        const std::uint32_t sampleIdx = tile.sampleBegin + tile.sampleCount;
+        for (std::uint32_t y = 0; y < bounds.size.y; ++y)
+        {
+            for (std::uint32_t x = 0; x < bounds.size.x; ++x)
+            {
+                tile.radianceSums[y * bounds.size.x + x] += samplePixel(
+                    camera,
+                    framebufferSize,
+                    bounds.origin.x + x,
+                    bounds.origin.y + y,
+                    sampleIdx,
+                    samplingParams);
+            }
+        }
+        ++tile.sampleCount;
+    }
+}
+
+void CpuPathTracer::accumulateTile(
+    const Camera&         camera,
+    const SamplingParams& samplingParams,
+    const std::uint32_t   tileIdx,
+    const std::uint32_t   numSamples,
+    Accumulation&         accumulation) const
+{
+    TileAccumulation tile = accumulation.tile(tileIdx);
+    accumulateTile(
+        camera,
+        accumulation.imageSize(),
+        samplingParams,
+        accumulation.tileBounds(tileIdx),
+        numSamples,
+        tile);
+    accumulation.setTile(tileIdx, tile);
+}
+
+glm::vec3 CpuPathTracer::skyRadiance(const glm::vec3& direction) const
+{
+    const float theta = std::acos(direction.y);
+    const float gamma = std::acos(std::clamp(glm::dot(direction, mSunDirection), -1.0f, 1.0f));
+
+    return glm::vec3(
+        sky_state_radiance(&mSkyState, theta, gamma, channel_r),
+        sky_state_radiance(&mSkyState, theta, gamma, channel_g),
+        sky_state_radiance(&mSkyState, theta, gamma, channel_b));
+}
+
+float CpuPathTracer::textureLod(
+    const std::uint32_t triangleIdx,
+    const glm::vec3&    direction,
+    const float         width) const
+{
+    const VertexAttributes& vert = mScene.vertexAttributes[triangleIdx];
+    if (mScene.virtualBaseColorTextures != nullptr)
+    {
+        NLRS_ASSERT(vert.textureIdx < mScene.virtualBaseColorTextures->numTextures());
+        return rayConeTextureLod(
+            mScene.positions[triangleIdx],
+            vert,
+            mScene.virtualBaseColorTextures->dimensions(vert.textureIdx),
+            direction,
+            width);
+    }
+    NLRS_ASSERT(vert.textureIdx < mScene.baseColorTextures.size());
+    return rayConeTextureLod(
+        mScene.positions[triangleIdx],
+        vert,
+        mScene.baseColorTextures[vert.textureIdx].dimensions(),
+        direction,
+        width);
+}
+
+glm::vec3 CpuPathTracer::evalTexture(
+    const std::uint32_t textureIdx,
+    const glm::vec2&    uv,
+    const float         lod) const
+{
+    if (mScene.virtualBaseColorTextures != nullptr)
+    {
+        NLRS_ASSERT(textureIdx < mScene.virtualBaseColorTextures->numTextures());
+        return decodeTexel(mScene.virtualBaseColorTextures->sample(textureIdx, uv, lod));
+    }
+    NLRS_ASSERT(textureIdx < mScene.baseColorTextures.size());
+    return sampleTexture(mScene.baseColorTextures[textureIdx], uv, lod, mScene.baseColorSampler);
+}
+} // namespace nlrs
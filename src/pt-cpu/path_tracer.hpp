@@ -0,0 +1,157 @@
+#pragma once
+
+#include "rng.hpp"
+
+#include <common/bvh.hpp>
+#include <common/camera.hpp>
+#include <common/extent.hpp>
+#include <common/sampling_params.hpp>
+#include <common/sky.hpp>
+#include <common/texture.hpp>
+#include <common/texture_sampling.hpp>
+#include <common/triangle_attributes.hpp>
+#include <pt-format/vertex_attributes.hpp>
+
+#include <glm/glm.hpp>
+#include <hw-skymodel/hw_skymodel.h>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace nlrs
+{
+class Accumulation;
+class VirtualTextureCache;
+struct Ray;
+struct TileAccumulation;
+struct TileBounds;
+
+struct CpuScene
+{
+    std::span<const BvhNode>          bvhNodes;
+    std::span<const Positions>        positions;
+    std::span<const VertexAttributes> vertexAttributes;
+    std::span<const Texture>          baseColorTextures;
+    // If not null, the base color textures are sampled through the cache instead of
+    // `baseColorTextures`, e.g. for a .pt file with paged textures.
+    const VirtualTextureCache*        virtualBaseColorTextures = nullptr;
+    // How `baseColorTextures` are filtered. Virtual textures are always sampled with
+    // TextureFilter::Nearest and TextureWrap::Repeat.
+    TextureSampler                    baseColorSampler = {};
+};
+
+// The surface seen through the center of a pixel. Used as edge-stopping features by the denoiser.
+// Pixels which see the sky have an albedo of one, a zero normal and an infinite depth.
+struct PixelFeatures
+{
+    glm::vec3 albedo;
+    glm::vec3 normal;
+    float     depth;
+};
+
+// A CPU implementation of the estimator in reference_path_tracer.wgsl. Random numbers are drawn
+// from an `Rng` instead of the blue noise texture, which makes each sample reproducible from its
+// pixel and sample index.
+class CpuPathTracer
+{
+public:
+    CpuPathTracer(CpuScene, const Sky&);
+
+    // Returns the radiance arriving along `primaryRay`. Textures are sampled at mip level 0.
+    glm::vec3 rayColor(const Ray& primaryRay, const SamplingParams&, Rng&) const;
+
+    // Returns the radiance arriving along a ray cone around `primaryRay`, whose width grows by
+    // `spreadAngle` per unit of distance travelled. Textures are sampled at the mip level which
+    // matches the width of the cone where it hits a surface.
+    glm::vec3 rayColor(
+        const Ray&            primaryRay,
+        float                 spreadAngle,
+        const SamplingParams& samplingParams,
+        Rng&                  rng) const;
+
+    // Returns the radiance of sample `sampleIdx` of pixel (`x`, `y`). Pixel (0, 0) is the upper
+    // left corner of the framebuffer.
+    glm::vec3 samplePixel(
+        const Camera&         camera,
+        const Extent2u&       framebufferSize,
+        std::uint32_t         x,
+        std::uint32_t         y,
+        std::uint32_t         sampleIdx,
+        const SamplingParams& samplingParams) const;
+
+    PixelFeatures pixelFeatures(
+        const Camera&   camera,
+        const Extent2u& framebufferSize,
+        std::uint32_t   x,
+        std::uint32_t   y) const;
+
+    // The features of each pixel of row `y`. Unless the textures are virtual, the albedos of the
+    // row are sampled TEXTURE_SAMPLE_BATCH_SIZE at a time with sampleTextureBatch.
+    void pixelFeatures(
+        const Camera&            camera,
+        const Extent2u&          framebufferSize,
+        std::uint32_t            y,
+        std::span<PixelFeatures> row) const;
+
+    // Renders the next `numSamples` samples of each pixel of the tile, starting from the tile's
+    // current sample end, and adds them to `tile`. Samples are added one sample index at a time, so
+    // the sums do not depend on how the samples of a tile are split between calls.
+    void accumulateTile(
+        const Camera&         camera,
+        const Extent2u&       framebufferSize,
+        const SamplingParams& samplingParams,
+        const TileBounds&     bounds,
+        std::uint32_t         numSamples,
+        TileAccumulation&     tile) const;
+
+    void accumulateTile(
+        const Camera&         camera,
+        const SamplingParams& samplingParams,
+        std::uint32_t         tileIdx,
+        std::uint32_t         numSamples,
+        Accumulation&         accumulation) const;
+
+private:
+    struct TextureLookup
+    {
+        std::uint32_t textureIdx;
+        glm::vec2     uv;
+        float         lod;
+    };
+
+    // Fills in the features of pixel (x, y), except for the albedo of the surface which the pixel
+    // sees, and returns the lookup of the albedo. Returns nullopt for pixels which see the sky,
+    // whose features are complete.
+    std::optional<TextureLookup> pixelSurface(
+        const Camera&   camera,
+        const Extent2u& framebufferSize,
+        std::uint32_t   x,
+        std::uint32_t   y,
+        PixelFeatures&  features) const;
+
+    glm::vec3 skyRadiance(const glm::vec3& direction) const;
+    float     textureLod(std::uint32_t triangleIdx, const glm::vec3& direction, float width) const;
+    // Samples the nearest pixel of the mip level nearest to `lod`.
+    glm::vec3 evalTexture(std::uint32_t textureIdx, const glm::vec2& uv, float lod) const;
+
+    CpuScene  mScene;
+    sky_state mSkyState;
+    glm::vec3 mSunDirection;
+};
+
+// The texture level of detail at which a ray cone of width `coneWidth` travelling along
+// `rayDirection` samples a texture of `textureDimensions` on a triangle, following "Texture Level
+// of Detail Strategies for Real-Time Ray Tracing" by Akenine-Möller et al. Level 0 is sampled by
+// cones of zero width, and on triangles without area in world or texture space.
+float rayConeTextureLod(
+    const Positions&        positions,
+    const VertexAttributes& attributes,
+    Texture::Dimensions     textureDimensions,
+    const glm::vec3&        rayDirection,
+    float                   coneWidth);
+
+// The path survives with a probability proportional to its throughput, clamped so that dim paths
+// still have a chance of surviving and bright paths a chance of being terminated.
+float russianRouletteSurvivalProbability(const glm::vec3& throughput);
+} // namespace nlrs
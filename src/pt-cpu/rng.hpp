@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+namespace nlrs
+{
+// A small PCG random number generator. The sequence is fully determined by the seed, so that
+// samples can be reproduced given the pixel and sample index alone.
+class Rng
+{
+public:
+    explicit Rng(const std::uint32_t seed)
+        : mState(seed)
+    {
+    }
+
+    // Seeding adapted from https://github.com/boksajak/referencePT
+    static Rng forSample(const std::uint32_t pixelIdx, const std::uint32_t sampleIdx)
+    {
+        return Rng(jenkinsHash(pixelIdx ^ jenkinsHash(sampleIdx)));
+    }
+
+    std::uint32_t nextUint()
+    {
+        // PCG hash, "Hash Functions for GPU Rendering", Jarzynski & Olano
+        mState = mState * 747796405u + 2891336453u;
+        const std::uint32_t word = ((mState >> ((mState >> 28u) + 4u)) ^ mState) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    // Returns a random number in [0, 1).
+    float nextFloat() { return static_cast<float>(nextUint() >> 8) / 16777216.0f; }
+
+private:
+    static std::uint32_t jenkinsHash(std::uint32_t x)
+    {
+        x += x << 10;
+        x ^= x >> 6;
+        x += x << 3;
+        x ^= x >> 11;
+        x += x << 15;
+        return x;
+    }
+
+    std::uint32_t mState;
+};
+} // namespace nlrs
@@ -1,37 +1,272 @@
-#include <common/file_stream.hpp>
+#include <common/gltf_model.hpp>
+#include <pt-format/batch_conversion.hpp>
+#include <pt-format/conversion_cache.hpp>
 #include <pt-format/pt_format.hpp>
 
 #include <fmt/core.h>
 
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
 #include <exception>
 #include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace fs = std::filesystem;
 using namespace nlrs;
 
-void printHelp() { std::printf("Usage:\n\tpt-format-tool <input_gltf_file>\n"); }
+void printHelp()
+{
+    std::printf(
+        "Usage:\n\tpt-format-tool [options] <input>...\n\n"
+        "Each input is a glTF file, or a directory which is searched recursively for glTF files.\n"
+        "Each file is converted to a .pt file next to it.\n\n"
+        "Options:\n"
+        "\t--compress lossless\tCompress the geometry. Decodes to identical data.\n"
+        "\t--compress lossy\tAlso quantize normals and texture coordinates.\n"
+        "\t--cache-dir <dir>\tReuse the BVH and decoded textures of previous conversions.\n"
+        "\t--direct-io\t\tWrite the .pt files past the page cache.\n"
+        "\t--force\t\t\tConvert the files even if the .pt files are up to date.\n"
+        "\t--glob <pattern>\tFiles to convert in directories, may be repeated\n"
+        "\t\t\t\t(default *.gltf and *.glb).\n"
+        "\t--jobs <n>\t\tConcurrent conversions (default: number of hardware threads).\n"
+        "\t--memory-budget <MiB>\tLimit on the estimated memory of concurrent conversions\n"
+        "\t\t\t\t(default 8192).\n"
+        "\t--texture-cache <MiB>\tKeep the decoded images which the files share in memory,\n"
+        "\t\t\t\tso that each is decoded once (default 1024, 0 disables).\n"
+        "\t--texture-compression none|bc1|bc7\n"
+        "\t\t\t\tBlock compress the textures (default none). BC1 stores 4\n"
+        "\t\t\t\tbits per texel without alpha, BC7 8 bits per texel.\n"
+        "\t--texture-quality fast|high\n"
+        "\t\t\t\tHow closely the blocks are fit to the textures (default fast).\n"
+        "\t--virtual-textures\tSplit the textures into pages, which pt-render streams in on\n"
+        "\t\t\t\tdemand, for scenes whose textures do not fit in memory.\n");
+}
+
+std::string_view statusName(const ConversionStatus status)
+{
+    switch (status)
+    {
+    case ConversionStatus::Converted:
+        return "converted";
+    case ConversionStatus::UpToDate:
+        return "up to date";
+    case ConversionStatus::Failed:
+        return "failed";
+    }
+    return "unknown";
+}
+
+double megabytes(const std::uint64_t numBytes)
+{
+    return static_cast<double>(numBytes) / (1024.0 * 1024.0);
+}
 
 int main(int argc, char** argv)
 try
 {
-    if (argc != 2)
+    if (argc < 2)
     {
         printHelp();
         return 0;
     }
 
-    fs::path path = argv[1];
-    if (!fs::exists(path))
+    BatchOptions                   options;
+    std::optional<ConversionCache> cache;
+    std::vector<std::string>       patterns;
+    std::vector<fs::path>          inputs;
+    for (int i = 1; i < argc; ++i)
     {
-        fmt::print(stderr, "File {} does not exist\n", path.string());
+        const std::string_view option = argv[i];
+        const bool             hasValue = i + 1 < argc;
+        if (!option.starts_with("--"))
+        {
+            inputs.emplace_back(option);
+        }
+        else if (option == "--compress" && hasValue)
+        {
+            const std::string_view mode = argv[++i];
+            if (mode == "lossless")
+            {
+                options.conversion.compression = GeometryCompression::Lossless;
+            }
+            else if (mode == "lossy")
+            {
+                options.conversion.compression = GeometryCompression::Lossy;
+            }
+            else
+            {
+                fmt::print(stderr, "Unknown compression mode {}\n", mode);
+                return 1;
+            }
+        }
+        else if (option == "--cache-dir" && hasValue)
+        {
+            cache.emplace(argv[++i]);
+        }
+        else if (option == "--direct-io")
+        {
+            options.conversion.directIo = true;
+        }
+        else if (option == "--force")
+        {
+            options.force = true;
+        }
+        else if (option == "--glob" && hasValue)
+        {
+            patterns.emplace_back(argv[++i]);
+        }
+        else if (option == "--jobs" && hasValue)
+        {
+            options.numJobs = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (option == "--memory-budget" && hasValue)
+        {
+            options.memoryBudget = std::stoull(argv[++i]) << 20;
+        }
+        else if (option == "--texture-cache" && hasValue)
+        {
+            options.textureResidencyBudget = std::stoull(argv[++i]) << 20;
+        }
+        else if (option == "--texture-compression" && hasValue)
+        {
+            const std::string_view mode = argv[++i];
+            if (mode == "none")
+            {
+                options.conversion.textureCompression = TextureCompression::None;
+            }
+            else if (mode == "bc1")
+            {
+                options.conversion.textureCompression = TextureCompression::Bc1;
+            }
+            else if (mode == "bc7")
+            {
+                options.conversion.textureCompression = TextureCompression::Bc7;
+            }
+            else
+            {
+                fmt::print(stderr, "Unknown texture compression {}\n", mode);
+                return 1;
+            }
+        }
+        else if (option == "--texture-quality" && hasValue)
+        {
+            const std::string_view quality = argv[++i];
+            if (quality == "fast")
+            {
+                options.conversion.textureQuality = TextureCompressionQuality::Fast;
+            }
+            else if (quality == "high")
+            {
+                options.conversion.textureQuality = TextureCompressionQuality::High;
+            }
+            else
+            {
+                fmt::print(stderr, "Unknown texture quality {}\n", quality);
+                return 1;
+            }
+        }
+        else if (option == "--virtual-textures")
+        {
+            options.conversion.virtualTextures = true;
+        }
+        else
+        {
+            printHelp();
+            return 1;
+        }
+    }
+    if (options.conversion.virtualTextures &&
+        options.conversion.textureCompression != TextureCompression::None)
+    {
+        fmt::print(stderr, "--virtual-textures cannot be combined with --texture-compression\n");
         return 1;
     }
+    options.conversion.cache = cache ? &*cache : nullptr;
+    if (patterns.empty())
+    {
+        patterns = {"*.gltf", "*.glb"};
+    }
+
+    for (const fs::path& input : inputs)
+    {
+        if (!fs::exists(input))
+        {
+            fmt::print(stderr, "File {} does not exist\n", input.string());
+            return 1;
+        }
+    }
+    const std::vector<fs::path> gltfPaths = findGltfFiles(inputs, patterns);
+
+    using Clock = std::chrono::steady_clock;
+    const auto  startTime = Clock::now();
+    std::size_t numFinished = 0;
+    const std::vector<ConversionResult> results =
+        convertBatch(gltfPaths, options, [&](const ConversionResult& result) -> void {
+            ++numFinished;
+            fmt::print(
+                "[{}/{}] {}: {}\n",
+                numFinished,
+                gltfPaths.size(),
+                result.gltfPath.string(),
+                statusName(result.status));
+        });
 
-    PtFormat ptFormat{path};
-    path.replace_extension(".pt");
-    OutputFileStream fileStream(path);
-    serialize(fileStream, ptFormat);
+    fmt::print(
+        "\n{:<10} {:>9} {:>12} {:>12} {:>12}  {}\n",
+        "status",
+        "time",
+        "input",
+        "output",
+        "duplicates",
+        "file");
+    int           numFailed = 0;
+    std::uint64_t duplicateBytes = 0;
+    for (const ConversionResult& result : results)
+    {
+        if (result.status == ConversionStatus::Failed)
+        {
+            ++numFailed;
+            fmt::print(stderr, "{}: {}\n", result.gltfPath.string(), result.error);
+            continue;
+        }
+        // The decoded textures and the transformed meshes which were stored once instead of
+        // several times.
+        const GltfDeduplication& deduplication = result.deduplication;
+        const std::uint64_t      savedBytes =
+            deduplication.duplicateTextureBytes + deduplication.duplicateMeshBytes;
+        duplicateBytes += savedBytes;
+        fmt::print(
+            "{:<10} {:>7.2f} s {:>8.1f} MiB {:>8.1f} MiB {:>8.1f} MiB  {}\n",
+            statusName(result.status),
+            result.seconds,
+            megabytes(result.inputSize),
+            megabytes(result.outputSize),
+            megabytes(savedBytes),
+            result.gltfPath.string());
+        if (deduplication.numDuplicateImages > 0 || deduplication.numDuplicateMeshes > 0)
+        {
+            fmt::print(
+                "{:<10} removed {} duplicate images ({:.1f} MiB of textures) and {} duplicate "
+                "meshes ({:.1f} MiB)\n",
+                "",
+                deduplication.numDuplicateImages,
+                megabytes(deduplication.duplicateTextureBytes),
+                deduplication.numDuplicateMeshes,
+                megabytes(deduplication.duplicateMeshBytes));
+        }
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+    fmt::print(
+        "{} files, {} failed, {:.1f} MiB of duplicates removed, in {:.2f} s.\n",
+        results.size(),
+        numFailed,
+        megabytes(duplicateBytes),
+        seconds);
+    return numFailed > 0 ? 1 : 0;
 }
 catch (const std::exception& e)
 {
@@ -0,0 +1,308 @@
+#include "batch_conversion.hpp"
+#include "pt_format.hpp"
+
+#include <common/assert.hpp>
+#include <common/deferred_texture.hpp>
+#include <common/gltf_model.hpp>
+#include <common/thread_pool.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace nlrs
+{
+namespace
+{
+// The peak memory of a conversion is estimated as a multiple of the size of its input files. The
+// decoded textures are typically several times larger than the compressed images, and the BVH
+// build and the flattened triangles several times larger than the vertex buffers.
+constexpr std::uint64_t MEMORY_PER_INPUT_BYTE = 8;
+
+std::uint64_t inputSize(const fs::path& gltfPath)
+{
+    std::uint64_t size = fs::file_size(gltfPath);
+    for (const fs::path& dependency : gltfDependencies(gltfPath))
+    {
+        size += fs::file_size(dependency);
+    }
+    return size;
+}
+
+fs::path ptPath(const fs::path& gltfPath)
+{
+    fs::path path = gltfPath;
+    path.replace_extension(".pt");
+    return path;
+}
+
+ConversionResult convertFile(
+    const fs::path&     gltfPath,
+    const std::uint64_t size,
+    const BatchOptions& options,
+    MemoryBudget&       memoryBudget)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto startTime = Clock::now();
+
+    ConversionResult result;
+    result.gltfPath = gltfPath;
+    result.inputSize = size;
+    try
+    {
+        const fs::path outputPath = ptPath(gltfPath);
+        if (!options.force &&
+            readSourceHash(outputPath) == gltfSourceHash(gltfPath, options.conversion))
+        {
+            result.status = ConversionStatus::UpToDate;
+        }
+        else
+        {
+            const std::uint64_t estimatedMemory = MEMORY_PER_INPUT_BYTE * size;
+            memoryBudget.acquire(estimatedMemory);
+            try
+            {
+                result.deduplication = convertGltf(gltfPath, outputPath, options.conversion);
+            }
+            catch (...)
+            {
+                memoryBudget.release(estimatedMemory);
+                throw;
+            }
+            memoryBudget.release(estimatedMemory);
+            result.status = ConversionStatus::Converted;
+        }
+        result.outputSize = fs::file_size(outputPath);
+    }
+    catch (const std::exception& e)
+    {
+        result.status = ConversionStatus::Failed;
+        result.error = e.what();
+    }
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+    return result;
+}
+} // namespace
+
+MemoryBudget::MemoryBudget(const std::uint64_t budget)
+    : mMutex(),
+      mReleased(),
+      mBudget(budget),
+      mUsed(0)
+{
+}
+
+void MemoryBudget::acquire(const std::uint64_t numBytes)
+{
+    std::unique_lock lock(mMutex);
+    mReleased.wait(lock, [this, numBytes]() { return mUsed == 0 || mUsed + numBytes <= mBudget; });
+    mUsed += numBytes;
+}
+
+void MemoryBudget::release(const std::uint64_t numBytes)
+{
+    {
+        const std::lock_guard lock(mMutex);
+        NLRS_ASSERT(numBytes <= mUsed);
+        mUsed -= numBytes;
+    }
+    mReleased.notify_all();
+}
+
+std::vector<std::size_t> largestFirst(const std::span<const std::uint64_t> sizes)
+{
+    std::vector<std::size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::stable_sort(
+        order.begin(), order.end(), [&sizes](const std::size_t a, const std::size_t b) -> bool {
+            return sizes[a] > sizes[b];
+        });
+    return order;
+}
+
+bool matchesGlob(const std::string_view name, const std::string_view pattern)
+{
+    // Backtracks to the character after the last `*` on a mismatch.
+    std::size_t nameIdx = 0;
+    std::size_t patternIdx = 0;
+    std::size_t starIdx = std::string_view::npos;
+    std::size_t starNameIdx = 0;
+    while (nameIdx < name.size())
+    {
+        if (patternIdx < pattern.size() &&
+            (pattern[patternIdx] == '?' || pattern[patternIdx] == name[nameIdx]))
+        {
+            ++nameIdx;
+            ++patternIdx;
+        }
+        else if (patternIdx < pattern.size() && pattern[patternIdx] == '*')
+        {
+            starIdx = patternIdx++;
+            starNameIdx = nameIdx;
+        }
+        else if (starIdx != std::string_view::npos)
+        {
+            patternIdx = starIdx + 1;
+            nameIdx = ++starNameIdx;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (patternIdx < pattern.size() && pattern[patternIdx] == '*')
+    {
+        ++patternIdx;
+    }
+    return patternIdx == pattern.size();
+}
+
+std::vector<fs::path> findGltfFiles(
+    const std::span<const fs::path>    inputs,
+    const std::span<const std::string> patterns)
+{
+    std::vector<fs::path> files;
+    for (const fs::path& input : inputs)
+    {
+        if (fs::is_directory(input))
+        {
+            for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input))
+            {
+                const std::string name = entry.path().filename().string();
+                if (entry.is_regular_file() &&
+                    std::any_of(
+                        patterns.begin(),
+                        patterns.end(),
+                        [&name](const std::string& pattern) -> bool {
+                            return matchesGlob(name, pattern);
+                        }))
+                {
+                    files.push_back(entry.path());
+                }
+            }
+        }
+        else
+        {
+            files.push_back(input);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+std::vector<ConversionResult> convertBatch(
+    const std::span<const fs::path>                     gltfPaths,
+    const BatchOptions&                                 options,
+    const std::function<void(const ConversionResult&)>& onResult)
+{
+    std::vector<ConversionResult> results(gltfPaths.size());
+    std::vector<std::uint64_t>    sizes(gltfPaths.size(), 0);
+
+    // E.g. foo.gltf and foo.glb in the same directory would both be written to foo.pt. Neither is
+    // converted, instead of the conversions overwriting each other.
+    std::vector<bool> collides(gltfPaths.size(), false);
+    {
+        std::map<fs::path, std::vector<std::size_t>> inputsByOutput;
+        for (std::size_t i = 0; i < gltfPaths.size(); ++i)
+        {
+            inputsByOutput[ptPath(gltfPaths[i]).lexically_normal()].push_back(i);
+        }
+        for (const auto& [outputPath, inputs] : inputsByOutput)
+        {
+            if (inputs.size() < 2)
+            {
+                continue;
+            }
+            std::string inputNames;
+            for (const std::size_t i : inputs)
+            {
+                if (!inputNames.empty())
+                {
+                    inputNames += ", ";
+                }
+                inputNames += gltfPaths[i].string();
+            }
+            for (const std::size_t i : inputs)
+            {
+                collides[i] = true;
+                results[i].gltfPath = gltfPaths[i];
+                results[i].error = fmt::format(
+                    "{} would be written by each of {}. Rename or move all but one of them.",
+                    outputPath.string(),
+                    inputNames);
+                onResult(results[i]);
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < gltfPaths.size(); ++i)
+    {
+        if (collides[i])
+        {
+            continue;
+        }
+        try
+        {
+            sizes[i] = inputSize(gltfPaths[i]);
+        }
+        catch (const std::exception&)
+        {
+            // The conversion reports the error.
+        }
+    }
+
+    const std::vector<std::size_t> order = largestFirst(sizes);
+
+    const std::uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    const std::uint32_t numJobs = options.numJobs > 0 ? options.numJobs : hardwareThreads;
+    // Each conversion runs on its share of the hardware threads, instead of every conversion
+    // starting a thread per hardware thread.
+    BatchOptions jobOptions = options;
+    if (jobOptions.conversion.numThreads == 0)
+    {
+        jobOptions.conversion.numThreads = std::max(hardwareThreads / numJobs, 1u);
+    }
+    TextureResidencyCache residentTextures(
+        static_cast<std::size_t>(options.textureResidencyBudget));
+    if (jobOptions.conversion.residentTextures == nullptr && options.textureResidencyBudget > 0)
+    {
+        jobOptions.conversion.residentTextures = &residentTextures;
+    }
+    MemoryBudget memoryBudget(options.memoryBudget);
+    std::mutex   resultMutex;
+    {
+        // The calling thread runs conversions as well.
+        ThreadPool threadPool(numJobs - 1);
+        for (const std::size_t i : order)
+        {
+            if (collides[i])
+            {
+                continue;
+            }
+            threadPool.push([&, i]() {
+                ConversionResult result =
+                    convertFile(gltfPaths[i], sizes[i], jobOptions, memoryBudget);
+                const std::lock_guard lock(resultMutex);
+                onResult(result);
+                results[i] = std::move(result);
+            });
+        }
+        threadPool.wait();
+    }
+    return results;
+}
+} // namespace nlrs
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "pt_format.hpp"
+
+#include <common/gltf_model.hpp>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nlrs
+{
+struct BatchOptions
+{
+    ConversionOptions conversion;
+    // Convert the files even if the .pt files are up to date.
+    bool              force = false;
+    std::uint32_t     numJobs = 0; // 0 means the number of hardware threads
+    std::uint64_t     memoryBudget = std::uint64_t(8) << 30;
+    // The decoded images which the files share are kept resident in this many bytes, in addition
+    // to `memoryBudget`, so that each is decoded once. 0 decodes the images of each file anew.
+    std::uint64_t     textureResidencyBudget = std::uint64_t(1) << 30;
+};
+
+enum class ConversionStatus
+{
+    Converted,
+    UpToDate,
+    Failed,
+};
+
+struct ConversionResult
+{
+    std::filesystem::path gltfPath;
+    ConversionStatus      status = ConversionStatus::Failed;
+    double                seconds = 0.0;
+    // The size of the glTF file and its external files.
+    std::uint64_t         inputSize = 0;
+    std::uint64_t         outputSize = 0;
+    // The duplicates which were removed from a converted file.
+    GltfDeduplication     deduplication;
+    std::string           error;
+};
+
+// Limits the total estimated memory of concurrent conversions.
+class MemoryBudget
+{
+public:
+    explicit MemoryBudget(std::uint64_t budget);
+
+    // Blocks until `numBytes` fit in the budget, or nothing else holds any of the budget.
+    void acquire(std::uint64_t numBytes);
+    void release(std::uint64_t numBytes);
+
+private:
+    std::mutex              mMutex;
+    std::condition_variable mReleased;
+    std::uint64_t           mBudget;
+    std::uint64_t           mUsed;
+};
+
+// The order in which convertBatch converts files with the given input sizes: the largest first,
+// and files of equal size in the given order.
+std::vector<std::size_t> largestFirst(std::span<const std::uint64_t> sizes);
+
+// Returns true if `name` matches `pattern`, in which `*` matches any sequence of characters and `?`
+// matches any single character.
+bool matchesGlob(std::string_view name, std::string_view pattern);
+
+// Returns the glTF files to convert, sorted and without duplicates. Files are used as is, and
+// directories are searched recursively for files whose names match any of `patterns`.
+std::vector<std::filesystem::path> findGltfFiles(
+    std::span<const std::filesystem::path> inputs,
+    std::span<const std::string>           patterns);
+
+// Converts each glTF file to a .pt file next to it, on up to `numJobs` threads. Unless
+// `conversion.numThreads` is set, each conversion runs on its share of the hardware threads, so
+// that the jobs together use about as many threads as there are hardware threads. A conversion only
+// starts once the estimated peak memory of the running conversions, including it, fits in
+// `memoryBudget`. A conversion which exceeds the budget by itself runs alone. The largest files
+// are converted first. `onResult` is called as each conversion finishes, one at a time. A failed
+// conversion does not stop the others. Files which would be converted to the same .pt file, e.g.
+// foo.gltf and foo.glb, fail without being converted.
+std::vector<ConversionResult> convertBatch(
+    std::span<const std::filesystem::path>              gltfPaths,
+    const BatchOptions&                                 options,
+    const std::function<void(const ConversionResult&)>& onResult);
+} // namespace nlrs
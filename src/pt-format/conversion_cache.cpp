@@ -0,0 +1,234 @@
+#include "conversion_cache.hpp"
+
+#include <common/file_stream.hpp>
+#include <common/hash.hpp>
+
+#include <fmt/core.h>
+
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace nlrs
+{
+namespace
+{
+// Change when the layout of an entry, or the output of a cached stage, changes.
+constexpr char CACHE_MAGIC[8] = {'P', 'T', 'C', 'A', 'C', 'H', 'E', '1'};
+
+struct CacheEntryHeader
+{
+    char          magic[8];
+    std::uint64_t key;
+    std::uint64_t payloadSize;
+    // FNV-1a hash of the payload.
+    std::uint64_t checksum;
+};
+
+// Reads the payload of a cache entry in place.
+class PayloadReader
+{
+public:
+    explicit PayloadReader(const std::span<const std::byte> payload)
+        : mPayload(payload),
+          mOffset(0)
+    {
+    }
+
+    // Returns false if the payload is too short.
+    bool read(void* const data, const std::size_t numBytes)
+    {
+        if (numBytes > mPayload.size() - mOffset)
+        {
+            return false;
+        }
+        std::memcpy(data, mPayload.data() + mOffset, numBytes);
+        mOffset += numBytes;
+        return true;
+    }
+
+    std::size_t remaining() const noexcept { return mPayload.size() - mOffset; }
+
+private:
+    std::span<const std::byte> mPayload;
+    std::size_t                mOffset;
+};
+} // namespace
+
+ConversionCache::ConversionCache(std::filesystem::path directory)
+    : mDirectory(std::move(directory))
+{
+    std::filesystem::create_directories(mDirectory);
+}
+
+std::optional<Bvh> ConversionCache::loadBvh(const std::uint64_t key) const
+{
+    const std::optional<std::vector<std::byte>> payload = load("bvh", key);
+    if (!payload)
+    {
+        return std::nullopt;
+    }
+
+    PayloadReader reader(*payload);
+    std::uint64_t numNodes = 0;
+    std::uint64_t numTriangles = 0;
+    if (!reader.read(&numNodes, sizeof(numNodes)) ||
+        !reader.read(&numTriangles, sizeof(numTriangles)) ||
+        reader.remaining() != numNodes * sizeof(BvhNode) + numTriangles * sizeof(std::uint64_t))
+    {
+        return std::nullopt;
+    }
+
+    Bvh bvh{
+        .nodes = std::vector<BvhNode>(static_cast<std::size_t>(numNodes)),
+        .triangleIndices = std::vector<std::size_t>(static_cast<std::size_t>(numTriangles))};
+    reader.read(bvh.nodes.data(), bvh.nodes.size() * sizeof(BvhNode));
+    for (std::size_t& triangleIdx : bvh.triangleIndices)
+    {
+        std::uint64_t idx = 0;
+        reader.read(&idx, sizeof(idx));
+        if (idx >= numTriangles)
+        {
+            return std::nullopt;
+        }
+        triangleIdx = static_cast<std::size_t>(idx);
+    }
+    return bvh;
+}
+
+void ConversionCache::storeBvh(const std::uint64_t key, const Bvh& bvh) const
+{
+    const std::uint64_t numNodes = bvh.nodes.size();
+    const std::uint64_t numTriangles = bvh.triangleIndices.size();
+    // std::size_t is not 64 bits on every platform.
+    const std::vector<std::uint64_t> triangleIndices(
+        bvh.triangleIndices.begin(), bvh.triangleIndices.end());
+    const std::span<const std::byte> payload[] = {
+        std::as_bytes(std::span(&numNodes, 1)),
+        std::as_bytes(std::span(&numTriangles, 1)),
+        std::as_bytes(std::span(bvh.nodes)),
+        std::as_bytes(std::span(triangleIndices))};
+    store("bvh", key, payload);
+}
+
+std::optional<Texture> ConversionCache::loadTexture(const std::uint64_t key) const
+{
+    const std::optional<std::vector<std::byte>> payload = load("texture", key);
+    if (!payload)
+    {
+        return std::nullopt;
+    }
+
+    PayloadReader       reader(*payload);
+    Texture::Dimensions dimensions{};
+    if (!reader.read(&dimensions, sizeof(dimensions)) ||
+        reader.remaining() != static_cast<std::uint64_t>(dimensions.width) * dimensions.height *
+                                  sizeof(Texture::BgraPixel))
+    {
+        return std::nullopt;
+    }
+
+    std::vector<Texture::BgraPixel> pixels(reader.remaining() / sizeof(Texture::BgraPixel));
+    reader.read(pixels.data(), pixels.size() * sizeof(Texture::BgraPixel));
+    return Texture(std::move(pixels), dimensions);
+}
+
+void ConversionCache::storeTexture(const std::uint64_t key, const Texture& texture) const
+{
+    // Textures are stored with BGRA pixels, which is what loadTexture returns.
+    if (texture.channelOrder() != Texture::ChannelOrder::Bgra)
+    {
+        storeTexture(key, texture.withChannelOrder(Texture::ChannelOrder::Bgra));
+        return;
+    }
+    const Texture::Dimensions        dimensions = texture.dimensions();
+    const std::span<const std::byte> payload[] = {
+        std::as_bytes(std::span(&dimensions, 1)), std::as_bytes(texture.pixels())};
+    store("texture", key, payload);
+}
+
+std::filesystem::path ConversionCache::entryPath(
+    const std::string_view stage,
+    const std::uint64_t    key) const
+{
+    return mDirectory / fmt::format("{}-{:016x}.bin", stage, key);
+}
+
+std::optional<std::vector<std::byte>> ConversionCache::load(
+    const std::string_view stage,
+    const std::uint64_t    key) const
+{
+    const std::filesystem::path path = entryPath(stage, key);
+    std::error_code             error;
+    const std::uint64_t         fileSize = std::filesystem::file_size(path, error);
+    if (error || fileSize < sizeof(CacheEntryHeader))
+    {
+        return std::nullopt;
+    }
+
+    try
+    {
+        InputFileStream  file(path);
+        CacheEntryHeader header{};
+        if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header) ||
+            std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+            header.key != key || header.payloadSize != fileSize - sizeof(header))
+        {
+            return std::nullopt;
+        }
+
+        std::vector<std::byte> payload(static_cast<std::size_t>(header.payloadSize));
+        if (file.read(reinterpret_cast<char*>(payload.data()), payload.size()) != payload.size() ||
+            fnv1a(payload.data(), payload.size()) != header.checksum)
+        {
+            return std::nullopt;
+        }
+        return payload;
+    }
+    catch (const std::runtime_error&)
+    {
+        return std::nullopt;
+    }
+}
+
+void ConversionCache::store(
+    const std::string_view                            stage,
+    const std::uint64_t                               key,
+    const std::span<const std::span<const std::byte>> payload) const
+{
+    CacheEntryHeader header{};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.key = key;
+    header.checksum = FNV_OFFSET_BASIS;
+    for (const std::span<const std::byte> piece : payload)
+    {
+        header.payloadSize += piece.size();
+        header.checksum = fnv1a(piece.data(), piece.size(), header.checksum);
+    }
+
+    const std::filesystem::path path = entryPath(stage, key);
+    std::filesystem::path       tmpPath = path;
+    tmpPath += fmt::format(".{:08x}.tmp", std::random_device()());
+    try
+    {
+        OutputFileStream file(tmpPath);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const std::span<const std::byte> piece : payload)
+        {
+            file.write(reinterpret_cast<const char*>(piece.data()), piece.size());
+        }
+        file.close();
+        std::filesystem::rename(tmpPath, path);
+    }
+    catch (const std::runtime_error&)
+    {
+        // The conversion does not depend on the cache, so the entry is skipped, e.g. when the disk
+        // is full.
+        std::error_code error;
+        std::filesystem::remove(tmpPath, error);
+    }
+}
+} // namespace nlrs
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <common/bvh.hpp>
+#include <common/texture.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace nlrs
+{
+// Stores the results of the expensive stages of converting a glTF file in a directory, keyed by a
+// hash of their inputs: the BVH by the hash of the triangle positions, and each decoded texture by
+// the hash of the encoded image. A modified glTF file can then be converted without rebuilding the
+// BVH if its geometry did not change, or decoding the images which did not change. Entries which
+// cannot be read, e.g. because they are corrupt, are treated as missing.
+class ConversionCache
+{
+public:
+    // Creates the directory if it does not exist.
+    explicit ConversionCache(std::filesystem::path directory);
+
+    std::optional<Bvh> loadBvh(std::uint64_t key) const;
+    void               storeBvh(std::uint64_t key, const Bvh& bvh) const;
+
+    std::optional<Texture> loadTexture(std::uint64_t key) const;
+    void                   storeTexture(std::uint64_t key, const Texture& texture) const;
+
+    const std::filesystem::path& directory() const noexcept { return mDirectory; }
+
+private:
+    std::filesystem::path entryPath(std::string_view stage, std::uint64_t key) const;
+    std::optional<std::vector<std::byte>> load(std::string_view stage, std::uint64_t key) const;
+    // Entries are written to a temporary file first, so that concurrent conversions never read a
+    // partially written entry. Storing is best effort: if the entry can not be written, the
+    // temporary file is removed and the entry stays missing.
+    void store(
+        std::string_view                             stage,
+        std::uint64_t                                key,
+        std::span<const std::span<const std::byte>> payload) const;
+
+    std::filesystem::path mDirectory;
+};
+} // namespace nlrs
@@ -0,0 +1,618 @@
+#include "geometry_codec.hpp"
+#include "vertex_attributes.hpp"
+
+#include <common/assert.hpp>
+#include <common/thread_pool.hpp>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace nlrs
+{
+namespace
+{
+// Small enough that a section is split into enough blocks to decode in parallel, and large enough
+// for the LZ stage to find matches.
+constexpr std::size_t BLOCK_SIZE_BYTES = 1 << 20;
+
+// The header of an encoded section, followed by the compressed size of each block as an u64, and
+// then the compressed blocks.
+struct EncodedSectionHeader
+{
+    std::uint64_t numElements;
+    std::uint64_t numElementsPerBlock;
+    std::uint32_t decodedElementSize;
+    std::uint32_t encodedElementSize;
+};
+
+[[noreturn]] void throwInvalidData()
+{
+    throw std::runtime_error("Invalid PtFormat file: invalid compressed section.");
+}
+
+// LZ77 with a token byte per sequence, as in LZ4. The high nibble of the token is the number of
+// literals, and the low nibble the match length minus MIN_MATCH_LENGTH. A nibble value of 15 is
+// followed by bytes which are added to the length, until a byte is not 255. The literals are
+// followed by the 16-bit match offset. The last sequence contains only literals.
+constexpr std::size_t MIN_MATCH_LENGTH = 4;
+constexpr std::size_t MAX_MATCH_OFFSET = 65535;
+constexpr int         HASH_BITS = 16;
+
+std::uint32_t load32(const std::uint8_t* const data)
+{
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+void writeLength(std::vector<std::byte>& output, std::size_t length)
+{
+    while (length >= 255)
+    {
+        output.push_back(std::byte{255});
+        length -= 255;
+    }
+    output.push_back(static_cast<std::byte>(length));
+}
+
+void writeSequence(
+    std::vector<std::byte>&             output,
+    const std::span<const std::uint8_t> literals,
+    const std::size_t                   matchOffset,
+    const std::size_t                   matchLength)
+{
+    const std::size_t literalNibble = std::min<std::size_t>(literals.size(), 15);
+    const std::size_t matchNibble =
+        matchLength > 0 ? std::min<std::size_t>(matchLength - MIN_MATCH_LENGTH, 15) : 0;
+    output.push_back(static_cast<std::byte>((literalNibble << 4) | matchNibble));
+    if (literalNibble == 15)
+    {
+        writeLength(output, literals.size() - 15);
+    }
+    const auto* const literalBytes = reinterpret_cast<const std::byte*>(literals.data());
+    output.insert(output.end(), literalBytes, literalBytes + literals.size());
+
+    if (matchLength > 0)
+    {
+        output.push_back(static_cast<std::byte>(matchOffset & 0xff));
+        output.push_back(static_cast<std::byte>(matchOffset >> 8));
+        if (matchNibble == 15)
+        {
+            writeLength(output, matchLength - MIN_MATCH_LENGTH - 15);
+        }
+    }
+}
+
+void lzCompress(const std::span<const std::uint8_t> input, std::vector<std::byte>& output)
+{
+    // Positions plus one of the last occurrence of each hashed 4-byte sequence. Zero is empty.
+    std::vector<std::uint32_t> table(std::size_t(1) << HASH_BITS, 0);
+
+    std::size_t anchor = 0;
+    std::size_t pos = 0;
+    while (pos + MIN_MATCH_LENGTH <= input.size())
+    {
+        const std::uint32_t sequence = load32(input.data() + pos);
+        const std::uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        const std::size_t   candidate = table[hash];
+        table[hash] = static_cast<std::uint32_t>(pos + 1);
+
+        if (candidate == 0 || pos - (candidate - 1) > MAX_MATCH_OFFSET ||
+            load32(input.data() + candidate - 1) != sequence)
+        {
+            ++pos;
+            continue;
+        }
+
+        const std::size_t matchPos = candidate - 1;
+        std::size_t       matchLength = MIN_MATCH_LENGTH;
+        while (pos + matchLength < input.size() &&
+               input[matchPos + matchLength] == input[pos + matchLength])
+        {
+            ++matchLength;
+        }
+
+        writeSequence(output, input.subspan(anchor, pos - anchor), pos - matchPos, matchLength);
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    writeSequence(output, input.subspan(anchor), 0, 0);
+}
+
+void lzDecompress(const std::span<const std::uint8_t> input, const std::span<std::uint8_t> output)
+{
+    std::size_t inPos = 0;
+    std::size_t outPos = 0;
+
+    const auto readLength = [&input, &inPos]() -> std::size_t {
+        std::size_t length = 0;
+        std::uint8_t byte = 255;
+        while (byte == 255)
+        {
+            if (inPos >= input.size())
+            {
+                throwInvalidData();
+            }
+            byte = input[inPos++];
+            length += byte;
+        }
+        return length;
+    };
+
+    while (inPos < input.size())
+    {
+        const std::uint8_t token = input[inPos++];
+
+        std::size_t numLiterals = token >> 4;
+        if (numLiterals == 15)
+        {
+            numLiterals += readLength();
+        }
+        if (numLiterals > input.size() - inPos || numLiterals > output.size() - outPos)
+        {
+            throwInvalidData();
+        }
+        std::memcpy(output.data() + outPos, input.data() + inPos, numLiterals);
+        inPos += numLiterals;
+        outPos += numLiterals;
+
+        if (inPos == input.size())
+        {
+            break;
+        }
+
+        if (input.size() - inPos < 2)
+        {
+            throwInvalidData();
+        }
+        const std::size_t offset = input[inPos] | (std::size_t(input[inPos + 1]) << 8);
+        inPos += 2;
+        std::size_t matchLength = (token & 0xf) + MIN_MATCH_LENGTH;
+        if ((token & 0xf) == 15)
+        {
+            matchLength += readLength();
+        }
+        if (offset == 0 || offset > outPos || matchLength > output.size() - outPos)
+        {
+            throwInvalidData();
+        }
+
+        // Matches may overlap the bytes they produce, which repeats the last `offset` bytes.
+        const std::uint8_t* source = output.data() + outPos - offset;
+        std::uint8_t*       dest = output.data() + outPos;
+        if (offset >= matchLength)
+        {
+            std::memcpy(dest, source, matchLength);
+        }
+        else
+        {
+            for (std::size_t i = 0; i < matchLength; ++i)
+            {
+                dest[i] = source[i];
+            }
+        }
+        outPos += matchLength;
+    }
+
+    if (outPos != output.size())
+    {
+        throwInvalidData();
+    }
+}
+
+// Octahedral normal encoding, see "A Survey of Efficient Representations for Independent Unit
+// Vectors" by Cigolle et al.
+std::uint32_t encodeNormal(const glm::vec3& n)
+{
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.0f)
+    {
+        return glm::packSnorm2x16(glm::vec2(0.0f));
+    }
+    glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+    if (n.z < 0.0f)
+    {
+        p = glm::vec2(
+            (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return glm::packSnorm2x16(p);
+}
+
+glm::vec3 decodeNormal(const std::uint32_t packed)
+{
+    const glm::vec2 p = glm::unpackSnorm2x16(packed);
+    glm::vec3       n = glm::vec3(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+    const float     t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+struct QuantizedVertexAttributes
+{
+    std::uint32_t n0;
+    std::uint32_t n1;
+    std::uint32_t n2;
+    std::uint32_t uv0;
+    std::uint32_t uv1;
+    std::uint32_t uv2;
+    std::uint32_t textureIdx;
+};
+
+std::size_t encodedElementSize(const SectionEncoding encoding, const std::size_t elementSize)
+{
+    switch (encoding)
+    {
+    case SectionEncoding::Filtered:
+        return elementSize;
+    case SectionEncoding::OctahedralNormals:
+        NLRS_ASSERT(elementSize == sizeof(glm::vec4));
+        return sizeof(std::uint32_t);
+    case SectionEncoding::HalfTexCoords:
+        NLRS_ASSERT(elementSize == sizeof(glm::vec2));
+        return sizeof(std::uint32_t);
+    case SectionEncoding::QuantizedVertexAttributes:
+        NLRS_ASSERT(elementSize == sizeof(VertexAttributes));
+        return sizeof(QuantizedVertexAttributes);
+    case SectionEncoding::Raw:
+        break;
+    }
+    throwInvalidData();
+}
+
+// Transforms one element into its encoded representation.
+void transformElement(const SectionEncoding encoding, const std::byte* const src, std::byte* dst)
+{
+    switch (encoding)
+    {
+    case SectionEncoding::OctahedralNormals:
+    {
+        glm::vec4 normal;
+        std::memcpy(&normal, src, sizeof(normal));
+        const std::uint32_t packed = encodeNormal(glm::vec3(normal));
+        std::memcpy(dst, &packed, sizeof(packed));
+        break;
+    }
+    case SectionEncoding::HalfTexCoords:
+    {
+        glm::vec2 uv;
+        std::memcpy(&uv, src, sizeof(uv));
+        const std::uint32_t packed = glm::packHalf2x16(uv);
+        std::memcpy(dst, &packed, sizeof(packed));
+        break;
+    }
+    case SectionEncoding::QuantizedVertexAttributes:
+    {
+        VertexAttributes attributes;
+        std::memcpy(&attributes, src, sizeof(attributes));
+        const QuantizedVertexAttributes quantized{
+            .n0 = encodeNormal(attributes.n0),
+            .n1 = encodeNormal(attributes.n1),
+            .n2 = encodeNormal(attributes.n2),
+            .uv0 = glm::packHalf2x16(attributes.uv0),
+            .uv1 = glm::packHalf2x16(attributes.uv1),
+            .uv2 = glm::packHalf2x16(attributes.uv2),
+            .textureIdx = attributes.textureIdx};
+        std::memcpy(dst, &quantized, sizeof(quantized));
+        break;
+    }
+    case SectionEncoding::Filtered:
+    case SectionEncoding::Raw:
+        NLRS_ASSERT(false);
+        break;
+    }
+}
+
+// The inverse of `transformElement`.
+void untransformElement(const SectionEncoding encoding, const std::byte* const src, std::byte* dst)
+{
+    switch (encoding)
+    {
+    case SectionEncoding::OctahedralNormals:
+    {
+        std::uint32_t packed;
+        std::memcpy(&packed, src, sizeof(packed));
+        const glm::vec4 normal = glm::vec4(decodeNormal(packed), 0.0f);
+        std::memcpy(dst, &normal, sizeof(normal));
+        break;
+    }
+    case SectionEncoding::HalfTexCoords:
+    {
+        std::uint32_t packed;
+        std::memcpy(&packed, src, sizeof(packed));
+        const glm::vec2 uv = glm::unpackHalf2x16(packed);
+        std::memcpy(dst, &uv, sizeof(uv));
+        break;
+    }
+    case SectionEncoding::QuantizedVertexAttributes:
+    {
+        QuantizedVertexAttributes quantized;
+        std::memcpy(&quantized, src, sizeof(quantized));
+        const VertexAttributes attributes{
+            .n0 = decodeNormal(quantized.n0),
+            .pad0 = 0.0f,
+            .n1 = decodeNormal(quantized.n1),
+            .pad1 = 0.0f,
+            .n2 = decodeNormal(quantized.n2),
+            .pad2 = 0.0f,
+            .uv0 = glm::unpackHalf2x16(quantized.uv0),
+            .uv1 = glm::unpackHalf2x16(quantized.uv1),
+            .uv2 = glm::unpackHalf2x16(quantized.uv2),
+            .textureIdx = quantized.textureIdx,
+            .pad3 = 0};
+        std::memcpy(dst, &attributes, sizeof(attributes));
+        break;
+    }
+    case SectionEncoding::Filtered:
+    case SectionEncoding::Raw:
+        NLRS_ASSERT(false);
+        break;
+    }
+}
+
+// Stores byte `p` of each element contiguously in plane `p`, and replaces each byte in a plane
+// with its difference to the previous byte. Similar values in consecutive elements then become
+// runs of small numbers, which the LZ stage compresses well.
+void splitBytePlanes(
+    const std::span<const std::byte> elements,
+    const std::size_t                elementSize,
+    const std::span<std::uint8_t>    planes)
+{
+    const std::size_t numElements = elements.size() / elementSize;
+    for (std::size_t p = 0; p < elementSize; ++p)
+    {
+        std::uint8_t* const plane = planes.data() + p * numElements;
+        std::uint8_t        previous = 0;
+        for (std::size_t i = 0; i < numElements; ++i)
+        {
+            const auto value = static_cast<std::uint8_t>(elements[i * elementSize + p]);
+            plane[i] = static_cast<std::uint8_t>(value - previous);
+            previous = value;
+        }
+    }
+}
+
+void mergeBytePlanes(
+    const std::span<const std::uint8_t> planes,
+    const std::size_t                   elementSize,
+    const std::span<std::byte>          elements)
+{
+    const std::size_t numElements = elements.size() / elementSize;
+    for (std::size_t p = 0; p < elementSize; ++p)
+    {
+        const std::uint8_t* const plane = planes.data() + p * numElements;
+        std::uint8_t              value = 0;
+        for (std::size_t i = 0; i < numElements; ++i)
+        {
+            value = static_cast<std::uint8_t>(value + plane[i]);
+            elements[i * elementSize + p] = static_cast<std::byte>(value);
+        }
+    }
+}
+} // namespace
+
+SectionEncoder::SectionEncoder(const SectionEncoding encoding, const std::size_t elementSize)
+    : mEncoding(encoding),
+      mDecodedElementSize(elementSize),
+      mEncodedElementSize(encodedElementSize(encoding, elementSize)),
+      mNumElementsPerBlock(std::max<std::size_t>(BLOCK_SIZE_BYTES / mEncodedElementSize, 1)),
+      mNumElements(0),
+      mPending(),
+      mBlockSizes(),
+      mBlocks()
+{
+    NLRS_ASSERT(encoding != SectionEncoding::Raw);
+    NLRS_ASSERT(elementSize > 0);
+}
+
+void SectionEncoder::append(std::span<const std::byte> elements)
+{
+    NLRS_ASSERT(elements.size() % mDecodedElementSize == 0);
+
+    const std::size_t blockSize = mNumElementsPerBlock * mDecodedElementSize;
+    if (!mPending.empty())
+    {
+        const std::size_t numBytes = std::min(elements.size(), blockSize - mPending.size());
+        mPending.insert(mPending.end(), elements.begin(), elements.begin() + numBytes);
+        elements = elements.subspan(numBytes);
+        if (mPending.size() == blockSize)
+        {
+            encodeBlock(mPending);
+            mPending.clear();
+        }
+    }
+    while (elements.size() >= blockSize)
+    {
+        encodeBlock(elements.first(blockSize));
+        elements = elements.subspan(blockSize);
+    }
+    mPending.insert(mPending.end(), elements.begin(), elements.end());
+}
+
+std::vector<std::byte> SectionEncoder::finish()
+{
+    if (!mPending.empty())
+    {
+        encodeBlock(mPending);
+        mPending.clear();
+    }
+
+    const EncodedSectionHeader header{
+        .numElements = mNumElements,
+        .numElementsPerBlock = mNumElementsPerBlock,
+        .decodedElementSize = static_cast<std::uint32_t>(mDecodedElementSize),
+        .encodedElementSize = static_cast<std::uint32_t>(mEncodedElementSize)};
+
+    std::vector<std::byte> encoded(sizeof(header) + mBlockSizes.size() * sizeof(std::uint64_t));
+    std::memcpy(encoded.data(), &header, sizeof(header));
+    std::memcpy(
+        encoded.data() + sizeof(header),
+        mBlockSizes.data(),
+        mBlockSizes.size() * sizeof(std::uint64_t));
+    encoded.insert(encoded.end(), mBlocks.begin(), mBlocks.end());
+
+    mNumElements = 0;
+    mBlockSizes.clear();
+    mBlocks.clear();
+    return encoded;
+}
+
+void SectionEncoder::encodeBlock(const std::span<const std::byte> elements)
+{
+    const std::size_t count = elements.size() / mDecodedElementSize;
+
+    std::vector<std::byte>     transformed;
+    std::span<const std::byte> encodedElements = elements;
+    if (mEncoding != SectionEncoding::Filtered)
+    {
+        transformed.resize(count * mEncodedElementSize);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            transformElement(
+                mEncoding,
+                elements.data() + i * mDecodedElementSize,
+                transformed.data() + i * mEncodedElementSize);
+        }
+        encodedElements = transformed;
+    }
+
+    std::vector<std::uint8_t> planes(encodedElements.size());
+    splitBytePlanes(encodedElements, mEncodedElementSize, planes);
+
+    const std::size_t blockBegin = mBlocks.size();
+    lzCompress(planes, mBlocks);
+    mBlockSizes.push_back(mBlocks.size() - blockBegin);
+    mNumElements += count;
+}
+
+std::vector<std::byte> encodeSection(
+    const SectionEncoding            encoding,
+    const std::span<const std::byte> decoded,
+    const std::size_t                elementSize)
+{
+    SectionEncoder encoder(encoding, elementSize);
+    encoder.append(decoded);
+    return encoder.finish();
+}
+
+SectionDecoder::SectionDecoder(
+    const SectionEncoding            encoding,
+    const std::span<const std::byte> encoded,
+    const std::span<std::byte>       decoded)
+    : mEncoding(encoding),
+      mEncoded(encoded),
+      mDecoded(decoded),
+      mNumElements(0),
+      mNumElementsPerBlock(0),
+      mDecodedElementSize(0),
+      mEncodedElementSize(0),
+      mBlockOffsets()
+{
+    NLRS_ASSERT(encoding != SectionEncoding::Raw);
+
+    EncodedSectionHeader header;
+    if (encoded.size() < sizeof(header))
+    {
+        throwInvalidData();
+    }
+    std::memcpy(&header, encoded.data(), sizeof(header));
+
+    const std::size_t elementSize = header.decodedElementSize;
+    if (elementSize == 0 || header.numElementsPerBlock == 0 ||
+        header.encodedElementSize != encodedElementSize(encoding, elementSize) ||
+        decoded.size() / elementSize != header.numElements || decoded.size() % elementSize != 0)
+    {
+        throwInvalidData();
+    }
+
+    mNumElements = static_cast<std::size_t>(header.numElements);
+    mNumElementsPerBlock = static_cast<std::size_t>(header.numElementsPerBlock);
+    mDecodedElementSize = elementSize;
+    mEncodedElementSize = header.encodedElementSize;
+
+    const std::size_t numBlocks = (mNumElements + mNumElementsPerBlock - 1) / mNumElementsPerBlock;
+    if (numBlocks > (encoded.size() - sizeof(header)) / sizeof(std::uint64_t))
+    {
+        throwInvalidData();
+    }
+
+    mBlockOffsets.resize(numBlocks + 1);
+    mBlockOffsets[0] = sizeof(header) + numBlocks * sizeof(std::uint64_t);
+    for (std::size_t block = 0; block < numBlocks; ++block)
+    {
+        std::uint64_t blockSize;
+        std::memcpy(
+            &blockSize,
+            encoded.data() + sizeof(header) + block * sizeof(std::uint64_t),
+            sizeof(blockSize));
+        if (blockSize > encoded.size() - mBlockOffsets[block])
+        {
+            throwInvalidData();
+        }
+        mBlockOffsets[block + 1] = mBlockOffsets[block] + static_cast<std::size_t>(blockSize);
+    }
+    if (mBlockOffsets[numBlocks] != encoded.size())
+    {
+        throwInvalidData();
+    }
+}
+
+void SectionDecoder::decodeBlock(const std::size_t block) const
+{
+    NLRS_ASSERT(block < numBlocks());
+
+    const std::size_t          begin = block * mNumElementsPerBlock;
+    const std::size_t          count = std::min(mNumElementsPerBlock, mNumElements - begin);
+    const std::span<std::byte> elements =
+        mDecoded.subspan(begin * mDecodedElementSize, count * mDecodedElementSize);
+
+    std::vector<std::uint8_t> planes(count * mEncodedElementSize);
+    lzDecompress(
+        std::span(
+            reinterpret_cast<const std::uint8_t*>(mEncoded.data()) + mBlockOffsets[block],
+            mBlockOffsets[block + 1] - mBlockOffsets[block]),
+        planes);
+
+    if (mEncoding == SectionEncoding::Filtered)
+    {
+        mergeBytePlanes(planes, mEncodedElementSize, elements);
+        return;
+    }
+
+    std::vector<std::byte> transformed(count * mEncodedElementSize);
+    mergeBytePlanes(planes, mEncodedElementSize, transformed);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        untransformElement(
+            mEncoding,
+            transformed.data() + i * mEncodedElementSize,
+            elements.data() + i * mDecodedElementSize);
+    }
+}
+
+void decodeSection(
+    const SectionEncoding            encoding,
+    const std::span<const std::byte> encoded,
+    const std::span<std::byte>       decoded,
+    const std::uint32_t              numThreads)
+{
+    const SectionDecoder decoder(encoding, encoded, decoded);
+    const std::size_t    numBlocks = decoder.numBlocks();
+
+    // The calling thread decodes blocks as well.
+    ThreadPool threadPool(static_cast<std::uint32_t>(
+        std::min<std::size_t>(std::max(numThreads, 1u), std::max<std::size_t>(numBlocks, 1)) - 1));
+    for (std::size_t block = 0; block < numBlocks; ++block)
+    {
+        threadPool.push([&decoder, block]() { decoder.decodeBlock(block); });
+    }
+    threadPool.wait();
+}
+} // namespace nlrs
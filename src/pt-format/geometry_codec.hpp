@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace nlrs
+{
+// How the bytes of a .pt file section are stored. Every encoding except `Raw` splits the section
+// into blocks of elements, which are compressed independently so that they can be decoded in
+// parallel. Within a block, each element is first transformed by the encoding, and the bytes of the
+// transformed elements are then split into byte planes, delta filtered and LZ compressed.
+enum class SectionEncoding : std::uint32_t
+{
+    // Stored as is, and used in place when the file is memory mapped.
+    Raw = 0,
+    // Lossless. The elements are not transformed.
+    Filtered = 1,
+    // Lossy. glm::vec4 normals with w = 0, stored as 16-bit octahedral coordinates.
+    OctahedralNormals = 2,
+    // Lossy. glm::vec2 texture coordinates, stored as half floats.
+    HalfTexCoords = 3,
+    // Lossy. VertexAttributes, with octahedral normals and half float texture coordinates.
+    QuantizedVertexAttributes = 4,
+};
+
+// Whether geometry sections are compressed when a .pt file is written.
+enum class GeometryCompression
+{
+    None,
+    // Byte planes, delta filtering and LZ compression. Decodes to identical bytes.
+    Lossless,
+    // Also quantizes normals and texture coordinates. Positions are always stored losslessly,
+    // since the BVH bounds are computed from them.
+    Lossy,
+};
+
+// Encodes `decoded`, an array of elements of `elementSize` bytes. The element size must match the
+// element type of transforming encodings. `encoding` must not be `Raw`.
+std::vector<std::byte> encodeSection(
+    SectionEncoding            encoding,
+    std::span<const std::byte> decoded,
+    std::size_t                elementSize);
+
+// Encodes a section one block at a time, so that the whole array does not need to be in memory
+// at once. Appending the array in parts yields the same bytes as `encodeSection`.
+class SectionEncoder
+{
+public:
+    SectionEncoder(SectionEncoding encoding, std::size_t elementSize);
+
+    // Appends whole elements.
+    void append(std::span<const std::byte> elements);
+
+    // Returns the encoded section, and resets the encoder.
+    std::vector<std::byte> finish();
+
+private:
+    void encodeBlock(std::span<const std::byte> elements);
+
+    SectionEncoding            mEncoding;
+    std::size_t                mDecodedElementSize;
+    std::size_t                mEncodedElementSize;
+    std::size_t                mNumElementsPerBlock;
+    std::uint64_t              mNumElements;
+    // Elements which do not fill a block yet.
+    std::vector<std::byte>     mPending;
+    std::vector<std::uint64_t> mBlockSizes;
+    std::vector<std::byte>     mBlocks;
+};
+
+// Decodes the blocks of a section encoded with `encodeSection` into `decoded`, which must be
+// exactly the size of the original array. The blocks are independent, and can be decoded on
+// different threads. `encoded` and `decoded` must outlive the decoder.
+class SectionDecoder
+{
+public:
+    // Throws if the header or the block table of the encoded data is invalid.
+    SectionDecoder(
+        SectionEncoding            encoding,
+        std::span<const std::byte> encoded,
+        std::span<std::byte>       decoded);
+
+    std::size_t numBlocks() const noexcept { return mBlockOffsets.size() - 1; }
+
+    // Throws if the encoded block is invalid.
+    void decodeBlock(std::size_t block) const;
+
+private:
+    SectionEncoding            mEncoding;
+    std::span<const std::byte> mEncoded;
+    std::span<std::byte>       mDecoded;
+    std::size_t                mNumElements;
+    std::size_t                mNumElementsPerBlock;
+    std::size_t                mDecodedElementSize;
+    std::size_t                mEncodedElementSize;
+    // The offset of each compressed block within the encoded data, followed by its end.
+    std::vector<std::size_t> mBlockOffsets;
+};
+
+// Decodes a section encoded with `encodeSection` into `decoded`, which must be exactly the size of
+// the original array. Blocks are decoded on up to `numThreads` threads. Throws if the encoded data
+// is invalid.
+void decodeSection(
+    SectionEncoding            encoding,
+    std::span<const std::byte> encoded,
+    std::span<std::byte>       decoded,
+    std::uint32_t              numThreads);
+} // namespace nlrs
@@ -1,23 +1,47 @@
+#include "conversion_cache.hpp"
 #include "pt_format.hpp"
 
 #include <common/assert.hpp>
+#include <common/buffer_stream.hpp>
+#include <common/deferred_texture.hpp>
 #include <common/gltf_model.hpp>
 #include <common/flattened_model.hpp>
+#include <common/hash.hpp>
 #include <common/stream.hpp>
+#include <common/thread_pool.hpp>
 
 #include <fmt/core.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <regex>
 #include <span>
+#include <stdexcept>
 #include <string_view>
 #include <string>
+#include <thread>
 #include <utility>
 
 namespace nlrs
 {
 PtFormat::PtFormat(std::filesystem::path gltfPath)
+    : PtFormat(GltfModel(gltfPath))
+{
+}
+
+PtFormat::PtFormat(GltfModel model)
     : bvhNodes(),
       bvhPositionAttributes(),
       trianglePositionAttributes(),
@@ -31,10 +55,10 @@ PtFormat::PtFormat(std::filesystem::path gltfPath)
       modelVertexTexCoords(),
       modelVertexIndices(),
       modelBaseColorTextureIndices(),
-      baseColorTextures()
+      baseColorTextures(),
+      compressedBaseColorTextures(),
+      pagedBaseColorTextures()
 {
-    nlrs::GltfModel model{gltfPath};
-
     {
         const FlattenedModel flattenedModel{model};
         auto [nodes, triangleIndices] = nlrs::buildBvh(flattenedModel.positions);
@@ -148,175 +172,2328 @@ PtFormat::PtFormat(std::filesystem::path gltfPath)
     }
 
     baseColorTextures = std::move(model.baseColorTextures);
+    {
+        // One texture at a time, so that only one texture is held twice in memory.
+        ThreadPool threadPool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+        for (Texture& texture : baseColorTextures)
+        {
+            texture = texture.withMipmaps(threadPool);
+        }
+    }
+}
+
+namespace
+{
+constexpr std::string_view MAGIC_BYTES = "PTFORMAT8";
+
+// Sections, and the array data within sections, start at multiples of this offset, so that the
+// arrays can be used in place when the file is memory mapped. Also a multiple of the alignment of
+// every stored type.
+constexpr std::size_t SECTION_ALIGNMENT = 16;
+
+// Rejects corrupt tables of contents before allocating memory for them.
+constexpr std::uint64_t MAX_NUM_SECTIONS = 1024;
+
+static_assert(sizeof(PtFormatSectionEntry) == 48, "The table of contents is written as is.");
+static_assert(sizeof(VirtualTextureDescriptor) == 16, "The descriptors are written as is.");
+
+// The element type of the model sections: a range of the corresponding vertex array.
+struct SliceRange
+{
+    std::uint64_t offset;
+    std::uint64_t count;
+};
+
+constexpr PtFormatSection REQUIRED_SECTIONS[] = {
+    PtFormatSection::BvhNodes,
+    PtFormatSection::BvhPositionAttributes,
+    PtFormatSection::TrianglePositionAttributes,
+    PtFormatSection::TriangleVertexAttributes,
+    PtFormatSection::VertexPositions,
+    PtFormatSection::VertexNormals,
+    PtFormatSection::VertexTexCoords,
+    PtFormatSection::VertexIndices,
+    PtFormatSection::ModelVertexPositions,
+    PtFormatSection::ModelVertexNormals,
+    PtFormatSection::ModelVertexTexCoords,
+    PtFormatSection::ModelVertexIndices,
+    PtFormatSection::ModelBaseColorTextureIndices,
+};
+
+// Every file also contains exactly one of the texture sections.
+bool isTextureSection(const PtFormatSection section)
+{
+    return section == PtFormatSection::BaseColorTextures ||
+           section == PtFormatSection::CompressedBaseColorTextures ||
+           section == PtFormatSection::PagedBaseColorTextures;
+}
+
+std::size_t paddingTo(const std::size_t offset, const std::size_t alignment)
+{
+    return (alignment - offset % alignment) % alignment;
+}
+
+void checkMagicBytes(const std::string_view magicBytes)
+{
+    if (magicBytes != MAGIC_BYTES)
+    {
+        const std::regex pattern("PTFORMAT\\d");
+        if (std::regex_search(magicBytes.begin(), magicBytes.end(), pattern))
+        {
+            throw std::runtime_error(fmt::format(
+                "Mismatching PtFormat file version. Invalid version in magic bytes: expected "
+                "'{}', got '{}'.",
+                MAGIC_BYTES,
+                magicBytes));
+        }
+        else
+        {
+            throw std::runtime_error("Invalid file format: expected PtFormat file.");
+        }
+    }
+}
+
+void checkSectionEntry(const PtFormatSectionEntry& entry, const std::uint64_t fileSize)
+{
+    const bool isPowerOfTwo =
+        entry.alignment != 0 && (entry.alignment & (entry.alignment - 1)) == 0;
+    if (!isPowerOfTwo || entry.offset % entry.alignment != 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "Invalid PtFormat file: section {} is misaligned.", sectionName(entry.section)));
+    }
+    if (entry.offset > fileSize || entry.size > fileSize - entry.offset)
+    {
+        throw std::runtime_error(fmt::format(
+            "Invalid PtFormat file: section {} is out of bounds.", sectionName(entry.section)));
+    }
+    if (entry.encoding > SectionEncoding::QuantizedVertexAttributes)
+    {
+        throw std::runtime_error(fmt::format(
+            "Unsupported PtFormat file: section {} has unknown encoding {}.",
+            sectionName(entry.section),
+            static_cast<std::uint32_t>(entry.encoding)));
+    }
+    if (entry.encoding == SectionEncoding::Raw && entry.decodedSize != entry.size)
+    {
+        throw std::runtime_error(fmt::format(
+            "Invalid PtFormat file: unexpected size of section {}.", sectionName(entry.section)));
+    }
+}
+
+std::uint32_t hardwareThreads() { return std::max(std::thread::hardware_concurrency(), 1u); }
+
+[[noreturn]] void throwMissingSection(const PtFormatSection section)
+{
+    throw std::runtime_error(
+        fmt::format("PtFormat file has no {} section.", sectionName(section)));
+}
+
+[[noreturn]] void throwChecksumMismatch(const PtFormatSection section)
+{
+    throw std::runtime_error(fmt::format(
+        "Invalid PtFormat file: checksum mismatch in section {}.", sectionName(section)));
+}
+
+// Sections are hashed in chunks of this size, so that the chunks can be hashed in parallel.
+constexpr std::size_t CHECKSUM_CHUNK_SIZE = 1 << 20;
+
+// The checksum of a section is the FNV-1a hash of the FNV-1a hashes of its chunks. The bytes can
+// be hashed incrementally with `update`, or the hashes of the chunks can be computed separately and
+// combined in order with `addChunk`.
+class Checksum
+{
+public:
+    Checksum()
+        : mHash(FNV_OFFSET_BASIS),
+          mChunkHash(FNV_OFFSET_BASIS),
+          mChunkSize(0)
+    {
+    }
+
+    void update(const void* const data, std::size_t numBytes)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        while (numBytes > 0)
+        {
+            const std::size_t n = std::min(numBytes, CHECKSUM_CHUNK_SIZE - mChunkSize);
+            mChunkHash = fnv1a(bytes, n, mChunkHash);
+            mChunkSize += n;
+            bytes += n;
+            numBytes -= n;
+            if (mChunkSize == CHECKSUM_CHUNK_SIZE)
+            {
+                mChunkSize = 0;
+                addChunk(std::exchange(mChunkHash, FNV_OFFSET_BASIS));
+            }
+        }
+    }
+
+    void addChunk(const std::uint64_t chunkHash)
+    {
+        NLRS_ASSERT(mChunkSize == 0);
+        mHash = fnv1a(&chunkHash, sizeof(chunkHash), mHash);
+    }
+
+    std::uint64_t value() const noexcept
+    {
+        return mChunkSize > 0 ? fnv1a(&mChunkHash, sizeof(mChunkHash), mHash) : mHash;
+    }
+
+private:
+    std::uint64_t mHash;
+    std::uint64_t mChunkHash;
+    std::size_t   mChunkSize;
+};
+
+// The bytes of a section as a sequence of pieces, e.g. the headers and pixels of each texture,
+// which are stored in separate buffers once the section has been read.
+class SectionPieces
+{
+public:
+    SectionPieces()
+        : mPieces(),
+          mOffsets(),
+          mSize(0)
+    {
+    }
+
+    void append(const std::span<const std::byte> piece)
+    {
+        mPieces.push_back(piece);
+        mOffsets.push_back(mSize);
+        mSize += piece.size();
+    }
+
+    std::uint64_t size() const noexcept { return mSize; }
+
+    std::size_t numChunks() const noexcept
+    {
+        return static_cast<std::size_t>((mSize + CHECKSUM_CHUNK_SIZE - 1) / CHECKSUM_CHUNK_SIZE);
+    }
+
+    std::uint64_t chunkHash(const std::size_t chunk) const
+    {
+        const std::uint64_t chunkBegin = static_cast<std::uint64_t>(chunk) * CHECKSUM_CHUNK_SIZE;
+        const std::uint64_t chunkEnd = std::min(chunkBegin + CHECKSUM_CHUNK_SIZE, mSize);
+        // The last piece which starts at or before the chunk.
+        std::size_t piece = static_cast<std::size_t>(
+            std::upper_bound(mOffsets.begin(), mOffsets.end(), chunkBegin) - mOffsets.begin() - 1);
+
+        std::uint64_t hash = FNV_OFFSET_BASIS;
+        for (; piece < mPieces.size() && mOffsets[piece] < chunkEnd; ++piece)
+        {
+            const std::uint64_t begin = std::max(chunkBegin, mOffsets[piece]) - mOffsets[piece];
+            const std::uint64_t end =
+                std::min<std::uint64_t>(chunkEnd - mOffsets[piece], mPieces[piece].size());
+            hash = fnv1a(
+                mPieces[piece].data() + begin, static_cast<std::size_t>(end - begin), hash);
+        }
+        return hash;
+    }
+
+private:
+    std::vector<std::span<const std::byte>> mPieces;
+    std::vector<std::uint64_t>              mOffsets;
+    std::uint64_t                           mSize;
+};
+
+// Computes the checksum of a section, hashing the chunks on `numThreads` threads.
+std::uint64_t parallelChecksum(const SectionPieces& pieces, const std::uint32_t numThreads)
+{
+    std::vector<std::uint64_t> chunkHashes(pieces.numChunks());
+    {
+        ThreadPool threadPool(numThreads - 1);
+        for (std::size_t chunk = 0; chunk < chunkHashes.size(); ++chunk)
+        {
+            threadPool.push([&, chunk]() { chunkHashes[chunk] = pieces.chunkHash(chunk); });
+        }
+        threadPool.wait();
+    }
+    Checksum checksum;
+    for (const std::uint64_t chunkHash : chunkHashes)
+    {
+        checksum.addChunk(chunkHash);
+    }
+    return checksum.value();
 }
 
+// Measures the size and checksum of a section without storing it.
+class ChecksumStream : public OutputStream
+{
+public:
+    ChecksumStream()
+        : mChecksum(),
+          mNumBytes(0)
+    {
+    }
+
+    void write(const char* const data, const std::size_t numBytes) override
+    {
+        mChecksum.update(data, numBytes);
+        mNumBytes += numBytes;
+    }
+
+    std::uint64_t checksum() const noexcept { return mChecksum.value(); }
+    std::uint64_t numBytes() const noexcept { return mNumBytes; }
+
+private:
+    Checksum      mChecksum;
+    std::uint64_t mNumBytes;
+};
+
+// Writes a PtFormat file, and measures the size and checksum of the section being written.
+class SectionFileStream : public OutputStream
+{
+public:
+    SectionFileStream(const std::filesystem::path& path, const FileStreamOptions options)
+        : mFile(path, options),
+          mSection()
+    {
+    }
+
+    void write(const char* const data, const std::size_t numBytes) override
+    {
+        mFile.write(data, numBytes);
+        mSection.write(data, numBytes);
+    }
+
+    void beginSection() { mSection = ChecksumStream(); }
+
+    const ChecksumStream& section() const noexcept { return mSection; }
+
+    // Overwrites bytes which have already been written, e.g. the table of contents.
+    void overwrite(const std::uint64_t offset, const void* const data, const std::size_t numBytes)
+    {
+        mFile.overwrite(offset, static_cast<const char*>(data), numBytes);
+    }
+
+    void close() { mFile.close(); }
+
+private:
+    OutputFileStream mFile;
+    ChecksumStream   mSection;
+};
+
+// Keeps track of the number of bytes written, so that data can be padded to `SECTION_ALIGNMENT`.
+class PtFormatWriter
+{
+public:
+    explicit PtFormatWriter(OutputStream& stream)
+        : mStream(stream),
+          mOffset(0)
+    {
+    }
+
+    void write(const void* data, const std::size_t numBytes)
+    {
+        mStream.write(static_cast<const char*>(data), numBytes);
+        mOffset += numBytes;
+    }
+
+    template<typename T>
+    void write(const T& value)
+    {
+        write(&value, sizeof(T));
+    }
+
+    void align()
+    {
+        constexpr char zeros[SECTION_ALIGNMENT] = {};
+        write(zeros, paddingTo(mOffset, SECTION_ALIGNMENT));
+    }
+
+    std::uint64_t offset() const noexcept { return mOffset; }
+
+private:
+    OutputStream& mStream;
+    std::uint64_t mOffset;
+};
+
+// Reads a PtFormat file from a stream, and keeps track of the offset.
+class PtFormatReader
+{
+public:
+    explicit PtFormatReader(InputStream& stream)
+        : mStream(stream),
+          mBufferStream(dynamic_cast<BufferStream*>(&stream)),
+          mOffset(0)
+    {
+    }
+
+    void read(void* data, const std::size_t numBytes)
+    {
+        if (mStream.read(static_cast<char*>(data), numBytes) != numBytes)
+        {
+            throw std::runtime_error("Unexpected end of PtFormat file.");
+        }
+        mOffset += numBytes;
+    }
+
+    template<typename T>
+    T read()
+    {
+        T value;
+        read(&value, sizeof(T));
+        return value;
+    }
+
+    // Reads `numBytes` bytes into `storage`. A BufferStream's bytes are returned in place instead,
+    // and remain valid until the stream is written to.
+    std::span<const std::byte> readBytes(
+        const std::size_t numBytes, std::vector<std::byte>& storage)
+    {
+        if (mBufferStream == nullptr)
+        {
+            storage.resize(numBytes);
+            read(storage.data(), storage.size());
+            return storage;
+        }
+        const std::span<const std::byte> bytes = mBufferStream->readSpan(numBytes);
+        if (bytes.size() != numBytes)
+        {
+            throw std::runtime_error("Unexpected end of PtFormat file.");
+        }
+        mOffset += numBytes;
+        return bytes;
+    }
+
+    void skip(std::uint64_t numBytes)
+    {
+        char buffer[4096];
+        while (numBytes > 0)
+        {
+            const std::size_t numRead =
+                static_cast<std::size_t>(std::min<std::uint64_t>(numBytes, sizeof(buffer)));
+            read(buffer, numRead);
+            numBytes -= numRead;
+        }
+    }
+
+    void align() { skip(paddingTo(mOffset, SECTION_ALIGNMENT)); }
+
+    std::uint64_t offset() const noexcept { return mOffset; }
+
+private:
+    InputStream&  mStream;
+    BufferStream* mBufferStream;
+    std::uint64_t mOffset;
+};
+
+// Reads a PtFormat file, or a section of one, in place. Arrays are returned as spans into `bytes`.
+class ByteReader
+{
+public:
+    explicit ByteReader(const std::span<const std::byte> bytes)
+        : mBytes(bytes),
+          mOffset(0)
+    {
+    }
+
+    std::span<const std::byte> read(const std::size_t numBytes)
+    {
+        if (numBytes > mBytes.size() - mOffset)
+        {
+            throw std::runtime_error("Unexpected end of PtFormat file.");
+        }
+        const std::span<const std::byte> bytes = mBytes.subspan(mOffset, numBytes);
+        mOffset += numBytes;
+        return bytes;
+    }
+
+    template<typename T>
+    T read()
+    {
+        T value;
+        std::memcpy(&value, read(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    std::span<const T> readArray(const std::uint64_t numElements)
+    {
+        if (numElements > (mBytes.size() - mOffset) / sizeof(T))
+        {
+            throw std::runtime_error("Unexpected end of PtFormat file.");
+        }
+        const std::span<const std::byte> bytes =
+            read(static_cast<std::size_t>(numElements) * sizeof(T));
+        // The mapping is page aligned, so the writer's padding aligns the data in memory as well.
+        NLRS_ASSERT(reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(T) == 0);
+        return {reinterpret_cast<const T*>(bytes.data()), static_cast<std::size_t>(numElements)};
+    }
+
+    void align() { read(paddingTo(mOffset, SECTION_ALIGNMENT)); }
+
+private:
+    std::span<const std::byte> mBytes;
+    std::size_t                mOffset;
+};
+
 template<typename T>
-void serialize(OutputStream& stream, const std::span<const T>& data)
+void writeArray(PtFormatWriter& writer, const std::vector<T>& data)
 {
-    const std::uint64_t numElements = static_cast<std::uint64_t>(data.size());
-    stream.write(reinterpret_cast<const char*>(&numElements), sizeof(std::uint64_t));
-    const std::size_t numBytes = sizeof(T) * numElements;
-    stream.write(reinterpret_cast<const char*>(data.data()), numBytes);
+    writer.write(data.data(), sizeof(T) * data.size());
 }
 
 template<typename T>
-void serialize(
-    OutputStream&                              stream,
-    const std::vector<T>&                      buffer,
-    const std::span<const std::span<const T>>& slices)
+void writeSlices(
+    PtFormatWriter&                        writer,
+    const std::vector<T>&                  buffer,
+    const std::vector<std::span<const T>>& slices)
 {
-    const std::uint64_t numSlices = static_cast<std::uint64_t>(slices.size());
-    stream.write(reinterpret_cast<const char*>(&numSlices), sizeof(std::uint64_t));
     const T* const bufferBegin = buffer.data();
-    for (const auto& offset : slices)
+    for (const auto& slice : slices)
     {
-        const T* const offsetBegin = offset.data();
-        NLRS_ASSERT(bufferBegin <= offsetBegin);
-        const std::uint64_t offsetIdx = static_cast<std::uint64_t>(offsetBegin - bufferBegin);
-        const std::uint64_t numElements = static_cast<std::uint64_t>(offset.size());
-        NLRS_ASSERT(offsetIdx + numElements <= buffer.size());
-        stream.write(reinterpret_cast<const char*>(&offsetIdx), sizeof(std::uint64_t));
-        stream.write(reinterpret_cast<const char*>(&numElements), sizeof(std::uint64_t));
+        const T* const sliceBegin = slice.data();
+        NLRS_ASSERT(bufferBegin <= sliceBegin);
+        const SliceRange range{
+            .offset = static_cast<std::uint64_t>(sliceBegin - bufferBegin),
+            .count = static_cast<std::uint64_t>(slice.size())};
+        NLRS_ASSERT(range.offset + range.count <= buffer.size());
+        writer.write(range);
     }
 }
 
-template<typename T>
-void deserialize(
-    InputStream&                     stream,
-    const std::vector<T>&            buffer,
-    std::vector<std::span<const T>>& slices)
+// Each texture is stored as its dimensions, number of mip levels and number of pixels, followed by
+// the BGRA pixels of every mip level, level 0 first, aligned to SECTION_ALIGNMENT.
+void writeTexture(PtFormatWriter& writer, const Texture& texture)
+{
+    if (texture.channelOrder() != Texture::ChannelOrder::Bgra)
+    {
+        writeTexture(writer, texture.withChannelOrder(Texture::ChannelOrder::Bgra));
+        return;
+    }
+    writer.write(texture.dimensions());
+    writer.write(static_cast<std::uint64_t>(texture.numMipLevels()));
+    writer.write(static_cast<std::uint64_t>(texture.mipChain().size()));
+    writer.align();
+    writer.write(texture.mipChain().data(), texture.mipChain().size_bytes());
+}
+
+void validateTextureHeader(
+    const Texture::Dimensions dimensions,
+    const std::uint64_t       numMipLevels,
+    const std::uint64_t       numPixels)
 {
-    std::uint64_t numSlices;
-    NLRS_ASSERT(
-        stream.read(reinterpret_cast<char*>(&numSlices), sizeof(std::uint64_t)) ==
-        sizeof(std::uint64_t));
-    slices.reserve(static_cast<std::size_t>(numSlices));
+    if (numMipLevels == 0 || numMipLevels > Texture::maxMipLevels(dimensions) ||
+        numPixels != Texture::mipChainSize(dimensions, static_cast<std::uint32_t>(numMipLevels)))
+    {
+        throw std::runtime_error(
+            "Invalid PtFormat file: texture size does not match its dimensions.");
+    }
+}
 
-    for (std::uint64_t i = 0; i < numSlices; ++i)
+void writeTextures(PtFormatWriter& writer, const std::span<const Texture> textures)
+{
+    writer.write(static_cast<std::uint64_t>(textures.size()));
+    for (const Texture& texture : textures)
     {
-        std::uint64_t offsetIdx;
-        NLRS_ASSERT(
-            stream.read(reinterpret_cast<char*>(&offsetIdx), sizeof(std::uint64_t)) ==
-            sizeof(std::uint64_t));
-        std::uint64_t numElements;
-        NLRS_ASSERT(
-            stream.read(reinterpret_cast<char*>(&numElements), sizeof(std::uint64_t)) ==
-            sizeof(std::uint64_t));
-        NLRS_ASSERT(offsetIdx + numElements <= buffer.size());
-        slices.push_back(std::span<const T>{buffer}.subspan(offsetIdx, numElements));
+        writeTexture(writer, texture);
     }
 }
 
-template<typename T>
-void deserialize(InputStream& stream, std::vector<T>& data)
+// Each compressed texture is stored as its dimensions, number of mip levels, TextureCompression and
+// number of bytes, followed by the blocks of every mip level, level 0 first, aligned to
+// SECTION_ALIGNMENT.
+void writeCompressedTextures(
+    PtFormatWriter&                          writer,
+    const std::span<const CompressedTexture> textures)
+{
+    writer.write(static_cast<std::uint64_t>(textures.size()));
+    for (const CompressedTexture& texture : textures)
+    {
+        writer.write(texture.dimensions());
+        writer.write(static_cast<std::uint64_t>(texture.numMipLevels()));
+        writer.write(static_cast<std::uint64_t>(texture.compression()));
+        writer.write(static_cast<std::uint64_t>(texture.mipChain().size()));
+        writer.align();
+        writer.write(texture.mipChain().data(), texture.mipChain().size_bytes());
+    }
+}
+
+void validateCompressedTextureHeader(
+    const Texture::Dimensions dimensions,
+    const std::uint64_t       numMipLevels,
+    const std::uint64_t       compression,
+    const std::uint64_t       numBytes)
+{
+    if (compression != static_cast<std::uint64_t>(TextureCompression::Bc1) &&
+        compression != static_cast<std::uint64_t>(TextureCompression::Bc7))
+    {
+        throw std::runtime_error(fmt::format(
+            "Unsupported PtFormat file: unknown texture compression {}.", compression));
+    }
+    if (numMipLevels == 0 || numMipLevels > Texture::maxMipLevels(dimensions) ||
+        numBytes != CompressedTexture::mipChainNumBytes(
+                        dimensions,
+                        static_cast<TextureCompression>(compression),
+                        static_cast<std::uint32_t>(numMipLevels)))
+    {
+        throw std::runtime_error(
+            "Invalid PtFormat file: texture size does not match its dimensions.");
+    }
+}
+
+// The paged textures are stored as the number of textures and the number of pages, followed by the
+// VirtualTextureDescriptors and, aligned to SECTION_ALIGNMENT, the pages.
+// Writes everything up to the pages, which follow the descriptors of `numPages` pages.
+void writePagedTexturesHeader(
+    PtFormatWriter&                                 writer,
+    const std::span<const VirtualTextureDescriptor> descriptors,
+    const std::uint64_t                             numPages)
 {
-    std::uint64_t numElements;
-    stream.read(reinterpret_cast<char*>(&numElements), sizeof(std::uint64_t));
-    data.resize(numElements);
-    const std::size_t numBytes = sizeof(T) * numElements;
-    NLRS_ASSERT(stream.read(reinterpret_cast<char*>(data.data()), numBytes) == numBytes);
+    writer.write(static_cast<std::uint64_t>(descriptors.size()));
+    writer.write(numPages);
+    writer.write(descriptors.data(), descriptors.size() * sizeof(VirtualTextureDescriptor));
+    writer.align();
 }
 
-void serialize(OutputStream& stream, const Texture& texture)
+void writePagedTextures(PtFormatWriter& writer, const PagedTextures& textures)
 {
-    const auto dimensions = texture.dimensions();
-    stream.write(reinterpret_cast<const char*>(&dimensions), sizeof(Texture::Dimensions));
-    serialize(stream, texture.pixels());
+    NLRS_ASSERT(textures.pages.size() % VIRTUAL_TEXTURE_PAGE_NUM_TEXELS == 0);
+    writePagedTexturesHeader(
+        writer, textures.descriptors, textures.pages.size() / VIRTUAL_TEXTURE_PAGE_NUM_TEXELS);
+    writer.write(textures.pages.data(), textures.pages.size() * sizeof(Texture::BgraPixel));
 }
 
-void deserialize(InputStream& stream, Texture& texture)
+constexpr std::size_t VIRTUAL_TEXTURE_PAGE_NUM_BYTES =
+    VIRTUAL_TEXTURE_PAGE_NUM_TEXELS * sizeof(Texture::BgraPixel);
+
+// Page indices are 32-bit, see VirtualTextureDescriptor::firstPage.
+void validateNumPages(const std::uint64_t numPages, const std::uint64_t sectionSize)
 {
-    Texture::Dimensions dimensions;
-    NLRS_ASSERT(
-        stream.read(reinterpret_cast<char*>(&dimensions), sizeof(Texture::Dimensions)) ==
-        sizeof(Texture::Dimensions));
-    std::vector<Texture::BgraPixel> pixels;
-    deserialize(stream, pixels);
-    texture = Texture{std::move(pixels), dimensions};
+    if (numPages > std::numeric_limits<std::uint32_t>::max() ||
+        numPages > sectionSize / VIRTUAL_TEXTURE_PAGE_NUM_BYTES)
+    {
+        throw std::runtime_error("Invalid PtFormat file: too many virtual texture pages.");
+    }
 }
 
-constexpr std::string_view MAGIC_BYTES = "PTFORMAT3";
+// The descriptors must refer to consecutive pages, in the order written by pageTextures.
+void validateVirtualTextureDescriptors(
+    const std::span<const VirtualTextureDescriptor> descriptors,
+    const std::uint64_t                             numPages)
+{
+    std::uint64_t firstPage = 0;
+    for (const VirtualTextureDescriptor& descriptor : descriptors)
+    {
+        const Texture::Dimensions dimensions{descriptor.width, descriptor.height};
+        if (descriptor.width == 0 || descriptor.height == 0 || descriptor.numMipLevels == 0 ||
+            descriptor.numMipLevels > Texture::maxMipLevels(dimensions) ||
+            descriptor.firstPage != firstPage)
+        {
+            throw std::runtime_error("Invalid PtFormat file: invalid virtual texture descriptor.");
+        }
+        for (std::uint32_t level = 0; level < descriptor.numMipLevels; ++level)
+        {
+            const Texture::Dimensions grid =
+                virtualTexturePageGrid(Texture::mipLevelDimensions(dimensions, level));
+            firstPage += static_cast<std::uint64_t>(grid.width) * grid.height;
+        }
+        if (firstPage > numPages)
+        {
+            break;
+        }
+    }
+    if (firstPage != numPages)
+    {
+        throw std::runtime_error(
+            "Invalid PtFormat file: the virtual texture pages do not match their descriptors.");
+    }
+}
 
-void serialize(OutputStream& stream, const PtFormat& format)
+// Reports the fraction of a fixed amount of work which has been done, from any thread. The
+// callback is called under a lock, so that the fractions it sees are increasing.
+class ProgressReporter
 {
-    stream.write(MAGIC_BYTES.data(), MAGIC_BYTES.size());
+public:
+    ProgressReporter(const std::function<void(float)>& callback, const std::uint64_t total)
+        : mCallback(callback),
+          mMutex(),
+          mDone(0),
+          mTotal(total)
+    {
+    }
 
-    serialize(stream, std::span(format.bvhNodes));
-    serialize(stream, std::span(format.bvhPositionAttributes));
-    serialize(stream, std::span(format.trianglePositionAttributes));
-    serialize(stream, std::span(format.triangleVertexAttributes));
+    void advance(const std::uint64_t amount)
+    {
+        if (!mCallback)
+        {
+            return;
+        }
+        const std::lock_guard lock(mMutex);
+        mDone += amount;
+        mCallback(static_cast<float>(static_cast<double>(mDone) / static_cast<double>(mTotal)));
+    }
 
-    serialize(stream, std::span(format.vertexPositions));
-    serialize(stream, std::span(format.vertexNormals));
-    serialize(stream, std::span(format.vertexTexCoords));
-    serialize(stream, std::span(format.vertexIndices));
+private:
+    const std::function<void(float)>& mCallback;
+    std::mutex                        mMutex;
+    std::uint64_t                     mDone;
+    std::uint64_t                     mTotal;
+};
 
-    serialize(stream, format.vertexPositions, std::span(format.modelVertexPositions));
-    serialize(stream, format.vertexNormals, std::span(format.modelVertexNormals));
-    serialize(stream, format.vertexTexCoords, std::span(format.modelVertexTexCoords));
-    serialize(stream, format.vertexIndices, std::span(format.modelVertexIndices));
-    serialize(stream, std::span(format.modelBaseColorTextureIndices));
+// Decompresses one texture per task on `numThreads` threads. `onProgress`, if set, receives the
+// fraction of the compressed bytes which have been decompressed.
+std::vector<Texture> decompressTextures(
+    const std::span<const CompressedTexture> textures,
+    const std::uint32_t                      numThreads,
+    const std::function<void(float)>&        onProgress = {})
+{
+    std::uint64_t totalBytes = 0;
+    for (const CompressedTexture& texture : textures)
+    {
+        totalBytes += texture.mipChain().size();
+    }
 
+    std::vector<Texture> decompressed(textures.size());
+    ProgressReporter     progress(onProgress, totalBytes);
+    ThreadPool           threadPool(numThreads - 1);
+    for (std::size_t i = 0; i < textures.size(); ++i)
     {
-        const std::uint64_t numTextures =
-            static_cast<std::uint64_t>(format.baseColorTextures.size());
-        stream.write(reinterpret_cast<const char*>(&numTextures), sizeof(std::uint64_t));
-        std::for_each(
-            format.baseColorTextures.begin(),
-            format.baseColorTextures.end(),
-            [&](const auto& texture) { serialize(stream, texture); });
+        threadPool.push([&textures, &decompressed, &progress, i]() {
+            decompressed[i] = textures[i].decompress();
+            progress.advance(textures[i].mipChain().size());
+        });
     }
+    threadPool.wait();
+    return decompressed;
 }
 
-void deserialize(InputStream& stream, PtFormat& format)
+// Reads the sections of a PtFormat file from a stream on the calling thread. Meanwhile, the
+// sections which have already been read are validated on a thread pool, and compressed sections are
+// decoded once they have been validated. The decoded arrays are identical to reading, validating
+// and decoding each section in turn.
+class ParallelSectionReader
 {
-    std::string magicBytes;
-    magicBytes.resize(MAGIC_BYTES.size());
-    NLRS_ASSERT(stream.read(magicBytes.data(), magicBytes.size()) == magicBytes.size());
+public:
+    ParallelSectionReader(PtFormatReader& reader, const std::uint32_t numThreads)
+        : mReader(reader),
+          mSections(),
+          mBuffers(),
+          mThreadPool(numThreads)
+    {
+    }
 
-    if (magicBytes != MAGIC_BYTES)
+    template<typename T>
+    void readArray(const PtFormatSectionEntry& entry, std::vector<T>& data)
     {
-        const std::regex pattern("PTFORMAT\\d");
-        if (std::regex_search(magicBytes, pattern))
+        if (entry.decodedSize % sizeof(T) != 0)
         {
             throw std::runtime_error(fmt::format(
-                "Mismatching PtFormat file version. Invalid version in magic bytes: expected "
-                "'{}', got '{}'.",
-                MAGIC_BYTES,
-                magicBytes));
+                "Invalid PtFormat file: the size of section {} is not a multiple of {} bytes.",
+                sectionName(entry.section),
+                sizeof(T)));
+        }
+        data.resize(static_cast<std::size_t>(entry.decodedSize / sizeof(T)));
+        const std::span<std::byte> decoded = std::as_writable_bytes(std::span(data));
+
+        PendingSection& section = addSection(entry);
+        if (entry.encoding == SectionEncoding::Raw)
+        {
+            mReader.read(decoded.data(), decoded.size());
+            section.pieces.append(decoded);
         }
         else
         {
-            throw std::runtime_error("Invalid file format: expected PtFormat file.");
+            const std::span<const std::byte> encoded = readBuffer(entry.size);
+            section.pieces.append(encoded);
+            section.decode = [encoded, decoded, &section, this]() {
+                const SectionDecoder& decoder =
+                    section.decoder.emplace(section.entry.encoding, encoded, decoded);
+                for (std::size_t block = 0; block < decoder.numBlocks(); ++block)
+                {
+                    mThreadPool.push([&decoder, block]() { decoder.decodeBlock(block); });
+                }
+            };
         }
+        validate(section);
     }
 
-    deserialize(stream, format.bvhNodes);
-    deserialize(stream, format.bvhPositionAttributes);
-    deserialize(stream, format.trianglePositionAttributes);
-    deserialize(stream, format.triangleVertexAttributes);
-
-    deserialize(stream, format.vertexPositions);
-    deserialize(stream, format.vertexNormals);
-    deserialize(stream, format.vertexTexCoords);
-    deserialize(stream, format.vertexIndices);
+    // Each texture is validated by the chunks which contain it. The pixels are stored in the same
+    // format as Texture's, so the textures do not need to be decoded.
+    void readTextures(const PtFormatSectionEntry& entry, std::vector<Texture>& textures)
+    {
+        if (entry.encoding != SectionEncoding::Raw)
+        {
+            throw std::runtime_error(fmt::format(
+                "Unsupported PtFormat file: section {} is compressed.",
+                sectionName(entry.section)));
+        }
 
-    deserialize(stream, format.vertexPositions, format.modelVertexPositions);
-    deserialize(stream, format.vertexNormals, format.modelVertexNormals);
-    deserialize(stream, format.vertexTexCoords, format.modelVertexTexCoords);
-    deserialize(stream, format.vertexIndices, format.modelVertexIndices);
-    deserialize(stream, format.modelBaseColorTextureIndices);
+        PendingSection& section = addSection(entry);
+        const auto      readHeader = [this, &section](const std::size_t numBytes) -> ByteReader {
+            const std::span<const std::byte> header = readBuffer(numBytes);
+            section.pieces.append(header);
+            return ByteReader(header);
+        };
 
+        const std::uint64_t sectionEnd = entry.offset + entry.size;
+        const std::uint64_t numTextures = readHeader(sizeof(std::uint64_t)).read<std::uint64_t>();
+        textures.clear();
+        for (std::uint64_t i = 0; i < numTextures; ++i)
+        {
+            // The dimensions, the number of mip levels and the number of pixels, padded to
+            // SECTION_ALIGNMENT.
+            const std::size_t headerSize =
+                sizeof(Texture::Dimensions) + sizeof(std::uint64_t) + sizeof(std::uint64_t);
+            const std::size_t padding = paddingTo(
+                static_cast<std::size_t>(mReader.offset()) + headerSize, SECTION_ALIGNMENT);
+            ByteReader          header = readHeader(headerSize + padding);
+            const auto          dimensions = header.read<Texture::Dimensions>();
+            const std::uint64_t numMipLevels = header.read<std::uint64_t>();
+            const std::uint64_t numPixels = header.read<std::uint64_t>();
+            validateTextureHeader(dimensions, numMipLevels, numPixels);
+            if (numPixels > (sectionEnd - std::min(mReader.offset(), sectionEnd)) /
+                                sizeof(Texture::BgraPixel))
+            {
+                throw std::runtime_error(
+                    "Invalid PtFormat file: texture size does not match its dimensions.");
+            }
+            std::vector<Texture::BgraPixel> pixels(static_cast<std::size_t>(numPixels));
+            mReader.read(pixels.data(), pixels.size() * sizeof(Texture::BgraPixel));
+            // Moving the pixels into the texture does not move the buffer being validated.
+            section.pieces.append(std::as_bytes(std::span(pixels)));
+            textures.push_back(Texture{
+                std::move(pixels),
+                dimensions,
+                Texture::ChannelOrder::Bgra,
+                static_cast<std::uint32_t>(numMipLevels)});
+        }
+        validate(section);
+    }
+
+    // Reads the compressed textures like readTextures. The textures are decompressed by the caller.
+    void readCompressedTextures(
+        const PtFormatSectionEntry&     entry,
+        std::vector<CompressedTexture>& textures)
+    {
+        if (entry.encoding != SectionEncoding::Raw)
+        {
+            throw std::runtime_error(fmt::format(
+                "Unsupported PtFormat file: section {} is compressed.",
+                sectionName(entry.section)));
+        }
+
+        PendingSection& section = addSection(entry);
+        const auto      readHeader = [this, &section](const std::size_t numBytes) -> ByteReader {
+            const std::span<const std::byte> header = readBuffer(numBytes);
+            section.pieces.append(header);
+            return ByteReader(header);
+        };
+
+        const std::uint64_t sectionEnd = entry.offset + entry.size;
+        const std::uint64_t numTextures = readHeader(sizeof(std::uint64_t)).read<std::uint64_t>();
+        textures.clear();
+        for (std::uint64_t i = 0; i < numTextures; ++i)
+        {
+            // The dimensions, the number of mip levels, the compression and the number of bytes,
+            // padded to SECTION_ALIGNMENT.
+            const std::size_t headerSize = sizeof(Texture::Dimensions) + 3 * sizeof(std::uint64_t);
+            const std::size_t padding = paddingTo(
+                static_cast<std::size_t>(mReader.offset()) + headerSize, SECTION_ALIGNMENT);
+            ByteReader          header = readHeader(headerSize + padding);
+            const auto          dimensions = header.read<Texture::Dimensions>();
+            const std::uint64_t numMipLevels = header.read<std::uint64_t>();
+            const std::uint64_t compression = header.read<std::uint64_t>();
+            const std::uint64_t numBytes = header.read<std::uint64_t>();
+            validateCompressedTextureHeader(dimensions, numMipLevels, compression, numBytes);
+            if (numBytes > sectionEnd - std::min(mReader.offset(), sectionEnd))
+            {
+                throw std::runtime_error(
+                    "Invalid PtFormat file: texture size does not match its dimensions.");
+            }
+            std::vector<std::uint8_t> blocks(static_cast<std::size_t>(numBytes));
+            mReader.read(blocks.data(), blocks.size());
+            // Moving the blocks into the texture does not move the buffer being validated.
+            section.pieces.append(std::as_bytes(std::span(blocks)));
+            textures.push_back(CompressedTexture{
+                std::move(blocks),
+                dimensions,
+                static_cast<TextureCompression>(compression),
+                static_cast<std::uint32_t>(numMipLevels)});
+        }
+        validate(section);
+    }
+
+    // Reads the descriptors and the pages like readTextures. The descriptors are validated before
+    // the pages are read.
+    void readPagedTextures(const PtFormatSectionEntry& entry, PagedTextures& textures)
+    {
+        if (entry.encoding != SectionEncoding::Raw)
+        {
+            throw std::runtime_error(fmt::format(
+                "Unsupported PtFormat file: section {} is compressed.",
+                sectionName(entry.section)));
+        }
+
+        PendingSection& section = addSection(entry);
+        const auto      readHeader = [this, &section](const std::size_t numBytes) -> ByteReader {
+            const std::span<const std::byte> header = readBuffer(numBytes);
+            section.pieces.append(header);
+            return ByteReader(header);
+        };
+
+        ByteReader          header = readHeader(2 * sizeof(std::uint64_t));
+        const std::uint64_t numTextures = header.read<std::uint64_t>();
+        const std::uint64_t numPages = header.read<std::uint64_t>();
+        validateNumPages(numPages, entry.size);
+        if (numTextures > entry.size / sizeof(VirtualTextureDescriptor))
+        {
+            throw std::runtime_error("Invalid PtFormat file: too many virtual textures.");
+        }
+
+        textures.descriptors.resize(static_cast<std::size_t>(numTextures));
+        mReader.read(
+            textures.descriptors.data(),
+            textures.descriptors.size() * sizeof(VirtualTextureDescriptor));
+        section.pieces.append(std::as_bytes(std::span(textures.descriptors)));
+        validateVirtualTextureDescriptors(textures.descriptors, numPages);
+
+        const std::size_t padding =
+            paddingTo(static_cast<std::size_t>(mReader.offset()), SECTION_ALIGNMENT);
+        if (padding > 0)
+        {
+            readHeader(padding);
+        }
+        textures.pages.resize(static_cast<std::size_t>(numPages) * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS);
+        mReader.read(textures.pages.data(), textures.pages.size() * sizeof(Texture::BgraPixel));
+        section.pieces.append(std::as_bytes(std::span(textures.pages)));
+        validate(section);
+    }
+
+    // Sections added by later versions of the format are validated, but not used.
+    void readUnknown(const PtFormatSectionEntry& entry)
+    {
+        PendingSection& section = addSection(entry);
+        section.pieces.append(readBuffer(entry.size));
+        validate(section);
+    }
+
+    // Waits until every section has been validated and decoded. Throws if a section's checksum does
+    // not match the table of contents, or if a section could not be decoded.
+    void finish() { mThreadPool.wait(); }
+
+private:
+    struct PendingSection
+    {
+        explicit PendingSection(const PtFormatSectionEntry& entry)
+            : entry(entry),
+              pieces(),
+              chunkHashes(),
+              numPendingChunks(0),
+              decode(),
+              decoder()
+        {
+        }
+
+        PtFormatSectionEntry       entry;
+        SectionPieces              pieces;
+        std::vector<std::uint64_t> chunkHashes;
+        std::atomic<std::size_t>   numPendingChunks;
+        // Called once the section has been validated.
+        std::function<void()>         decode;
+        std::optional<SectionDecoder> decoder;
+    };
+
+    PendingSection& addSection(const PtFormatSectionEntry& entry)
+    {
+        return mSections.emplace_back(entry);
+    }
+
+    std::span<const std::byte> readBuffer(const std::uint64_t numBytes)
+    {
+        return mReader.readBytes(static_cast<std::size_t>(numBytes), mBuffers.emplace_back());
+    }
+
+    // Hashes the chunks of the section on the thread pool. The task which hashes the last chunk
+    // compares the checksum, and starts decoding the section.
+    void validate(PendingSection& section)
+    {
+        const std::size_t numChunks = section.pieces.numChunks();
+        if (numChunks == 0)
+        {
+            checkSection(section);
+            return;
+        }
+        section.chunkHashes.resize(numChunks);
+        section.numPendingChunks = numChunks;
+        for (std::size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            mThreadPool.push([&section, chunk, this]() {
+                section.chunkHashes[chunk] = section.pieces.chunkHash(chunk);
+                if (--section.numPendingChunks == 0)
+                {
+                    checkSection(section);
+                }
+            });
+        }
+    }
+
+    void checkSection(PendingSection& section)
+    {
+        Checksum checksum;
+        for (const std::uint64_t chunkHash : section.chunkHashes)
+        {
+            checksum.addChunk(chunkHash);
+        }
+        if (checksum.value() != section.entry.checksum)
+        {
+            throwChecksumMismatch(section.entry.section);
+        }
+        if (section.decode)
+        {
+            section.decode();
+        }
+    }
+
+    PtFormatReader& mReader;
+    // Deques, so that the tasks' references remain valid as sections are added.
+    std::deque<PendingSection>         mSections;
+    std::deque<std::vector<std::byte>> mBuffers;
+    // Declared last, so that the pending tasks finish before the sections are destroyed.
+    ThreadPool mThreadPool;
+};
+
+// Writes a section of a PtFormat file. Raw sections are written directly from PtFormat, and
+// compressed sections from their encoded bytes.
+struct SectionWriter
+{
+    PtFormatSection                      section;
+    SectionEncoding                      encoding;
+    // Only known up front for compressed sections.
+    std::uint64_t                        decodedSize;
+    std::function<void(PtFormatWriter&)> write;
+};
+
+// Positions are always stored losslessly, since the BVH is built from them. The model sections and
+// the textures are always stored raw.
+SectionEncoding sectionEncoding(
+    const PtFormatSection     section,
+    const GeometryCompression compression)
+{
+    if (compression == GeometryCompression::None)
+    {
+        return SectionEncoding::Raw;
+    }
+    const bool isLossy = compression == GeometryCompression::Lossy;
+    switch (section)
+    {
+    case PtFormatSection::BvhNodes:
+    case PtFormatSection::BvhPositionAttributes:
+    case PtFormatSection::TrianglePositionAttributes:
+    case PtFormatSection::VertexPositions:
+    case PtFormatSection::VertexIndices:
+        return SectionEncoding::Filtered;
+    case PtFormatSection::TriangleVertexAttributes:
+        return isLossy ? SectionEncoding::QuantizedVertexAttributes : SectionEncoding::Filtered;
+    case PtFormatSection::VertexNormals:
+        return isLossy ? SectionEncoding::OctahedralNormals : SectionEncoding::Filtered;
+    case PtFormatSection::VertexTexCoords:
+        return isLossy ? SectionEncoding::HalfTexCoords : SectionEncoding::Filtered;
+    case PtFormatSection::ModelVertexPositions:
+    case PtFormatSection::ModelVertexNormals:
+    case PtFormatSection::ModelVertexTexCoords:
+    case PtFormatSection::ModelVertexIndices:
+    case PtFormatSection::ModelBaseColorTextureIndices:
+    case PtFormatSection::BaseColorTextures:
+    case PtFormatSection::SourceHash:
+    case PtFormatSection::CompressedBaseColorTextures:
+    case PtFormatSection::PagedBaseColorTextures:
+        break;
+    }
+    return SectionEncoding::Raw;
+}
+
+template<typename T>
+SectionWriter arrayWriter(
+    const GeometryCompression compression,
+    const PtFormatSection     section,
+    const std::vector<T>&     data)
+{
+    const SectionEncoding            encoding = sectionEncoding(section, compression);
+    const std::span<const std::byte> bytes = std::as_bytes(std::span(data));
+    if (encoding == SectionEncoding::Raw)
+    {
+        return {section, encoding, bytes.size(), [&data](PtFormatWriter& writer) {
+                    writeArray(writer, data);
+                }};
+    }
+    const auto encoded =
+        std::make_shared<const std::vector<std::byte>>(encodeSection(encoding, bytes, sizeof(T)));
+    return {section, encoding, bytes.size(), [encoded](PtFormatWriter& writer) {
+                writer.write(encoded->data(), encoded->size());
+            }};
+}
+
+SectionWriter rawWriter(const PtFormatSection section, std::function<void(PtFormatWriter&)> write)
+{
+    return {section, SectionEncoding::Raw, 0, std::move(write)};
+}
+
+SectionWriter textureWriter(const PtFormat& format)
+{
+    if (!format.pagedBaseColorTextures.descriptors.empty())
+    {
+        return rawWriter(PtFormatSection::PagedBaseColorTextures, [&](PtFormatWriter& writer) {
+            writePagedTextures(writer, format.pagedBaseColorTextures);
+        });
+    }
+    if (!format.compressedBaseColorTextures.empty())
+    {
+        return rawWriter(PtFormatSection::CompressedBaseColorTextures, [&](PtFormatWriter& writer) {
+            writeCompressedTextures(writer, format.compressedBaseColorTextures);
+        });
+    }
+    return rawWriter(PtFormatSection::BaseColorTextures, [&](PtFormatWriter& writer) {
+        writeTextures(writer, format.baseColorTextures);
+    });
+}
+
+template<typename T>
+std::vector<std::span<const T>> toSlices(
+    const PtFormatSection          section,
+    const std::vector<SliceRange>& ranges,
+    const std::span<const T>       buffer)
+{
+    std::vector<std::span<const T>> slices;
+    slices.reserve(ranges.size());
+    for (const auto& [offset, count] : ranges)
+    {
+        if (offset > buffer.size() || count > buffer.size() - offset)
+        {
+            throw std::runtime_error(fmt::format(
+                "Invalid PtFormat file: slice out of bounds in section {}.",
+                sectionName(section)));
+        }
+        slices.push_back(buffer.subspan(offset, count));
+    }
+    return slices;
+}
+} // namespace
+
+std::string_view sectionName(const PtFormatSection section)
+{
+    switch (section)
+    {
+    case PtFormatSection::BvhNodes:
+        return "BvhNodes";
+    case PtFormatSection::BvhPositionAttributes:
+        return "BvhPositionAttributes";
+    case PtFormatSection::TrianglePositionAttributes:
+        return "TrianglePositionAttributes";
+    case PtFormatSection::TriangleVertexAttributes:
+        return "TriangleVertexAttributes";
+    case PtFormatSection::VertexPositions:
+        return "VertexPositions";
+    case PtFormatSection::VertexNormals:
+        return "VertexNormals";
+    case PtFormatSection::VertexTexCoords:
+        return "VertexTexCoords";
+    case PtFormatSection::VertexIndices:
+        return "VertexIndices";
+    case PtFormatSection::ModelVertexPositions:
+        return "ModelVertexPositions";
+    case PtFormatSection::ModelVertexNormals:
+        return "ModelVertexNormals";
+    case PtFormatSection::ModelVertexTexCoords:
+        return "ModelVertexTexCoords";
+    case PtFormatSection::ModelVertexIndices:
+        return "ModelVertexIndices";
+    case PtFormatSection::ModelBaseColorTextureIndices:
+        return "ModelBaseColorTextureIndices";
+    case PtFormatSection::BaseColorTextures:
+        return "BaseColorTextures";
+    case PtFormatSection::SourceHash:
+        return "SourceHash";
+    case PtFormatSection::CompressedBaseColorTextures:
+        return "CompressedBaseColorTextures";
+    case PtFormatSection::PagedBaseColorTextures:
+        return "PagedBaseColorTextures";
+    }
+    return "Unknown";
+}
+
+void serialize(OutputStream& stream, const PtFormat& format, const GeometryCompression compression)
+{
+    // The same order as convertGltf, which writes each section as soon as it has been produced.
+    const SectionWriter sectionWriters[] = {
+        textureWriter(format),
+        arrayWriter(compression, PtFormatSection::VertexPositions, format.vertexPositions),
+        arrayWriter(compression, PtFormatSection::VertexNormals, format.vertexNormals),
+        arrayWriter(compression, PtFormatSection::VertexTexCoords, format.vertexTexCoords),
+        arrayWriter(compression, PtFormatSection::VertexIndices, format.vertexIndices),
+        rawWriter(
+            PtFormatSection::ModelVertexPositions,
+            [&](PtFormatWriter& writer) {
+                writeSlices(writer, format.vertexPositions, format.modelVertexPositions);
+            }),
+        rawWriter(
+            PtFormatSection::ModelVertexNormals,
+            [&](PtFormatWriter& writer) {
+                writeSlices(writer, format.vertexNormals, format.modelVertexNormals);
+            }),
+        rawWriter(
+            PtFormatSection::ModelVertexTexCoords,
+            [&](PtFormatWriter& writer) {
+                writeSlices(writer, format.vertexTexCoords, format.modelVertexTexCoords);
+            }),
+        rawWriter(
+            PtFormatSection::ModelVertexIndices,
+            [&](PtFormatWriter& writer) {
+                writeSlices(writer, format.vertexIndices, format.modelVertexIndices);
+            }),
+        arrayWriter(
+            compression,
+            PtFormatSection::ModelBaseColorTextureIndices,
+            format.modelBaseColorTextureIndices),
+        arrayWriter(compression, PtFormatSection::BvhNodes, format.bvhNodes),
+        arrayWriter(
+            compression, PtFormatSection::BvhPositionAttributes, format.bvhPositionAttributes),
+        arrayWriter(
+            compression,
+            PtFormatSection::TrianglePositionAttributes,
+            format.trianglePositionAttributes),
+        arrayWriter(
+            compression,
+            PtFormatSection::TriangleVertexAttributes,
+            format.triangleVertexAttributes),
+    };
+
+    // The table of contents precedes the sections, so each section is written twice: first to
+    // measure its size and checksum, and then to the stream.
+    std::vector<PtFormatSectionEntry> entries;
+    {
+        const std::size_t headerSize = MAGIC_BYTES.size() +
+                                       paddingTo(MAGIC_BYTES.size(), SECTION_ALIGNMENT) +
+                                       sizeof(std::uint64_t) +
+                                       std::size(sectionWriters) * sizeof(PtFormatSectionEntry);
+        std::uint64_t offset = headerSize;
+        for (const auto& [section, encoding, decodedSize, writeSection] : sectionWriters)
+        {
+            ChecksumStream checksumStream;
+            PtFormatWriter checksumWriter(checksumStream);
+            writeSection(checksumWriter);
+
+            offset += paddingTo(offset, SECTION_ALIGNMENT);
+            entries.push_back(PtFormatSectionEntry{
+                .section = section,
+                .encoding = encoding,
+                .offset = offset,
+                .size = checksumStream.numBytes(),
+                .decodedSize =
+                    encoding == SectionEncoding::Raw ? checksumStream.numBytes() : decodedSize,
+                .checksum = checksumStream.checksum(),
+                .alignment = static_cast<std::uint32_t>(SECTION_ALIGNMENT),
+                .pad = 0});
+            offset += checksumStream.numBytes();
+        }
+    }
+
+    PtFormatWriter writer(stream);
+    writer.write(MAGIC_BYTES.data(), MAGIC_BYTES.size());
+    writer.align();
+    writer.write(static_cast<std::uint64_t>(entries.size()));
+    writer.write(entries.data(), entries.size() * sizeof(PtFormatSectionEntry));
+
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        writer.align();
+        NLRS_ASSERT(writer.offset() == entries[i].offset);
+        sectionWriters[i].write(writer);
+        NLRS_ASSERT(writer.offset() == entries[i].offset + entries[i].size);
+    }
+}
+
+void deserialize(InputStream& stream, PtFormat& format, const std::uint32_t numThreads)
+{
+    PtFormatReader reader(stream);
+
+    std::string magicBytes;
+    magicBytes.resize(MAGIC_BYTES.size());
+    reader.read(magicBytes.data(), magicBytes.size());
+    checkMagicBytes(magicBytes);
+    reader.align();
+
+    const std::uint64_t numSections = reader.read<std::uint64_t>();
+    if (numSections > MAX_NUM_SECTIONS)
+    {
+        throw std::runtime_error("Invalid PtFormat file: too many sections.");
+    }
+    std::vector<PtFormatSectionEntry> entries(static_cast<std::size_t>(numSections));
+    reader.read(entries.data(), entries.size() * sizeof(PtFormatSectionEntry));
+
+    // A stream can only be read forwards.
+    std::sort(entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) -> bool {
+        return lhs.offset < rhs.offset;
+    });
+    // Each section is read into its array while the previous sections are still being validated.
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        if (std::any_of(entries.begin() + i + 1, entries.end(), [&](const auto& entry) -> bool {
+                return entry.section == entries[i].section;
+            }))
+        {
+            throw std::runtime_error(fmt::format(
+                "Invalid PtFormat file: duplicate section {}.", sectionName(entries[i].section)));
+        }
+    }
+
+    ParallelSectionReader   sectionReader(reader, numThreads > 0 ? numThreads : hardwareThreads());
+    std::vector<SliceRange> modelVertexPositions;
+    std::vector<SliceRange> modelVertexNormals;
+    std::vector<SliceRange> modelVertexTexCoords;
+    std::vector<SliceRange> modelVertexIndices;
+    for (const PtFormatSectionEntry& entry : entries)
+    {
+        checkSectionEntry(entry, std::numeric_limits<std::uint64_t>::max());
+        if (entry.offset < reader.offset())
+        {
+            throw std::runtime_error(fmt::format(
+                "Invalid PtFormat file: section {} overlaps another section.",
+                sectionName(entry.section)));
+        }
+        reader.skip(entry.offset - reader.offset());
+
+        switch (entry.section)
+        {
+        case PtFormatSection::BvhNodes:
+            sectionReader.readArray(entry, format.bvhNodes);
+            break;
+        case PtFormatSection::BvhPositionAttributes:
+            sectionReader.readArray(entry, format.bvhPositionAttributes);
+            break;
+        case PtFormatSection::TrianglePositionAttributes:
+            sectionReader.readArray(entry, format.trianglePositionAttributes);
+            break;
+        case PtFormatSection::TriangleVertexAttributes:
+            sectionReader.readArray(entry, format.triangleVertexAttributes);
+            break;
+        case PtFormatSection::VertexPositions:
+            sectionReader.readArray(entry, format.vertexPositions);
+            break;
+        case PtFormatSection::VertexNormals:
+            sectionReader.readArray(entry, format.vertexNormals);
+            break;
+        case PtFormatSection::VertexTexCoords:
+            sectionReader.readArray(entry, format.vertexTexCoords);
+            break;
+        case PtFormatSection::VertexIndices:
+            sectionReader.readArray(entry, format.vertexIndices);
+            break;
+        case PtFormatSection::ModelVertexPositions:
+            sectionReader.readArray(entry, modelVertexPositions);
+            break;
+        case PtFormatSection::ModelVertexNormals:
+            sectionReader.readArray(entry, modelVertexNormals);
+            break;
+        case PtFormatSection::ModelVertexTexCoords:
+            sectionReader.readArray(entry, modelVertexTexCoords);
+            break;
+        case PtFormatSection::ModelVertexIndices:
+            sectionReader.readArray(entry, modelVertexIndices);
+            break;
+        case PtFormatSection::ModelBaseColorTextureIndices:
+            sectionReader.readArray(entry, format.modelBaseColorTextureIndices);
+            break;
+        case PtFormatSection::BaseColorTextures:
+            sectionReader.readTextures(entry, format.baseColorTextures);
+            break;
+        case PtFormatSection::CompressedBaseColorTextures:
+            sectionReader.readCompressedTextures(entry, format.compressedBaseColorTextures);
+            break;
+        case PtFormatSection::PagedBaseColorTextures:
+            sectionReader.readPagedTextures(entry, format.pagedBaseColorTextures);
+            break;
+        default:
+            // Sections added by later versions of the format.
+            sectionReader.readUnknown(entry);
+            break;
+        }
+
+        if (reader.offset() != entry.offset + entry.size)
+        {
+            throw std::runtime_error(fmt::format(
+                "Invalid PtFormat file: unexpected size of section {}.",
+                sectionName(entry.section)));
+        }
+    }
+    sectionReader.finish();
+
+    for (const PtFormatSection section : REQUIRED_SECTIONS)
+    {
+        if (std::none_of(entries.begin(), entries.end(), [section](const auto& entry) -> bool {
+                return entry.section == section;
+            }))
+        {
+            throwMissingSection(section);
+        }
+    }
+    if (std::none_of(entries.begin(), entries.end(), [](const auto& entry) -> bool {
+            return isTextureSection(entry.section);
+        }))
+    {
+        throwMissingSection(PtFormatSection::BaseColorTextures);
+    }
+    if (!format.compressedBaseColorTextures.empty())
+    {
+        format.baseColorTextures = decompressTextures(
+            format.compressedBaseColorTextures, numThreads > 0 ? numThreads : hardwareThreads());
+    }
+    if (!format.pagedBaseColorTextures.descriptors.empty())
+    {
+        format.baseColorTextures = unpageTextures(VirtualTexturePages{
+            .descriptors = format.pagedBaseColorTextures.descriptors,
+            .pages = format.pagedBaseColorTextures.pages});
+    }
+
+    format.modelVertexPositions = toSlices(
+        PtFormatSection::ModelVertexPositions,
+        modelVertexPositions,
+        std::span<const glm::vec4>(format.vertexPositions));
+    format.modelVertexNormals = toSlices(
+        PtFormatSection::ModelVertexNormals,
+        modelVertexNormals,
+        std::span<const glm::vec4>(format.vertexNormals));
+    format.modelVertexTexCoords = toSlices(
+        PtFormatSection::ModelVertexTexCoords,
+        modelVertexTexCoords,
+        std::span<const glm::vec2>(format.vertexTexCoords));
+    format.modelVertexIndices = toSlices(
+        PtFormatSection::ModelVertexIndices,
+        modelVertexIndices,
+        std::span<const std::uint32_t>(format.vertexIndices));
+}
+
+struct PtFormatFileWriter::State
+{
+    State(
+        const std::filesystem::path& path,
+        const std::size_t            numSections,
+        const GeometryCompression    compression,
+        const FileStreamOptions      fileOptions)
+        : stream(path, fileOptions),
+          writer(stream),
+          compression(compression),
+          numSections(numSections),
+          entries(),
+          section(),
+          encoder()
+    {
+    }
+
+    SectionFileStream                   stream;
+    PtFormatWriter                      writer;
+    GeometryCompression                 compression;
+    std::size_t                         numSections;
+    std::vector<PtFormatSectionEntry>   entries;
+    // The section being written, if any.
+    std::optional<PtFormatSectionEntry> section;
+    // Only used for compressed sections.
+    std::optional<SectionEncoder>       encoder;
+};
+
+namespace
+{
+std::uint64_t tableOfContentsOffset()
+{
+    return MAGIC_BYTES.size() + paddingTo(MAGIC_BYTES.size(), SECTION_ALIGNMENT) +
+           sizeof(std::uint64_t);
+}
+} // namespace
+
+PtFormatFileWriter::PtFormatFileWriter(
+    const std::filesystem::path& path,
+    const std::size_t            numSections,
+    const GeometryCompression    compression,
+    const FileStreamOptions      fileOptions)
+    : mState(std::make_unique<State>(path, numSections, compression, fileOptions))
+{
+    PtFormatWriter& writer = mState->writer;
+    writer.write(MAGIC_BYTES.data(), MAGIC_BYTES.size());
+    writer.align();
+    writer.write(static_cast<std::uint64_t>(numSections));
+    NLRS_ASSERT(writer.offset() == tableOfContentsOffset());
+    // Filled in by finish. Until then, the zeroed entries are rejected when the file is read.
+    const PtFormatSectionEntry emptyEntry{};
+    for (std::size_t i = 0; i < numSections; ++i)
     {
-        std::uint64_t numTextures;
+        writer.write(emptyEntry);
+    }
+    mState->entries.reserve(numSections);
+}
+
+PtFormatFileWriter::~PtFormatFileWriter() = default;
+
+PtFormatFileWriter::PtFormatFileWriter(PtFormatFileWriter&&) noexcept = default;
+
+PtFormatFileWriter& PtFormatFileWriter::operator=(PtFormatFileWriter&&) noexcept = default;
+
+void PtFormatFileWriter::writeTextures(
+    const PtFormatSection          section,
+    const std::span<const Texture> textures)
+{
+    beginSection(section, 1);
+    NLRS_ASSERT(!mState->encoder);
+    nlrs::writeTextures(mState->writer, textures);
+    endSection();
+}
+
+void PtFormatFileWriter::writeCompressedTextures(
+    const PtFormatSection                    section,
+    const std::span<const CompressedTexture> textures)
+{
+    beginSection(section, 1);
+    NLRS_ASSERT(!mState->encoder);
+    nlrs::writeCompressedTextures(mState->writer, textures);
+    endSection();
+}
+
+void PtFormatFileWriter::writePagedTextures(
+    const PtFormatSection section,
+    const PagedTextures&  textures)
+{
+    beginSection(section, 1);
+    NLRS_ASSERT(!mState->encoder);
+    nlrs::writePagedTextures(mState->writer, textures);
+    endSection();
+}
+
+void PtFormatFileWriter::writePagedTextures(
+    const PtFormatSection                                              section,
+    const std::span<const VirtualTextureDescriptor>                    descriptors,
+    const std::function<std::vector<Texture::BgraPixel>(std::size_t)>& texturePages)
+{
+    std::uint64_t numPages = 0;
+    for (const VirtualTextureDescriptor& descriptor : descriptors)
+    {
+        NLRS_ASSERT(descriptor.firstPage == numPages);
+        numPages += virtualTextureNumPages(
+            Texture::Dimensions{descriptor.width, descriptor.height}, descriptor.numMipLevels);
+    }
+
+    beginSection(section, 1);
+    NLRS_ASSERT(!mState->encoder);
+    writePagedTexturesHeader(mState->writer, descriptors, numPages);
+    for (std::size_t i = 0; i < descriptors.size(); ++i)
+    {
+        const std::vector<Texture::BgraPixel> pages = texturePages(i);
         NLRS_ASSERT(
-            stream.read(reinterpret_cast<char*>(&numTextures), sizeof(std::uint64_t)) ==
-            sizeof(std::uint64_t));
-        format.baseColorTextures.resize(numTextures);
-        std::for_each(
-            format.baseColorTextures.begin(), format.baseColorTextures.end(), [&](auto& texture) {
-                deserialize(stream, texture);
+            pages.size() ==
+            std::size_t{virtualTextureNumPages(
+                Texture::Dimensions{descriptors[i].width, descriptors[i].height},
+                descriptors[i].numMipLevels)} *
+                VIRTUAL_TEXTURE_PAGE_NUM_TEXELS);
+        mState->writer.write(pages.data(), pages.size() * sizeof(Texture::BgraPixel));
+    }
+    endSection();
+}
+
+void PtFormatFileWriter::beginSection(const PtFormatSection section, const std::size_t elementSize)
+{
+    NLRS_ASSERT(!mState->section);
+    NLRS_ASSERT(mState->entries.size() < mState->numSections);
+
+    mState->writer.align();
+    mState->stream.beginSection();
+
+    const SectionEncoding encoding = sectionEncoding(section, mState->compression);
+    mState->section = PtFormatSectionEntry{
+        .section = section,
+        .encoding = encoding,
+        .offset = mState->writer.offset(),
+        .size = 0,
+        .decodedSize = 0,
+        .checksum = 0,
+        .alignment = static_cast<std::uint32_t>(SECTION_ALIGNMENT),
+        .pad = 0};
+    if (encoding != SectionEncoding::Raw)
+    {
+        mState->encoder.emplace(encoding, elementSize);
+    }
+}
+
+void PtFormatFileWriter::append(const std::span<const std::byte> bytes)
+{
+    NLRS_ASSERT(mState->section);
+    if (mState->encoder)
+    {
+        mState->encoder->append(bytes);
+    }
+    else
+    {
+        mState->writer.write(bytes.data(), bytes.size());
+    }
+    mState->section->decodedSize += bytes.size();
+}
+
+void PtFormatFileWriter::endSection()
+{
+    NLRS_ASSERT(mState->section);
+    if (mState->encoder)
+    {
+        const std::vector<std::byte> encoded = mState->encoder->finish();
+        mState->writer.write(encoded.data(), encoded.size());
+        mState->encoder.reset();
+    }
+
+    PtFormatSectionEntry& entry = *mState->section;
+    entry.size = mState->stream.section().numBytes();
+    if (entry.encoding == SectionEncoding::Raw)
+    {
+        // Also counts the texture headers and padding, which are not appended.
+        entry.decodedSize = entry.size;
+    }
+    entry.checksum = mState->stream.section().checksum();
+    mState->entries.push_back(entry);
+    mState->section.reset();
+}
+
+void PtFormatFileWriter::finish()
+{
+    NLRS_ASSERT(!mState->section);
+    NLRS_ASSERT(mState->entries.size() == mState->numSections);
+    mState->stream.overwrite(
+        tableOfContentsOffset(),
+        mState->entries.data(),
+        mState->entries.size() * sizeof(PtFormatSectionEntry));
+    mState->stream.close();
+}
+
+namespace
+{
+// The per-vertex and per-triangle arrays are converted in chunks of this many elements, so that
+// only a chunk of each converted array is in memory at a time.
+constexpr std::size_t CONVERSION_CHUNK_SIZE = 1 << 16;
+
+// Appends `element(i)` for each i in [0, count) to the section being written, in chunks.
+template<typename T, typename F>
+void appendChunked(PtFormatFileWriter& writer, const std::size_t count, const F& element)
+{
+    std::vector<T> chunk;
+    chunk.reserve(std::min(count, CONVERSION_CHUNK_SIZE));
+    for (std::size_t begin = 0; begin < count; begin += CONVERSION_CHUNK_SIZE)
+    {
+        const std::size_t end = std::min(begin + CONVERSION_CHUNK_SIZE, count);
+        chunk.clear();
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            chunk.push_back(element(i));
+        }
+        writer.append(std::as_bytes(std::span(chunk)));
+    }
+}
+
+// The BVH only depends on the triangle positions, so a cached BVH is reused if they are unchanged.
+Bvh buildCachedBvh(
+    const std::span<const Positions> positions,
+    const ConversionCache* const     cache)
+{
+    if (cache == nullptr)
+    {
+        return buildBvh(positions);
+    }
+    const std::uint64_t key = fnv1a(positions.data(), positions.size_bytes());
+    if (std::optional<Bvh> bvh = cache->loadBvh(key);
+        bvh && bvh->triangleIndices.size() == positions.size())
+    {
+        return std::move(*bvh);
+    }
+    Bvh bvh = buildBvh(positions);
+    cache->storeBvh(key, bvh);
+    return bvh;
+}
+
+// The sections are written in the same order, and with the same contents, as in serialize. The
+// SourceHash section follows the other sections.
+void convertModel(
+    GltfModel                          model,
+    const std::filesystem::path&       ptPath,
+    const ConversionOptions&           options,
+    const std::optional<std::uint64_t> sourceHash)
+{
+    if (options.virtualTextures && options.textureCompression != TextureCompression::None)
+    {
+        throw std::runtime_error("Virtual textures can not be block compressed.");
+    }
+
+    // The required sections, the texture section and the optional SourceHash section.
+    PtFormatFileWriter writer(
+        ptPath,
+        std::size(REQUIRED_SECTIONS) + 1 + (sourceHash ? 1 : 0),
+        options.compression,
+        FileStreamOptions{.directIo = options.directIo});
+
+    {
+        std::vector<Texture> textures = std::move(model.baseColorTextures);
+        ThreadPool           threadPool(
+            (options.numThreads > 0 ? options.numThreads : hardwareThreads()) - 1);
+        if (options.virtualTextures)
+        {
+            // Only the mip chain and the pages of one texture are in memory at a time, and each
+            // source texture is released once it has been paged.
+            std::vector<VirtualTextureDescriptor> descriptors;
+            std::uint32_t                         numPages = 0;
+            for (const Texture& texture : textures)
+            {
+                const std::uint32_t numMipLevels = Texture::maxMipLevels(texture.dimensions());
+                descriptors.push_back(VirtualTextureDescriptor{
+                    .width = texture.dimensions().width,
+                    .height = texture.dimensions().height,
+                    .numMipLevels = numMipLevels,
+                    .firstPage = numPages});
+                numPages += virtualTextureNumPages(texture.dimensions(), numMipLevels);
+            }
+            writer.writePagedTextures(
+                PtFormatSection::PagedBaseColorTextures,
+                descriptors,
+                [&textures, &threadPool](const std::size_t i) -> std::vector<Texture::BgraPixel> {
+                    const Texture texture =
+                        std::exchange(textures[i], Texture()).withMipmaps(threadPool);
+                    return pageTextures(std::span(&texture, 1), threadPool).pages;
+                });
+        }
+        else if (options.textureCompression == TextureCompression::None)
+        {
+            for (Texture& texture : textures)
+            {
+                texture = texture.withMipmaps(threadPool);
+            }
+            writer.writeTextures(PtFormatSection::BaseColorTextures, textures);
+        }
+        else
+        {
+            std::vector<CompressedTexture> compressedTextures;
+            compressedTextures.reserve(textures.size());
+            for (Texture& texture : textures)
+            {
+                // Only the compressed copy is kept.
+                compressedTextures.push_back(compressTexture(
+                    std::exchange(texture, Texture()).withMipmaps(threadPool),
+                    options.textureCompression,
+                    options.textureQuality,
+                    threadPool));
+            }
+            writer.writeCompressedTextures(
+                PtFormatSection::CompressedBaseColorTextures, compressedTextures);
+        }
+    }
+
+    std::vector<SliceRange>    vertexRanges;
+    std::vector<SliceRange>    indexRanges;
+    std::vector<std::uint32_t> textureIndices;
+    // The index of the first triangle of each mesh, followed by the total number of triangles.
+    std::vector<std::size_t>   meshTriangleOffsets{0};
+    std::uint64_t              numVertices = 0;
+    std::uint64_t              numIndices = 0;
+    for (const GltfMesh& mesh : model.meshes)
+    {
+        NLRS_ASSERT(mesh.positions.size() == mesh.normals.size());
+        NLRS_ASSERT(mesh.positions.size() == mesh.texCoords.size());
+        NLRS_ASSERT(
+            mesh.baseColorTextureIndex <
+            static_cast<std::size_t>(std::numeric_limits<std::uint32_t>::max()));
+        vertexRanges.push_back(SliceRange{.offset = numVertices, .count = mesh.positions.size()});
+        indexRanges.push_back(SliceRange{.offset = numIndices, .count = mesh.indices.size()});
+        numVertices += mesh.positions.size();
+        numIndices += mesh.indices.size();
+        textureIndices.push_back(static_cast<std::uint32_t>(mesh.baseColorTextureIndex));
+        meshTriangleOffsets.push_back(meshTriangleOffsets.back() + mesh.indices.size() / 3);
+    }
+    const std::size_t numTriangles = meshTriangleOffsets.back();
+
+    writer.beginSection(PtFormatSection::VertexPositions, sizeof(glm::vec4));
+    for (const GltfMesh& mesh : model.meshes)
+    {
+        appendChunked<glm::vec4>(writer, mesh.positions.size(), [&mesh](const std::size_t i) {
+            return glm::vec4(mesh.positions[i], 1.0f);
+        });
+    }
+    writer.endSection();
+    writer.beginSection(PtFormatSection::VertexNormals, sizeof(glm::vec4));
+    for (const GltfMesh& mesh : model.meshes)
+    {
+        appendChunked<glm::vec4>(writer, mesh.normals.size(), [&mesh](const std::size_t i) {
+            return glm::vec4(mesh.normals[i], 0.0f);
+        });
+    }
+    writer.endSection();
+    writer.beginSection(PtFormatSection::VertexTexCoords, sizeof(glm::vec2));
+    for (const GltfMesh& mesh : model.meshes)
+    {
+        writer.append(std::as_bytes(std::span(mesh.texCoords)));
+    }
+    writer.endSection();
+    writer.beginSection(PtFormatSection::VertexIndices, sizeof(std::uint32_t));
+    for (const GltfMesh& mesh : model.meshes)
+    {
+        writer.append(std::as_bytes(std::span(mesh.indices)));
+    }
+    writer.endSection();
+
+    writer.writeArray<SliceRange>(PtFormatSection::ModelVertexPositions, vertexRanges);
+    writer.writeArray<SliceRange>(PtFormatSection::ModelVertexNormals, vertexRanges);
+    writer.writeArray<SliceRange>(PtFormatSection::ModelVertexTexCoords, vertexRanges);
+    writer.writeArray<SliceRange>(PtFormatSection::ModelVertexIndices, indexRanges);
+    writer.writeArray<std::uint32_t>(
+        PtFormatSection::ModelBaseColorTextureIndices, textureIndices);
+
+    // The triangle in the model of each triangle in BVH order.
+    std::vector<std::size_t> sourceTriangles(numTriangles);
+    {
+        // Only the positions are flattened, unlike with FlattenedModel.
+        std::vector<Positions> positions;
+        positions.reserve(numTriangles);
+        for (const GltfMesh& mesh : model.meshes)
+        {
+            for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+            {
+                positions.push_back(Positions{
+                    .v0 = mesh.positions[mesh.indices[i + 0]],
+                    .v1 = mesh.positions[mesh.indices[i + 1]],
+                    .v2 = mesh.positions[mesh.indices[i + 2]]});
+            }
+        }
+
+        {
+            const Bvh bvh = buildCachedBvh(positions, options.cache);
+            writer.writeArray<BvhNode>(PtFormatSection::BvhNodes, bvh.nodes);
+            // The inverse of the permutation applied by reorderAttributes.
+            for (std::size_t i = 0; i < numTriangles; ++i)
+            {
+                sourceTriangles[bvh.triangleIndices[i]] = i;
+            }
+        }
+
+        writer.beginSection(PtFormatSection::BvhPositionAttributes, sizeof(Positions));
+        appendChunked<Positions>(writer, numTriangles, [&](const std::size_t i) {
+            return positions[sourceTriangles[i]];
+        });
+        writer.endSection();
+
+        writer.beginSection(
+            PtFormatSection::TrianglePositionAttributes, sizeof(PositionAttribute));
+        appendChunked<PositionAttribute>(writer, numTriangles, [&](const std::size_t i) {
+            const Positions& ps = positions[sourceTriangles[i]];
+            return PositionAttribute{.p0 = ps.v0, .p1 = ps.v1, .p2 = ps.v2};
+        });
+        writer.endSection();
+    }
+
+    writer.beginSection(PtFormatSection::TriangleVertexAttributes, sizeof(VertexAttributes));
+    appendChunked<VertexAttributes>(writer, numTriangles, [&](const std::size_t i) {
+        const std::size_t triangleIdx = sourceTriangles[i];
+        const std::size_t meshIdx =
+            static_cast<std::size_t>(
+                std::upper_bound(
+                    meshTriangleOffsets.begin(), meshTriangleOffsets.end(), triangleIdx) -
+                meshTriangleOffsets.begin()) -
+            1;
+        const GltfMesh&     mesh = model.meshes[meshIdx];
+        const std::size_t   firstIdx = 3 * (triangleIdx - meshTriangleOffsets[meshIdx]);
+        const std::uint32_t idx0 = mesh.indices[firstIdx + 0];
+        const std::uint32_t idx1 = mesh.indices[firstIdx + 1];
+        const std::uint32_t idx2 = mesh.indices[firstIdx + 2];
+        return VertexAttributes{
+            .n0 = mesh.normals[idx0],
+            .n1 = mesh.normals[idx1],
+            .n2 = mesh.normals[idx2],
+            .uv0 = mesh.texCoords[idx0],
+            .uv1 = mesh.texCoords[idx1],
+            .uv2 = mesh.texCoords[idx2],
+            .textureIdx = static_cast<std::uint32_t>(mesh.baseColorTextureIndex)};
+    });
+    writer.endSection();
+
+    if (sourceHash)
+    {
+        writer.writeArray<std::uint64_t>(PtFormatSection::SourceHash, std::span(&*sourceHash, 1));
+    }
+
+    writer.finish();
+}
+
+// Increment when convertGltf produces a different file from the same glTF file, so that files
+// converted by older versions are converted again.
+constexpr std::uint32_t CONVERTER_VERSION = 5;
+} // namespace
+
+GltfDeduplication convertGltf(
+    const std::filesystem::path& gltfPath,
+    const std::filesystem::path& ptPath,
+    const ConversionOptions&     options)
+{
+    // Hashed before loading, so that a file which changes during the conversion is converted again.
+    const std::uint64_t          sourceHash = gltfSourceHash(gltfPath, options);
+    const ConversionCache* const cache = options.cache;
+    const auto decodeUncached = [cache](const std::span<const std::uint8_t> data) -> Texture {
+        if (cache == nullptr)
+        {
+            return Texture::fromMemory(data);
+        }
+        const std::uint64_t key = encodedImageKey(data);
+        if (std::optional<Texture> texture = cache->loadTexture(key))
+        {
+            return std::move(*texture);
+        }
+        Texture texture = Texture::fromMemory(data);
+        cache->storeTexture(key, texture);
+        return texture;
+    };
+    TextureResidencyCache* const residentTextures = options.residentTextures;
+    const ImageDecoder           decodeImage =
+        [&decodeUncached, residentTextures](const std::span<const std::uint8_t> data) -> Texture {
+        if (residentTextures == nullptr)
+        {
+            return decodeUncached(data);
+        }
+        const std::shared_ptr<const Texture> texture = residentTextures->acquire(
+            encodedImageKey(data), [&decodeUncached, data]() -> Texture {
+                return decodeUncached(data);
             });
+        // The model owns its textures, and the conversion releases them once they are written.
+        return Texture(
+            std::vector<Texture::Pixel>(texture->mipChain().begin(), texture->mipChain().end()),
+            texture->dimensions(),
+            texture->channelOrder(),
+            texture->numMipLevels());
+    };
+    GltfModel               model(gltfPath, decodeImage, options.numThreads);
+    const GltfDeduplication deduplication = model.deduplication;
+    convertModel(std::move(model), ptPath, options, sourceHash);
+    return deduplication;
+}
+
+GltfDeduplication convertGltf(
+    GltfModel                    model,
+    const std::filesystem::path& ptPath,
+    const ConversionOptions&     options)
+{
+    const GltfDeduplication deduplication = model.deduplication;
+    convertModel(std::move(model), ptPath, options, std::nullopt);
+    return deduplication;
+}
+
+std::uint64_t gltfSourceHash(
+    const std::filesystem::path& gltfPath,
+    const ConversionOptions&     options)
+{
+    std::uint64_t hash = fnv1a(MAGIC_BYTES.data(), MAGIC_BYTES.size());
+    hash = fnv1a(&CONVERTER_VERSION, sizeof(CONVERTER_VERSION), hash);
+    // The cache and the number of threads do not affect the output.
+    hash = fnv1a(&options.compression, sizeof(options.compression), hash);
+    hash = fnv1a(&options.textureCompression, sizeof(options.textureCompression), hash);
+    if (options.textureCompression != TextureCompression::None)
+    {
+        hash = fnv1a(&options.textureQuality, sizeof(options.textureQuality), hash);
+    }
+    // Only hashed when set, so that the hashes of files without virtual textures are unchanged.
+    if (options.virtualTextures)
+    {
+        hash = fnv1a(&options.virtualTextures, sizeof(options.virtualTextures), hash);
     }
+
+    std::vector<char> buffer(CHECKSUM_CHUNK_SIZE);
+    const auto        hashFile = [&buffer, &hash](const std::filesystem::path& path) -> void {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error(fmt::format("Failed to open file: {}", path.string()));
+        }
+        std::uint64_t size = 0;
+        while (file)
+        {
+            file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            const std::size_t numRead = static_cast<std::size_t>(file.gcount());
+            hash = fnv1a(buffer.data(), numRead, hash);
+            size += numRead;
+        }
+        // Separates the contents of consecutive files.
+        hash = fnv1a(&size, sizeof(size), hash);
+    };
+
+    hashFile(gltfPath);
+    for (const std::filesystem::path& dependency : gltfDependencies(gltfPath))
+    {
+        hashFile(dependency);
+    }
+    return hash;
+}
+
+std::optional<std::uint64_t> readSourceHash(const std::filesystem::path& ptPath)
+{
+    if (!std::filesystem::exists(ptPath))
+    {
+        return std::nullopt;
+    }
+    try
+    {
+        const PtFormatFile file(ptPath);
+        if (!file.hasSection(PtFormatSection::SourceHash))
+        {
+            return std::nullopt;
+        }
+        file.validate(PtFormatSection::SourceHash);
+        const std::span<const std::uint64_t> hash =
+            file.array<std::uint64_t>(PtFormatSection::SourceHash);
+        if (hash.size() != 1)
+        {
+            return std::nullopt;
+        }
+        return hash[0];
+    }
+    catch (const std::runtime_error&)
+    {
+        // E.g. a file written by an older version.
+        return std::nullopt;
+    }
+}
+
+// Compressed sections, decoded on first access. The vectors are not modified after insertion, so
+// spans into them remain valid.
+struct PtFormatFile::DecodedSections
+{
+    std::mutex                                         mutex;
+    std::map<PtFormatSection, std::vector<std::byte>> sections;
+};
+
+PtFormatFile::PtFormatFile(const std::filesystem::path& path)
+    : mFile(path),
+      mSections(),
+      mDecodedSections(std::make_unique<DecodedSections>())
+{
+    const std::span<const std::byte> bytes = mFile.bytes();
+    ByteReader                       reader(bytes);
+
+    {
+        const std::span<const std::byte> magicBytes =
+            reader.read(std::min(MAGIC_BYTES.size(), bytes.size()));
+        checkMagicBytes(std::string_view(
+            reinterpret_cast<const char*>(magicBytes.data()), magicBytes.size()));
+        reader.align();
+    }
+
+    const std::uint64_t numSections = reader.read<std::uint64_t>();
+    if (numSections > MAX_NUM_SECTIONS)
+    {
+        throw std::runtime_error("Invalid PtFormat file: too many sections.");
+    }
+    mSections.reserve(static_cast<std::size_t>(numSections));
+    for (std::uint64_t i = 0; i < numSections; ++i)
+    {
+        const auto entry = reader.read<PtFormatSectionEntry>();
+        checkSectionEntry(entry, bytes.size());
+        mSections.push_back(entry);
+    }
+}
+
+PtFormatFile::~PtFormatFile() = default;
+
+PtFormatFile::PtFormatFile(PtFormatFile&&) noexcept = default;
+
+PtFormatFile& PtFormatFile::operator=(PtFormatFile&&) noexcept = default;
+
+bool PtFormatFile::hasSection(const PtFormatSection section) const noexcept
+{
+    return findSection(section) != nullptr;
+}
+
+std::uint64_t PtFormatFile::contentHash() const noexcept
+{
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+    for (const PtFormatSectionEntry& entry : mSections)
+    {
+        hash = fnv1a(&entry.section, sizeof(entry.section), hash);
+        hash = fnv1a(&entry.decodedSize, sizeof(entry.decodedSize), hash);
+        hash = fnv1a(&entry.checksum, sizeof(entry.checksum), hash);
+    }
+    return hash;
+}
+
+std::vector<Texture> PtFormatFile::textures(const PtFormatSection section) const
+{
+    ByteReader reader(sectionBytes(section, alignof(std::uint64_t)));
+
+    const std::uint64_t  numTextures = reader.read<std::uint64_t>();
+    std::vector<Texture> textures;
+    for (std::uint64_t i = 0; i < numTextures; ++i)
+    {
+        const auto          dimensions = reader.read<Texture::Dimensions>();
+        const std::uint64_t numMipLevels = reader.read<std::uint64_t>();
+        const std::uint64_t numPixels = reader.read<std::uint64_t>();
+        reader.align();
+        validateTextureHeader(dimensions, numMipLevels, numPixels);
+        // The stored pixels are in the same format as Texture's, so no texture needs to be
+        // converted or copied.
+        textures.push_back(Texture::fromBorrowedPixels(
+            reader.readArray<Texture::BgraPixel>(numPixels),
+            dimensions,
+            static_cast<std::uint32_t>(numMipLevels)));
+    }
+    return textures;
+}
+
+std::vector<CompressedTexture> PtFormatFile::compressedTextures(const PtFormatSection section) const
+{
+    ByteReader reader(sectionBytes(section, alignof(std::uint64_t)));
+
+    const std::uint64_t            numTextures = reader.read<std::uint64_t>();
+    std::vector<CompressedTexture> textures;
+    for (std::uint64_t i = 0; i < numTextures; ++i)
+    {
+        const auto          dimensions = reader.read<Texture::Dimensions>();
+        const std::uint64_t numMipLevels = reader.read<std::uint64_t>();
+        const std::uint64_t compression = reader.read<std::uint64_t>();
+        const std::uint64_t numBytes = reader.read<std::uint64_t>();
+        reader.align();
+        validateCompressedTextureHeader(dimensions, numMipLevels, compression, numBytes);
+        textures.push_back(CompressedTexture::fromBorrowedBlocks(
+            reader.readArray<std::uint8_t>(numBytes),
+            dimensions,
+            static_cast<TextureCompression>(compression),
+            static_cast<std::uint32_t>(numMipLevels)));
+    }
+    return textures;
+}
+
+VirtualTexturePages PtFormatFile::pagedTextures(const PtFormatSection section) const
+{
+    const std::span<const std::byte> bytes = sectionBytes(section, alignof(std::uint64_t));
+    ByteReader                       reader(bytes);
+
+    const std::uint64_t numTextures = reader.read<std::uint64_t>();
+    const std::uint64_t numPages = reader.read<std::uint64_t>();
+    validateNumPages(numPages, bytes.size());
+    const std::span<const VirtualTextureDescriptor> descriptors =
+        reader.readArray<VirtualTextureDescriptor>(numTextures);
+    validateVirtualTextureDescriptors(descriptors, numPages);
+    reader.align();
+    return VirtualTexturePages{
+        .descriptors = descriptors,
+        .pages = reader.readArray<Texture::BgraPixel>(numPages * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS)};
+}
+
+void PtFormatFile::validate(const PtFormatSection section) const
+{
+    const PtFormatSectionEntry* const entry = findSection(section);
+    if (entry == nullptr)
+    {
+        throwMissingSection(section);
+    }
+    SectionPieces pieces;
+    pieces.append(mFile.bytes().subspan(
+        static_cast<std::size_t>(entry->offset), static_cast<std::size_t>(entry->size)));
+    if (parallelChecksum(pieces, hardwareThreads()) != entry->checksum)
+    {
+        throwChecksumMismatch(section);
+    }
+}
+
+void PtFormatFile::decodeSections(
+    const std::uint32_t               numThreads,
+    const std::function<void(float)>& onProgress) const
+{
+    const std::lock_guard lock(mDecodedSections->mutex);
+
+    // Decoding the blocks of all sections on the same thread pool keeps every thread busy, even
+    // when most sections are small.
+    std::map<PtFormatSection, std::vector<std::byte>> decodedSections;
+    std::deque<SectionDecoder>                        decoders;
+    std::size_t                                       numBlocks = 0;
+    for (const PtFormatSectionEntry& entry : mSections)
+    {
+        if (entry.encoding == SectionEncoding::Raw ||
+            mDecodedSections->sections.contains(entry.section) ||
+            decodedSections.contains(entry.section))
+        {
+            continue;
+        }
+        std::vector<std::byte>& decoded = decodedSections[entry.section];
+        decoded.resize(static_cast<std::size_t>(entry.decodedSize));
+        numBlocks += decoders
+                         .emplace_back(
+                             entry.encoding,
+                             mFile.bytes().subspan(
+                                 static_cast<std::size_t>(entry.offset),
+                                 static_cast<std::size_t>(entry.size)),
+                             decoded)
+                         .numBlocks();
+    }
+
+    ProgressReporter progress(onProgress, numBlocks);
+    ThreadPool       threadPool((numThreads > 0 ? numThreads : hardwareThreads()) - 1);
+    for (const SectionDecoder& decoder : decoders)
+    {
+        for (std::size_t block = 0; block < decoder.numBlocks(); ++block)
+        {
+            threadPool.push([&decoder, &progress, block]() {
+                decoder.decodeBlock(block);
+                progress.advance(1);
+            });
+        }
+    }
+    threadPool.wait();
+
+    mDecodedSections->sections.merge(decodedSections);
+}
+
+const PtFormatSectionEntry* PtFormatFile::findSection(
+    const PtFormatSection section) const noexcept
+{
+    const auto it = std::find_if(mSections.begin(), mSections.end(), [section](const auto& entry) {
+        return entry.section == section;
+    });
+    return it != mSections.end() ? &*it : nullptr;
+}
+
+std::span<const std::byte> PtFormatFile::sectionBytes(
+    const PtFormatSection section,
+    const std::size_t     alignment) const
+{
+    const PtFormatSectionEntry* const entry = findSection(section);
+    if (entry == nullptr)
+    {
+        throwMissingSection(section);
+    }
+    if (entry->alignment % alignment != 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "Invalid PtFormat file: section {} is not aligned to {} bytes.",
+            sectionName(section),
+            alignment));
+    }
+    const std::span<const std::byte> bytes = mFile.bytes().subspan(
+        static_cast<std::size_t>(entry->offset), static_cast<std::size_t>(entry->size));
+    if (entry->encoding == SectionEncoding::Raw)
+    {
+        return bytes;
+    }
+
+    const std::lock_guard lock(mDecodedSections->mutex);
+    auto                  it = mDecodedSections->sections.find(section);
+    if (it == mDecodedSections->sections.end())
+    {
+        std::vector<std::byte> decoded(static_cast<std::size_t>(entry->decodedSize));
+        decodeSection(entry->encoding, bytes, decoded, hardwareThreads());
+        it = mDecodedSections->sections.emplace(section, std::move(decoded)).first;
+    }
+    return it->second;
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> PtFormatFile::sliceRanges(
+    const PtFormatSection section,
+    const std::size_t     bufferSize) const
+{
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    for (const auto& [offset, count] : array<SliceRange>(section))
+    {
+        if (offset > bufferSize || count > bufferSize - offset)
+        {
+            throw std::runtime_error(fmt::format(
+                "Invalid PtFormat file: slice out of bounds in section {}.",
+                sectionName(section)));
+        }
+        ranges.emplace_back(static_cast<std::size_t>(offset), static_cast<std::size_t>(count));
+    }
+    return ranges;
+}
+
+void PtFormatFile::throwSizeMismatch(const PtFormatSection section, const std::size_t elementSize)
+{
+    throw std::runtime_error(fmt::format(
+        "Invalid PtFormat file: the size of section {} is not a multiple of {} bytes.",
+        sectionName(section),
+        elementSize));
+}
+
+namespace
+{
+PtFormatFile openDecoded(
+    const std::filesystem::path& path,
+    const LoadProgressCallback&  onProgress)
+{
+    PtFormatFile file(path);
+    if (onProgress)
+    {
+        file.decodeSections(
+            0, [&onProgress](const float fraction) -> void {
+                onProgress(LoadStage::DecodingSections, fraction);
+            });
+    }
+    else
+    {
+        file.decodeSections();
+    }
+    return file;
+}
+
+std::vector<CompressedTexture> borrowCompressedTextures(const PtFormatFile& file)
+{
+    if (!file.hasSection(PtFormatSection::CompressedBaseColorTextures))
+    {
+        return {};
+    }
+    return file.compressedTextures(PtFormatSection::CompressedBaseColorTextures);
+}
+
+VirtualTexturePages borrowPagedTextures(const PtFormatFile& file)
+{
+    if (!file.hasSection(PtFormatSection::PagedBaseColorTextures))
+    {
+        return {};
+    }
+    return file.pagedTextures(PtFormatSection::PagedBaseColorTextures);
+}
+
+std::vector<Texture> loadTextures(
+    const PtFormatFile&                      file,
+    const std::span<const CompressedTexture> compressedTextures,
+    const LoadProgressCallback&              onProgress)
+{
+    // Paged textures are sampled through a VirtualTextureCache instead.
+    if (file.hasSection(PtFormatSection::PagedBaseColorTextures))
+    {
+        return {};
+    }
+    if (!file.hasSection(PtFormatSection::CompressedBaseColorTextures))
+    {
+        return file.textures(PtFormatSection::BaseColorTextures);
+    }
+    if (!onProgress)
+    {
+        return decompressTextures(compressedTextures, hardwareThreads());
+    }
+    return decompressTextures(
+        compressedTextures, hardwareThreads(), [&onProgress](const float fraction) -> void {
+            onProgress(LoadStage::DecompressingTextures, fraction);
+        });
+}
+} // namespace
+
+MappedPtFormat::MappedPtFormat(
+    const std::filesystem::path& path,
+    const LoadProgressCallback&  onProgress)
+    : file(openDecoded(path, onProgress)),
+      bvhNodes(file.array<BvhNode>(PtFormatSection::BvhNodes)),
+      bvhPositionAttributes(file.array<Positions>(PtFormatSection::BvhPositionAttributes)),
+      trianglePositionAttributes(
+          file.array<PositionAttribute>(PtFormatSection::TrianglePositionAttributes)),
+      triangleVertexAttributes(
+          file.array<VertexAttributes>(PtFormatSection::TriangleVertexAttributes)),
+      vertexPositions(file.array<glm::vec4>(PtFormatSection::VertexPositions)),
+      vertexNormals(file.array<glm::vec4>(PtFormatSection::VertexNormals)),
+      vertexTexCoords(file.array<glm::vec2>(PtFormatSection::VertexTexCoords)),
+      vertexIndices(file.array<std::uint32_t>(PtFormatSection::VertexIndices)),
+      modelVertexPositions(file.slices(PtFormatSection::ModelVertexPositions, vertexPositions)),
+      modelVertexNormals(file.slices(PtFormatSection::ModelVertexNormals, vertexNormals)),
+      modelVertexTexCoords(file.slices(PtFormatSection::ModelVertexTexCoords, vertexTexCoords)),
+      modelVertexIndices(file.slices(PtFormatSection::ModelVertexIndices, vertexIndices)),
+      modelBaseColorTextureIndices(
+          file.array<std::uint32_t>(PtFormatSection::ModelBaseColorTextureIndices)),
+      compressedBaseColorTextures(borrowCompressedTextures(file)),
+      pagedBaseColorTextures(borrowPagedTextures(file)),
+      baseColorTextures(loadTextures(file, compressedBaseColorTextures, onProgress))
+{
 }
 } // namespace nlrs
@@ -1,24 +1,41 @@
 #pragma once
 
+#include "geometry_codec.hpp"
 #include "vertex_attributes.hpp"
 
 #include <common/bvh.hpp>
+#include <common/file_stream.hpp>
+#include <common/mapped_file.hpp>
 #include <common/triangle_attributes.hpp>
 #include <common/texture.hpp>
+#include <common/texture_compression.hpp>
+#include <common/virtual_texture.hpp>
 
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <span>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace nlrs
 {
 class InputStream;
+class ConversionCache;
 class OutputStream;
+struct GltfDeduplication;
+struct GltfModel;
+class TextureResidencyCache;
 
 struct PtFormat
 {
     PtFormat() = default;
     PtFormat(std::filesystem::path gltfPath);
+    explicit PtFormat(GltfModel model);
 
     std::vector<BvhNode> bvhNodes;
     // TODO: is this field actually used somewhere? from triangle_attributes.hpp
@@ -36,9 +53,318 @@ struct PtFormat
     std::vector<std::span<const std::uint32_t>> modelVertexIndices;
     std::vector<std::uint32_t>                  modelBaseColorTextureIndices;
 
-    std::vector<Texture> baseColorTextures;
+    std::vector<Texture>           baseColorTextures;
+    // If not empty, stored instead of baseColorTextures, which then hold the decompressed textures
+    // when the file is read.
+    std::vector<CompressedTexture> compressedBaseColorTextures;
+    // If its descriptors are not empty, stored instead of baseColorTextures, which then hold the
+    // reassembled textures when the file is read.
+    PagedTextures                  pagedBaseColorTextures;
 };
 
-void serialize(OutputStream&, const PtFormat&);
-void deserialize(InputStream&, PtFormat&);
+// The file starts with a table of contents, which lists the offset, size, alignment and checksum
+// of each section. Each section contains one of PtFormat's arrays.
+enum class PtFormatSection : std::uint32_t
+{
+    BvhNodes = 1,
+    BvhPositionAttributes = 2,
+    TrianglePositionAttributes = 3,
+    TriangleVertexAttributes = 4,
+    VertexPositions = 5,
+    VertexNormals = 6,
+    VertexTexCoords = 7,
+    VertexIndices = 8,
+    ModelVertexPositions = 9,
+    ModelVertexNormals = 10,
+    ModelVertexTexCoords = 11,
+    ModelVertexIndices = 12,
+    ModelBaseColorTextureIndices = 13,
+    BaseColorTextures = 14,
+    // A single 64-bit hash of the glTF file, its external files and the conversion settings, which
+    // the file was converted from. Only present in files written by convertGltf from a glTF file.
+    SourceHash = 15,
+    // Block compressed base color textures, see TextureCompression. A file contains either this
+    // section or BaseColorTextures.
+    CompressedBaseColorTextures = 16,
+    // Base color textures split into pages for VirtualTextureCache, see PagedTextures. A file
+    // contains either this section or one of the other texture sections.
+    PagedBaseColorTextures = 17,
+};
+
+std::string_view sectionName(PtFormatSection section);
+
+struct PtFormatSectionEntry
+{
+    PtFormatSection section;
+    SectionEncoding encoding;
+    std::uint64_t   offset;
+    // The number of bytes stored in the file.
+    std::uint64_t   size;
+    // The size of the section after decoding. Equal to `size` for raw sections.
+    std::uint64_t   decodedSize;
+    // 64-bit FNV-1a hash of the FNV-1a hashes of each 1 MiB chunk of the stored section bytes.
+    std::uint64_t   checksum;
+    std::uint32_t   alignment;
+    std::uint32_t   pad;
+};
+
+// The geometry arrays can optionally be compressed, see GeometryCompression. The model sections and
+// textures are always stored raw. The textures are stored block compressed if
+// `format.compressedBaseColorTextures` is not empty, and paged if the descriptors of
+// `format.pagedBaseColorTextures` are not empty.
+void serialize(
+    OutputStream&       stream,
+    const PtFormat&     format,
+    GeometryCompression compression = GeometryCompression::None);
+// Reads every section, and throws if a section's checksum does not match the table of contents.
+// The sections are validated and decoded on `numThreads` threads while the stream is read. 0 means
+// the number of hardware threads.
+void deserialize(InputStream& stream, PtFormat& format, std::uint32_t numThreads = 0);
+
+// Writes a .pt file section by section, so that the arrays of a section can be released as soon as
+// it has been written. Space for the table of contents is reserved at the start of the file, and
+// the table is written by `finish`. The geometry sections are compressed as in `serialize`. They
+// are encoded while they are appended, and only the encoded bytes are kept until the section ends.
+class PtFormatFileWriter
+{
+public:
+    PtFormatFileWriter(
+        const std::filesystem::path& path,
+        std::size_t                  numSections,
+        GeometryCompression          compression = GeometryCompression::None,
+        FileStreamOptions            fileOptions = {});
+    ~PtFormatFileWriter();
+
+    PtFormatFileWriter(const PtFormatFileWriter&) = delete;
+    PtFormatFileWriter& operator=(const PtFormatFileWriter&) = delete;
+
+    PtFormatFileWriter(PtFormatFileWriter&&) noexcept;
+    PtFormatFileWriter& operator=(PtFormatFileWriter&&) noexcept;
+
+    template<typename T>
+    void writeArray(const PtFormatSection section, const std::span<const T> data)
+    {
+        beginSection(section, sizeof(T));
+        append(std::as_bytes(data));
+        endSection();
+    }
+
+    void writeTextures(PtFormatSection section, std::span<const Texture> textures);
+    void writeCompressedTextures(
+        PtFormatSection                    section,
+        std::span<const CompressedTexture> textures);
+    void writePagedTextures(PtFormatSection section, const PagedTextures& textures);
+    // Writes the pages of one texture at a time, so that only they need to be in memory.
+    // `texturePages(i)` returns the pages of texture i, as paged by pageTextures, and is called for
+    // each texture in order. The descriptors must be those pageTextures returns for the textures.
+    void writePagedTextures(
+        PtFormatSection                                                    section,
+        std::span<const VirtualTextureDescriptor>                          descriptors,
+        const std::function<std::vector<Texture::BgraPixel>(std::size_t)>& texturePages);
+
+    // Writes a section in pieces, e.g. a large array in chunks. Each piece must consist of whole
+    // elements of `elementSize` bytes.
+    void beginSection(PtFormatSection section, std::size_t elementSize);
+    void append(std::span<const std::byte> bytes);
+    void endSection();
+
+    // Writes the table of contents and closes the file. Exactly `numSections` sections must have
+    // been written.
+    void finish();
+
+private:
+    struct State;
+
+    std::unique_ptr<State> mState;
+};
+
+struct ConversionOptions
+{
+    GeometryCompression       compression = GeometryCompression::None;
+    // The base color textures are stored block compressed unless this is None, in which case
+    // `textureQuality` is unused.
+    TextureCompression        textureCompression = TextureCompression::None;
+    TextureCompressionQuality textureQuality = TextureCompressionQuality::Fast;
+    // The base color textures are split into pages, which are sampled through a
+    // VirtualTextureCache, so that scenes whose textures do not fit in memory can be rendered. Can
+    // not be combined with `textureCompression`.
+    bool                      virtualTextures = false;
+    // If not null, the BVH and the decoded textures are looked up in and stored to the cache.
+    const ConversionCache*    cache = nullptr;
+    // If not null, the decoded images are kept in it, so that conversions which share images, e.g.
+    // the models of a batch, decode each of them once.
+    TextureResidencyCache*    residentTextures = nullptr;
+    // The threads which decode the images and filter, compress or page the textures. 0 means the
+    // number of hardware threads.
+    std::uint32_t             numThreads = 0;
+    // Writes the .pt file with direct I/O, so that converting large scenes does not evict other
+    // files from the page cache.
+    bool                      directIo = false;
+};
+
+// Converts a glTF model to a .pt file, which is identical to serializing PtFormat(model), with the
+// textures compressed with compressTexture if `options.textureCompression` is not None, or paged
+// with pageTextures if `options.virtualTextures` is set. Each section is written as soon as it has
+// been produced, the per-triangle arrays are produced in chunks, and the textures and intermediate
+// arrays are released once they have been written, so that far less memory is needed than for
+// building a PtFormat. When converting a glTF file, its gltfSourceHash is stored in the SourceHash
+// section. Returns the duplicate images and meshes which were removed when loading the model.
+GltfDeduplication convertGltf(
+    const std::filesystem::path& gltfPath,
+    const std::filesystem::path& ptPath,
+    const ConversionOptions&     options = {});
+GltfDeduplication convertGltf(
+    GltfModel                    model,
+    const std::filesystem::path& ptPath,
+    const ConversionOptions&     options = {});
+
+// Hashes the contents of a glTF file and its external buffers and images, the settings which
+// affect the output of convertGltf, and the version of the file format. A .pt file needs to be
+// converted again if its SourceHash differs.
+std::uint64_t gltfSourceHash(
+    const std::filesystem::path& gltfPath,
+    const ConversionOptions&     options);
+
+// Returns the SourceHash of a .pt file, or nothing if the file does not exist, is not a valid .pt
+// file of the current version, or has no SourceHash section.
+std::optional<std::uint64_t> readSourceHash(const std::filesystem::path& ptPath);
+
+// Reads individual sections of a .pt file on demand. The file is memory mapped, and only the table
+// of contents is read up front. Sections are paged in by the operating system when they are
+// accessed, and are returned as spans into the mapping, which remain valid for the lifetime of the
+// object. Compressed sections are decoded in parallel the first time they are accessed, and the
+// spans then refer to decoded copies owned by the object. The accessors throw if the file does not
+// contain the section.
+class PtFormatFile
+{
+public:
+    explicit PtFormatFile(const std::filesystem::path& path);
+    ~PtFormatFile();
+
+    PtFormatFile(const PtFormatFile&) = delete;
+    PtFormatFile& operator=(const PtFormatFile&) = delete;
+
+    PtFormatFile(PtFormatFile&&) noexcept;
+    PtFormatFile& operator=(PtFormatFile&&) noexcept;
+
+    std::span<const PtFormatSectionEntry> sections() const noexcept { return mSections; }
+    bool                                  hasSection(PtFormatSection section) const noexcept;
+    // A hash of the checksums in the table of contents, which identifies the contents of the file
+    // without reading the sections.
+    std::uint64_t                         contentHash() const noexcept;
+
+    template<typename T>
+    std::span<const T> array(const PtFormatSection section) const
+    {
+        const std::span<const std::byte> bytes = sectionBytes(section, alignof(T));
+        if (bytes.size() % sizeof(T) != 0)
+        {
+            throwSizeMismatch(section, sizeof(T));
+        }
+        return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    // Returns the spans of `buffer` stored in a model section, e.g. `ModelVertexPositions` with the
+    // array of `VertexPositions` as the buffer.
+    template<typename T>
+    std::vector<std::span<const T>> slices(
+        const PtFormatSection    section,
+        const std::span<const T> buffer) const
+    {
+        std::vector<std::span<const T>> spans;
+        for (const auto& [offset, count] : sliceRanges(section, buffer.size()))
+        {
+            spans.push_back(buffer.subspan(offset, count));
+        }
+        return spans;
+    }
+
+    // Returns textures which refer to the pixels in the mapping, created with
+    // Texture::fromBorrowedPixels.
+    std::vector<Texture>           textures(PtFormatSection section) const;
+    // Returns textures which refer to the blocks in the mapping, created with
+    // CompressedTexture::fromBorrowedBlocks.
+    std::vector<CompressedTexture> compressedTextures(PtFormatSection section) const;
+    // Returns the descriptors and pages in the mapping. The operating system reads the pages from
+    // disk when a VirtualTextureCache first copies them.
+    VirtualTexturePages            pagedTextures(PtFormatSection section) const;
+
+    // Reads the whole section as stored in the file, and throws if its checksum does not match the
+    // table of contents. The section is hashed in parallel.
+    void validate(PtFormatSection section) const;
+
+    // Decodes every compressed section on `numThreads` threads, instead of each section when it is
+    // first accessed. 0 means the number of hardware threads. `onProgress`, if set, receives the
+    // fraction of the blocks which have been decoded, after each block.
+    void decodeSections(
+        std::uint32_t                     numThreads = 0,
+        const std::function<void(float)>& onProgress = {}) const;
+
+    std::span<const std::byte> bytes() const noexcept { return mFile.bytes(); }
+
+private:
+    const PtFormatSectionEntry* findSection(PtFormatSection section) const noexcept;
+    std::span<const std::byte>  sectionBytes(PtFormatSection section, std::size_t alignment) const;
+    std::vector<std::pair<std::size_t, std::size_t>> sliceRanges(
+        PtFormatSection section,
+        std::size_t     bufferSize) const;
+    [[noreturn]] static void throwSizeMismatch(PtFormatSection section, std::size_t elementSize);
+
+    struct DecodedSections;
+
+    MappedFile                        mFile;
+    std::vector<PtFormatSectionEntry> mSections;
+    std::unique_ptr<DecodedSections>  mDecodedSections;
+};
+
+// The stages of constructing a MappedPtFormat which take time, in order.
+enum class LoadStage : std::uint8_t
+{
+    DecodingSections,
+    DecompressingTextures,
+};
+
+// Receives the stage being loaded, and the fraction of its work which has been done, in [0, 1].
+// Called from the loading threads, but never concurrently, and with increasing fractions.
+using LoadProgressCallback = std::function<void(LoadStage stage, float fraction)>;
+
+// Every section of a .pt file, mapped into memory with PtFormatFile. Instead of being copied into
+// vectors, the arrays and texture pixels refer directly to the file contents, or to the decoded
+// copies of compressed sections, which are decoded in parallel on construction. The spans remain
+// valid when the object is moved, and until it is destroyed.
+struct MappedPtFormat
+{
+    explicit MappedPtFormat(
+        const std::filesystem::path& path,
+        const LoadProgressCallback&  onProgress = {});
+
+    PtFormatFile file;
+
+    std::span<const BvhNode>           bvhNodes;
+    std::span<const Positions>         bvhPositionAttributes;
+    std::span<const PositionAttribute> trianglePositionAttributes;
+    std::span<const VertexAttributes>  triangleVertexAttributes;
+
+    std::span<const glm::vec4>                  vertexPositions;
+    std::span<const glm::vec4>                  vertexNormals;
+    std::span<const glm::vec2>                  vertexTexCoords;
+    std::span<const std::uint32_t>              vertexIndices;
+    std::vector<std::span<const glm::vec4>>     modelVertexPositions;
+    std::vector<std::span<const glm::vec4>>     modelVertexNormals;
+    std::vector<std::span<const glm::vec2>>     modelVertexTexCoords;
+    std::vector<std::span<const std::uint32_t>> modelVertexIndices;
+    std::span<const std::uint32_t>              modelBaseColorTextureIndices;
+
+    // Textures created with CompressedTexture::fromBorrowedBlocks, if the file stores its textures
+    // block compressed.
+    std::vector<CompressedTexture> compressedBaseColorTextures;
+    // The pages in the mapping, if the file stores its textures paged. The textures are then
+    // sampled through a VirtualTextureCache, and baseColorTextures is empty.
+    VirtualTexturePages            pagedBaseColorTextures;
+    // Textures created with Texture::fromBorrowedPixels, or the decompressed textures, which are
+    // decompressed in parallel on construction. They are decompressed eagerly because every path
+    // tracer samples the decompressed texels, so compressed files take as much memory once loaded
+    // as uncompressed ones; only the G-buffer textures on the GPU are smaller.
+    std::vector<Texture>           baseColorTextures;
+};
 } // namespace nlrs
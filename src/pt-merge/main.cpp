@@ -0,0 +1,91 @@
+#include <common/file_stream.hpp>
+#include <pt-cpu/accumulation.hpp>
+#include <pt-cpu/image_writer.hpp>
+
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace nlrs;
+
+void printHelp()
+{
+    std::printf(
+        "Usage:\n"
+        "\tpt-merge <output_accumulation> <input_accumulation>... [options]\n"
+        "\n"
+        "Merges accumulations of the same render, e.g. checkpoints of pt-render runs with\n"
+        "different --first-sample and --spp values, into a single accumulation.\n"
+        "\n"
+        "Options:\n"
+        "\t--image <file>              also write the merged image as .hdr or .png\n"
+        "\t--exposure-stops <n>        exposure of the PNG output (default 2)\n");
+}
+
+int main(int argc, char** argv)
+try
+{
+    std::vector<fs::path>   inputPaths;
+    std::optional<fs::path> imagePath;
+    int                     exposureStops = 2;
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--image" && i + 1 < argc)
+        {
+            imagePath = argv[++i];
+        }
+        else if (arg == "--exposure-stops" && i + 1 < argc)
+        {
+            exposureStops = std::stoi(argv[++i]);
+        }
+        else
+        {
+            inputPaths.emplace_back(arg);
+        }
+    }
+
+    if (inputPaths.empty())
+    {
+        printHelp();
+        return 0;
+    }
+
+    for (const fs::path& path : inputPaths)
+    {
+        if (!fs::exists(path))
+        {
+            fmt::print(stderr, "File {} does not exist\n", path.string());
+            return 1;
+        }
+    }
+
+    const Accumulation result = mergeAccumulationFiles(inputPaths);
+    {
+        OutputFileStream file(argv[1]);
+        serialize(file, result);
+        file.close();
+    }
+
+    if (imagePath)
+    {
+        writeImage(*imagePath, result.imageSize(), result.resolve(), exposureStops);
+    }
+}
+catch (const std::exception& e)
+{
+    fmt::print(stderr, "Exception occurred. {}\n", e.what());
+    return 1;
+}
+catch (...)
+{
+    fmt::print(stderr, "Unknown exception occurred.\n");
+    return 1;
+}
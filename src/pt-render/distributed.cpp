@@ -0,0 +1,454 @@
+#include "distributed.hpp"
+#include "render_options.hpp"
+
+#include <common/stream.hpp>
+#include <pt-cpu/accumulation.hpp>
+#include <pt-cpu/path_tracer.hpp>
+#include <pt-format/pt_format.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The coordinator and a worker exchange the following messages:
+//
+// 1. Coordinator: MAGIC_BYTES, followed by the render args as a list of strings.
+// 2. Worker: the render settings of its scene and the render args.
+// 3. Coordinator: 1 if the settings match the accumulation's, 0 if the worker is rejected.
+// 4. Coordinator: a job, consisting of the tile index, the number of samples to render, the tile's
+//    bounds, and the tile's current accumulation. NO_MORE_TILES instead of a tile index ends the
+//    session.
+// 5. Worker: the tile's accumulation with the samples added. Continue from 4.
+//
+// Integers are sent in host byte order, since workers run on the same kind of machine as the
+// coordinator in practice, and the radiance sums are sent as raw floats anyway.
+
+namespace nlrs
+{
+namespace
+{
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+
+constexpr std::string_view MAGIC_BYTES = "PTRENDER1";
+constexpr std::uint32_t    NO_MORE_TILES = std::numeric_limits<std::uint32_t>::max();
+
+void write(OutputStream& stream, const std::uint32_t value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(std::uint32_t));
+}
+
+template<typename T>
+void write(OutputStream& stream, const std::span<const T> data)
+{
+    const std::uint64_t numElements = static_cast<std::uint64_t>(data.size());
+    stream.write(reinterpret_cast<const char*>(&numElements), sizeof(std::uint64_t));
+    stream.write(reinterpret_cast<const char*>(data.data()), sizeof(T) * data.size());
+}
+
+void write(OutputStream& stream, const TileAccumulation& tile)
+{
+    write(stream, tile.sampleBegin);
+    write(stream, tile.sampleCount);
+    write(stream, std::span<const glm::vec3>(tile.radianceSums));
+}
+
+void readExactly(InputStream& stream, char* const data, const std::size_t numBytes)
+{
+    if (stream.read(data, numBytes) != numBytes)
+    {
+        throw std::runtime_error("Connection closed unexpectedly.");
+    }
+}
+
+void read(InputStream& stream, std::uint32_t& value)
+{
+    readExactly(stream, reinterpret_cast<char*>(&value), sizeof(std::uint32_t));
+}
+
+void read(InputStream& stream, std::string& str)
+{
+    std::uint64_t numChars;
+    readExactly(stream, reinterpret_cast<char*>(&numChars), sizeof(std::uint64_t));
+    str.resize(static_cast<std::size_t>(numChars));
+    readExactly(stream, str.data(), str.size());
+}
+
+template<typename T>
+void read(InputStream& stream, std::vector<T>& data)
+{
+    std::uint64_t numElements;
+    readExactly(stream, reinterpret_cast<char*>(&numElements), sizeof(std::uint64_t));
+    data.resize(static_cast<std::size_t>(numElements));
+    readExactly(stream, reinterpret_cast<char*>(data.data()), sizeof(T) * data.size());
+}
+
+void read(InputStream& stream, TileAccumulation& tile)
+{
+    read(stream, tile.sampleBegin);
+    read(stream, tile.sampleCount);
+    read(stream, tile.radianceSums);
+}
+
+void writeArgs(OutputStream& stream, const std::span<const std::string> args)
+{
+    write(stream, static_cast<std::uint32_t>(args.size()));
+    for (const std::string& arg : args)
+    {
+        write(stream, std::span<const char>(arg));
+    }
+}
+
+std::vector<std::string> readArgs(InputStream& stream)
+{
+    std::uint32_t numArgs;
+    read(stream, numArgs);
+    std::vector<std::string> args(numArgs);
+    for (std::string& arg : args)
+    {
+        read(stream, arg);
+    }
+    return args;
+}
+
+Accumulation copyAccumulation(const Accumulation& accumulation)
+{
+    return Accumulation(
+        accumulation.imageSize(),
+        accumulation.tileSize(),
+        accumulation.renderSettings(),
+        std::vector<std::uint32_t>(
+            accumulation.tileSampleBegins().begin(), accumulation.tileSampleBegins().end()),
+        std::vector<std::uint32_t>(
+            accumulation.tileSampleCounts().begin(), accumulation.tileSampleCounts().end()),
+        std::vector<glm::vec3>(
+            accumulation.radianceSums().begin(), accumulation.radianceSums().end()));
+}
+
+struct CoordinatorState
+{
+    std::mutex                mutex;
+    std::condition_variable   tilesChanged;
+    std::deque<std::uint32_t> pendingTiles;
+    std::uint32_t             numTilesInFlight = 0;
+    std::uint32_t             numTilesCompleted = 0;
+    bool                      stopping = false;
+
+    bool isComplete() const { return pendingTiles.empty() && numTilesInFlight == 0; }
+};
+
+struct WorkerConnection
+{
+    TcpStream    stream;
+    std::jthread thread;
+};
+
+void serveWorker(
+    TcpStream&                         stream,
+    const std::span<const std::string> renderArgs,
+    const std::uint32_t                sampleEnd,
+    Accumulation&                      accumulation,
+    CoordinatorState&                  state)
+{
+    stream.write(MAGIC_BYTES.data(), MAGIC_BYTES.size());
+    writeArgs(stream, renderArgs);
+
+    std::string workerSettings;
+    read(stream, workerSettings);
+    const bool accepted = workerSettings == accumulation.renderSettings();
+    write(stream, static_cast<std::uint32_t>(accepted));
+    if (!accepted)
+    {
+        throw std::runtime_error(
+            fmt::format("Rejected worker with render settings '{}'.", workerSettings));
+    }
+
+    while (true)
+    {
+        std::uint32_t    tileIdx;
+        TileBounds       bounds;
+        TileAccumulation tile;
+        {
+            std::unique_lock lock(state.mutex);
+            // A tile in flight on another worker is handed out again if that worker disconnects.
+            state.tilesChanged.wait(lock, [&state]() -> bool {
+                return state.stopping || !state.pendingTiles.empty() || state.isComplete();
+            });
+            if (state.stopping || state.pendingTiles.empty())
+            {
+                break;
+            }
+            tileIdx = state.pendingTiles.front();
+            state.pendingTiles.pop_front();
+            ++state.numTilesInFlight;
+            bounds = accumulation.tileBounds(tileIdx);
+            tile = accumulation.tile(tileIdx);
+        }
+
+        const std::uint32_t tileSampleEnd = tile.sampleBegin + tile.sampleCount;
+        const std::uint32_t numSamples = sampleEnd - std::min(tileSampleEnd, sampleEnd);
+
+        TileAccumulation result;
+        try
+        {
+            write(stream, tileIdx);
+            write(stream, numSamples);
+            write(stream, bounds.origin.x);
+            write(stream, bounds.origin.y);
+            write(stream, bounds.size.x);
+            write(stream, bounds.size.y);
+            write(stream, tile);
+            read(stream, result);
+
+            if (result.sampleBegin != tile.sampleBegin ||
+                result.sampleCount != tile.sampleCount + numSamples ||
+                result.radianceSums.size() != tile.radianceSums.size())
+            {
+                throw std::runtime_error(fmt::format("Invalid result for tile {}.", tileIdx));
+            }
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard lock(state.mutex);
+                state.pendingTiles.push_front(tileIdx);
+                --state.numTilesInFlight;
+            }
+            state.tilesChanged.notify_all();
+            throw;
+        }
+
+        {
+            std::lock_guard lock(state.mutex);
+            accumulation.setTile(tileIdx, result);
+            --state.numTilesInFlight;
+            ++state.numTilesCompleted;
+        }
+        state.tilesChanged.notify_all();
+    }
+
+    write(stream, NO_MORE_TILES);
+}
+
+// Performs the worker's side of the handshake. Returns std::nullopt if the coordinator closed the
+// connection without sending anything, which happens when the render completed before the
+// connection was accepted.
+std::optional<RenderOptions> receiveRenderOptions(
+    TcpStream&                   stream,
+    const std::filesystem::path& scenePath)
+{
+    std::string magicBytes;
+    magicBytes.resize(MAGIC_BYTES.size());
+    const std::size_t numRead = stream.read(magicBytes.data(), magicBytes.size());
+    if (numRead == 0)
+    {
+        return std::nullopt;
+    }
+    if (numRead != magicBytes.size() || magicBytes != MAGIC_BYTES)
+    {
+        throw std::runtime_error("The coordinator is not a compatible pt-render process.");
+    }
+
+    const std::vector<std::string> args = readArgs(stream);
+    RenderOptions                  options = parseRenderOptions(scenePath, {}, args);
+    const std::string              settings = renderSettings(options);
+    write(stream, std::span<const char>(settings));
+
+    std::uint32_t accepted;
+    read(stream, accepted);
+    if (accepted == 0)
+    {
+        throw std::runtime_error(
+            fmt::format("The coordinator rejected the render settings '{}'.", settings));
+    }
+
+    return options;
+}
+
+void renderTiles(
+    TcpStream&           stream,
+    const CpuPathTracer& pathTracer,
+    const Camera&        camera,
+    const RenderOptions& options)
+{
+    while (true)
+    {
+        // The coordinator may close the connection instead of sending NO_MORE_TILES when it is
+        // shutting down.
+        std::uint32_t tileIdx;
+        if (stream.read(reinterpret_cast<char*>(&tileIdx), sizeof(tileIdx)) != sizeof(tileIdx) ||
+            tileIdx == NO_MORE_TILES)
+        {
+            break;
+        }
+
+        std::uint32_t    numSamples;
+        TileBounds       bounds;
+        TileAccumulation tile;
+        read(stream, numSamples);
+        read(stream, bounds.origin.x);
+        read(stream, bounds.origin.y);
+        read(stream, bounds.size.x);
+        read(stream, bounds.size.y);
+        read(stream, tile);
+
+        if (tile.radianceSums.size() != area(bounds.size))
+        {
+            throw std::runtime_error(fmt::format("Invalid job for tile {}.", tileIdx));
+        }
+
+        pathTracer.accumulateTile(
+            camera, options.imageSize, options.samplingParams, bounds, numSamples, tile);
+        write(stream, tile);
+    }
+}
+} // namespace
+
+void coordinateRender(
+    TcpListener&                                    listener,
+    const std::span<const std::string>              renderArgs,
+    const std::uint32_t                             sampleEnd,
+    Accumulation&                                   accumulation,
+    const std::function<bool()>&                    shouldStop,
+    const std::function<void(const Accumulation&)>& onProgress)
+{
+    CoordinatorState state;
+    for (std::uint32_t tileIdx = 0; tileIdx < accumulation.tileCount(); ++tileIdx)
+    {
+        if (accumulation.tileSampleEnd(tileIdx) < sampleEnd)
+        {
+            state.pendingTiles.push_back(tileIdx);
+        }
+    }
+
+    // A list, since the handler threads refer to their connection's stream.
+    std::list<WorkerConnection> connections;
+    std::uint32_t               numTilesReported = 0;
+    while (true)
+    {
+        // The accumulation is copied under the lock, and reported after releasing it, so that the
+        // handler threads do not wait for e.g. a checkpoint to be written.
+        std::optional<Accumulation> progress;
+        bool                        complete = false;
+        {
+            std::lock_guard lock(state.mutex);
+            if (state.numTilesCompleted != numTilesReported)
+            {
+                numTilesReported = state.numTilesCompleted;
+                progress.emplace(copyAccumulation(accumulation));
+            }
+            complete = state.isComplete();
+        }
+        if (progress)
+        {
+            onProgress(*progress);
+        }
+        if (complete)
+        {
+            break;
+        }
+
+        if (shouldStop())
+        {
+            break;
+        }
+
+        if (std::optional<TcpStream> stream = listener.accept(std::chrono::milliseconds(100)))
+        {
+            connections.push_back(WorkerConnection{std::move(*stream), {}});
+            WorkerConnection& connection = connections.back();
+            connection.thread = std::jthread([&, &stream = connection.stream]() -> void {
+                try
+                {
+                    serveWorker(stream, renderArgs, sampleEnd, accumulation, state);
+                }
+                catch (const std::exception& e)
+                {
+                    std::lock_guard lock(state.mutex);
+                    if (!state.stopping)
+                    {
+                        fmt::print(stderr, "\nWorker disconnected. {}\n", e.what());
+                    }
+                }
+            });
+        }
+    }
+
+    {
+        std::lock_guard lock(state.mutex);
+        state.stopping = true;
+    }
+    state.tilesChanged.notify_all();
+    // Unblocks handlers waiting on workers which are still rendering, or were never heard from.
+    for (WorkerConnection& connection : connections)
+    {
+        connection.stream.shutdown();
+    }
+    connections.clear();
+}
+
+void runWorker(
+    const std::filesystem::path& scenePath,
+    const SocketAddress&         address,
+    const std::uint32_t          numThreads)
+{
+    TcpStream                          stream = TcpStream::connect(address);
+    const std::optional<RenderOptions> options = receiveRenderOptions(stream, scenePath);
+    if (!options)
+    {
+        return;
+    }
+
+    const MappedPtFormat ptFormat(scenePath);
+    // The tiles of a worker's threads are not synchronized, so there is no point between passes at
+    // which a VirtualTextureCache could be updated.
+    if (ptFormat.file.hasSection(PtFormatSection::PagedBaseColorTextures))
+    {
+        throw std::runtime_error(
+            "Distributed rendering does not support .pt files with virtual textures.");
+    }
+
+    const CpuPathTracer pathTracer(
+        CpuScene{
+            .bvhNodes = ptFormat.bvhNodes,
+            .positions = ptFormat.bvhPositionAttributes,
+            .vertexAttributes = ptFormat.triangleVertexAttributes,
+            .baseColorTextures = ptFormat.baseColorTextures,
+            .baseColorSampler = TextureSampler{.filter = options->textureFilter},
+        },
+        options->sky);
+    const Camera camera = cameraFromOptions(*options);
+
+    std::vector<std::jthread> threads;
+    for (std::uint32_t i = 1; i < numThreads; ++i)
+    {
+        threads.emplace_back([&]() -> void {
+            try
+            {
+                TcpStream threadStream = TcpStream::connect(address);
+                if (receiveRenderOptions(threadStream, scenePath))
+                {
+                    renderTiles(threadStream, pathTracer, camera, *options);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                fmt::print(stderr, "Worker thread stopped. {}\n", e.what());
+            }
+        });
+    }
+    renderTiles(stream, pathTracer, camera, *options);
+}
+} // namespace nlrs
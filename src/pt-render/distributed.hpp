@@ -0,0 +1,41 @@
+#pragma once
+
+#include "socket.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <string>
+
+namespace nlrs
+{
+class Accumulation;
+
+// Renders the remaining samples of each tile of `accumulation`, up to `sampleEnd`, on the worker
+// processes which connect to `listener`. Workers receive `renderArgs`, the render options of the
+// command line, and are rejected if their scene and options do not reproduce the accumulation's
+// render settings.
+//
+// A tile is rendered by a single worker, continuing from the tile's current sums, so the result is
+// identical to rendering the tile in a single process. The tiles of workers which disconnect are
+// handed out again.
+//
+// `onProgress` is called on the calling thread after tiles have completed, with a copy of
+// `accumulation`, so that results keep being written while it runs. Returns once every tile is
+// complete, or `shouldStop` returns true.
+void coordinateRender(
+    TcpListener&                                    listener,
+    std::span<const std::string>                    renderArgs,
+    std::uint32_t                                   sampleEnd,
+    Accumulation&                                   accumulation,
+    const std::function<bool()>&                    shouldStop,
+    const std::function<void(const Accumulation&)>& onProgress);
+
+// Connects `numThreads` times to the coordinator at `address`, and renders tiles of `scenePath` on
+// each connection until the coordinator runs out of tiles.
+void runWorker(
+    const std::filesystem::path& scenePath,
+    const SocketAddress&         address,
+    std::uint32_t                numThreads);
+} // namespace nlrs
@@ -0,0 +1,648 @@
+#include "distributed.hpp"
+#include "render_options.hpp"
+#include "socket.hpp"
+
+#include <common/file_stream.hpp>
+#include <common/thread_pool.hpp>
+#include <common/virtual_texture.hpp>
+#include <pt-cpu/accumulation.hpp>
+#include <pt-cpu/denoiser.hpp>
+#include <pt-cpu/image_writer.hpp>
+#include <pt-cpu/path_tracer.hpp>
+#include <pt-format/pt_format.hpp>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace nlrs;
+
+void printHelp()
+{
+    std::printf(
+        "Usage:\n"
+        "\tpt-render <input_pt_file> <output_image> [options]\n"
+        "\tpt-render <input_pt_file> --worker <host>:<port> [--threads <n>]\n"
+        "\n"
+        "The output image is written as Radiance HDR (.hdr) or tonemapped PNG (.png).\n"
+        "\n"
+        "Options:\n"
+        "\t--size <width>x<height>      image size (default 640x480)\n"
+        "\t--spp <n>                    render up to sample n of each pixel (default 128)\n"
+        "\t--first-sample <n>           first sample index to render (default 0)\n"
+        "\t--bounces <n>                maximum number of bounces (default 4)\n"
+        "\t--min-bounces <n>            bounces before Russian roulette starts (default 2)\n"
+        "\t--no-russian-roulette        always trace paths to the maximum number of bounces\n"
+        "\t--camera-position <x,y,z>    (default 1.22,1.25,-1.25)\n"
+        "\t--camera-yaw <degrees>       (default 129.64)\n"
+        "\t--camera-pitch <degrees>     (default -13.73)\n"
+        "\t--camera-vfov <degrees>      (default 80)\n"
+        "\t--sun-zenith <degrees>       (default 30)\n"
+        "\t--sun-azimuth <degrees>      (default 0)\n"
+        "\t--sky-turbidity <t>          (default 1)\n"
+        "\t--exposure-stops <n>         exposure of the PNG output (default 2)\n"
+        "\t--tile-size <n>              (default 32)\n"
+        "\t--threads <n>                (default: number of hardware threads)\n"
+        "\t--denoise                    filter the image with the a-trous denoiser\n"
+        "\t--denoise-iterations <n>     number of denoiser iterations (default 5)\n"
+        "\t--texture-cache <MiB>        memory for the pages of virtual textures (default 512)\n"
+        "\t--texture-filter <filter>    nearest, bilinear or trilinear (default nearest)\n"
+        "\t--out-of-core                render one row of tiles at a time, streaming it to the\n"
+        "\t                             output image, for images which do not fit in memory\n"
+        "\t--checkpoint <file>          periodically write the accumulation to file\n"
+        "\t--checkpoint-interval <s>    seconds between checkpoints (default 60)\n"
+        "\t--resume                     continue from the checkpoint file, if it exists\n"
+        "\t--listen <host>:<port>       render on worker processes connecting to the address\n"
+        "\t--spawn-workers <n>          start n worker processes on this machine\n"
+        "\n"
+        "Workers started with --worker connect to a coordinator started with --listen, and\n"
+        "receive the coordinator's options. The scene file must be the same on every machine.\n");
+}
+
+Accumulation loadOrCreateAccumulation(const RenderOptions& options)
+{
+    const std::string settings = renderSettings(options);
+
+    if (options.resume && options.checkpointPath && fs::exists(*options.checkpointPath))
+    {
+        Accumulation accumulation;
+        {
+            InputFileStream file(*options.checkpointPath);
+            deserialize(file, accumulation);
+        }
+
+        if (accumulation.renderSettings() != settings)
+        {
+            throw std::runtime_error(fmt::format(
+                "Checkpoint {} was rendered with different settings: '{}'.",
+                options.checkpointPath->string(),
+                accumulation.renderSettings()));
+        }
+
+        if (accumulation.tileSize() != options.tileSize)
+        {
+            throw std::runtime_error(fmt::format(
+                "Checkpoint {} was rendered with tile size {}.",
+                options.checkpointPath->string(),
+                accumulation.tileSize()));
+        }
+
+        fmt::print("Resuming from checkpoint {}\n", options.checkpointPath->string());
+        return accumulation;
+    }
+
+    return Accumulation{options.imageSize, options.tileSize, settings, options.firstSample};
+}
+
+// The checkpoint is first written to a temporary file, so that a job terminated mid-write leaves
+// the previous checkpoint intact.
+void writeCheckpoint(const fs::path& path, const Accumulation& accumulation)
+{
+    fs::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        OutputFileStream file(tmpPath);
+        serialize(file, accumulation);
+        file.close();
+    }
+    fs::rename(tmpPath, path);
+}
+
+bool isComplete(const Accumulation& accumulation, const std::uint32_t sampleEnd)
+{
+    for (std::uint32_t tileIdx = 0; tileIdx < accumulation.tileCount(); ++tileIdx)
+    {
+        if (accumulation.tileSampleEnd(tileIdx) < sampleEnd)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void printProgress(const Accumulation& accumulation, const std::uint32_t sampleEnd)
+{
+    std::uint64_t numRendered = 0;
+    std::uint64_t numTotal = 0;
+    for (std::uint32_t tileIdx = 0; tileIdx < accumulation.tileCount(); ++tileIdx)
+    {
+        const std::uint32_t tileSampleBegin = accumulation.tileSampleBegin(tileIdx);
+        numRendered += std::min(accumulation.tileSampleEnd(tileIdx), sampleEnd) -
+                       std::min(tileSampleBegin, sampleEnd);
+        numTotal += sampleEnd - std::min(tileSampleBegin, sampleEnd);
+    }
+    numTotal = std::max<std::uint64_t>(numTotal, 1);
+    fmt::print(
+        "\rRendered {:.1f}%",
+        100.0 * static_cast<double>(numRendered) / static_cast<double>(numTotal));
+    std::fflush(stdout);
+}
+
+std::atomic<bool> gStopRequested = false;
+
+extern "C" void requestStop(int) { gStopRequested = true; }
+
+using ProgressCallback = std::function<void(const Accumulation&)>;
+
+// Returns null unless the .pt file stores its textures paged.
+std::unique_ptr<VirtualTextureCache> virtualTextureCache(
+    const MappedPtFormat& ptFormat,
+    const RenderOptions&  options)
+{
+    if (ptFormat.pagedBaseColorTextures.descriptors.empty())
+    {
+        return nullptr;
+    }
+    const std::uint64_t numPages = (static_cast<std::uint64_t>(options.textureCacheMegabytes)
+                                    << 20) /
+                                   (VIRTUAL_TEXTURE_PAGE_NUM_TEXELS * sizeof(Texture::BgraPixel));
+    return std::make_unique<VirtualTextureCache>(
+        ptFormat.pagedBaseColorTextures,
+        static_cast<std::uint32_t>(
+            std::min<std::uint64_t>(numPages, std::numeric_limits<std::uint32_t>::max())));
+}
+
+CpuScene cpuScene(
+    const MappedPtFormat&            ptFormat,
+    const VirtualTextureCache* const textureCache,
+    const RenderOptions&             options)
+{
+    return CpuScene{
+        .bvhNodes = ptFormat.bvhNodes,
+        .positions = ptFormat.bvhPositionAttributes,
+        .vertexAttributes = ptFormat.triangleVertexAttributes,
+        .baseColorTextures = ptFormat.baseColorTextures,
+        .virtualBaseColorTextures = textureCache,
+        .baseColorSampler = TextureSampler{.filter = options.textureFilter},
+    };
+}
+
+std::uint32_t numThreadsFromOptions(const RenderOptions& options)
+{
+    return options.numThreads > 0 ? options.numThreads
+                                   : std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Samples the textures seen through each pixel of rows [`rowsBegin`, `rowsEnd`), and streams in
+// the pages which they request, so that the first samples of the rows do not fall back to less
+// detailed mip levels. Pages requested by later bounces are streamed in between passes.
+void streamVisibleTextures(
+    const CpuPathTracer& pathTracer,
+    const Camera&        camera,
+    const Extent2u       imageSize,
+    const std::uint32_t  rowsBegin,
+    const std::uint32_t  rowsEnd,
+    VirtualTextureCache& textureCache,
+    ThreadPool&          threadPool)
+{
+    for (std::uint32_t y = rowsBegin; y < rowsEnd; ++y)
+    {
+        threadPool.push([&, y]() -> void {
+            for (std::uint32_t x = 0; x < imageSize.x; ++x)
+            {
+                pathTracer.pixelFeatures(camera, imageSize, x, y);
+            }
+        });
+    }
+    threadPool.wait();
+    textureCache.update(threadPool);
+}
+
+void renderLocally(
+    const RenderOptions&    options,
+    Accumulation&           accumulation,
+    const ProgressCallback& onProgress)
+{
+    const MappedPtFormat                       ptFormat(options.scenePath);
+    const std::unique_ptr<VirtualTextureCache> textureCache =
+        virtualTextureCache(ptFormat, options);
+    const CpuPathTracer pathTracer(cpuScene(ptFormat, textureCache.get(), options), options.sky);
+    const Camera        camera = cameraFromOptions(options);
+    const std::uint32_t sampleEnd = options.samplingParams.numSamplesPerPixel;
+    const std::uint32_t numThreads = numThreadsFromOptions(options);
+    ThreadPool          threadPool(textureCache ? numThreads - 1 : 0);
+    if (textureCache)
+    {
+        streamVisibleTextures(
+            pathTracer,
+            camera,
+            options.imageSize,
+            0,
+            options.imageSize.y,
+            *textureCache,
+            threadPool);
+    }
+
+    // Tiles are rendered in passes of a few samples each, so that the image converges evenly and
+    // checkpoints can be written between passes.
+    const std::uint32_t samplesPerPass = 4;
+
+    while (!gStopRequested && !isComplete(accumulation, sampleEnd))
+    {
+        std::atomic<std::uint32_t> nextTileIdx = 0;
+        auto                       renderTiles = [&]() -> void {
+            while (!gStopRequested)
+            {
+                const std::uint32_t tileIdx = nextTileIdx++;
+                if (tileIdx >= accumulation.tileCount())
+                {
+                    break;
+                }
+                const std::uint32_t tileSampleEnd = accumulation.tileSampleEnd(tileIdx);
+                const std::uint32_t numSamples =
+                    std::min(samplesPerPass, sampleEnd - std::min(tileSampleEnd, sampleEnd));
+                pathTracer.accumulateTile(
+                    camera, options.samplingParams, tileIdx, numSamples, accumulation);
+            }
+        };
+
+        {
+            std::vector<std::jthread> workers;
+            for (std::uint32_t i = 1; i < numThreads; ++i)
+            {
+                workers.emplace_back(renderTiles);
+            }
+            renderTiles();
+        }
+
+        // The cache must not be updated while the tiles are being rendered.
+        if (textureCache)
+        {
+            textureCache->update(threadPool);
+        }
+        onProgress(accumulation);
+    }
+}
+
+// Renders the denoiser's features for each pixel, and filters the estimate with them.
+std::vector<glm::vec3> denoiseEstimate(
+    const RenderOptions&          options,
+    const std::vector<glm::vec3>& estimate)
+{
+    const MappedPtFormat                       ptFormat(options.scenePath);
+    const std::unique_ptr<VirtualTextureCache> textureCache =
+        virtualTextureCache(ptFormat, options);
+    const CpuPathTracer pathTracer(cpuScene(ptFormat, textureCache.get(), options), options.sky);
+    const Camera        camera = cameraFromOptions(options);
+    const Extent2u      imageSize = options.imageSize;
+    const std::uint32_t numThreads = numThreadsFromOptions(options);
+    if (textureCache)
+    {
+        ThreadPool threadPool(numThreads - 1);
+        streamVisibleTextures(
+            pathTracer, camera, imageSize, 0, imageSize.y, *textureCache, threadPool);
+    }
+
+    std::vector<PixelFeatures> features(area(imageSize));
+    {
+        std::atomic<std::uint32_t> nextRow = 0;
+        auto                       renderRows = [&]() -> void {
+            for (std::uint32_t y = nextRow++; y < imageSize.y; y = nextRow++)
+            {
+                pathTracer.pixelFeatures(
+                    camera,
+                    imageSize,
+                    y,
+                    std::span(features).subspan(std::size_t{y} * imageSize.x, imageSize.x));
+            }
+        };
+
+        std::vector<std::jthread> workers;
+        for (std::uint32_t i = 1; i < numThreads; ++i)
+        {
+            workers.emplace_back(renderRows);
+        }
+        renderRows();
+    }
+
+    DenoiserParams params;
+    params.numIterations = options.denoiseIterations;
+    return denoise(imageSize, estimate, features, params, numThreads);
+}
+
+// Renders one row of tiles at a time to completion, and streams the resolved rows to the output
+// image. Memory use depends on the image width and tile size, but not on the image height.
+void renderOutOfCore(const RenderOptions& options)
+{
+    const MappedPtFormat                       ptFormat(options.scenePath);
+    const std::unique_ptr<VirtualTextureCache> textureCache =
+        virtualTextureCache(ptFormat, options);
+    const CpuPathTracer pathTracer(cpuScene(ptFormat, textureCache.get(), options), options.sky);
+    const Camera        camera = cameraFromOptions(options);
+    const std::uint32_t numThreads = numThreadsFromOptions(options);
+    ThreadPool          threadPool(textureCache ? numThreads - 1 : 0);
+
+    const Extent2u      imageSize = options.imageSize;
+    const std::uint32_t tileSize = options.tileSize;
+    const std::uint32_t numTilesX = (imageSize.x + tileSize - 1) / tileSize;
+    const std::uint32_t numSamples =
+        options.samplingParams.numSamplesPerPixel - options.firstSample;
+
+    // The image is written to a temporary file, which replaces the output only once the image is
+    // complete, so that a stopped render does not overwrite the previous image with a partial one.
+    fs::path tmpPath = options.outputPath;
+    tmpPath += ".tmp";
+    OutputFileStream    file(tmpPath);
+    ScanlineImageWriter writer(
+        file, imageFormatFromPath(options.outputPath), imageSize, options.exposureStops);
+    std::vector<glm::vec3> rows;
+
+    for (std::uint32_t rowsBegin = 0; rowsBegin < imageSize.y; rowsBegin += tileSize)
+    {
+        const std::uint32_t numRows = std::min(tileSize, imageSize.y - rowsBegin);
+        rows.assign(static_cast<std::size_t>(imageSize.x) * numRows, glm::vec3(0.0f));
+        // Only the pages of the textures seen by the current rows need to be resident.
+        if (textureCache)
+        {
+            streamVisibleTextures(
+                pathTracer,
+                camera,
+                imageSize,
+                rowsBegin,
+                rowsBegin + numRows,
+                *textureCache,
+                threadPool);
+        }
+
+        std::atomic<std::uint32_t> nextTileX = 0;
+        auto                       renderTiles = [&]() -> void {
+            while (!gStopRequested)
+            {
+                const std::uint32_t tileX = nextTileX++;
+                if (tileX >= numTilesX)
+                {
+                    break;
+                }
+
+                const TileBounds bounds{
+                    .origin = Extent2u(tileX * tileSize, rowsBegin),
+                    .size = Extent2u(std::min(tileSize, imageSize.x - tileX * tileSize), numRows)};
+                TileAccumulation tile{
+                    .sampleBegin = options.firstSample,
+                    .sampleCount = 0,
+                    .radianceSums = std::vector<glm::vec3>(area(bounds.size), glm::vec3(0.0f))};
+                pathTracer.accumulateTile(
+                    camera, imageSize, options.samplingParams, bounds, numSamples, tile);
+
+                // Resolved in the same way as Accumulation::resolve.
+                const float invSampleCount =
+                    tile.sampleCount > 0 ? 1.0f / static_cast<float>(tile.sampleCount) : 0.0f;
+                for (std::uint32_t y = 0; y < bounds.size.y; ++y)
+                {
+                    for (std::uint32_t x = 0; x < bounds.size.x; ++x)
+                    {
+                        rows[y * imageSize.x + bounds.origin.x + x] =
+                            tile.radianceSums[y * bounds.size.x + x] * invSampleCount;
+                    }
+                }
+            }
+        };
+
+        {
+            std::vector<std::jthread> workers;
+            for (std::uint32_t i = 1; i < numThreads; ++i)
+            {
+                workers.emplace_back(renderTiles);
+            }
+            renderTiles();
+        }
+
+        if (gStopRequested)
+        {
+            file.close();
+            fs::remove(tmpPath);
+            return;
+        }
+
+        writer.writeRows(rows);
+        fmt::print(
+            "\rRendered {:.1f}%",
+            100.0 * static_cast<double>(writer.numRowsWritten()) /
+                static_cast<double>(imageSize.y));
+        std::fflush(stdout);
+    }
+
+    writer.finish();
+    file.close();
+    fs::rename(tmpPath, options.outputPath);
+}
+
+// Hands the tiles out to worker processes. Returns early if every spawned worker exits before the
+// render is complete.
+void renderDistributed(
+    const RenderOptions&               options,
+    const std::span<const std::string> renderArgs,
+    const std::string&                 executable,
+    Accumulation&                      accumulation,
+    const ProgressCallback&            onProgress)
+{
+    // Declared before the listener, so that workers still waiting to be accepted see the listener
+    // close before the threads wait for them to exit.
+    std::vector<std::jthread>  spawnedWorkers;
+    std::atomic<std::uint32_t> numRunningWorkers = options.numSpawnedWorkers;
+
+    // Checked before workers are started, since every worker would fail in the same way.
+    if (PtFormatFile(options.scenePath).hasSection(PtFormatSection::PagedBaseColorTextures))
+    {
+        throw std::runtime_error(
+            "Distributed rendering does not support .pt files with virtual textures.");
+    }
+
+    const SocketAddress address = parseSocketAddress(*options.listenAddress);
+    TcpListener         listener(address);
+    fmt::print("Listening for workers on {}:{}\n", address.host, listener.port());
+
+    if (options.numSpawnedWorkers > 0)
+    {
+        const std::string host = address.host == "0.0.0.0" ? "127.0.0.1" : address.host;
+        std::string       command = fmt::format(
+            "\"{}\" \"{}\" --worker {}:{} --threads 1",
+            executable,
+            options.scenePath.string(),
+            host,
+            listener.port());
+#if defined(_WIN32)
+        // cmd.exe strips the outermost quotes of the command line.
+        command = fmt::format("\"{}\"", command);
+#endif
+        for (std::uint32_t i = 0; i < options.numSpawnedWorkers; ++i)
+        {
+            spawnedWorkers.emplace_back([&numRunningWorkers, command]() -> void {
+                std::system(command.c_str());
+                --numRunningWorkers;
+            });
+        }
+    }
+
+    coordinateRender(
+        listener,
+        renderArgs,
+        options.samplingParams.numSamplesPerPixel,
+        accumulation,
+        [&]() -> bool {
+            return gStopRequested || (options.numSpawnedWorkers > 0 && numRunningWorkers == 0);
+        },
+        onProgress);
+}
+
+int workerMain(const int argc, char** const argv)
+{
+    const fs::path scenePath = argv[1];
+    std::uint32_t  numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    if (argc < 4)
+    {
+        throw std::runtime_error("Missing value for option --worker.");
+    }
+    const SocketAddress address = parseSocketAddress(argv[3]);
+
+    for (int i = 4; i < argc; ++i)
+    {
+        const std::string_view option = argv[i];
+        if (option == "--threads" && i + 1 < argc)
+        {
+            numThreads = std::max(static_cast<std::uint32_t>(std::stoul(argv[++i])), 1u);
+        }
+        else
+        {
+            throw std::runtime_error(fmt::format("Unknown worker option {}.", option));
+        }
+    }
+
+    if (!fs::exists(scenePath))
+    {
+        fmt::print(stderr, "File {} does not exist\n", scenePath.string());
+        return 1;
+    }
+
+    nlrs::runWorker(scenePath, address, numThreads);
+    return 0;
+}
+
+int main(int argc, char** argv)
+try
+{
+    if (argc < 3)
+    {
+        printHelp();
+        return 0;
+    }
+
+    if (std::string_view(argv[2]) == "--worker")
+    {
+        return workerMain(argc, argv);
+    }
+
+    const std::vector<std::string> args(argv + 3, argv + argc);
+    const RenderOptions            options = parseRenderOptions(argv[1], argv[2], args);
+    if (!fs::exists(options.scenePath))
+    {
+        fmt::print(stderr, "File {} does not exist\n", options.scenePath.string());
+        return 1;
+    }
+
+    // A preempted job receives SIGTERM. Tiles which are already being rendered are finished, and
+    // the accumulation is checkpointed before exiting.
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    if (options.outOfCore)
+    {
+        renderOutOfCore(options);
+        fmt::print("\n");
+        if (gStopRequested)
+        {
+            fmt::print(stderr, "Render stopped before completion.\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    // With virtual textures, the mip level which a sample reads depends on the pages which happen
+    // to be resident, so the samples of a resumed or merged render would not form the same
+    // estimate as a single render.
+    if (options.checkpointPath &&
+        PtFormatFile(options.scenePath).hasSection(PtFormatSection::PagedBaseColorTextures))
+    {
+        fmt::print(stderr, "--checkpoint is not supported for .pt files with virtual textures.\n");
+        return 1;
+    }
+
+    const std::uint32_t sampleEnd = options.samplingParams.numSamplesPerPixel;
+    Accumulation        accumulation = loadOrCreateAccumulation(options);
+
+    using Clock = std::chrono::steady_clock;
+    auto       lastCheckpointTime = Clock::now();
+    const auto onProgress = [&](const Accumulation& progress) -> void {
+        printProgress(progress, sampleEnd);
+        const auto now = Clock::now();
+        if (options.checkpointPath &&
+            now - lastCheckpointTime >= std::chrono::seconds(options.checkpointIntervalSeconds))
+        {
+            writeCheckpoint(*options.checkpointPath, progress);
+            lastCheckpointTime = now;
+        }
+    };
+
+    if (options.listenAddress)
+    {
+        renderDistributed(options, args, argv[0], accumulation, onProgress);
+    }
+    else
+    {
+        renderLocally(options, accumulation, onProgress);
+    }
+    fmt::print("\n");
+
+    if (options.checkpointPath)
+    {
+        writeCheckpoint(*options.checkpointPath, accumulation);
+    }
+
+    if (gStopRequested)
+    {
+        fmt::print(stderr, "Render stopped before completion.\n");
+        return 1;
+    }
+
+    if (!isComplete(accumulation, sampleEnd))
+    {
+        fmt::print(stderr, "All workers exited before the render completed.\n");
+        return 1;
+    }
+
+    std::vector<glm::vec3> estimate = accumulation.resolve();
+    if (options.denoise)
+    {
+        estimate = denoiseEstimate(options, estimate);
+    }
+    writeImage(options.outputPath, accumulation.imageSize(), estimate, options.exposureStops);
+}
+catch (const std::exception& e)
+{
+    fmt::print(stderr, "Exception occurred. {}\n", e.what());
+    return 1;
+}
+catch (...)
+{
+    fmt::print(stderr, "Unknown exception occurred.\n");
+    return 1;
+}
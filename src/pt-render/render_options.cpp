@@ -0,0 +1,310 @@
+#include "render_options.hpp"
+
+#include <common/units/angle.hpp>
+#include <pt-format/pt_format.hpp>
+
+#include <fmt/core.h>
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+namespace nlrs
+{
+namespace
+{
+std::uint32_t parseUint(const std::string_view option, const std::string& value)
+{
+    try
+    {
+        std::size_t         numParsed = 0;
+        const unsigned long x = std::stoul(value, &numParsed);
+        if (numParsed == value.size() && x <= std::numeric_limits<std::uint32_t>::max())
+        {
+            return static_cast<std::uint32_t>(x);
+        }
+    }
+    catch (const std::logic_error&)
+    {
+    }
+    throw std::runtime_error(fmt::format("Invalid value '{}' for option {}.", value, option));
+}
+
+float parseFloat(const std::string_view option, const std::string& value)
+{
+    try
+    {
+        std::size_t numParsed = 0;
+        const float x = std::stof(value, &numParsed);
+        if (numParsed == value.size())
+        {
+            return x;
+        }
+    }
+    catch (const std::logic_error&)
+    {
+    }
+    throw std::runtime_error(fmt::format("Invalid value '{}' for option {}.", value, option));
+}
+
+TextureFilter parseTextureFilter(const std::string_view option, const std::string& value)
+{
+    if (value == "nearest")
+    {
+        return TextureFilter::Nearest;
+    }
+    if (value == "bilinear")
+    {
+        return TextureFilter::Bilinear;
+    }
+    if (value == "trilinear")
+    {
+        return TextureFilter::Trilinear;
+    }
+    throw std::runtime_error(fmt::format("Invalid value '{}' for option {}.", value, option));
+}
+
+std::string_view textureFilterName(const TextureFilter filter)
+{
+    switch (filter)
+    {
+    case TextureFilter::Nearest:
+        return "nearest";
+    case TextureFilter::Bilinear:
+        return "bilinear";
+    case TextureFilter::Trilinear:
+        return "trilinear";
+    }
+    return "unknown";
+}
+} // namespace
+
+RenderOptions parseRenderOptions(
+    std::filesystem::path              scenePath,
+    std::filesystem::path              outputPath,
+    const std::span<const std::string> args)
+{
+    RenderOptions options;
+    options.scenePath = std::move(scenePath);
+    options.outputPath = std::move(outputPath);
+
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        const std::string_view option = args[i];
+        auto                   value = [&]() -> std::string {
+            if (i + 1 >= args.size())
+            {
+                throw std::runtime_error(fmt::format("Missing value for option {}.", option));
+            }
+            return args[++i];
+        };
+
+        if (option == "--size")
+        {
+            const std::string size = value();
+            const auto        sep = size.find('x');
+            if (sep == std::string::npos)
+            {
+                throw std::runtime_error(fmt::format("Invalid value '{}' for --size.", size));
+            }
+            options.imageSize = Extent2u(
+                parseUint(option, size.substr(0, sep)), parseUint(option, size.substr(sep + 1)));
+        }
+        else if (option == "--spp")
+        {
+            options.samplingParams.numSamplesPerPixel = parseUint(option, value());
+        }
+        else if (option == "--first-sample")
+        {
+            options.firstSample = parseUint(option, value());
+        }
+        else if (option == "--bounces")
+        {
+            options.samplingParams.numBounces = parseUint(option, value());
+        }
+        else if (option == "--min-bounces")
+        {
+            options.samplingParams.minBounces = parseUint(option, value());
+        }
+        else if (option == "--no-russian-roulette")
+        {
+            options.samplingParams.russianRoulette = false;
+        }
+        else if (option == "--camera-position")
+        {
+            const std::string position = value();
+            const auto        sep0 = position.find(',');
+            const auto        sep1 =
+                sep0 == std::string::npos ? std::string::npos : position.find(',', sep0 + 1);
+            if (sep1 == std::string::npos)
+            {
+                throw std::runtime_error(
+                    fmt::format("Invalid value '{}' for --camera-position.", position));
+            }
+            options.cameraPosition = glm::vec3(
+                parseFloat(option, position.substr(0, sep0)),
+                parseFloat(option, position.substr(sep0 + 1, sep1 - sep0 - 1)),
+                parseFloat(option, position.substr(sep1 + 1)));
+        }
+        else if (option == "--camera-yaw")
+        {
+            options.cameraYawDegrees = parseFloat(option, value());
+        }
+        else if (option == "--camera-pitch")
+        {
+            options.cameraPitchDegrees = parseFloat(option, value());
+        }
+        else if (option == "--camera-vfov")
+        {
+            options.cameraVfovDegrees = parseFloat(option, value());
+        }
+        else if (option == "--sun-zenith")
+        {
+            options.sky.sunZenithDegrees = parseFloat(option, value());
+        }
+        else if (option == "--sun-azimuth")
+        {
+            options.sky.sunAzimuthDegrees = parseFloat(option, value());
+        }
+        else if (option == "--sky-turbidity")
+        {
+            options.sky.turbidity = parseFloat(option, value());
+        }
+        else if (option == "--exposure-stops")
+        {
+            options.exposureStops = static_cast<int>(parseUint(option, value()));
+        }
+        else if (option == "--tile-size")
+        {
+            options.tileSize = parseUint(option, value());
+        }
+        else if (option == "--threads")
+        {
+            options.numThreads = parseUint(option, value());
+        }
+        else if (option == "--out-of-core")
+        {
+            options.outOfCore = true;
+        }
+        else if (option == "--denoise")
+        {
+            options.denoise = true;
+        }
+        else if (option == "--denoise-iterations")
+        {
+            options.denoise = true;
+            options.denoiseIterations = parseUint(option, value());
+        }
+        else if (option == "--texture-cache")
+        {
+            options.textureCacheMegabytes = parseUint(option, value());
+        }
+        else if (option == "--texture-filter")
+        {
+            options.textureFilter = parseTextureFilter(option, value());
+        }
+        else if (option == "--checkpoint")
+        {
+            options.checkpointPath = value();
+        }
+        else if (option == "--checkpoint-interval")
+        {
+            options.checkpointIntervalSeconds = parseUint(option, value());
+        }
+        else if (option == "--resume")
+        {
+            options.resume = true;
+        }
+        else if (option == "--listen")
+        {
+            options.listenAddress = value();
+        }
+        else if (option == "--spawn-workers")
+        {
+            options.numSpawnedWorkers = parseUint(option, value());
+        }
+        else
+        {
+            throw std::runtime_error(fmt::format("Unknown option {}.", option));
+        }
+    }
+
+    if (area(options.imageSize) == 0 || options.tileSize == 0)
+    {
+        throw std::runtime_error("Image size and tile size must be greater than zero.");
+    }
+
+    if (options.firstSample > options.samplingParams.numSamplesPerPixel)
+    {
+        throw std::runtime_error("--first-sample must not be greater than --spp.");
+    }
+
+    // Checkpoints and distributed renders keep the accumulation of the whole image in memory.
+    if (options.outOfCore &&
+        (options.checkpointPath || options.listenAddress || options.numSpawnedWorkers > 0))
+    {
+        throw std::runtime_error(
+            "--out-of-core cannot be combined with --checkpoint, --listen or --spawn-workers.");
+    }
+
+    // The denoiser's footprint spans many rows of tiles.
+    if (options.outOfCore && options.denoise)
+    {
+        throw std::runtime_error("--out-of-core cannot be combined with --denoise.");
+    }
+
+    if (options.numSpawnedWorkers > 0 && !options.listenAddress)
+    {
+        options.listenAddress = "127.0.0.1:0";
+    }
+
+    return options;
+}
+
+Camera cameraFromOptions(const RenderOptions& options)
+{
+    const float     yaw = Angle::degrees(options.cameraYawDegrees).asRadians();
+    const float     pitch = Angle::degrees(options.cameraPitchDegrees).asRadians();
+    const glm::vec3 forward = glm::normalize(glm::vec3(
+        std::cos(yaw) * std::cos(pitch), std::sin(pitch), std::sin(yaw) * std::cos(pitch)));
+    const float     focusDistance = 10.0f;
+    return createCamera(
+        options.cameraPosition,
+        options.cameraPosition + focusDistance * forward,
+        0.0f,
+        focusDistance,
+        Angle::degrees(options.cameraVfovDegrees),
+        aspectRatio(options.imageSize));
+}
+
+std::string renderSettings(const RenderOptions& options)
+{
+    const SamplingParams& sampling = options.samplingParams;
+    const Sky&            sky = options.sky;
+    return fmt::format(
+        "scene={} sceneHash={:016x} size={}x{} camera=({},{},{}) yaw={} pitch={} vfov={} "
+        "bounces={} russianRoulette={} minBounces={} sky=({},{},{},{},{},{}) textureFilter={}",
+        options.scenePath.filename().string(),
+        PtFormatFile(options.scenePath).contentHash(),
+        options.imageSize.x,
+        options.imageSize.y,
+        options.cameraPosition.x,
+        options.cameraPosition.y,
+        options.cameraPosition.z,
+        options.cameraYawDegrees,
+        options.cameraPitchDegrees,
+        options.cameraVfovDegrees,
+        sampling.numBounces,
+        sampling.russianRoulette,
+        sampling.minBounces,
+        sky.turbidity,
+        sky.albedo[0],
+        sky.albedo[1],
+        sky.albedo[2],
+        sky.sunZenithDegrees,
+        sky.sunAzimuthDegrees,
+        textureFilterName(options.textureFilter));
+}
+} // namespace nlrs
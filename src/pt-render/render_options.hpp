@@ -0,0 +1,63 @@
+#pragma once
+
+#include <common/camera.hpp>
+#include <common/extent.hpp>
+#include <common/sampling_params.hpp>
+#include <common/sky.hpp>
+#include <common/texture_sampling.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace nlrs
+{
+struct RenderOptions
+{
+    std::filesystem::path scenePath;
+    std::filesystem::path outputPath;
+    Extent2u              imageSize = Extent2u(640, 480);
+    std::uint32_t         firstSample = 0;
+    SamplingParams        samplingParams;
+    glm::vec3             cameraPosition = glm::vec3(1.22f, 1.25f, -1.25f);
+    float                 cameraYawDegrees = 129.64f;
+    float                 cameraPitchDegrees = -13.73f;
+    float                 cameraVfovDegrees = 80.0f;
+    Sky                   sky;
+    int                   exposureStops = 2;
+    std::uint32_t         tileSize = 32;
+    std::uint32_t         numThreads = 0; // 0 means the number of hardware threads
+    bool                  outOfCore = false;
+    bool                  denoise = false;
+    std::uint32_t         denoiseIterations = 5;
+    // The memory of the physical pages of .pt files with virtual textures.
+    std::uint32_t         textureCacheMegabytes = 512;
+    TextureFilter         textureFilter = TextureFilter::Nearest;
+
+    std::optional<std::filesystem::path> checkpointPath;
+    std::uint32_t                        checkpointIntervalSeconds = 60;
+    bool                                 resume = false;
+
+    // Distributed rendering
+    std::optional<std::string> listenAddress;
+    std::uint32_t              numSpawnedWorkers = 0;
+};
+
+// Parses the option arguments following the positional arguments on the command line.
+RenderOptions parseRenderOptions(
+    std::filesystem::path        scenePath,
+    std::filesystem::path        outputPath,
+    std::span<const std::string> args);
+
+Camera cameraFromOptions(const RenderOptions& options);
+
+// Everything which affects the value of a sample. The sample range, output, checkpointing and
+// distribution options are left out, since they can differ between runs contributing to the same
+// image. The scene is identified by its file name and PtFormatFile::contentHash, so that a
+// different .pt file with the same name is rejected. Opens the scene file to read the hash.
+std::string renderSettings(const RenderOptions& options);
+} // namespace nlrs
@@ -0,0 +1,262 @@
+#include "socket.hpp"
+
+#include <fmt/core.h>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace nlrs
+{
+namespace
+{
+#if defined(_WIN32)
+constexpr SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+
+struct WinsockInitializer
+{
+    WinsockInitializer()
+    {
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+        {
+            throw std::runtime_error("Failed to initialize Winsock.");
+        }
+    }
+    ~WinsockInitializer() { WSACleanup(); }
+};
+
+void ensureSocketsInitialized() { static WinsockInitializer initializer; }
+
+void closeSocket(const SocketHandle socket) { closesocket(socket); }
+
+constexpr int SHUTDOWN_BOTH = SD_BOTH;
+#else
+constexpr SocketHandle INVALID_SOCKET_HANDLE = -1;
+
+void ensureSocketsInitialized() {}
+
+void closeSocket(const SocketHandle socket) { close(socket); }
+
+constexpr int SHUTDOWN_BOTH = SHUT_RDWR;
+#endif
+
+// Writing to a socket closed by the peer must not raise SIGPIPE, which would terminate the process.
+#if defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+// Large messages are sent and received in chunks, since the Winsock functions take int lengths.
+constexpr std::size_t MAX_CHUNK_SIZE = 1 << 20;
+
+sockaddr_in toSockaddr(const SocketAddress& address)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(address.port);
+    if (inet_pton(AF_INET, address.host.c_str(), &addr.sin_addr) != 1)
+    {
+        throw std::runtime_error(fmt::format("Invalid IPv4 address '{}'.", address.host));
+    }
+    return addr;
+}
+
+SocketHandle createSocket()
+{
+    ensureSocketsInitialized();
+    const SocketHandle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET_HANDLE)
+    {
+        throw std::runtime_error("Failed to create socket.");
+    }
+    return s;
+}
+} // namespace
+
+SocketAddress parseSocketAddress(const std::string& address)
+{
+    const auto sep = address.rfind(':');
+    if (sep == std::string::npos)
+    {
+        throw std::runtime_error(
+            fmt::format("Invalid socket address '{}'. Expected <host>:<port>.", address));
+    }
+
+    const std::string portStr = address.substr(sep + 1);
+    const bool        isNumber = !portStr.empty() && portStr.size() <= 5 &&
+                          std::all_of(portStr.begin(), portStr.end(), [](const char c) -> bool {
+                              return c >= '0' && c <= '9';
+                          });
+    if (!isNumber || std::stoul(portStr) > 65535)
+    {
+        throw std::runtime_error(fmt::format("Invalid port in socket address '{}'.", address));
+    }
+
+    return SocketAddress{address.substr(0, sep), static_cast<std::uint16_t>(std::stoul(portStr))};
+}
+
+TcpStream::TcpStream(const SocketHandle socket)
+    : mSocket(socket)
+{
+    // Job messages are small and latency bound.
+    const int noDelay = 1;
+    setsockopt(
+        mSocket,
+        IPPROTO_TCP,
+        TCP_NODELAY,
+        reinterpret_cast<const char*>(&noDelay),
+        sizeof(noDelay));
+#if defined(SO_NOSIGPIPE)
+    const int noSigPipe = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+}
+
+TcpStream::~TcpStream()
+{
+    if (mSocket != INVALID_SOCKET_HANDLE)
+    {
+        closeSocket(mSocket);
+    }
+}
+
+TcpStream::TcpStream(TcpStream&& other) noexcept
+    : mSocket(std::exchange(other.mSocket, INVALID_SOCKET_HANDLE))
+{
+}
+
+TcpStream& TcpStream::operator=(TcpStream&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (mSocket != INVALID_SOCKET_HANDLE)
+        {
+            closeSocket(mSocket);
+        }
+        mSocket = std::exchange(other.mSocket, INVALID_SOCKET_HANDLE);
+    }
+    return *this;
+}
+
+TcpStream TcpStream::connect(const SocketAddress& address)
+{
+    const sockaddr_in  addr = toSockaddr(address);
+    const SocketHandle s = createSocket();
+    if (::connect(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        closeSocket(s);
+        throw std::runtime_error(
+            fmt::format("Failed to connect to {}:{}.", address.host, address.port));
+    }
+    return TcpStream(s);
+}
+
+std::size_t TcpStream::read(char* const data, const std::size_t numBytes)
+{
+    std::size_t numRead = 0;
+    while (numRead < numBytes)
+    {
+        const std::size_t chunkSize = std::min(numBytes - numRead, MAX_CHUNK_SIZE);
+        const auto        result = recv(mSocket, data + numRead, static_cast<int>(chunkSize), 0);
+        if (result <= 0)
+        {
+            // Connection closed or failed.
+            break;
+        }
+        numRead += static_cast<std::size_t>(result);
+    }
+    return numRead;
+}
+
+void TcpStream::write(const char* const data, const std::size_t numBytes)
+{
+    std::size_t numWritten = 0;
+    while (numWritten < numBytes)
+    {
+        const std::size_t chunkSize = std::min(numBytes - numWritten, MAX_CHUNK_SIZE);
+        const auto        result =
+            send(mSocket, data + numWritten, static_cast<int>(chunkSize), SEND_FLAGS);
+        if (result <= 0)
+        {
+            throw std::runtime_error("Failed to write to socket: connection closed.");
+        }
+        numWritten += static_cast<std::size_t>(result);
+    }
+}
+
+void TcpStream::shutdown() noexcept { ::shutdown(mSocket, SHUTDOWN_BOTH); }
+
+TcpListener::TcpListener(const SocketAddress& address)
+    : mSocket(createSocket())
+{
+    const int reuseAddress = 1;
+    setsockopt(
+        mSocket,
+        SOL_SOCKET,
+        SO_REUSEADDR,
+        reinterpret_cast<const char*>(&reuseAddress),
+        sizeof(reuseAddress));
+
+    const sockaddr_in addr = toSockaddr(address);
+    if (bind(mSocket, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(mSocket, SOMAXCONN) != 0)
+    {
+        closeSocket(mSocket);
+        throw std::runtime_error(
+            fmt::format("Failed to listen on {}:{}.", address.host, address.port));
+    }
+}
+
+TcpListener::~TcpListener() { closeSocket(mSocket); }
+
+std::uint16_t TcpListener::port() const
+{
+    sockaddr_in addr;
+    socklen_t   addrLen = sizeof(addr);
+    if (getsockname(mSocket, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0)
+    {
+        throw std::runtime_error("Failed to query listening socket address.");
+    }
+    return ntohs(addr.sin_port);
+}
+
+std::optional<TcpStream> TcpListener::accept(const std::chrono::milliseconds timeout)
+{
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(mSocket, &readSet);
+
+    timeval tv;
+    tv.tv_sec = static_cast<long>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<long>((timeout.count() % 1000) * 1000);
+
+    const int numReady = select(static_cast<int>(mSocket + 1), &readSet, nullptr, nullptr, &tv);
+    if (numReady <= 0)
+    {
+        return std::nullopt;
+    }
+
+    const SocketHandle s = ::accept(mSocket, nullptr, nullptr);
+    if (s == INVALID_SOCKET_HANDLE)
+    {
+        return std::nullopt;
+    }
+    return TcpStream(s);
+}
+} // namespace nlrs
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <common/stream.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace nlrs
+{
+#if defined(_WIN32)
+using SocketHandle = std::uintptr_t;
+#else
+using SocketHandle = int;
+#endif
+
+struct SocketAddress
+{
+    std::string   host;
+    std::uint16_t port;
+};
+
+// Parses an IPv4 address of the form <host>:<port>, e.g. 127.0.0.1:7070.
+SocketAddress parseSocketAddress(const std::string& address);
+
+// A connected TCP socket. Reads block until the requested number of bytes has been received, or
+// the connection has been closed.
+class TcpStream : public InputStream, public OutputStream
+{
+public:
+    explicit TcpStream(SocketHandle);
+    virtual ~TcpStream();
+
+    TcpStream(const TcpStream&) = delete;
+    TcpStream& operator=(const TcpStream&) = delete;
+
+    TcpStream(TcpStream&&) noexcept;
+    TcpStream& operator=(TcpStream&&) noexcept;
+
+    static TcpStream connect(const SocketAddress&);
+
+    virtual std::size_t read(char* data, std::size_t numBytes) override;
+    virtual void        write(const char* data, std::size_t numBytes) override;
+
+    // Shuts down both directions of the connection. A read blocked on another thread returns.
+    void shutdown() noexcept;
+
+private:
+    SocketHandle mSocket;
+};
+
+class TcpListener
+{
+public:
+    // Port 0 binds to any free port.
+    explicit TcpListener(const SocketAddress&);
+    ~TcpListener();
+
+    TcpListener(const TcpListener&) = delete;
+    TcpListener& operator=(const TcpListener&) = delete;
+
+    std::uint16_t port() const;
+
+    // Returns std::nullopt if no connection arrived within `timeout`.
+    std::optional<TcpStream> accept(std::chrono::milliseconds timeout);
+
+private:
+    SocketHandle mSocket;
+};
+} // namespace nlrs
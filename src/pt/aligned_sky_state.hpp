@@ -1,27 +1,17 @@
 #pragma once
 
 #include <common/assert.hpp>
+#include <common/sky.hpp>
 #include <common/units/angle.hpp>
 
 #include <glm/glm.hpp>
 #include <hw-skymodel/hw_skymodel.h>
 
-#include <array>
 #include <cstring>
 #include <numbers>
 
 namespace nlrs
 {
-struct Sky
-{
-    float                turbidity = 1.0f;
-    std::array<float, 3> albedo = {1.0f, 1.0f, 1.0f};
-    float                sunZenithDegrees = 30.0f;
-    float                sunAzimuthDegrees = 0.0f;
-
-    bool operator==(const Sky&) const noexcept = default;
-};
-
 // A 16-byte aligned sky state for the hw-skymodel library. Matches the layout of the following WGSL
 // struct:
 //
@@ -49,12 +39,8 @@ struct AlignedSkyState
           padding2(0.0f)
     {
         const float sunZenith = Angle::degrees(sky.sunZenithDegrees).asRadians();
-        const float sunAzimuth = Angle::degrees(sky.sunAzimuthDegrees).asRadians();
 
-        sunDirection = glm::normalize(glm::vec3(
-            std::sin(sunZenith) * std::cos(sunAzimuth),
-            std::cos(sunZenith),
-            -std::sin(sunZenith) * std::sin(sunAzimuth)));
+        sunDirection = nlrs::sunDirection(sky);
 
         const sky_params skyParams{
             .elevation = 0.5f * std::numbers::pi_v<float> - sunZenith,
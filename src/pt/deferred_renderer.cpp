@@ -58,6 +58,30 @@ WGPUTexture createGbufferTexture(
     return wgpuDeviceCreateTexture(device, &desc);
 }
 
+// The compressed textures are uploaded as is if the device supports BC textures. BC textures must
+// have dimensions which are multiples of the block size.
+bool canUploadCompressed(const GpuContext& gpuContext, const CompressedTexture& texture)
+{
+    const Texture::Dimensions dimensions = texture.dimensions();
+    return gpuContext.textureCompressionBc && dimensions.width % TEXTURE_BLOCK_SIZE == 0 &&
+           dimensions.height % TEXTURE_BLOCK_SIZE == 0;
+}
+
+WGPUTextureFormat compressedTextureFormat(const TextureCompression compression)
+{
+    switch (compression)
+    {
+    case TextureCompression::Bc1:
+        return WGPUTextureFormat_BC1RGBAUnorm;
+    case TextureCompression::Bc7:
+        return WGPUTextureFormat_BC7RGBAUnorm;
+    case TextureCompression::None:
+        break;
+    }
+    NLRS_ASSERT(false);
+    return WGPUTextureFormat_Undefined;
+}
+
 WGPUTextureView createGbufferTextureView(
     const WGPUTexture       texture,
     const char* const       label,
@@ -193,7 +217,8 @@ DeferredRenderer::DeferredRenderer(
         rendererDesc.sceneBvhNodes,
         rendererDesc.scenePositionAttributes,
         rendererDesc.sceneVertexAttributes,
-        rendererDesc.sceneBaseColorTextures};
+        rendererDesc.sceneBaseColorTextures,
+        rendererDesc.sceneTexelLayout};
     mResolvePass = ResolvePass{gpuContext, mSampleBuffer, rendererDesc};
 }
 
@@ -631,75 +656,118 @@ DeferredRenderer::GbufferPass::GbufferPass(
           return indices;
       }()),
       mBaseColorTextures([&gpuContext, &rendererDesc]() -> std::vector<GpuTexture> {
-          std::vector<GpuTexture> textures;
-          std::transform(
-              rendererDesc.sceneBaseColorTextures.begin(),
-              rendererDesc.sceneBaseColorTextures.end(),
-              std::back_inserter(textures),
-              [&gpuContext](const Texture& texture) -> GpuTexture {
-                  const auto                  dimensions = texture.dimensions();
-                  const WGPUTextureFormat     TEXTURE_FORMAT = WGPUTextureFormat_BGRA8Unorm;
-                  const WGPUTextureDescriptor textureDesc{
-                      .nextInChain = nullptr,
-                      .label = "Mesh texture",
-                      .usage = WGPUTextureUsage_CopyDst | WGPUTextureUsage_TextureBinding,
-                      .dimension = WGPUTextureDimension_2D,
-                      .size = {dimensions.width, dimensions.height, 1},
-                      .format = TEXTURE_FORMAT,
-                      .mipLevelCount = 1,
-                      .sampleCount = 1,
-                      .viewFormatCount = 1,
-                      .viewFormats = &TEXTURE_FORMAT,
-                  };
-                  const WGPUTexture gpuTexture =
-                      wgpuDeviceCreateTexture(gpuContext.device, &textureDesc);
+          const std::span<const Texture>           decodedTextures =
+              rendererDesc.sceneBaseColorTextures;
+          const std::span<const CompressedTexture> compressedTextures =
+              rendererDesc.sceneCompressedBaseColorTextures;
 
-                  const WGPUTextureViewDescriptor viewDesc{
-                      .nextInChain = nullptr,
-                      .label = "Mesh texture view",
-                      .format = TEXTURE_FORMAT,
-                      .dimension = WGPUTextureViewDimension_2D,
-                      .baseMipLevel = 0,
-                      .mipLevelCount = 1,
-                      .baseArrayLayer = 0,
-                      .arrayLayerCount = 1,
-                      .aspect = WGPUTextureAspect_All,
-                  };
-                  const WGPUTextureView view = wgpuTextureCreateView(gpuTexture, &viewDesc);
+          std::vector<GpuTexture> textures;
+          for (std::size_t textureIdx = 0; textureIdx < decodedTextures.size(); ++textureIdx)
+          {
+              const Texture&           texture = decodedTextures[textureIdx];
+              const CompressedTexture* compressed = nullptr;
+              if (textureIdx < compressedTextures.size() &&
+                  canUploadCompressed(gpuContext, compressedTextures[textureIdx]))
+              {
+                  compressed = &compressedTextures[textureIdx];
+              }
+
+              const auto                  dimensions = texture.dimensions();
+              const WGPUTextureFormat     TEXTURE_FORMAT =
+                  compressed != nullptr ? compressedTextureFormat(compressed->compression())
+                                        : WGPUTextureFormat_BGRA8Unorm;
+              const WGPUTextureDescriptor textureDesc{
+                  .nextInChain = nullptr,
+                  .label = "Mesh texture",
+                  .usage = WGPUTextureUsage_CopyDst | WGPUTextureUsage_TextureBinding,
+                  .dimension = WGPUTextureDimension_2D,
+                  .size = {dimensions.width, dimensions.height, 1},
+                  .format = TEXTURE_FORMAT,
+                  .mipLevelCount = texture.numMipLevels(),
+                  .sampleCount = 1,
+                  .viewFormatCount = 1,
+                  .viewFormats = &TEXTURE_FORMAT,
+              };
+              const WGPUTexture gpuTexture =
+                  wgpuDeviceCreateTexture(gpuContext.device, &textureDesc);
+
+              const WGPUTextureViewDescriptor viewDesc{
+                  .nextInChain = nullptr,
+                  .label = "Mesh texture view",
+                  .format = TEXTURE_FORMAT,
+                  .dimension = WGPUTextureViewDimension_2D,
+                  .baseMipLevel = 0,
+                  .mipLevelCount = texture.numMipLevels(),
+                  .baseArrayLayer = 0,
+                  .arrayLayerCount = 1,
+                  .aspect = WGPUTextureAspect_All,
+              };
+              const WGPUTextureView view = wgpuTextureCreateView(gpuTexture, &viewDesc);
+
+              for (std::uint32_t level = 0; level < texture.numMipLevels(); ++level)
+              {
+                  const auto levelDimensions = texture.mipLevelDimensions(level);
 
                   const WGPUImageCopyTexture imageDestination{
                       .nextInChain = nullptr,
                       .texture = gpuTexture,
-                      .mipLevel = 0,
+                      .mipLevel = level,
                       .origin = {0, 0, 0},
                       .aspect = WGPUTextureAspect_All,
                   };
+                  if (compressed != nullptr)
+                  {
+                      // Block compressed levels are copied in whole blocks, including the blocks
+                      // which extend past the edges of the smallest levels.
+                      const auto blocks = CompressedTexture::blockDimensions(levelDimensions);
+                      const auto data = compressed->mipLevel(level);
+                      const WGPUTextureDataLayout sourceDataLayout{
+                          .nextInChain = nullptr,
+                          .offset = 0,
+                          .bytesPerRow = static_cast<std::uint32_t>(
+                              blocks.width * compressedBlockNumBytes(compressed->compression())),
+                          .rowsPerImage = blocks.height,
+                      };
+                      const WGPUExtent3D writeSize{
+                          .width = blocks.width * TEXTURE_BLOCK_SIZE,
+                          .height = blocks.height * TEXTURE_BLOCK_SIZE,
+                          .depthOrArrayLayers = 1};
+                      wgpuQueueWriteTexture(
+                          gpuContext.queue,
+                          &imageDestination,
+                          data.data(),
+                          data.size_bytes(),
+                          &sourceDataLayout,
+                          &writeSize);
+                      continue;
+                  }
+
+                  const auto                  pixels = texture.mipLevel(level);
                   const WGPUTextureDataLayout sourceDataLayout{
                       .nextInChain = nullptr,
                       .offset = 0,
-                      .bytesPerRow =
-                          static_cast<std::uint32_t>(dimensions.width * sizeof(Texture::BgraPixel)),
-                      .rowsPerImage = dimensions.height,
+                      .bytesPerRow = static_cast<std::uint32_t>(
+                          levelDimensions.width * sizeof(Texture::BgraPixel)),
+                      .rowsPerImage = levelDimensions.height,
                   };
                   const WGPUExtent3D writeSize{
-                      .width = dimensions.width,
-                      .height = dimensions.height,
+                      .width = levelDimensions.width,
+                      .height = levelDimensions.height,
                       .depthOrArrayLayers = 1};
-                  const std::size_t numPixelBytes = sizeof(Texture::BgraPixel);
-                  const std::size_t numTextureBytes = texture.pixels().size() * numPixelBytes;
                   wgpuQueueWriteTexture(
                       gpuContext.queue,
                       &imageDestination,
-                      texture.pixels().data(),
-                      numTextureBytes,
+                      pixels.data(),
+                      pixels.size_bytes(),
                       &sourceDataLayout,
                       &writeSize);
+              }
 
-                  return GpuTexture{
-                      .texture = gpuTexture,
-                      .view = view,
-                  };
+              textures.push_back(GpuTexture{
+                  .texture = gpuTexture,
+                  .view = view,
               });
+          }
           return textures;
       }()),
       mBaseColorTextureBindGroups(),
@@ -1401,7 +1469,8 @@ DeferredRenderer::LightingPass::LightingPass(
     std::span<const BvhNode>           sceneBvhNodes,
     std::span<const PositionAttribute> scenePositionAttributes,
     std::span<const VertexAttributes>  sceneVertexAttributes,
-    std::span<const Texture>           sceneBaseColorTextures)
+    std::span<const Texture>           sceneBaseColorTextures,
+    const TexelLayout                  sceneTexelLayout)
     : mCurrentSky{},
       mSkyStateBuffer{
           gpuContext.device,
@@ -1452,6 +1521,7 @@ DeferredRenderer::LightingPass::LightingPass(
       }()},
       mBvhBindGroup{},
       mSampleBindGroup{},
+      mTextureAtlasStats{},
       mPipeline(nullptr)
 {
     {
@@ -1491,62 +1561,27 @@ DeferredRenderer::LightingPass::LightingPass(
             textureBindGroupEntry(2, depthTextureView)}};
 
     {
-        struct TextureDescriptor
-        {
-            std::uint32_t width, height, offset;
-        };
-        // Ensure matches layout of `TextureDescriptor` definition in shader.
-        std::vector<TextureDescriptor> textureDescriptors;
-        textureDescriptors.reserve(sceneBaseColorTextures.size());
-
-        std::vector<Texture::BgraPixel> textureData;
-        textureData.reserve((2 << 28) / sizeof(Texture::BgraPixel));
-
-        // Texture descriptors and texture data need to appended in the order of
-        // sceneBaseColorTextures. The vertex attribute's `textureIdx` indexes into that array, and
-        // we want to use the same indices to index into the texture descriptor array.
-
-        for (const Texture& baseColorTexture : sceneBaseColorTextures)
-        {
-            const auto dimensions = baseColorTexture.dimensions();
-            const auto pixels = baseColorTexture.pixels();
-
-            const std::uint32_t width = dimensions.width;
-            const std::uint32_t height = dimensions.height;
-            const std::uint32_t offset = static_cast<std::uint32_t>(textureData.size());
-
-            textureData.resize(textureData.size() + pixels.size());
-            std::memcpy(
-                textureData.data() + offset,
-                pixels.data(),
-                pixels.size() * sizeof(Texture::BgraPixel));
-
-            textureDescriptors.push_back({width, height, offset});
-        }
+        // Texture descriptors are stored in the order of sceneBaseColorTextures. The vertex
+        // attribute's `textureIdx` indexes into that array, and we want to use the same indices to
+        // index into the texture descriptor array. Each descriptor locates its texture in the
+        // atlas.
+        const TextureAtlas textureAtlas = buildTextureAtlas(
+            sceneBaseColorTextures,
+            sceneTexelLayout,
+            static_cast<std::size_t>(REQUIRED_LIMITS.maxStorageBufferBindingSize));
+        mTextureAtlasStats = textureAtlas.stats;
 
         mTextureDescriptorBuffer = GpuBuffer(
             gpuContext.device,
             "texture descriptor buffer",
             {GpuBufferUsage::ReadOnlyStorage, GpuBufferUsage::CopyDst},
-            std::span<const TextureDescriptor>(textureDescriptors));
-
-        const std::size_t textureDataNumBytes = textureData.size() * sizeof(Texture::BgraPixel);
-        const std::size_t maxStorageBufferBindingSize =
-            static_cast<std::size_t>(REQUIRED_LIMITS.maxStorageBufferBindingSize);
-        if (textureDataNumBytes > maxStorageBufferBindingSize)
-        {
-            throw std::runtime_error(fmt::format(
-                "Texture buffer size ({}) exceeds "
-                "maxStorageBufferBindingSize ({}).",
-                textureDataNumBytes,
-                maxStorageBufferBindingSize));
-        }
+            std::span<const TextureAtlasDescriptor>(textureAtlas.descriptors));
 
         mTextureBuffer = GpuBuffer(
             gpuContext.device,
-            "texture buffer",
+            "texture atlas buffer",
             {GpuBufferUsage::ReadOnlyStorage, GpuBufferUsage::CopyDst},
-            std::span<const Texture::BgraPixel>(textureData));
+            std::span<const Texture::BgraPixel>(textureAtlas.texels));
     }
 
     const GpuBindGroupLayout bvhBindGroupLayout{
@@ -1671,6 +1706,7 @@ DeferredRenderer::LightingPass::LightingPass(LightingPass&& other) noexcept
         mBlueNoiseBuffer = std::move(other.mBlueNoiseBuffer);
         mBvhBindGroup = std::move(other.mBvhBindGroup);
         mSampleBindGroup = std::move(other.mSampleBindGroup);
+        mTextureAtlasStats = other.mTextureAtlasStats;
         mPipeline = other.mPipeline;
         other.mPipeline = nullptr;
     }
@@ -1695,6 +1731,7 @@ DeferredRenderer::LightingPass& DeferredRenderer::LightingPass::operator=(
         mBlueNoiseBuffer = std::move(other.mBlueNoiseBuffer);
         mBvhBindGroup = std::move(other.mBvhBindGroup);
         mSampleBindGroup = std::move(other.mSampleBindGroup);
+        mTextureAtlasStats = other.mTextureAtlasStats;
         computePipelineSafeRelease(mPipeline);
         mPipeline = other.mPipeline;
         other.mPipeline = nullptr;
@@ -1769,6 +1806,11 @@ void DeferredRenderer::LightingPass::resize(
             textureBindGroupEntry(2, depthTextureView)}};
 }
 
+TextureAtlasStats DeferredRenderer::LightingPass::textureAtlasStats() const
+{
+    return mTextureAtlasStats;
+}
+
 DeferredRenderer::ResolvePass::ResolvePass(
     const GpuContext&                 gpuContext,
     const GpuBuffer&                  sampleBuffer,
@@ -2052,6 +2094,11 @@ DeferredRenderer::PerfStats DeferredRenderer::getPerfStats() const
             mResolvePassDurationsNs.size()};
 }
 
+TextureAtlasStats DeferredRenderer::getTextureAtlasStats() const
+{
+    return mLightingPass.textureAtlasStats();
+}
+
 void DeferredRenderer::invalidateTemporalAccumulation()
 {
     // In the first frame of the accumulation sequence, we are forced to write the lighting pass
@@ -7,7 +7,10 @@
 
 #include <common/bvh.hpp>
 #include <common/extent.hpp>
+#include <common/texel_layout.hpp>
 #include <common/texture.hpp>
+#include <common/texture_atlas.hpp>
+#include <common/texture_compression.hpp>
 #include <pt-format/vertex_attributes.hpp>
 
 #include <glm/glm.hpp>
@@ -27,18 +30,22 @@ class Gui;
 
 struct DeferredRendererDescriptor
 {
-    Extent2u                                  framebufferSize;
-    Extent2u                                  maxFramebufferSize;
-    std::span<std::span<const glm::vec4>>     modelPositions;
-    std::span<std::span<const glm::vec4>>     modelNormals;
-    std::span<std::span<const glm::vec2>>     modelTexCoords;
-    std::span<std::span<const std::uint32_t>> modelIndices;
-    std::span<std::uint32_t>                  modelBaseColorTextureIndices;
-    std::span<Texture>                        sceneBaseColorTextures;
+    Extent2u                                        framebufferSize;
+    Extent2u                                        maxFramebufferSize;
+    std::span<const std::span<const glm::vec4>>     modelPositions;
+    std::span<const std::span<const glm::vec4>>     modelNormals;
+    std::span<const std::span<const glm::vec2>>     modelTexCoords;
+    std::span<const std::span<const std::uint32_t>> modelIndices;
+    std::span<const std::uint32_t>                  modelBaseColorTextureIndices;
+    std::span<const Texture>                        sceneBaseColorTextures;
+    // Optional. The G-buffer pass uploads these instead of the decoded textures, if the device
+    // supports BC textures. In the order of sceneBaseColorTextures.
+    std::span<const CompressedTexture>              sceneCompressedBaseColorTextures;
 
     std::span<const BvhNode>           sceneBvhNodes;
     std::span<const PositionAttribute> scenePositionAttributes;
     std::span<const VertexAttributes>  sceneVertexAttributes;
+    TexelLayout                        sceneTexelLayout;
 };
 
 struct RenderDescriptor
@@ -74,7 +81,8 @@ public:
     void renderDebug(const GpuContext&, const glm::mat4&, const Extent2f&, WGPUTextureView, Gui&);
     void resize(const GpuContext&, const Extent2u&);
 
-    PerfStats getPerfStats() const;
+    PerfStats         getPerfStats() const;
+    TextureAtlasStats getTextureAtlasStats() const;
 
 private:
     struct IndexBuffer
@@ -187,6 +195,7 @@ private:
         GpuBuffer           mBlueNoiseBuffer = GpuBuffer{};
         GpuBindGroup        mBvhBindGroup = GpuBindGroup{};
         GpuBindGroup        mSampleBindGroup = GpuBindGroup{};
+        TextureAtlasStats   mTextureAtlasStats = TextureAtlasStats{};
         WGPUComputePipeline mPipeline = nullptr;
 
         struct Uniforms
@@ -209,7 +218,8 @@ private:
             std::span<const BvhNode>           bvhNodes,
             std::span<const PositionAttribute> positionAttributes,
             std::span<const VertexAttributes>  vertexAttributes,
-            std::span<const Texture>           baseColorTextures);
+            std::span<const Texture>           baseColorTextures,
+            TexelLayout                        texelLayout);
         ~LightingPass();
 
         LightingPass(const LightingPass&) = delete;
@@ -231,6 +241,8 @@ private:
             WGPUTextureView albedoTextureView,
             WGPUTextureView normalTextureView,
             WGPUTextureView depthTextureView);
+
+        TextureAtlasStats textureAtlasStats() const;
     };
 
     struct ResolvePass
@@ -43,10 +43,16 @@ struct VertexAttributes {
     textureDescriptorIdx: u32,
 }
 
+// Level 0 of the texture is at (`x`, `y`) in the texture atlas. Level 1 is to its right, and the
+// following levels are below level 1.
 struct TextureDescriptor {
+    x: u32,
+    y: u32,
     width: u32,
     height: u32,
-    offset: u32,
+    numMipLevels: u32,
+    atlasWidth: u32,
+    layout: u32,
 }
 
 struct Ray {
@@ -122,7 +128,12 @@ fn main(@builtin(global_invocation_id) globalInvocationId: vec3<u32>) {
         let encodedNormal = textureLoad(gbufferNormal, textureIdx, 0).rgb;
         let decodedNormal = 2f * encodedNormal - vec3(1f);
         let albedo = textureLoad(gbufferAlbedo, textureIdx, 0).rgb;
-        color = surfaceColor(coord, offsetPosition(position, decodedNormal), decodedNormal, albedo);
+        // The ray cone through the pixel, whose width at the surface is the distance to the
+        // neighbouring pixel at the same depth.
+        let eyeDistance = length(position - uniforms.cameraEye.xyz);
+        let pixelWidth = length(worldFromUv(uv + vec2f(1f / uniforms.framebufferSize.x, 0f), depthSample) - position);
+        let spreadAngle = pixelWidth / eyeDistance;
+        color = surfaceColor(coord, offsetPosition(position, decodedNormal), decodedNormal, albedo, spreadAngle, eyeDistance);
     }
 
     let sampleBufferIdx = textureIdx.y * u32(uniforms.framebufferSize.x) + textureIdx.x;
@@ -139,8 +150,11 @@ fn worldFromUv(uv: vec2f, depthSample: f32) -> vec3f {
 
 const NUM_BOUNCES = 2;
 
+// The width of the ray cone around the path grows by `spreadAngle` per unit of distance travelled,
+// and `eyeDistance` has been travelled from the camera to the primary surface.
 @must_use
-fn surfaceColor(coord: vec2u, primaryPos: vec3f, primaryNormal: vec3f, primaryAlbedo: vec3f) -> vec3f {
+fn surfaceColor(coord: vec2u, primaryPos: vec3f, primaryNormal: vec3f, primaryAlbedo: vec3f, spreadAngle: f32, eyeDistance: f32) -> vec3f {
+    var pathLength = eyeDistance;
     var position = primaryPos;
     var normal = primaryNormal;
     var albedo = primaryAlbedo;
@@ -157,11 +171,10 @@ fn surfaceColor(coord: vec2u, primaryPos: vec3f, primaryNormal: vec3f, primaryAl
 
         var hit: Intersection;
         if rayIntersectBvh(ray, T_MAX, &hit) {
+            pathLength += hit.t;
             position = hit.p;
             normal = hit.n;
-            let uv = hit.uv;
-            let textureDescriptorIdx = hit.textureDescriptorIdx;
-            albedo = evalTexture(textureDescriptorIdx, uv);
+            albedo = evalTexture(hit, ray.direction, spreadAngle * pathLength);
         } else {
             let v = ray.direction;
             let s = skyState.sunDirection;
@@ -250,26 +263,92 @@ fn evalImplicitLambertian(u: vec2f, n: vec3f) -> vec3f {
 }
 
 @must_use
-fn evalTexture(textureDescriptorIdx: u32, uv: vec2f) -> vec3f {
-    let textureDesc = textureDescriptors[textureDescriptorIdx];
-    return textureLookup(textureDesc, uv);
+fn evalTexture(hit: Intersection, rayDirection: vec3f, coneWidth: f32) -> vec3f {
+    let textureDesc = textureDescriptors[hit.textureDescriptorIdx];
+    let lod = rayConeTextureLod(
+        positionAttributes[hit.triangleIdx],
+        vertexAttributes[hit.triangleIdx],
+        textureDesc,
+        rayDirection,
+        coneWidth
+    );
+    return textureLookup(textureDesc, hit.uv, lod);
+}
+
+// The texture level of detail at which a ray cone of width `coneWidth` samples the texture of a
+// triangle, as in rayConeTextureLod in path_tracer.cpp.
+@must_use
+fn rayConeTextureLod(tri: Positions, vert: VertexAttributes, desc: TextureDescriptor, rayDirection: vec3f, coneWidth: f32) -> f32 {
+    let normal = cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+    let duv1 = vert.uv1 - vert.uv0;
+    let duv2 = vert.uv2 - vert.uv0;
+
+    let worldArea = length(normal);
+    let texelArea = abs(duv1.x * duv2.y - duv2.x * duv1.y) * f32(desc.width) * f32(desc.height);
+    // The cosine of the angle between the ray and the triangle, times `worldArea`.
+    let projectedArea = abs(dot(normal, rayDirection));
+    if coneWidth <= 0f || texelArea <= 0f || projectedArea <= 0f {
+        return 0f;
+    }
+
+    return log2(coneWidth) + 0.5f * log2(texelArea) + 0.5f * log2(worldArea) - log2(projectedArea);
 }
 
+// Samples the nearest pixel of the mip level nearest to `lod`.
 @must_use
-fn textureLookup(desc: TextureDescriptor, uv: vec2f) -> vec3f {
+fn textureLookup(desc: TextureDescriptor, uv: vec2f, lod: f32) -> vec3f {
+    let level = u32(clamp(floor(lod + 0.5f), 0f, f32(desc.numMipLevels - 1u)));
+    var x = desc.x;
+    var y = desc.y;
+    var width = desc.width;
+    var height = desc.height;
+    for (var l = 0u; l < level; l += 1u) {
+        if l == 0u {
+            x += width;
+        } else {
+            y += height;
+        }
+        width = max(width >> 1u, 1u);
+        height = max(height >> 1u, 1u);
+    }
+
     let u = fract(uv.x);
     let v = fract(uv.y);
 
-    let j = u32(u * f32(desc.width));
-    let i = u32(v * f32(desc.height));
-    let idx = i * desc.width + j;
+    let j = min(u32(u * f32(width)), width - 1u);
+    let i = min(u32(v * f32(height)), height - 1u);
+    let idx = texelIndex(desc.layout, desc.atlasWidth, x + j, y + i);
 
-    let bgra = textures[desc.offset + idx];
+    let bgra = textures[idx];
     let srgb = vec3(f32((bgra >> 16u) & 0xffu), f32((bgra >> 8u) & 0xffu), f32(bgra & 0xffu)) / 255f;
     let linearRgb = pow(srgb, vec3(2.2f));
     return linearRgb;
 }
 
+// Ensure matches `TexelLayout` and `TEXEL_TILE_SIZE` in texel_layout.hpp.
+const TEXEL_LAYOUT_TILED = 1u;
+const TEXEL_TILE_SIZE = 8u;
+
+// The index of texel (`x`, `y`) of an image `width` texels wide stored in `layout`. Tiled images
+// consist of 8x8 tiles in row-major order, with the texels of each tile in Morton order.
+@must_use
+fn texelIndex(layout: u32, width: u32, x: u32, y: u32) -> u32 {
+    if layout != TEXEL_LAYOUT_TILED {
+        return y * width + x;
+    }
+    let tilesPerRow = (width + TEXEL_TILE_SIZE - 1u) / TEXEL_TILE_SIZE;
+    let tileIdx = (y / TEXEL_TILE_SIZE) * tilesPerRow + x / TEXEL_TILE_SIZE;
+    let tileTexelIdx = spreadTileBits(x % TEXEL_TILE_SIZE) | (spreadTileBits(y % TEXEL_TILE_SIZE) << 1u);
+    return tileIdx * TEXEL_TILE_SIZE * TEXEL_TILE_SIZE + tileTexelIdx;
+}
+
+// Inserts a zero bit between each of the three low bits of `v`.
+@must_use
+fn spreadTileBits(v: u32) -> u32 {
+    let w = (v | (v << 2u)) & 0x33u;
+    return (w | (w << 1u)) & 0x55u;
+}
+
 @must_use
 fn pixarOnb(n: vec3f) -> mat3x3f {
     // https://www.jcgt.org/published/0006/01/01/paper-lowres.pdf
@@ -287,6 +366,8 @@ struct Intersection {
     n: vec3f,
     uv: vec2f,
     textureDescriptorIdx: u32,
+    triangleIdx: u32,
+    t: f32,
 }
 
 @must_use
@@ -319,7 +400,7 @@ fn rayIntersectBvh(ray: Ray, rayTMax: f32, hit: ptr<function, Intersection>) ->
                         let uv = b[0] * vert.uv0 + b[1] * vert.uv1 + b[2] * vert.uv2;
                         let textureDescriptorIdx = vertexAttributes[triangleIdx].textureDescriptorIdx;
 
-                        *hit = Intersection(p, n, uv, textureDescriptorIdx);
+                        *hit = Intersection(p, n, uv, textureDescriptorIdx, triangleIdx, trihit.t);
                     }
                 }
                 if toVisitOffset == 0u {
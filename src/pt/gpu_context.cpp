@@ -2,10 +2,10 @@
 
 #include <GLFW/glfw3.h>
 
-#include <array>
 #include <cassert>
 #include <cstdio>
 #include <stdexcept>
+#include <vector>
 
 namespace nlrs
 {
@@ -125,7 +125,8 @@ void queueSafeRelease(const WGPUQueue queue)
 GpuContext::GpuContext(const WGPURequiredLimits& requiredLimits)
     : instance(nullptr),
       device(nullptr),
-      queue(nullptr)
+      queue(nullptr),
+      textureCompressionBc(false)
 {
     instance = []() -> WGPUInstance {
         // GPU timers are an unsafe API and are disabled by default due to exposing client
@@ -186,10 +187,17 @@ GpuContext::GpuContext(const WGPURequiredLimits& requiredLimits)
         throw std::runtime_error("Failed to create WGPUAdapter instance.");
     }
 
-    device = [adapter, &requiredLimits]() -> WGPUDevice {
-        const std::array<WGPUFeatureName, 1> requiredFeatures{
+    // BC textures are optional, and are uploaded decompressed when they are not supported.
+    textureCompressionBc = wgpuAdapterHasFeature(adapter, WGPUFeatureName_TextureCompressionBC);
+
+    device = [this, adapter, &requiredLimits]() -> WGPUDevice {
+        std::vector<WGPUFeatureName> requiredFeatures{
             WGPUFeatureName_TimestampQuery,
         };
+        if (textureCompressionBc)
+        {
+            requiredFeatures.push_back(WGPUFeatureName_TextureCompressionBC);
+        }
 
         const WGPUDeviceDescriptor deviceDesc{
             .nextInChain = nullptr,
@@ -13,6 +13,8 @@ struct GpuContext
     WGPUInstance instance;
     WGPUDevice   device;
     WGPUQueue    queue;
+    // Whether the device supports the BC texture formats, such as BC1RGBAUnorm and BC7RGBAUnorm.
+    bool         textureCompressionBc;
 
     GpuContext(const WGPURequiredLimits&);
     ~GpuContext();
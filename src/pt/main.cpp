@@ -4,11 +4,11 @@
 #include "gui.hpp"
 #include "deferred_renderer.hpp"
 #include "reference_path_tracer.hpp"
+#include "scene_loader.hpp"
 #include "window.hpp"
 
 #include <common/assert.hpp>
 #include <common/bvh.hpp>
-#include <common/file_stream.hpp>
 #include <common/ray_intersection.hpp>
 #include <common/triangle_attributes.hpp>
 #include <pt-format/vertex_attributes.hpp>
@@ -26,7 +26,8 @@
 #include <cstdio>
 #include <exception>
 #include <filesystem>
-#include <tuple>
+#include <memory>
+#include <optional>
 #include <utility>
 
 namespace fs = std::filesystem;
@@ -36,6 +37,23 @@ inline constexpr int defaultWindowHeight = 480;
 
 void printHelp() { std::printf("Usage:\n\tpt <input_pt_file>\n"); }
 
+void textureAtlasStatsText(const nlrs::TextureAtlasStats& stats)
+{
+    ImGui::Text(
+        "texture atlas: %ux%u, %.1f %% occupied",
+        stats.dimensions.width,
+        stats.dimensions.height,
+        100.0f * stats.occupancy);
+    if (!stats.hasMipChains)
+    {
+        ImGui::Text("texture atlas: level 0 only");
+    }
+    if (stats.numDownscaledTextures > 0)
+    {
+        ImGui::Text("texture atlas: %u textures downscaled", stats.numDownscaledTextures);
+    }
+}
+
 enum RendererType
 {
     RendererType_PathTracer,
@@ -48,8 +66,10 @@ struct UiState
     int   rendererType = RendererType_Deferred;
     float vfovDegrees = 70.0f;
     // sampling
-    int numSamplesPerPixel = 64;
-    int numBounces = 2;
+    int  numSamplesPerPixel = 64;
+    int  numBounces = 2;
+    bool russianRoulette = true;
+    int  minBounces = 2;
     // sky
     float                sunZenithDegrees = 30.0f;
     float                sunAzimuthDegrees = 0.0f;
@@ -61,11 +81,19 @@ struct UiState
 
 struct AppState
 {
-    nlrs::FlyCameraController    cameraController;
-    std::vector<nlrs::BvhNode>   bvhNodes;
-    std::vector<nlrs::Positions> positions;
-    UiState                      ui;
-    bool                         focusPressed = false;
+    nlrs::FlyCameraController cameraController;
+    UiState                   ui;
+    bool                      focusPressed = false;
+};
+
+// The scene is loaded by a SceneLoader while the window shows the loading progress. Once the scene
+// has been loaded, the deferred renderer is created, so that the first interactive frame is not
+// held up by uploading the path tracer's scene. The path tracer is created on the next frame.
+struct SceneState
+{
+    std::unique_ptr<nlrs::MappedPtFormat>    ptFormat;
+    std::optional<nlrs::DeferredRenderer>    deferredRenderer;
+    std::optional<nlrs::ReferencePathTracer> referenceRenderer;
 };
 
 nlrs::Extent2i largestMonitorResolution()
@@ -101,6 +129,106 @@ nlrs::Extent2i largestMonitorResolution()
     return maxResolution;
 }
 
+// The scene is uploaded to the GPU straight from the mapped file.
+nlrs::DeferredRenderer createDeferredRenderer(
+    const nlrs::GpuContext&     gpuContext,
+    const nlrs::Extent2u        framebufferSize,
+    const nlrs::Extent2i        largestResolution,
+    const nlrs::MappedPtFormat& ptFormat)
+{
+    return nlrs::DeferredRenderer{
+        gpuContext,
+        nlrs::DeferredRendererDescriptor{
+            .framebufferSize = framebufferSize,
+            .maxFramebufferSize = nlrs::Extent2u(largestResolution),
+            .modelPositions = ptFormat.modelVertexPositions,
+            .modelNormals = ptFormat.modelVertexNormals,
+            .modelTexCoords = ptFormat.modelVertexTexCoords,
+            .modelIndices = ptFormat.modelVertexIndices,
+            .modelBaseColorTextureIndices = ptFormat.modelBaseColorTextureIndices,
+            .sceneBaseColorTextures = ptFormat.baseColorTextures,
+            .sceneCompressedBaseColorTextures = ptFormat.compressedBaseColorTextures,
+            .sceneBvhNodes = ptFormat.bvhNodes,
+            .scenePositionAttributes = ptFormat.trianglePositionAttributes,
+            .sceneVertexAttributes = ptFormat.triangleVertexAttributes,
+            .sceneTexelLayout = nlrs::TexelLayout::Tiled}};
+}
+
+nlrs::ReferencePathTracer createReferencePathTracer(
+    const nlrs::GpuContext&     gpuContext,
+    const nlrs::Extent2u        framebufferSize,
+    const nlrs::Extent2i        largestResolution,
+    const nlrs::MappedPtFormat& ptFormat)
+{
+    const nlrs::RendererDescriptor rendererDesc{
+        nlrs::RenderParameters{
+            framebufferSize,
+            nlrs::FlyCameraController{}.getCamera(),
+            nlrs::SamplingParams(),
+            nlrs::Sky(),
+            1.0f},
+        largestResolution,
+        nlrs::TexelLayout::Tiled,
+    };
+
+    nlrs::Scene scene{
+        .bvhNodes = ptFormat.bvhNodes,
+        .positionAttributes = ptFormat.trianglePositionAttributes,
+        .vertexAttributes = ptFormat.triangleVertexAttributes,
+        .baseColorTextures = ptFormat.baseColorTextures,
+    };
+
+    return nlrs::ReferencePathTracer{rendererDesc, gpuContext, std::move(scene)};
+}
+
+// Clears the window and draws the GUI, while there is no scene to render.
+void renderLoadingScreen(
+    const nlrs::GpuContext& gpuContext,
+    const WGPUTextureView   textureView,
+    nlrs::Gui&              gui)
+{
+    const WGPUCommandEncoderDescriptor cmdEncoderDesc{
+        .nextInChain = nullptr,
+        .label = "Loading screen command encoder",
+    };
+    const WGPUCommandEncoder encoder =
+        wgpuDeviceCreateCommandEncoder(gpuContext.device, &cmdEncoderDesc);
+
+    const WGPURenderPassColorAttachment renderPassColorAttachment{
+        .nextInChain = nullptr,
+        .view = textureView,
+        .depthSlice = WGPU_DEPTH_SLICE_UNDEFINED,
+        .resolveTarget = nullptr,
+        .loadOp = WGPULoadOp_Clear,
+        .storeOp = WGPUStoreOp_Store,
+        .clearValue = WGPUColor{0.0, 0.0, 0.0, 1.0},
+    };
+    const WGPURenderPassDescriptor renderPassDesc{
+        .nextInChain = nullptr,
+        .label = "Loading screen render pass",
+        .colorAttachmentCount = 1,
+        .colorAttachments = &renderPassColorAttachment,
+        .depthStencilAttachment = nullptr,
+        .occlusionQuerySet = nullptr,
+        .timestampWrites = nullptr,
+    };
+    const WGPURenderPassEncoder renderPassEncoder =
+        wgpuCommandEncoderBeginRenderPass(encoder, &renderPassDesc);
+    gui.render(renderPassEncoder);
+    wgpuRenderPassEncoderEnd(renderPassEncoder);
+
+    const WGPUCommandBufferDescriptor cmdBufferDesc{
+        .nextInChain = nullptr,
+        .label = "Loading screen command buffer",
+    };
+    const WGPUCommandBuffer cmdBuffer = wgpuCommandEncoderFinish(encoder, &cmdBufferDesc);
+    wgpuQueueSubmit(gpuContext.queue, 1, &cmdBuffer);
+
+    wgpuCommandBufferRelease(cmdBuffer);
+    wgpuRenderPassEncoderRelease(renderPassEncoder);
+    wgpuCommandEncoderRelease(encoder);
+}
+
 int main(int argc, char** argv)
 try
 {
@@ -120,73 +248,60 @@ try
         return nlrs::Window{windowDesc, gpuContext};
     }();
 
-    nlrs::Gui gui(window.ptr(), gpuContext);
-    auto [appState, referenceRenderer, deferredRenderer] = [&gpuContext, &window, argv]()
-        -> std::tuple<AppState, nlrs::ReferencePathTracer, nlrs::DeferredRenderer> {
-        nlrs::PtFormat ptFormat;
+    const fs::path path = argv[1];
+    if (!fs::exists(path))
+    {
+        fmt::print(stderr, "File {} does not exist\n", path.string());
+        return 1;
+    }
+    nlrs::SceneLoader sceneLoader(path);
+
+    nlrs::Gui            gui(window.ptr(), gpuContext);
+    const nlrs::Extent2i largestResolution = largestMonitorResolution();
+    AppState             appState{};
+    SceneState           sceneState{};
+
+    auto onNewFrame = [&gui]() -> void { gui.beginFrame(); };
+
+    auto onUpdate = [&appState,
+                     &sceneState,
+                     &sceneLoader,
+                     &gpuContext,
+                     &window,
+                     &largestResolution,
+                     &path](GLFWwindow* windowPtr, float deltaTime) -> void {
+        if (!sceneState.ptFormat)
         {
-            const fs::path path = argv[1];
-            if (!fs::exists(path))
+            sceneState.ptFormat = sceneLoader.takeScene();
+            if (!sceneState.ptFormat)
             {
-                fmt::print(stderr, "File {} does not exist\n", path.string());
-                std::exit(1);
+                ImGui::Begin("Loading");
+                ImGui::Text("%s", path.filename().string().c_str());
+                ImGui::ProgressBar(
+                    sceneLoader.progress(), ImVec2(-1.0f, 0.0f), sceneLoader.stage());
+                ImGui::End();
+                return;
             }
-            nlrs::InputFileStream file(argv[1]);
-            nlrs::deserialize(file, ptFormat);
+            sceneState.deferredRenderer.emplace(createDeferredRenderer(
+                gpuContext,
+                nlrs::Extent2u(window.resolution()),
+                largestResolution,
+                *sceneState.ptFormat));
         }
-
-        const nlrs::Extent2i largestResolution = largestMonitorResolution();
-
-        const nlrs::RendererDescriptor rendererDesc{
-            nlrs::RenderParameters{
+        else if (!sceneState.referenceRenderer)
+        {
+            // The deferred renderer has rendered a frame by now.
+            sceneState.referenceRenderer.emplace(createReferencePathTracer(
+                gpuContext,
                 nlrs::Extent2u(window.resolution()),
-                nlrs::FlyCameraController{}.getCamera(),
-                nlrs::SamplingParams(),
-                nlrs::Sky(),
-                1.0f},
-            largestResolution,
-        };
-
-        nlrs::Scene scene{
-            .bvhNodes = ptFormat.bvhNodes,
-            .positionAttributes = ptFormat.trianglePositionAttributes,
-            .vertexAttributes = ptFormat.triangleVertexAttributes,
-            .baseColorTextures = ptFormat.baseColorTextures,
-        };
-
-        nlrs::ReferencePathTracer referenceRenderer{rendererDesc, gpuContext, std::move(scene)};
-
-        nlrs::DeferredRenderer deferredRenderer{
-            gpuContext,
-            nlrs::DeferredRendererDescriptor{
-                .framebufferSize = nlrs::Extent2u(window.resolution()),
-                .maxFramebufferSize = nlrs::Extent2u(largestResolution),
-                .modelPositions = ptFormat.modelVertexPositions,
-                .modelNormals = ptFormat.modelVertexNormals,
-                .modelTexCoords = ptFormat.modelVertexTexCoords,
-                .modelIndices = ptFormat.modelVertexIndices,
-                .modelBaseColorTextureIndices = ptFormat.modelBaseColorTextureIndices,
-                .sceneBaseColorTextures = ptFormat.baseColorTextures,
-                .sceneBvhNodes = ptFormat.bvhNodes,
-                .scenePositionAttributes = ptFormat.trianglePositionAttributes,
-                .sceneVertexAttributes = ptFormat.triangleVertexAttributes}};
-
-        AppState app{
-            .cameraController{},
-            .bvhNodes = std::move(ptFormat.bvhNodes),
-            .positions = std::move(ptFormat.bvhPositionAttributes),
-            .ui = UiState{},
-            .focusPressed = false,
-        };
-
-        return std::make_tuple(
-            std::move(app), std::move(referenceRenderer), std::move(deferredRenderer));
-    }();
-
-    auto onNewFrame = [&gui]() -> void { gui.beginFrame(); };
+                largestResolution,
+                *sceneState.ptFormat));
+        }
+        const nlrs::MappedPtFormat&      ptFormat = *sceneState.ptFormat;
+        const nlrs::DeferredRenderer&    deferredRenderer = *sceneState.deferredRenderer;
+        const nlrs::ReferencePathTracer* referenceRenderer =
+            sceneState.referenceRenderer ? &*sceneState.referenceRenderer : nullptr;
 
-    auto onUpdate = [&appState, &referenceRenderer, &deferredRenderer](
-                        GLFWwindow* windowPtr, float deltaTime) -> void {
         {
             // Skip input if ImGui captured input
             if (!ImGui::GetIO().WantCaptureMouse)
@@ -215,7 +330,12 @@ try
 
                     nlrs::Intersection hitData;
                     if (nlrs::rayIntersectBvh(
-                            ray, appState.bvhNodes, appState.positions, 1000.f, hitData, nullptr))
+                            ray,
+                            ptFormat.bvhNodes,
+                            ptFormat.bvhPositionAttributes,
+                            1000.f,
+                            hitData,
+                            nullptr))
                     {
                         const glm::vec3 dir = hitData.p - appState.cameraController.position();
                         const glm::vec3 cameraForward =
@@ -248,13 +368,19 @@ try
                 {
                 case RendererType_PathTracer:
                 {
-                    const float renderAverageMs = referenceRenderer.averageRenderpassDurationMs();
-                    const float progressPercentage = referenceRenderer.renderProgressPercentage();
+                    if (referenceRenderer == nullptr)
+                    {
+                        ImGui::Text("uploading scene");
+                        break;
+                    }
+                    const float renderAverageMs = referenceRenderer->averageRenderpassDurationMs();
+                    const float progressPercentage = referenceRenderer->renderProgressPercentage();
                     ImGui::Text(
                         "render pass: %.2f ms (%.1f FPS)",
                         renderAverageMs,
                         1000.0f / renderAverageMs);
                     ImGui::Text("render progress: %.2f %%", progressPercentage);
+                    textureAtlasStatsText(referenceRenderer->textureAtlasStats());
                     break;
                 }
                 case RendererType_Deferred:
@@ -272,6 +398,7 @@ try
                         "resolve pass: %.2f ms (%.1f FPS)",
                         perfStats.averageResolvePassDurationsMs,
                         1000.0f / perfStats.averageResolvePassDurationsMs);
+                    textureAtlasStatsText(deferredRenderer.getTextureAtlasStats());
                     break;
                 }
                 default:
@@ -299,6 +426,9 @@ try
             ImGui::SameLine();
             ImGui::RadioButton("8", &appState.ui.numBounces, 8);
 
+            ImGui::Checkbox("russian roulette", &appState.ui.russianRoulette);
+            ImGui::SliderInt("min bounces", &appState.ui.minBounces, 1, 8);
+
             ImGui::SliderFloat("sun zenith", &appState.ui.sunZenithDegrees, 0.0f, 90.0f, "%.2f");
             ImGui::SliderFloat("sun azimuth", &appState.ui.sunAzimuthDegrees, 0.0f, 360.0f, "%.2f");
             ImGui::SliderFloat("sky turbidity", &appState.ui.skyTurbidity, 1.0f, 10.0f, "%.2f");
@@ -338,7 +468,7 @@ try
         }
     };
 
-    auto onRender = [&appState, &gpuContext, &gui, &referenceRenderer, &deferredRenderer](
+    auto onRender = [&appState, &gpuContext, &gui, &sceneState](
                         GLFWwindow* windowPtr, WGPUSwapChain swapChain) -> void {
         const WGPUTextureView targetTextureView = wgpuSwapChainGetCurrentTextureView(swapChain);
         if (!targetTextureView)
@@ -348,6 +478,16 @@ try
             return;
         }
 
+        if (!sceneState.deferredRenderer)
+        {
+            renderLoadingScreen(gpuContext, targetTextureView, gui);
+            wgpuTextureViewRelease(targetTextureView);
+            return;
+        }
+        nlrs::DeferredRenderer&    deferredRenderer = *sceneState.deferredRenderer;
+        nlrs::ReferencePathTracer* referenceRenderer =
+            sceneState.referenceRenderer ? &*sceneState.referenceRenderer : nullptr;
+
         nlrs::Extent2i windowResolution;
         glfwGetFramebufferSize(windowPtr, &windowResolution.x, &windowResolution.y);
         NLRS_ASSERT(appState.ui.exposureStops >= 0);
@@ -357,6 +497,8 @@ try
             nlrs::SamplingParams{
                 static_cast<std::uint32_t>(appState.ui.numSamplesPerPixel),
                 static_cast<std::uint32_t>(appState.ui.numBounces),
+                appState.ui.russianRoulette,
+                static_cast<std::uint32_t>(appState.ui.minBounces),
             },
             nlrs::Sky{
                 appState.ui.skyTurbidity,
@@ -365,12 +507,20 @@ try
                 appState.ui.sunAzimuthDegrees,
             },
             1.0f / std::exp2(static_cast<float>(appState.ui.exposureStops))};
-        referenceRenderer.setRenderParameters(renderParams);
+        if (referenceRenderer != nullptr)
+        {
+            referenceRenderer->setRenderParameters(renderParams);
+        }
 
-        switch (appState.ui.rendererType)
+        // The deferred renderer is shown until the path tracer's scene has been uploaded.
+        const int rendererType = appState.ui.rendererType == RendererType_PathTracer &&
+                                         referenceRenderer == nullptr
+                                     ? RendererType_Deferred
+                                     : appState.ui.rendererType;
+        switch (rendererType)
         {
         case RendererType_PathTracer:
-            referenceRenderer.render(gpuContext, targetTextureView, gui);
+            referenceRenderer->render(gpuContext, targetTextureView, gui);
             break;
         case RendererType_Deferred:
         {
@@ -406,11 +556,14 @@ try
         wgpuTextureViewRelease(targetTextureView);
     };
 
-    auto onResize = [&gpuContext, &deferredRenderer](const nlrs::FramebufferSize newSize) -> void {
+    auto onResize = [&gpuContext, &sceneState](const nlrs::FramebufferSize newSize) -> void {
         // TODO: this function is not really needed since I get the current framebuffer size on
         // each render anyway.
         const auto sz = nlrs::Extent2u(newSize);
-        deferredRenderer.resize(gpuContext, sz);
+        if (sceneState.deferredRenderer)
+        {
+            sceneState.deferredRenderer->resize(gpuContext, sz);
+        }
     };
 
     window.run(
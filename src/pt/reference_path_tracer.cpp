@@ -11,7 +11,6 @@
 #include <common/bvh.hpp>
 #include <common/gltf_model.hpp>
 
-#include <fmt/core.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -19,13 +18,11 @@
 #include <bit>
 #include <cassert>
 #include <cstdint>
-#include <cstring>
 #include <cstdio>
 #include <deque>
 #include <numbers>
 #include <numeric>
 #include <span>
-#include <stdexcept>
 #include <utility>
 
 namespace nlrs
@@ -83,7 +80,9 @@ struct SamplingStateLayout
     std::uint32_t numSamplesPerPixel;
     std::uint32_t numBounces;
     std::uint32_t accumulatedSampleCount;
-    std::uint32_t padding;
+    std::uint32_t russianRoulette;
+    std::uint32_t minBounces;
+    std::uint32_t padding[3];
 
     SamplingStateLayout(
         const SamplingParams& samplingParams,
@@ -91,7 +90,9 @@ struct SamplingStateLayout
         : numSamplesPerPixel(samplingParams.numSamplesPerPixel),
           numBounces(samplingParams.numBounces),
           accumulatedSampleCount(accumulatedSampleCount),
-          padding(0)
+          russianRoulette(samplingParams.russianRoulette ? 1u : 0u),
+          minBounces(samplingParams.minBounces),
+          padding{0, 0, 0}
     {
     }
 };
@@ -204,69 +205,35 @@ ReferencePathTracer::ReferencePathTracer(
       mCurrentRenderParams(rendererDesc.renderParams),
       mFrameCount(0),
       mAccumulatedSampleCount(0),
+      mTextureAtlasStats{},
       mRenderPassDurationsNs()
 {
     {
-        struct TextureDescriptor
-        {
-            std::uint32_t width, height, offset;
-        };
-        // Ensure matches layout of `TextureDescriptor` definition in shader.
-        std::vector<TextureDescriptor> textureDescriptors;
-        textureDescriptors.reserve(scene.baseColorTextures.size());
-
-        std::vector<Texture::BgraPixel> textureData;
-        textureData.reserve((2 << 28) / sizeof(Texture::BgraPixel));
-
-        // Texture descriptors and texture data need to appended in the order of the model's
-        // baseColorTextures. The model's baseColorTextureIndices index into that array, and we want
-        // to use the same indices to index into the texture descriptor array.
+        // Texture descriptors are stored in the order of the model's baseColorTextures. The
+        // model's baseColorTextureIndices index into that array, and we want to use the same
+        // indices to index into the texture descriptor array. Each descriptor locates its texture
+        // in the atlas.
         //
         // Summary:
         // baseColorTextureIndices -> baseColorTextures becomes
-        // textureDescriptorIndices -> textureDescriptor -> textureData lookup
-
-        for (const Texture& baseColorTexture : scene.baseColorTextures)
-        {
-            const auto dimensions = baseColorTexture.dimensions();
-            const auto pixels = baseColorTexture.pixels();
-
-            const std::uint32_t width = dimensions.width;
-            const std::uint32_t height = dimensions.height;
-            const std::uint32_t offset = static_cast<std::uint32_t>(textureData.size());
-
-            textureData.resize(textureData.size() + pixels.size());
-            std::memcpy(
-                textureData.data() + offset,
-                pixels.data(),
-                pixels.size() * sizeof(Texture::BgraPixel));
-
-            textureDescriptors.push_back({width, height, offset});
-        }
+        // textureDescriptorIndices -> textureDescriptor -> texture atlas lookup
+        const TextureAtlas textureAtlas = buildTextureAtlas(
+            scene.baseColorTextures,
+            rendererDesc.texelLayout,
+            static_cast<std::size_t>(REQUIRED_LIMITS.maxStorageBufferBindingSize));
+        mTextureAtlasStats = textureAtlas.stats;
 
         mTextureDescriptorBuffer = GpuBuffer(
             gpuContext.device,
             "texture descriptor buffer",
             {GpuBufferUsage::ReadOnlyStorage, GpuBufferUsage::CopyDst},
-            std::span<const TextureDescriptor>(textureDescriptors));
-
-        const std::size_t textureDataNumBytes = textureData.size() * sizeof(Texture::BgraPixel);
-        const std::size_t maxStorageBufferBindingSize =
-            static_cast<std::size_t>(REQUIRED_LIMITS.maxStorageBufferBindingSize);
-        if (textureDataNumBytes > maxStorageBufferBindingSize)
-        {
-            throw std::runtime_error(fmt::format(
-                "Texture buffer size ({}) exceeds "
-                "maxStorageBufferBindingSize ({}).",
-                textureDataNumBytes,
-                maxStorageBufferBindingSize));
-        }
+            std::span<const TextureAtlasDescriptor>(textureAtlas.descriptors));
 
         mTextureBuffer = GpuBuffer(
             gpuContext.device,
-            "texture buffer",
+            "texture atlas buffer",
             {GpuBufferUsage::ReadOnlyStorage, GpuBufferUsage::CopyDst},
-            std::span<const Texture::BgraPixel>(textureData));
+            std::span<const Texture::BgraPixel>(textureAtlas.texels));
     }
 
     {
@@ -507,6 +474,7 @@ ReferencePathTracer::ReferencePathTracer(ReferencePathTracer&& other)
         mCurrentRenderParams = other.mCurrentRenderParams;
         mFrameCount = other.mFrameCount;
         mAccumulatedSampleCount = other.mAccumulatedSampleCount;
+        mTextureAtlasStats = other.mTextureAtlasStats;
 
         mRenderPassDurationsNs = std::move(other.mRenderPassDurationsNs);
     }
@@ -539,6 +507,7 @@ ReferencePathTracer& ReferencePathTracer::operator=(ReferencePathTracer&& other)
         mCurrentRenderParams = other.mCurrentRenderParams;
         mFrameCount = other.mFrameCount;
         mAccumulatedSampleCount = other.mAccumulatedSampleCount;
+        mTextureAtlasStats = other.mTextureAtlasStats;
 
         mRenderPassDurationsNs = std::move(other.mRenderPassDurationsNs);
     }
@@ -720,4 +689,6 @@ float ReferencePathTracer::renderProgressPercentage() const
     return 100.0f * static_cast<float>(mAccumulatedSampleCount) /
            static_cast<float>(mCurrentRenderParams.samplingParams.numSamplesPerPixel);
 }
+
+TextureAtlasStats ReferencePathTracer::textureAtlasStats() const { return mTextureAtlasStats; }
 } // namespace nlrs
@@ -7,7 +7,10 @@
 #include <common/bvh.hpp>
 #include <common/camera.hpp>
 #include <common/extent.hpp>
+#include <common/sampling_params.hpp>
+#include <common/texel_layout.hpp>
 #include <common/texture.hpp>
+#include <common/texture_atlas.hpp>
 #include <pt-format/vertex_attributes.hpp>
 
 #include <webgpu/webgpu.h>
@@ -23,14 +26,6 @@ struct GpuContext;
 class Gui;
 class Window;
 
-struct SamplingParams
-{
-    std::uint32_t numSamplesPerPixel = 128;
-    std::uint32_t numBounces = 4;
-
-    bool operator==(const SamplingParams&) const noexcept = default;
-};
-
 struct RenderParameters
 {
     Extent2u       framebufferSize;
@@ -54,6 +49,7 @@ struct RendererDescriptor
 {
     RenderParameters renderParams;
     Extent2i         maxFramebufferSize;
+    TexelLayout      texelLayout;
 };
 
 class ReferencePathTracer
@@ -75,6 +71,8 @@ public:
     float averageRenderpassDurationMs() const;
     float renderProgressPercentage() const;
 
+    TextureAtlasStats textureAtlasStats() const;
+
 private:
     GpuBuffer          mVertexBuffer;
     GpuBuffer          mRenderParamsBuffer;
@@ -98,6 +96,8 @@ private:
     std::uint32_t    mFrameCount;
     std::uint32_t    mAccumulatedSampleCount;
 
+    TextureAtlasStats mTextureAtlasStats;
+
     std::deque<std::uint64_t> mRenderPassDurationsNs;
 };
 } // namespace nlrs
@@ -52,7 +52,8 @@ fn fsMain(in: VertexOutput) -> @location(0) vec4f {
         let blueNoise = animatedBlueNoise(coord, renderParams.frameData.frameCount, renderParams.samplingState.numSamplesPerPixel);
         let jitter = blueNoise / vec2f(dimensions);
         let primaryRay = generateCameraRay(blueNoise, renderParams.camera, u + jitter.x, (1.0 - v) + jitter.y);
-        imageBuffer[idx] += rayColor(blueNoise, primaryRay, coord);
+        let spreadAngle = pixelSpreadAngle(renderParams.camera, dimensions);
+        imageBuffer[idx] += rayColor(blueNoise, primaryRay, spreadAngle, coord);
         accumulatedSampleCount += 1u;
     }
 
@@ -108,6 +109,8 @@ struct SamplingState {
     numSamplesPerPixel: u32,
     numBounces: u32,
     accumulatedSampleCount: u32,
+    russianRoulette: u32,
+    minBounces: u32,
 }
 
 struct SkyState {
@@ -158,6 +161,8 @@ struct Intersection {
     n: vec3f,
     uv: vec2f,
     textureDescriptorIdx: u32,
+    triangleIdx: u32,
+    t: f32,
 }
 
 struct TriangleHit {
@@ -177,18 +182,23 @@ struct BlueNoise {
     data: array<vec2f>,
 }
 
+// The width of the ray cone around the path grows by `spreadAngle` per unit of distance travelled,
+// as in CpuPathTracer::rayColor.
 @must_use
-fn rayColor(blueNoise: vec2f, primaryRay: Ray, coord: vec2u) -> vec3f {
+fn rayColor(blueNoise: vec2f, primaryRay: Ray, spreadAngle: f32, coord: vec2u) -> vec3f {
     var ray = primaryRay;
     var radiance = vec3(0f);
     var throughput = vec3(1f);
+    var pathLength = 0f;
 
     var bounce = 1u;
     let numBounces = renderParams.samplingState.numBounces;
+    var rngState = initRng(coord, renderParams.frameData.dimensions, renderParams.frameData.frameCount);
     loop {
         var hit: Intersection;
         if rayIntersectBvh(ray, T_MAX, &hit) {
-            let albedo = evalTexture(hit.textureDescriptorIdx, hit.uv);
+            pathLength += hit.t;
+            let albedo = evalTexture(hit, ray.direction, spreadAngle * pathLength);
             let p = hit.p;
 
             let lightDirection = sampleSolarDiskDirection(blueNoise, SOLAR_COS_THETA_MAX, skyState.sunDirection);
@@ -209,6 +219,14 @@ fn rayColor(blueNoise: vec2f, primaryRay: Ray, coord: vec2u) -> vec3f {
             let scatter = evalImplicitLambertian(blueNoise, hit.n, albedo);
             ray = Ray(p, scatter.wi);
             throughput *= scatter.throughput;
+
+            if renderParams.samplingState.russianRoulette == 1u && bounce >= renderParams.samplingState.minBounces {
+                let survivalProbability = russianRouletteSurvivalProbability(throughput);
+                if rngNextFloat(&rngState) >= survivalProbability {
+                    break;
+                }
+                throughput /= survivalProbability;
+            }
         } else {
             let v = ray.direction;
             let s = skyState.sunDirection;
@@ -233,6 +251,20 @@ fn rayColor(blueNoise: vec2f, primaryRay: Ray, coord: vec2u) -> vec3f {
     return radiance;
 }
 
+// The path survives with a probability proportional to its throughput, clamped so that dim paths
+// still have a chance of surviving and bright paths a chance of being terminated.
+@must_use
+fn russianRouletteSurvivalProbability(throughput: vec3f) -> f32 {
+    return clamp(max(throughput.r, max(throughput.g, throughput.b)), 0.05f, 0.95f);
+}
+
+// The angle subtended by a pixel at the camera.
+@must_use
+fn pixelSpreadAngle(camera: Camera, dimensions: vec2u) -> f32 {
+    let focusPlaneCenter = camera.lowerLeftCorner + 0.5f * camera.horizontal + 0.5f * camera.vertical;
+    return length(camera.vertical) / (f32(dimensions.y) * length(focusPlaneCenter - camera.origin));
+}
+
 @must_use
 fn generateCameraRay(noise: vec2f, camera: Camera, u: f32, v: f32) -> Ray {
     let randomPointInLens = camera.lensRadius * pointInUnitDisk(noise);
@@ -301,9 +333,35 @@ fn evalImplicitLambertian(blueNoise: vec2f, n: vec3f, albedo: vec3f) -> Scatter
 }
 
 @must_use
-fn evalTexture(textureDescriptorIdx: u32, uv: vec2f) -> vec3f {
-    let textureDesc = textureDescriptors[textureDescriptorIdx];
-    return textureLookup(textureDesc, uv);
+fn evalTexture(hit: Intersection, rayDirection: vec3f, coneWidth: f32) -> vec3f {
+    let textureDesc = textureDescriptors[hit.textureDescriptorIdx];
+    let lod = rayConeTextureLod(
+        positionAttributes[hit.triangleIdx],
+        vertexAttributes[hit.triangleIdx],
+        textureDesc,
+        rayDirection,
+        coneWidth
+    );
+    return textureLookup(textureDesc, hit.uv, lod);
+}
+
+// The texture level of detail at which a ray cone of width `coneWidth` samples the texture of a
+// triangle, as in rayConeTextureLod in path_tracer.cpp.
+@must_use
+fn rayConeTextureLod(tri: Positions, vert: VertexAttributes, desc: TextureDescriptor, rayDirection: vec3f, coneWidth: f32) -> f32 {
+    let normal = cross(tri.p1 - tri.p0, tri.p2 - tri.p0);
+    let duv1 = vert.uv1 - vert.uv0;
+    let duv2 = vert.uv2 - vert.uv0;
+
+    let worldArea = length(normal);
+    let texelArea = abs(duv1.x * duv2.y - duv2.x * duv1.y) * f32(desc.width) * f32(desc.height);
+    // The cosine of the angle between the ray and the triangle, times `worldArea`.
+    let projectedArea = abs(dot(normal, rayDirection));
+    if coneWidth <= 0f || texelArea <= 0f || projectedArea <= 0f {
+        return 0f;
+    }
+
+    return log2(coneWidth) + 0.5f * log2(texelArea) + 0.5f * log2(worldArea) - log2(projectedArea);
 }
 
 @must_use
@@ -397,7 +455,7 @@ fn rayIntersectBvh(ray: Ray, rayTMax: f32, hit: ptr<function, Intersection>) ->
                         let uv = b[0] * vert.uv0 + b[1] * vert.uv1 + b[2] * vert.uv2;
                         let textureDescriptorIdx = vertexAttributes[triangleIdx].textureDescriptorIdx;
 
-                        *hit = Intersection(p, n, uv, textureDescriptorIdx);
+                        *hit = Intersection(p, n, uv, textureDescriptorIdx, triangleIdx, trihit.t);
                     }
                 }
                 if toVisitOffset == 0u {
@@ -543,27 +601,73 @@ fn offsetRay(p: vec3f, n: vec3f) -> vec3f {
     );
 }
 
+// Level 0 of the texture is at (`x`, `y`) in the texture atlas. Level 1 is to its right, and the
+// following levels are below level 1.
 struct TextureDescriptor {
+    x: u32,
+    y: u32,
     width: u32,
     height: u32,
-    offset: u32,
+    numMipLevels: u32,
+    atlasWidth: u32,
+    layout: u32,
 }
 
+// Samples the nearest pixel of the mip level nearest to `lod`.
 @must_use
-fn textureLookup(desc: TextureDescriptor, uv: vec2f) -> vec3f {
+fn textureLookup(desc: TextureDescriptor, uv: vec2f, lod: f32) -> vec3f {
+    let level = u32(clamp(floor(lod + 0.5f), 0f, f32(desc.numMipLevels - 1u)));
+    var x = desc.x;
+    var y = desc.y;
+    var width = desc.width;
+    var height = desc.height;
+    for (var l = 0u; l < level; l += 1u) {
+        if l == 0u {
+            x += width;
+        } else {
+            y += height;
+        }
+        width = max(width >> 1u, 1u);
+        height = max(height >> 1u, 1u);
+    }
+
     let u = fract(uv.x);
     let v = fract(uv.y);
 
-    let j = u32(u * f32(desc.width));
-    let i = u32(v * f32(desc.height));
-    let idx = i * desc.width + j;
+    let j = min(u32(u * f32(width)), width - 1u);
+    let i = min(u32(v * f32(height)), height - 1u);
+    let idx = texelIndex(desc.layout, desc.atlasWidth, x + j, y + i);
 
-    let bgra = textures[desc.offset + idx];
+    let bgra = textures[idx];
     let srgb = vec3(f32((bgra >> 16u) & 0xffu), f32((bgra >> 8u) & 0xffu), f32(bgra & 0xffu)) / 255f;
     let linearRgb = pow(srgb, vec3(2.2f));
     return linearRgb;
 }
 
+// Ensure matches `TexelLayout` and `TEXEL_TILE_SIZE` in texel_layout.hpp.
+const TEXEL_LAYOUT_TILED = 1u;
+const TEXEL_TILE_SIZE = 8u;
+
+// The index of texel (`x`, `y`) of an image `width` texels wide stored in `layout`. Tiled images
+// consist of 8x8 tiles in row-major order, with the texels of each tile in Morton order.
+@must_use
+fn texelIndex(layout: u32, width: u32, x: u32, y: u32) -> u32 {
+    if layout != TEXEL_LAYOUT_TILED {
+        return y * width + x;
+    }
+    let tilesPerRow = (width + TEXEL_TILE_SIZE - 1u) / TEXEL_TILE_SIZE;
+    let tileIdx = (y / TEXEL_TILE_SIZE) * tilesPerRow + x / TEXEL_TILE_SIZE;
+    let tileTexelIdx = spreadTileBits(x % TEXEL_TILE_SIZE) | (spreadTileBits(y % TEXEL_TILE_SIZE) << 1u);
+    return tileIdx * TEXEL_TILE_SIZE * TEXEL_TILE_SIZE + tileTexelIdx;
+}
+
+// Inserts a zero bit between each of the three low bits of `v`.
+@must_use
+fn spreadTileBits(v: u32) -> u32 {
+    let w = (v | (v << 2u)) & 0x33u;
+    return (w | (w << 1u)) & 0x55u;
+}
+
 // `u` is a random number in [0, 1].
 @must_use
 fn directionInCone(u: vec2f, cosThetaMax: f32) -> vec3f {
@@ -614,3 +718,31 @@ fn animatedBlueNoise(coord: vec2u, frameIdx: u32, totalSampleCount: u32) -> vec2
     ));
     return fract(blueNoise + r2Seq);
 }
+
+@must_use
+fn initRng(pixel: vec2u, resolution: vec2u, frame: u32) -> u32 {
+    // Adapted from https://github.com/boksajak/referencePT
+    let seed = dot(pixel, vec2u(1u, resolution.x)) ^ jenkinsHash(frame);
+    return jenkinsHash(seed);
+}
+
+// Returns a random number in [0, 1).
+@must_use
+fn rngNextFloat(state: ptr<function, u32>) -> f32 {
+    // PCG hash, "Hash Functions for GPU Rendering", Jarzynski & Olano
+    *state = *state * 747796405u + 2891336453u;
+    let word = ((*state >> ((*state >> 28u) + 4u)) ^ *state) * 277803737u;
+    let x = (word >> 22u) ^ word;
+    return f32(x >> 8u) / 16777216f;
+}
+
+@must_use
+fn jenkinsHash(input: u32) -> u32 {
+    var x = input;
+    x += x << 10u;
+    x ^= x >> 6u;
+    x += x << 3u;
+    x ^= x >> 11u;
+    x += x << 15u;
+    return x;
+}
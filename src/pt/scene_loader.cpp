@@ -0,0 +1,109 @@
+#include "scene_loader.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+namespace nlrs
+{
+namespace
+{
+// Pages are read one at a time, so that the loader can report progress and be stopped.
+constexpr std::size_t PAGE_SIZE = 4096;
+constexpr std::size_t PROGRESS_INTERVAL = 1 << 24;
+} // namespace
+
+SceneLoader::SceneLoader(std::filesystem::path path)
+    : mStage("Opening file"),
+      mProgress(0.0f),
+      mMutex(),
+      mScene(),
+      mException(nullptr),
+      mThread([this, path = std::move(path)](const std::stop_token stopToken) {
+          load(stopToken, path);
+      })
+{
+}
+
+std::unique_ptr<MappedPtFormat> SceneLoader::takeScene()
+{
+    const std::lock_guard lock(mMutex);
+    if (mException)
+    {
+        std::rethrow_exception(std::exchange(mException, nullptr));
+    }
+    return std::move(mScene);
+}
+
+void SceneLoader::load(const std::stop_token stopToken, const std::filesystem::path& path)
+{
+    try
+    {
+        mStage = "Decoding sections";
+        auto scene = std::make_unique<MappedPtFormat>(
+            path, [this](const LoadStage stage, const float fraction) -> void {
+                mStage = stage == LoadStage::DecodingSections ? "Decoding sections"
+                                                              : "Decompressing textures";
+                mProgress = fraction;
+            });
+        // Checked before reading the sections, since the pages may not fit in memory.
+        if (scene->file.hasSection(PtFormatSection::PagedBaseColorTextures))
+        {
+            throw std::runtime_error(
+                "The GPU renderers do not support .pt files with virtual textures. Render them "
+                "with pt-render.");
+        }
+
+        mStage = "Reading sections";
+        mProgress = 0.0f;
+        std::uint64_t totalBytes = 0;
+        for (const PtFormatSectionEntry& entry : scene->file.sections())
+        {
+            totalBytes += entry.encoding == SectionEncoding::Raw ? entry.size : 0;
+        }
+
+        // The decoded sections are already resident. Reading a byte of every page of the mapped
+        // sections makes the operating system read them in.
+        std::uint64_t numBytesRead = 0;
+        std::byte     sum{0};
+        for (const PtFormatSectionEntry& entry : scene->file.sections())
+        {
+            if (entry.encoding != SectionEncoding::Raw)
+            {
+                continue;
+            }
+            const std::span<const std::byte> bytes = scene->file.bytes().subspan(
+                static_cast<std::size_t>(entry.offset), static_cast<std::size_t>(entry.size));
+            for (std::size_t offset = 0; offset < bytes.size(); offset += PAGE_SIZE)
+            {
+                sum ^= *static_cast<const volatile std::byte*>(bytes.data() + offset);
+                if (offset % PROGRESS_INTERVAL == 0)
+                {
+                    if (stopToken.stop_requested())
+                    {
+                        return;
+                    }
+                    mProgress = static_cast<float>(
+                        static_cast<double>(numBytesRead + offset) /
+                        static_cast<double>(std::max<std::uint64_t>(totalBytes, 1)));
+                }
+            }
+            numBytesRead += bytes.size();
+        }
+        static_cast<void>(sum);
+
+        mStage = "Uploading scene";
+        mProgress = 1.0f;
+        const std::lock_guard lock(mMutex);
+        mScene = std::move(scene);
+    }
+    catch (...)
+    {
+        const std::lock_guard lock(mMutex);
+        mException = std::current_exception();
+    }
+}
+} // namespace nlrs
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <pt-format/pt_format.hpp>
+
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace nlrs
+{
+// Loads a .pt file on a background thread, so that the window stays responsive while the scene is
+// read from disk. The file is mapped and its compressed sections are decoded, and then every page
+// of the uncompressed sections is read, so that uploading the scene to the GPU on the render thread
+// does not wait for the disk.
+class SceneLoader
+{
+public:
+    explicit SceneLoader(std::filesystem::path path);
+    // Stops loading and waits for the loader thread.
+    ~SceneLoader() = default;
+
+    SceneLoader(const SceneLoader&) = delete;
+    SceneLoader& operator=(const SceneLoader&) = delete;
+
+    // What the loader is currently doing, e.g. "Decoding sections".
+    const char* stage() const noexcept { return mStage.load(); }
+    // The fraction of the current stage which has been done, in [0, 1].
+    float progress() const noexcept { return mProgress.load(); }
+
+    // Returns the scene once it has been loaded, and nullptr before that, or once the scene has
+    // already been taken. Rethrows the exception if loading failed.
+    std::unique_ptr<MappedPtFormat> takeScene();
+
+private:
+    void load(std::stop_token stopToken, const std::filesystem::path& path);
+
+    std::atomic<const char*>        mStage;
+    std::atomic<float>              mProgress;
+    std::mutex                      mMutex;
+    std::unique_ptr<MappedPtFormat> mScene;
+    std::exception_ptr              mException;
+    // Declared last, so that the thread is joined before the other members are destroyed.
+    std::jthread mThread;
+};
+} // namespace nlrs
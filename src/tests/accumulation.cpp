@@ -0,0 +1,238 @@
+#include <common/buffer_stream.hpp>
+#include <common/extent.hpp>
+#include <pt-cpu/accumulation.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// Adds a constant radiance sample to every pixel of the tile.
+void addSample(Accumulation& accumulation, const std::uint32_t tileIdx, const glm::vec3& radiance)
+{
+    TileAccumulation tile = accumulation.tile(tileIdx);
+    for (glm::vec3& sum : tile.radianceSums)
+    {
+        sum += radiance;
+    }
+    ++tile.sampleCount;
+    accumulation.setTile(tileIdx, tile);
+}
+} // namespace
+
+SCENARIO("Accumulation tiles cover the image", "[accumulation]")
+{
+    GIVEN("An image size which is not a multiple of the tile size")
+    {
+        const Accumulation accumulation(Extent2u(10, 7), 4, "settings", 0);
+
+        THEN("edge tiles are clipped to the image")
+        {
+            REQUIRE(accumulation.tileCount() == 6);
+
+            const TileBounds first = accumulation.tileBounds(0);
+            REQUIRE(first.origin == Extent2u(0, 0));
+            REQUIRE(first.size == Extent2u(4, 4));
+
+            const TileBounds last = accumulation.tileBounds(5);
+            REQUIRE(last.origin == Extent2u(8, 4));
+            REQUIRE(last.size == Extent2u(2, 3));
+        }
+    }
+}
+
+SCENARIO("Accumulating and resolving tile samples", "[accumulation]")
+{
+    GIVEN("An accumulation starting from sample 8")
+    {
+        Accumulation accumulation(Extent2u(4, 2), 2, "settings", 8);
+
+        WHEN("two samples are added to the first tile")
+        {
+            addSample(accumulation, 0, glm::vec3(1.0f, 2.0f, 3.0f));
+            addSample(accumulation, 0, glm::vec3(3.0f, 2.0f, 1.0f));
+
+            THEN("the tile's sample range advances")
+            {
+                REQUIRE(accumulation.tileSampleBegin(0) == 8);
+                REQUIRE(accumulation.tileSampleEnd(0) == 10);
+                REQUIRE(accumulation.tileSampleCount(1) == 0);
+            }
+
+            THEN("the tile resolves to the mean and the other tile is black")
+            {
+                const std::vector<glm::vec3> estimate = accumulation.resolve();
+                REQUIRE(estimate[0] == glm::vec3(2.0f));
+                REQUIRE(estimate[5] == glm::vec3(2.0f));
+                REQUIRE(estimate[2] == glm::vec3(0.0f));
+                REQUIRE(estimate[7] == glm::vec3(0.0f));
+            }
+        }
+    }
+}
+
+SCENARIO("Copying tiles out of and into an accumulation", "[accumulation]")
+{
+    GIVEN("An accumulation with a clipped edge tile")
+    {
+        Accumulation accumulation(Extent2u(5, 3), 2, "settings", 0);
+        addSample(accumulation, 5, glm::vec3(1.0f));
+
+        WHEN("the edge tile is copied out")
+        {
+            TileAccumulation tile = accumulation.tile(5);
+
+            THEN("it contains the tile's pixels and sample range")
+            {
+                REQUIRE(tile.sampleBegin == 0);
+                REQUIRE(tile.sampleCount == 1);
+                REQUIRE(tile.radianceSums == std::vector<glm::vec3>{glm::vec3(1.0f)});
+            }
+
+            THEN("copying a modified tile back in updates only that tile")
+            {
+                tile.radianceSums[0] = glm::vec3(5.0f);
+                tile.sampleCount = 2;
+                accumulation.setTile(5, tile);
+
+                REQUIRE(accumulation.tileSampleEnd(5) == 2);
+                REQUIRE(accumulation.tileSampleCount(4) == 0);
+                const std::vector<glm::vec3> estimate = accumulation.resolve();
+                REQUIRE(estimate[14] == glm::vec3(2.5f));
+                REQUIRE(estimate[13] == glm::vec3(0.0f));
+            }
+        }
+
+        THEN("copying in a tile of the wrong size should throw")
+        {
+            REQUIRE_THROWS_WITH(
+                accumulation.setTile(0, TileAccumulation{0, 1, {glm::vec3(1.0f)}}),
+                "Tile 0 has 4 pixels, got 1.");
+        }
+    }
+}
+
+SCENARIO("Serialize and deserialize Accumulation", "[accumulation]")
+{
+    GIVEN("An accumulation with samples")
+    {
+        Accumulation accumulation(Extent2u(5, 3), 2, "scene=box.pt", 0);
+        for (std::uint32_t tileIdx = 0; tileIdx < accumulation.tileCount(); ++tileIdx)
+        {
+            for (std::uint32_t i = 0; i <= tileIdx; ++i)
+            {
+                addSample(accumulation, tileIdx, glm::vec3(0.1f * tileIdx, 0.3f, 1.0f / 3.0f));
+            }
+        }
+
+        WHEN("serializing to a buffer stream")
+        {
+            BufferStream stream;
+            serialize(stream, accumulation);
+
+            THEN("deserializing from the buffer stream yields the same object")
+            {
+                Accumulation deserializedAccumulation;
+                deserialize(stream, deserializedAccumulation);
+                REQUIRE(deserializedAccumulation == accumulation);
+            }
+        }
+    }
+
+    GIVEN("mismatching magic bytes")
+    {
+        constexpr std::string_view magicBytes = "PTACCUM0";
+
+        BufferStream stream;
+        stream.write(magicBytes.data(), magicBytes.size());
+
+        THEN("deserializing should throw")
+        {
+            Accumulation accumulation;
+            REQUIRE_THROWS_WITH(
+                deserialize(stream, accumulation),
+                "Mismatching accumulation file version. Invalid version in magic bytes: expected "
+                "'PTACCUM1', got 'PTACCUM0'.");
+        }
+    }
+
+    GIVEN("a truncated accumulation file")
+    {
+        BufferStream source;
+        serialize(source, Accumulation(Extent2u(4, 4), 2, "settings", 0));
+
+        std::vector<char> bytes(64);
+        source.read(bytes.data(), bytes.size());
+        BufferStream stream;
+        stream.write(bytes.data(), bytes.size());
+
+        THEN("deserializing should throw")
+        {
+            Accumulation accumulation;
+            REQUIRE_THROWS_WITH(
+                deserialize(stream, accumulation), "Unexpected end of accumulation file.");
+        }
+    }
+}
+
+SCENARIO("Merging accumulations", "[accumulation]")
+{
+    GIVEN("Accumulations of adjacent sample ranges")
+    {
+        Accumulation first(Extent2u(4, 4), 2, "settings", 0);
+        Accumulation second(Extent2u(4, 4), 2, "settings", 2);
+        for (std::uint32_t tileIdx = 0; tileIdx < first.tileCount(); ++tileIdx)
+        {
+            addSample(first, tileIdx, glm::vec3(1.0f));
+            addSample(first, tileIdx, glm::vec3(2.0f));
+            addSample(second, tileIdx, glm::vec3(3.0f));
+            addSample(second, tileIdx, glm::vec3(6.0f));
+        }
+
+        THEN("merging covers both sample ranges, in either order")
+        {
+            const Accumulation merged = merge(first, second);
+            REQUIRE(merge(second, first) == merged);
+            for (std::uint32_t tileIdx = 0; tileIdx < merged.tileCount(); ++tileIdx)
+            {
+                REQUIRE(merged.tileSampleBegin(tileIdx) == 0);
+                REQUIRE(merged.tileSampleEnd(tileIdx) == 4);
+            }
+            for (const glm::vec3& estimate : merged.resolve())
+            {
+                REQUIRE(estimate == glm::vec3(3.0f));
+            }
+        }
+    }
+
+    GIVEN("Accumulations with a gap between their sample ranges")
+    {
+        Accumulation first(Extent2u(2, 2), 2, "settings", 0);
+        Accumulation second(Extent2u(2, 2), 2, "settings", 2);
+        addSample(first, 0, glm::vec3(1.0f));
+        addSample(second, 0, glm::vec3(1.0f));
+
+        THEN("merging should throw")
+        {
+            REQUIRE_THROWS_WITH(
+                merge(first, second),
+                "Cannot merge tile 0: sample ranges [0, 1) and [2, 3) are not adjacent.");
+        }
+    }
+
+    GIVEN("Accumulations with different render settings")
+    {
+        const Accumulation first(Extent2u(2, 2), 2, "bounces=4", 0);
+        const Accumulation second(Extent2u(2, 2), 2, "bounces=8", 0);
+
+        THEN("merging should throw")
+        {
+            REQUIRE_THROWS(merge(first, second));
+        }
+    }
+}
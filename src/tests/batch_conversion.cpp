@@ -0,0 +1,190 @@
+#include <pt-format/batch_conversion.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace nlrs;
+
+namespace
+{
+void writeFile(const fs::path& path, const std::string& contents)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream file(path, std::ios::binary);
+    file << contents;
+}
+} // namespace
+
+TEST_CASE("Glob patterns match file names", "[batch-conversion]")
+{
+    REQUIRE(matchesGlob("Sponza.gltf", "*.gltf"));
+    REQUIRE(matchesGlob(".gltf", "*.gltf"));
+    REQUIRE_FALSE(matchesGlob("Sponza.glb", "*.gltf"));
+    REQUIRE_FALSE(matchesGlob("Sponza.gltf.bak", "*.gltf"));
+
+    // `*` matches any sequence, including the empty one.
+    REQUIRE(matchesGlob("", "*"));
+    REQUIRE(matchesGlob("", "**"));
+    REQUIRE(matchesGlob("abc", "a*b*c"));
+    REQUIRE(matchesGlob("aXbYc", "a*b*c"));
+    REQUIRE_FALSE(matchesGlob("acb", "a*b*c"));
+    // The match backtracks past a partial match of the text after the `*`.
+    REQUIRE(matchesGlob("aab", "*ab"));
+    REQUIRE(matchesGlob("abcabd", "*abd"));
+
+    // `?` matches exactly one character.
+    REQUIRE(matchesGlob("a.glb", "?.gl?"));
+    REQUIRE_FALSE(matchesGlob(".glb", "?.glb"));
+    REQUIRE_FALSE(matchesGlob("", "?"));
+    REQUIRE_FALSE(matchesGlob("", "?*"));
+    REQUIRE(matchesGlob("x", "?*"));
+    REQUIRE_FALSE(matchesGlob("ab", "?"));
+
+    REQUIRE(matchesGlob("", ""));
+    REQUIRE_FALSE(matchesGlob("a", ""));
+    // Matching is case sensitive.
+    REQUIRE_FALSE(matchesGlob("Sponza.GLTF", "*.gltf"));
+}
+
+SCENARIO("Find the glTF files to convert", "[batch-conversion]")
+{
+    GIVEN("a directory tree with glTF files and other files")
+    {
+        const fs::path directory = "batch-conversion-test";
+        writeFile(directory / "a.gltf", "");
+        writeFile(directory / "models" / "b.glb", "");
+        writeFile(directory / "models" / "notes.txt", "");
+        writeFile(directory / "models" / "c.gltf.bak", "");
+        writeFile(directory / "models" / "nested" / "d.gltf", "");
+        const std::vector<std::string> patterns{"*.gltf", "*.glb"};
+
+        WHEN("searching the directory")
+        {
+            const std::vector<fs::path> inputs{directory};
+            const std::vector<fs::path> files = findGltfFiles(inputs, patterns);
+
+            THEN("the matching files of every subdirectory are found, sorted")
+            {
+                const std::vector<fs::path> expected{
+                    directory / "a.gltf",
+                    directory / "models" / "b.glb",
+                    directory / "models" / "nested" / "d.gltf"};
+                REQUIRE(files == expected);
+            }
+        }
+
+        WHEN("the inputs overlap, and a file is given explicitly")
+        {
+            const std::vector<fs::path> inputs{
+                directory / "models" / "notes.txt", directory / "models", directory / "models"};
+            const std::vector<fs::path> files = findGltfFiles(inputs, patterns);
+
+            THEN("the explicit file is used as is, and each file is found once")
+            {
+                const std::vector<fs::path> expected{
+                    directory / "models" / "b.glb",
+                    directory / "models" / "nested" / "d.gltf",
+                    directory / "models" / "notes.txt"};
+                REQUIRE(files == expected);
+            }
+        }
+
+        fs::remove_all(directory);
+    }
+}
+
+SCENARIO("Limit the memory of concurrent conversions", "[batch-conversion]")
+{
+    GIVEN("a memory budget")
+    {
+        MemoryBudget budget(100);
+
+        THEN("reservations which fit in the budget do not block")
+        {
+            budget.acquire(40);
+            budget.acquire(60);
+            budget.release(40);
+            budget.release(60);
+        }
+
+        THEN("a reservation larger than the budget does not block when nothing else is reserved")
+        {
+            budget.acquire(1000);
+            budget.release(1000);
+        }
+
+        WHEN("a reservation does not fit next to another")
+        {
+            budget.acquire(60);
+            std::atomic<bool> acquired = false;
+            std::thread       thread([&budget, &acquired]() -> void {
+                budget.acquire(60);
+                acquired = true;
+                budget.release(60);
+            });
+
+            THEN("it blocks until the other reservation is released")
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                const bool acquiredWhileReserved = acquired;
+                budget.release(60);
+                thread.join();
+                REQUIRE_FALSE(acquiredWhileReserved);
+                REQUIRE(acquired);
+            }
+        }
+    }
+}
+
+TEST_CASE("The largest files are converted first", "[batch-conversion]")
+{
+    const std::vector<std::uint64_t> sizes{10, 30, 20, 30, 0};
+    const std::vector<std::size_t>   expected{1, 3, 2, 0, 4};
+    REQUIRE(largestFirst(sizes) == expected);
+    REQUIRE(largestFirst(std::vector<std::uint64_t>{}).empty());
+}
+
+SCENARIO("Files which would be converted to the same .pt file", "[batch-conversion]")
+{
+    GIVEN("a .gltf and a .glb file with the same name")
+    {
+        const fs::path directory = "batch-conversion-test";
+        writeFile(directory / "model.gltf", "{}");
+        writeFile(directory / "model.glb", "glTF");
+        const std::vector<fs::path> gltfPaths{directory / "model.glb", directory / "model.gltf"};
+
+        WHEN("converting them")
+        {
+            std::size_t                         numReported = 0;
+            const std::vector<ConversionResult> results = convertBatch(
+                gltfPaths, BatchOptions{}, [&numReported](const ConversionResult&) -> void {
+                    ++numReported;
+                });
+
+            THEN("both fail, naming the shared output, and no .pt file is written")
+            {
+                REQUIRE(numReported == 2);
+                REQUIRE(results.size() == 2);
+                for (std::size_t i = 0; i < results.size(); ++i)
+                {
+                    REQUIRE(results[i].gltfPath == gltfPaths[i]);
+                    REQUIRE(results[i].status == ConversionStatus::Failed);
+                    REQUIRE(results[i].error.find("model.pt") != std::string::npos);
+                }
+                REQUIRE_FALSE(fs::exists(directory / "model.pt"));
+            }
+        }
+
+        fs::remove_all(directory);
+    }
+}
@@ -0,0 +1,95 @@
+#include <pt-format/conversion_cache.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace nlrs;
+
+SCENARIO("Cache conversion stages", "[conversion-cache]")
+{
+    GIVEN("a conversion cache")
+    {
+        const fs::path        directory = "cache-test";
+        const ConversionCache cache(directory);
+
+        const Bvh bvh{
+            .nodes = {BvhNode{
+                .aabb = Aabb(glm::vec3(-1.0f), glm::vec3(1.0f)),
+                .trianglesOffset = 0,
+                .secondChildOffset = 0,
+                .triangleCount = 3,
+                .splitAxis = 2}},
+            .triangleIndices = {2, 0, 1}};
+        const Texture texture(
+            std::vector<Texture::BgraPixel>{0xff000000, 0xff0000ff, 0xff00ff00},
+            Texture::Dimensions{3, 1});
+
+        THEN("missing entries are not found")
+        {
+            REQUIRE_FALSE(cache.loadBvh(1).has_value());
+            REQUIRE_FALSE(cache.loadTexture(1).has_value());
+        }
+
+        WHEN("storing a BVH and a texture")
+        {
+            cache.storeBvh(1, bvh);
+            cache.storeTexture(1, texture);
+
+            THEN("loading them yields the same BVH and texture")
+            {
+                const std::optional<Bvh> cachedBvh = cache.loadBvh(1);
+                REQUIRE(cachedBvh.has_value());
+                REQUIRE(cachedBvh->triangleIndices == bvh.triangleIndices);
+                REQUIRE(cachedBvh->nodes.size() == 1);
+                REQUIRE(
+                    std::memcmp(cachedBvh->nodes.data(), bvh.nodes.data(), sizeof(BvhNode)) == 0);
+
+                const std::optional<Texture> cachedTexture = cache.loadTexture(1);
+                REQUIRE(cachedTexture.has_value());
+                REQUIRE(*cachedTexture == texture);
+            }
+
+            THEN("entries with other keys are not found")
+            {
+                REQUIRE_FALSE(cache.loadBvh(2).has_value());
+            }
+
+            AND_WHEN("an entry is corrupted")
+            {
+                for (const fs::directory_entry& entry : fs::directory_iterator(directory))
+                {
+                    std::fstream file(
+                        entry.path(), std::ios::binary | std::ios::in | std::ios::out);
+                    file.seekp(-1, std::ios::end);
+                    file.put('\x7f');
+                }
+
+                THEN("it is treated as missing")
+                {
+                    REQUIRE_FALSE(cache.loadBvh(1).has_value());
+                    REQUIRE_FALSE(cache.loadTexture(1).has_value());
+                }
+            }
+        }
+
+        WHEN("an entry can not be written")
+        {
+            fs::remove_all(directory);
+
+            THEN("storing it does not throw, and it is not found")
+            {
+                REQUIRE_NOTHROW(cache.storeBvh(1, bvh));
+                REQUIRE_FALSE(cache.loadBvh(1).has_value());
+            }
+        }
+
+        fs::remove_all(directory);
+    }
+}
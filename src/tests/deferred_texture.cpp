@@ -0,0 +1,286 @@
+#include <common/deferred_texture.hpp>
+#include <common/texture.hpp>
+#include <common/thread_pool.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <stb_image_write.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// A texture of `numPixels` pixels, each `value`, which occupies 4 * `numPixels` bytes.
+Texture makeTexture(const std::uint32_t numPixels, const std::uint32_t value)
+{
+    return Texture(
+        std::vector<Texture::Pixel>(numPixels, value), Texture::Dimensions{numPixels, 1});
+}
+
+std::vector<std::uint8_t> encodePng(const std::uint32_t width, const std::uint32_t height)
+{
+    std::vector<std::uint32_t> rgbaPixels;
+    for (std::uint32_t i = 0; i < width * height; ++i)
+    {
+        rgbaPixels.push_back(i * 2654435761u);
+    }
+    std::vector<std::uint8_t> png;
+    const int                 result = stbi_write_png_to_func(
+        [](void* const context, void* const data, const int size) {
+            const auto* const bytes = static_cast<const std::uint8_t*>(data);
+            static_cast<std::vector<std::uint8_t>*>(context)->insert(
+                static_cast<std::vector<std::uint8_t>*>(context)->end(), bytes, bytes + size);
+        },
+        &png,
+        static_cast<int>(width),
+        static_cast<int>(height),
+        4,
+        rgbaPixels.data(),
+        static_cast<int>(width * 4));
+    REQUIRE(result != 0);
+    return png;
+}
+} // namespace
+
+SCENARIO("Decode deferred textures on first access", "[deferred-texture]")
+{
+    GIVEN("a deferred texture with an encoded image")
+    {
+        const std::vector<std::uint8_t> png = encodePng(13, 7);
+        const DeferredTexture           texture(png);
+
+        THEN("its dimensions are known before it is decoded")
+        {
+            REQUIRE(texture.dimensions() == Texture::Dimensions{13, 7});
+            REQUIRE(texture.encodedNumBytes() == png.size());
+        }
+
+        THEN("it is decoded on first access and kept, and the encoded image is released")
+        {
+            const Texture& decoded = texture.texture();
+            REQUIRE(decoded == Texture::fromMemory(png));
+            REQUIRE(&texture.texture() == &decoded);
+            REQUIRE(texture.encodedNumBytes() == 0);
+        }
+    }
+
+    GIVEN("threads which access the same deferred texture at the same time")
+    {
+        const std::vector<std::uint8_t> png = encodePng(64, 64);
+        const DeferredTexture           texture(png);
+        ThreadPool                      threadPool(4);
+        std::vector<const Texture*>     decoded(64, nullptr);
+        for (std::size_t i = 0; i < decoded.size(); ++i)
+        {
+            threadPool.push(
+                [&texture, &decoded, i]() -> void { decoded[i] = &texture.texture(); });
+        }
+        threadPool.wait();
+
+        THEN("they all see the same decoded texture")
+        {
+            REQUIRE(*decoded[0] == Texture::fromMemory(png));
+            for (const Texture* const t : decoded)
+            {
+                REQUIRE(t == decoded[0]);
+            }
+        }
+    }
+
+    GIVEN("a deferred texture which is already decoded")
+    {
+        const DeferredTexture texture(Texture::fromPixel(1.0f, 0.0f, 0.0f, 1.0f));
+
+        THEN("it has no encoded image")
+        {
+            REQUIRE(texture.dimensions() == Texture::Dimensions{1, 1});
+            REQUIRE(texture.encodedNumBytes() == 0);
+            REQUIRE(texture.texture().pixels().size() == 1);
+        }
+    }
+
+    GIVEN("bytes which are not an image")
+    {
+        THEN("creating a deferred texture throws")
+        {
+            REQUIRE_THROWS_AS(
+                DeferredTexture(std::vector<std::uint8_t>{1, 2, 3, 4}), std::runtime_error);
+        }
+    }
+}
+
+SCENARIO("Keep decoded textures resident in a cache", "[deferred-texture]")
+{
+    GIVEN("a cache with room for two textures")
+    {
+        TextureResidencyCache cache(2 * 4 * 16);
+        int                   numDecodes = 0;
+        const auto            acquire = [&cache, &numDecodes](const std::uint64_t key) {
+            return cache.acquire(key, [&numDecodes, key]() -> Texture {
+                ++numDecodes;
+                return makeTexture(16, static_cast<std::uint32_t>(key));
+            });
+        };
+
+        WHEN("a texture is acquired twice")
+        {
+            const std::shared_ptr<const Texture> first = acquire(1);
+            const std::shared_ptr<const Texture> second = acquire(1);
+
+            THEN("it is decoded once")
+            {
+                REQUIRE(numDecodes == 1);
+                REQUIRE(first == second);
+                REQUIRE(first->pixels()[0] == 1);
+                REQUIRE(cache.stats().numHits == 1);
+                REQUIRE(cache.stats().numMisses == 1);
+                REQUIRE(cache.stats().residentNumBytes == 4 * 16);
+            }
+        }
+
+        WHEN("a third texture is acquired")
+        {
+            acquire(1);
+            acquire(2);
+            acquire(1);
+            const std::shared_ptr<const Texture> third = acquire(3);
+
+            THEN("the least recently used texture is evicted")
+            {
+                REQUIRE(cache.stats().numEvictions == 1);
+                REQUIRE(cache.stats().residentNumBytes == 2 * 4 * 16);
+                acquire(1);
+                REQUIRE(numDecodes == 3);
+                acquire(2);
+                REQUIRE(numDecodes == 4);
+            }
+
+            THEN("the evicted texture stays alive while it is referenced")
+            {
+                const std::shared_ptr<const Texture> second = acquire(2);
+                REQUIRE(third->pixels()[0] == 3);
+                REQUIRE(second->pixels()[0] == 2);
+            }
+        }
+
+        WHEN("a texture is larger than the budget")
+        {
+            const std::shared_ptr<const Texture> large = cache.acquire(
+                7, []() -> Texture { return makeTexture(1024, 7); });
+
+            THEN("it is resident until the next texture is acquired")
+            {
+                REQUIRE(cache.stats().residentNumBytes == 4 * 1024);
+                acquire(1);
+                REQUIRE(cache.stats().residentNumBytes == 4 * 16);
+                REQUIRE(large->pixels().size() == 1024);
+            }
+        }
+
+        WHEN("decoding a texture throws")
+        {
+            THEN("the exception is rethrown and the texture is not cached")
+            {
+                REQUIRE_THROWS_AS(
+                    cache.acquire(
+                        1, []() -> Texture { throw std::runtime_error("Corrupt image."); }),
+                    std::runtime_error);
+                REQUIRE(acquire(1)->pixels()[0] == 1);
+                REQUIRE(numDecodes == 1);
+            }
+        }
+    }
+
+    GIVEN("threads which acquire the same textures at the same time")
+    {
+        TextureResidencyCache    cache(1 << 20);
+        std::atomic<int>         numDecodes = 0;
+        ThreadPool               threadPool(4);
+        std::vector<std::size_t> values(64, 0);
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            threadPool.push([&cache, &numDecodes, &values, i]() -> void {
+                const std::uint64_t key = i % 4;
+                values[i] = cache.acquire(key, [&numDecodes, key]() -> Texture {
+                                     ++numDecodes;
+                                     return makeTexture(16, static_cast<std::uint32_t>(key));
+                                 })->pixels()[0];
+            });
+        }
+        threadPool.wait();
+
+        THEN("each texture is decoded once")
+        {
+            REQUIRE(numDecodes == 4);
+            for (std::size_t i = 0; i < values.size(); ++i)
+            {
+                REQUIRE(values[i] == i % 4);
+            }
+        }
+    }
+
+    GIVEN("a deferred texture with an encoded image")
+    {
+        TextureResidencyCache           cache(1 << 20);
+        const std::vector<std::uint8_t> png = encodePng(13, 7);
+        const DeferredTexture           texture(png);
+
+        THEN("its dimensions are known before it is decoded")
+        {
+            REQUIRE(texture.dimensions() == Texture::Dimensions{13, 7});
+            REQUIRE(cache.stats().numMisses == 0);
+        }
+
+        THEN("it is decoded into the cache on first access, and the encoded image is kept")
+        {
+            const std::shared_ptr<const Texture> decoded = texture.texture(cache);
+            REQUIRE(*decoded == Texture::fromMemory(png));
+            REQUIRE(texture.texture(cache) == decoded);
+            REQUIRE(texture.encodedNumBytes() == png.size());
+            REQUIRE(cache.stats().numMisses == 1);
+            REQUIRE(cache.stats().numHits == 1);
+        }
+
+        THEN("once it is decoded and kept, the cache returns the kept texture")
+        {
+            const Texture& decoded = texture.texture();
+            REQUIRE(texture.texture(cache).get() == &decoded);
+            REQUIRE(cache.stats().numMisses == 0);
+        }
+    }
+
+    GIVEN("deferred textures with identical encoded images")
+    {
+        TextureResidencyCache           cache(1 << 20);
+        const std::vector<std::uint8_t> png = encodePng(13, 7);
+        const DeferredTexture           first(png);
+        const DeferredTexture           second(png);
+
+        THEN("they share the decoded texture")
+        {
+            REQUIRE(first.texture(cache) == second.texture(cache));
+            REQUIRE(cache.stats().numMisses == 1);
+            REQUIRE(cache.stats().numHits == 1);
+        }
+    }
+
+    GIVEN("a deferred texture which is already decoded")
+    {
+        TextureResidencyCache cache(0);
+        const DeferredTexture texture(Texture::fromPixel(1.0f, 0.0f, 0.0f, 1.0f));
+
+        THEN("it does not occupy the cache")
+        {
+            REQUIRE(texture.dimensions() == Texture::Dimensions{1, 1});
+            REQUIRE(texture.encodedNumBytes() == 0);
+            REQUIRE(texture.texture(cache)->pixels().size() == 1);
+            REQUIRE(cache.stats().numMisses == 0);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#include <common/extent.hpp>
+#include <pt-cpu/denoiser.hpp>
+#include <pt-cpu/path_tracer.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// Deterministic noise in [0.5, 1.5].
+float noise(const std::uint32_t idx)
+{
+    std::uint32_t h = idx * 747796405u + 2891336453u;
+    h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+    h = (h >> 22u) ^ h;
+    return 0.5f + static_cast<float>(h) / static_cast<float>(0xffffffffu);
+}
+
+double meanSquaredError(const std::vector<glm::vec3>& image, const glm::vec3& expected)
+{
+    double sum = 0.0;
+    for (const glm::vec3& c : image)
+    {
+        const glm::vec3 d = c - expected;
+        sum += glm::dot(d, d);
+    }
+    return sum / static_cast<double>(image.size());
+}
+} // namespace
+
+SCENARIO("Denoising with the à-trous filter", "[denoiser]")
+{
+    const Extent2u       imageSize(32, 16);
+    const PixelFeatures  flat{.albedo = glm::vec3(0.5f), .normal = glm::vec3(0, 1, 0), .depth = 2};
+    const DenoiserParams params;
+
+    GIVEN("A constant image of a flat surface")
+    {
+        const std::vector<glm::vec3>     radiance(area(imageSize), glm::vec3(0.25f, 0.5f, 1.0f));
+        const std::vector<PixelFeatures> features(area(imageSize), flat);
+
+        THEN("the image is unchanged")
+        {
+            const std::vector<glm::vec3> result =
+                denoise(imageSize, radiance, features, params, 2);
+            REQUIRE(meanSquaredError(result, glm::vec3(0.25f, 0.5f, 1.0f)) < 1e-10);
+        }
+    }
+
+    GIVEN("A noisy image of a flat surface")
+    {
+        std::vector<glm::vec3> radiance;
+        for (std::uint32_t i = 0; i < area(imageSize); ++i)
+        {
+            radiance.push_back(glm::vec3(noise(3 * i), noise(3 * i + 1), noise(3 * i + 2)));
+        }
+        const std::vector<PixelFeatures> features(area(imageSize), flat);
+
+        THEN("the error is reduced by an order of magnitude")
+        {
+            const std::vector<glm::vec3> result =
+                denoise(imageSize, radiance, features, params, 2);
+            REQUIRE(
+                meanSquaredError(result, glm::vec3(1.0f)) <
+                0.1 * meanSquaredError(radiance, glm::vec3(1.0f)));
+        }
+    }
+
+    GIVEN("A noisy image whose width is not a multiple of the pixels filtered at once")
+    {
+        const Extent2u             oddSize(37, 11);
+        std::vector<glm::vec3>     radiance;
+        std::vector<glm::vec3>     mirroredRadiance;
+        std::vector<PixelFeatures> features;
+        std::vector<PixelFeatures> mirroredFeatures;
+        for (std::uint32_t y = 0; y < oddSize.y; ++y)
+        {
+            for (std::uint32_t x = 0; x < oddSize.x; ++x)
+            {
+                const auto pixel = [&](const std::uint32_t px) -> std::uint32_t {
+                    return y * oddSize.x + px;
+                };
+                const std::uint32_t mirroredX = oddSize.x - 1 - x;
+                radiance.push_back(glm::vec3(noise(3 * pixel(x)), noise(3 * pixel(x) + 1), 1.0f));
+                mirroredRadiance.push_back(glm::vec3(
+                    noise(3 * pixel(mirroredX)), noise(3 * pixel(mirroredX) + 1), 1.0f));
+                // The sky covers the left columns, so that some of the filtered pixels are sky.
+                const auto featuresAt = [](const std::uint32_t px) -> PixelFeatures {
+                    return px < 5 ? PixelFeatures{
+                                        .albedo = glm::vec3(1.0f),
+                                        .normal = glm::vec3(0.0f),
+                                        .depth = std::numeric_limits<float>::infinity()}
+                                  : PixelFeatures{
+                                        .albedo = glm::vec3(0.5f),
+                                        .normal = glm::vec3(0, 1, 0),
+                                        .depth = 2.0f + 0.1f * static_cast<float>(px)};
+                };
+                features.push_back(featuresAt(x));
+                mirroredFeatures.push_back(featuresAt(mirroredX));
+            }
+        }
+
+        THEN("denoising the mirrored image yields the mirrored result")
+        {
+            const std::vector<glm::vec3> result = denoise(oddSize, radiance, features, params, 2);
+            const std::vector<glm::vec3> mirroredResult =
+                denoise(oddSize, mirroredRadiance, mirroredFeatures, params, 2);
+            for (std::uint32_t y = 0; y < oddSize.y; ++y)
+            {
+                for (std::uint32_t x = 0; x < oddSize.x; ++x)
+                {
+                    const glm::vec3 c = result[y * oddSize.x + x];
+                    const glm::vec3 m = mirroredResult[y * oddSize.x + oddSize.x - 1 - x];
+                    REQUIRE(glm::dot(c - m, c - m) <= 1e-10f * glm::dot(c, c));
+                }
+            }
+        }
+    }
+
+    GIVEN("Two surfaces with different normals, and sky")
+    {
+        std::vector<glm::vec3>     radiance;
+        std::vector<PixelFeatures> features;
+        for (std::uint32_t y = 0; y < imageSize.y; ++y)
+        {
+            for (std::uint32_t x = 0; x < imageSize.x; ++x)
+            {
+                if (y < 4)
+                {
+                    radiance.push_back(glm::vec3(8.0f));
+                    features.push_back(PixelFeatures{
+                        .albedo = glm::vec3(1.0f),
+                        .normal = glm::vec3(0.0f),
+                        .depth = std::numeric_limits<float>::infinity()});
+                }
+                else if (x < 16)
+                {
+                    radiance.push_back(glm::vec3(1.0f));
+                    features.push_back(flat);
+                }
+                else
+                {
+                    radiance.push_back(glm::vec3(0.1f));
+                    features.push_back(PixelFeatures{
+                        .albedo = glm::vec3(0.5f), .normal = glm::vec3(1, 0, 0), .depth = 2});
+                }
+            }
+        }
+
+        THEN("the regions do not bleed into each other")
+        {
+            const std::vector<glm::vec3> result =
+                denoise(imageSize, radiance, features, params, 2);
+            for (std::size_t i = 0; i < result.size(); ++i)
+            {
+                REQUIRE(std::abs(result[i].r - radiance[i].r) < 1e-3f * radiance[i].r);
+            }
+        }
+    }
+}
@@ -0,0 +1,190 @@
+#include <common/file_stream.hpp>
+#include <common/gltf_model.hpp>
+#include <pt-cpu/accumulation.hpp>
+#include <pt-cpu/path_tracer.hpp>
+#include <pt-format/pt_format.hpp>
+#include <pt-render/distributed.hpp>
+#include <pt-render/render_options.hpp>
+#include <pt-render/socket.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace nlrs;
+
+namespace
+{
+// A wavy grid in front of the default camera, so that the tiles see both geometry and the sky.
+void writeScene(const fs::path& path)
+{
+    constexpr std::uint32_t    size = 8;
+    std::vector<glm::vec3>     positions;
+    std::vector<glm::vec3>     normals;
+    std::vector<glm::vec2>     texCoords;
+    std::vector<std::uint32_t> indices;
+    for (std::uint32_t y = 0; y <= size; ++y)
+    {
+        for (std::uint32_t x = 0; x <= size; ++x)
+        {
+            const glm::vec2 uv = glm::vec2(x, y) / static_cast<float>(size);
+            positions.emplace_back(uv.x, 0.1f * std::sin(10.0f * uv.x * uv.y), uv.y);
+            normals.emplace_back(0.0f, 1.0f, 0.0f);
+            texCoords.push_back(uv);
+        }
+    }
+    for (std::uint32_t y = 0; y < size; ++y)
+    {
+        for (std::uint32_t x = 0; x < size; ++x)
+        {
+            const std::uint32_t i = y * (size + 1) + x;
+            const std::uint32_t j = i + size + 1;
+            indices.insert(indices.end(), {i, i + 1, j, i + 1, j + 1, j});
+        }
+    }
+
+    std::vector<GltfMesh> meshes;
+    meshes.emplace_back(
+        std::move(positions), std::move(normals), std::move(texCoords), std::move(indices), 0);
+    std::vector<Texture> textures;
+    textures.push_back(Texture::fromPixel(0.25f, 0.5f, 0.75f, 1.0f));
+    convertGltf(GltfModel(std::move(meshes), std::move(textures)), path);
+}
+
+// Renders samples [accumulation's first sample, sampleEnd) of every tile in this process.
+void renderInProcess(
+    const RenderOptions& options,
+    const std::uint32_t  sampleEnd,
+    Accumulation&        accumulation)
+{
+    const MappedPtFormat ptFormat(options.scenePath);
+    const CpuPathTracer  pathTracer(
+        CpuScene{
+            .bvhNodes = ptFormat.bvhNodes,
+            .positions = ptFormat.bvhPositionAttributes,
+            .vertexAttributes = ptFormat.triangleVertexAttributes,
+            .baseColorTextures = ptFormat.baseColorTextures,
+            .baseColorSampler = TextureSampler{.filter = options.textureFilter},
+        },
+        options.sky);
+    const Camera camera = cameraFromOptions(options);
+    for (std::uint32_t tileIdx = 0; tileIdx < accumulation.tileCount(); ++tileIdx)
+    {
+        pathTracer.accumulateTile(
+            camera,
+            options.samplingParams,
+            tileIdx,
+            sampleEnd - accumulation.tileSampleEnd(tileIdx),
+            accumulation);
+    }
+}
+
+void writeAccumulation(const fs::path& path, const Accumulation& accumulation)
+{
+    OutputFileStream file(path);
+    serialize(file, accumulation);
+    file.close();
+}
+} // namespace
+
+SCENARIO("Render tiles on workers", "[distributed]")
+{
+    GIVEN("a scene and render options")
+    {
+        const fs::path directory = "distributed-test";
+        fs::create_directories(directory);
+        const fs::path scenePath = directory / "scene.pt";
+        writeScene(scenePath);
+
+        const std::vector<std::string> args{
+            "--size", "40x24", "--spp", "3", "--tile-size", "16", "--threads", "1"};
+        const RenderOptions options = parseRenderOptions(scenePath, {}, args);
+        const std::uint32_t sampleEnd = options.samplingParams.numSamplesPerPixel;
+
+        WHEN("a coordinator hands out the tiles to two workers over localhost")
+        {
+            Accumulation accumulation(
+                options.imageSize, options.tileSize, renderSettings(options), 0);
+            std::uint32_t                   numProgressReports = 0;
+            std::vector<std::exception_ptr> workerErrors(2);
+            {
+                // Declared before the listener, so that a worker which was not accepted before the
+                // render completed sees the listener close before the threads are joined.
+                std::vector<std::jthread> workers;
+                TcpListener               listener(SocketAddress{"127.0.0.1", 0});
+                const SocketAddress       address{"127.0.0.1", listener.port()};
+                for (std::exception_ptr& error : workerErrors)
+                {
+                    workers.emplace_back([&scenePath, &address, &error]() -> void {
+                        try
+                        {
+                            runWorker(scenePath, address, 1);
+                        }
+                        catch (...)
+                        {
+                            error = std::current_exception();
+                        }
+                    });
+                }
+
+                coordinateRender(
+                    listener,
+                    args,
+                    sampleEnd,
+                    accumulation,
+                    []() -> bool { return false; },
+                    [&numProgressReports](const Accumulation&) -> void {
+                        ++numProgressReports;
+                    });
+            }
+            for (const std::exception_ptr& error : workerErrors)
+            {
+                REQUIRE_FALSE(error);
+            }
+
+            THEN("the accumulation is bit-identical to rendering every tile in one process")
+            {
+                Accumulation expected(
+                    options.imageSize, options.tileSize, renderSettings(options), 0);
+                renderInProcess(options, sampleEnd, expected);
+                REQUIRE(numProgressReports > 0);
+                REQUIRE(accumulation == expected);
+            }
+        }
+
+        WHEN("two runs render adjacent sample ranges, and their checkpoints are merged")
+        {
+            // Single sample runs add each sample to zero, so the merged sums are exactly the sums
+            // of a single run, which adds the samples in the same order.
+            Accumulation first(options.imageSize, options.tileSize, renderSettings(options), 0);
+            Accumulation second(options.imageSize, options.tileSize, renderSettings(options), 1);
+            renderInProcess(options, 1, first);
+            renderInProcess(options, 2, second);
+            writeAccumulation(directory / "first.ptacc", first);
+            writeAccumulation(directory / "second.ptacc", second);
+
+            // The files are given out of order, as pt-merge allows.
+            const std::vector<fs::path> paths{
+                directory / "second.ptacc", directory / "first.ptacc"};
+            const Accumulation merged = mergeAccumulationFiles(paths);
+
+            THEN("the merged accumulation is identical to a single run of both samples")
+            {
+                Accumulation expected(
+                    options.imageSize, options.tileSize, renderSettings(options), 0);
+                renderInProcess(options, 2, expected);
+                REQUIRE(merged == expected);
+            }
+        }
+
+        fs::remove_all(directory);
+    }
+}
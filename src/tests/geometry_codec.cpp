@@ -0,0 +1,214 @@
+#include <pt-format/geometry_codec.hpp>
+#include <pt-format/vertex_attributes.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// Deterministic noise in [0, 1].
+float noise(const std::uint32_t idx)
+{
+    std::uint32_t h = idx * 747796405u + 2891336453u;
+    h = ((h >> ((h >> 28u) + 4u)) ^ h) * 277803737u;
+    h = (h >> 22u) ^ h;
+    return static_cast<float>(h) / static_cast<float>(0xffffffffu);
+}
+
+glm::vec3 unitVector(const std::uint32_t idx)
+{
+    const float z = 2.0f * noise(2 * idx) - 1.0f;
+    const float phi = 6.2831853f * noise(2 * idx + 1);
+    const float r = std::sqrt(std::max(1.0f - z * z, 0.0f));
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+template<typename T>
+std::vector<T> roundTrip(const SectionEncoding encoding, const std::vector<T>& data)
+{
+    const std::vector<std::byte> encoded =
+        encodeSection(encoding, std::as_bytes(std::span(data)), sizeof(T));
+    std::vector<T> decoded(data.size());
+    decodeSection(encoding, encoded, std::as_writable_bytes(std::span(decoded)), 4);
+    return decoded;
+}
+} // namespace
+
+SCENARIO("Lossless section encoding", "[geometry-codec]")
+{
+    GIVEN("a vertex array spanning several blocks")
+    {
+        // A grid of positions, similar to a tessellated surface.
+        std::vector<glm::vec4> positions;
+        for (std::uint32_t i = 0; i < 200'000; ++i)
+        {
+            positions.emplace_back(
+                static_cast<float>(i % 512) * 0.01f,
+                std::sin(static_cast<float>(i) * 0.001f),
+                static_cast<float>(i / 512) * 0.01f,
+                1.0f);
+        }
+        const std::span<const std::byte> bytes = std::as_bytes(std::span(positions));
+
+        WHEN("encoding the array")
+        {
+            const std::vector<std::byte> encoded =
+                encodeSection(SectionEncoding::Filtered, bytes, sizeof(glm::vec4));
+
+            THEN("the encoded array is smaller")
+            {
+                REQUIRE(encoded.size() < bytes.size() / 2);
+            }
+
+            THEN("decoding on several threads yields identical bytes")
+            {
+                std::vector<std::byte> decoded(bytes.size());
+                decodeSection(SectionEncoding::Filtered, encoded, decoded, 4);
+                REQUIRE(std::memcmp(decoded.data(), bytes.data(), bytes.size()) == 0);
+            }
+
+            THEN("encoding the array in uneven pieces yields identical bytes")
+            {
+                SectionEncoder encoder(SectionEncoding::Filtered, sizeof(glm::vec4));
+                const std::size_t pieceSize = 12'345 * sizeof(glm::vec4);
+                for (std::size_t offset = 0; offset < bytes.size(); offset += pieceSize)
+                {
+                    const std::size_t size = std::min(pieceSize, bytes.size() - offset);
+                    encoder.append(bytes.subspan(offset, size));
+                }
+                REQUIRE(encoder.finish() == encoded);
+            }
+
+            THEN("decoding into an array of the wrong size throws")
+            {
+                std::vector<std::byte> decoded(bytes.size() - sizeof(glm::vec4));
+                REQUIRE_THROWS_AS(
+                    decodeSection(SectionEncoding::Filtered, encoded, decoded, 1),
+                    std::runtime_error);
+            }
+
+            THEN("decoding truncated data throws")
+            {
+                std::vector<std::byte> decoded(bytes.size());
+                REQUIRE_THROWS_WITH(
+                    decodeSection(
+                        SectionEncoding::Filtered,
+                        std::span(encoded).first(encoded.size() - 1),
+                        decoded,
+                        4),
+                    "Invalid PtFormat file: invalid compressed section.");
+            }
+        }
+    }
+
+    GIVEN("incompressible indices")
+    {
+        std::vector<std::uint32_t> indices;
+        for (std::uint32_t i = 0; i < 10'000; ++i)
+        {
+            indices.push_back(static_cast<std::uint32_t>(noise(i) * 4294967295.0f));
+        }
+
+        THEN("decoding yields identical indices")
+        {
+            REQUIRE(roundTrip(SectionEncoding::Filtered, indices) == indices);
+        }
+    }
+
+    GIVEN("an empty array")
+    {
+        const std::vector<std::uint32_t> indices;
+
+        THEN("decoding yields an empty array")
+        {
+            REQUIRE(roundTrip(SectionEncoding::Filtered, indices).empty());
+        }
+    }
+}
+
+SCENARIO("Lossy section encoding", "[geometry-codec]")
+{
+    GIVEN("unit normals")
+    {
+        std::vector<glm::vec4> normals;
+        for (std::uint32_t i = 0; i < 10'000; ++i)
+        {
+            normals.emplace_back(unitVector(i), 0.0f);
+        }
+
+        THEN("the decoded normals are within 0.006 degrees of the original")
+        {
+            const std::vector<glm::vec4> decoded =
+                roundTrip(SectionEncoding::OctahedralNormals, normals);
+            for (std::size_t i = 0; i < normals.size(); ++i)
+            {
+                REQUIRE(glm::length(normals[i] - decoded[i]) < 1e-4f);
+                REQUIRE(decoded[i].w == 0.0f);
+            }
+        }
+    }
+
+    GIVEN("texture coordinates")
+    {
+        std::vector<glm::vec2> texCoords;
+        for (std::uint32_t i = 0; i < 10'000; ++i)
+        {
+            texCoords.emplace_back(noise(2 * i), 4.0f * noise(2 * i + 1));
+        }
+
+        THEN("the decoded coordinates have half float precision")
+        {
+            const std::vector<glm::vec2> decoded =
+                roundTrip(SectionEncoding::HalfTexCoords, texCoords);
+            for (std::size_t i = 0; i < texCoords.size(); ++i)
+            {
+                REQUIRE(std::abs(decoded[i].x - texCoords[i].x) <= 1.0f / 2048.0f);
+                REQUIRE(std::abs(decoded[i].y - texCoords[i].y) <= 4.0f / 2048.0f);
+            }
+        }
+    }
+
+    GIVEN("vertex attributes")
+    {
+        std::vector<VertexAttributes> attributes;
+        for (std::uint32_t i = 0; i < 1'000; ++i)
+        {
+            attributes.push_back(VertexAttributes{
+                .n0 = unitVector(3 * i),
+                .pad0 = 0.0f,
+                .n1 = unitVector(3 * i + 1),
+                .pad1 = 0.0f,
+                .n2 = unitVector(3 * i + 2),
+                .pad2 = 0.0f,
+                .uv0 = glm::vec2(noise(i), 0.5f),
+                .uv1 = glm::vec2(0.25f, noise(i)),
+                .uv2 = glm::vec2(1.0f, 0.0f),
+                .textureIdx = i % 7,
+                .pad3 = 0});
+        }
+
+        THEN("the texture indices are exact, and the normals and coordinates are close")
+        {
+            const std::vector<VertexAttributes> decoded =
+                roundTrip(SectionEncoding::QuantizedVertexAttributes, attributes);
+            for (std::size_t i = 0; i < attributes.size(); ++i)
+            {
+                REQUIRE(decoded[i].textureIdx == attributes[i].textureIdx);
+                REQUIRE(glm::length(decoded[i].n1 - attributes[i].n1) < 1e-4f);
+                REQUIRE(std::abs(decoded[i].uv0.x - attributes[i].uv0.x) <= 1.0f / 2048.0f);
+                REQUIRE(decoded[i].uv2 == attributes[i].uv2);
+            }
+        }
+    }
+}
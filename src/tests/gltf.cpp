@@ -1,6 +1,128 @@
+#include <common/deferred_texture.hpp>
 #include <common/gltf_model.hpp>
 
 #include <catch2/catch_test_macros.hpp>
+#include <fmt/core.h>
+#include <glm/glm.hpp>
+#include <stb_image_write.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+nlrs::GltfMesh makeTriangle(const float offset, const std::size_t textureIdx)
+{
+    return nlrs::GltfMesh(
+        {glm::vec3(offset, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+        {glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, 1.0f)},
+        {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f)},
+        {0, 1, 2},
+        textureIdx);
+}
+
+// Writes a glTF file with one triangle mesh per image, in which mesh i uses image
+// `meshImages[i]`. The images are 8x8 PNG files with different contents. Returns the encoded
+// images.
+std::vector<std::vector<std::uint8_t>> writeMultiImageGltf(
+    const fs::path&                    gltfPath,
+    const std::span<const std::size_t> meshImages)
+{
+    const std::size_t                      numImages = meshImages.size();
+    std::vector<std::vector<std::uint8_t>> images;
+    std::string                            imagesJson;
+    for (std::size_t i = 0; i < numImages; ++i)
+    {
+        std::array<std::uint32_t, 64> rgbaPixels;
+        for (std::size_t p = 0; p < rgbaPixels.size(); ++p)
+        {
+            const std::uint32_t rgb = static_cast<std::uint32_t>((i + 1) * (p + 1) * 2654435761u);
+            rgbaPixels[p] = 0xff000000u | rgb;
+        }
+        const fs::path imagePath = gltfPath.parent_path() / fmt::format("image{}.png", i);
+        REQUIRE(stbi_write_png(imagePath.string().c_str(), 8, 8, 4, rgbaPixels.data(), 32) != 0);
+        std::ifstream file(imagePath, std::ios::binary);
+        images.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        imagesJson += fmt::format("{}{{\"uri\":\"image{}.png\"}}", i > 0 ? "," : "", i);
+    }
+
+    // One triangle: positions, normals, texture coordinates and 16-bit indices.
+    const std::array<float, 9>         positions{0, 0, 0, 1, 0, 0, 0, 1, 0};
+    const std::array<float, 9>         normals{0, 0, 1, 0, 0, 1, 0, 0, 1};
+    const std::array<float, 6>         texCoords{0, 0, 1, 0, 0, 1};
+    const std::array<std::uint16_t, 4> indices{0, 1, 2, 0};
+    {
+        std::ofstream buffer(gltfPath.parent_path() / "geometry.bin", std::ios::binary);
+        buffer.write(reinterpret_cast<const char*>(positions.data()), sizeof(positions));
+        buffer.write(reinterpret_cast<const char*>(normals.data()), sizeof(normals));
+        buffer.write(reinterpret_cast<const char*>(texCoords.data()), sizeof(texCoords));
+        buffer.write(reinterpret_cast<const char*>(indices.data()), sizeof(indices));
+    }
+
+    std::string nodesJson;
+    std::string sceneNodesJson;
+    std::string meshesJson;
+    std::string materialsJson;
+    std::string texturesJson;
+    for (std::size_t i = 0; i < numImages; ++i)
+    {
+        const std::string_view separator = i > 0 ? "," : "";
+        sceneNodesJson += fmt::format("{}{}", separator, i);
+        // Translated, so that the meshes differ in more than their textures.
+        nodesJson += fmt::format("{}{{\"mesh\":{},\"translation\":[{},0,0]}}", separator, i, i);
+        meshesJson += fmt::format(
+            "{}{{\"primitives\":[{{\"attributes\":{{\"POSITION\":0,\"NORMAL\":1,"
+            "\"TEXCOORD_0\":2}},\"indices\":3,\"material\":{}}}]}}",
+            separator,
+            i);
+        materialsJson += fmt::format(
+            "{}{{\"pbrMetallicRoughness\":{{\"baseColorTexture\":{{\"index\":{}}}}}}}",
+            separator,
+            i);
+        texturesJson +=
+            fmt::format("{}{{\"sampler\":0,\"source\":{}}}", separator, meshImages[i]);
+    }
+
+    std::ofstream gltf(gltfPath);
+    gltf << fmt::format(
+        R"({{"asset":{{"version":"2.0"}},"scene":0,"scenes":[{{"nodes":[{}]}}],"nodes":[{}],)"
+        R"("meshes":[{}],"materials":[{}],"textures":[{}],)"
+        R"("samplers":[{{"wrapS":10497,"wrapT":10497}}],"images":[{}],)"
+        R"("buffers":[{{"uri":"geometry.bin","byteLength":104}}],"bufferViews":[)"
+        R"({{"buffer":0,"byteOffset":0,"byteLength":36}},)"
+        R"({{"buffer":0,"byteOffset":36,"byteLength":36}},)"
+        R"({{"buffer":0,"byteOffset":72,"byteLength":24}},)"
+        R"({{"buffer":0,"byteOffset":96,"byteLength":6}}],"accessors":[)"
+        R"({{"bufferView":0,"componentType":5126,"count":3,"type":"VEC3",)"
+        R"("min":[0,0,0],"max":[1,1,0]}},)"
+        R"({{"bufferView":1,"componentType":5126,"count":3,"type":"VEC3"}},)"
+        R"({{"bufferView":2,"componentType":5126,"count":3,"type":"VEC2"}},)"
+        R"({{"bufferView":3,"componentType":5123,"count":3,"type":"SCALAR"}}]}})",
+        sceneNodesJson,
+        nodesJson,
+        meshesJson,
+        materialsJson,
+        texturesJson,
+        imagesJson);
+    return images;
+}
+} // namespace
 
 TEST_CASE("Loading Gltf model produces triangle output", "[gltf]")
 {
@@ -16,3 +138,122 @@ TEST_CASE("Loading Gltf model produces triangle output", "[gltf]")
         REQUIRE(mesh.baseColorTextureIndex < model.baseColorTextures.size());
     }
 }
+
+TEST_CASE("Loading Gltf model with deferred textures does not decode the images", "[gltf]")
+{
+    const nlrs::GltfModel model("Duck.glb");
+    const nlrs::GltfModel deferredModel = nlrs::GltfModel::withDeferredTextures("Duck.glb");
+    REQUIRE(deferredModel.baseColorTextures.empty());
+    REQUIRE(deferredModel.deferredBaseColorTextures.size() == model.baseColorTextures.size());
+    REQUIRE(deferredModel.meshes.size() == model.meshes.size());
+
+    for (std::size_t i = 0; i < model.baseColorTextures.size(); ++i)
+    {
+        const nlrs::DeferredTexture& texture = deferredModel.deferredBaseColorTextures[i];
+        REQUIRE(texture.dimensions() == model.baseColorTextures[i].dimensions());
+        REQUIRE(texture.texture() == model.baseColorTextures[i]);
+    }
+}
+
+SCENARIO("Remove duplicate meshes", "[gltf]")
+{
+    GIVEN("meshes of which some are identical, and some differ only in their texture")
+    {
+        std::vector<nlrs::GltfMesh> meshes;
+        meshes.push_back(makeTriangle(0.0f, 0));
+        meshes.push_back(makeTriangle(0.5f, 0));
+        meshes.push_back(makeTriangle(0.0f, 0));
+        meshes.push_back(makeTriangle(0.0f, 1));
+        meshes.push_back(makeTriangle(0.5f, 0));
+
+        WHEN("removing the duplicates")
+        {
+            nlrs::GltfDeduplication deduplication;
+            nlrs::removeDuplicateMeshes(meshes, deduplication);
+
+            THEN("the first of each set of identical meshes remains, in order")
+            {
+                REQUIRE(meshes.size() == 3);
+                REQUIRE(meshes[0].positions[0].x == 0.0f);
+                REQUIRE(meshes[0].baseColorTextureIndex == 0);
+                REQUIRE(meshes[1].positions[0].x == 0.5f);
+                REQUIRE(meshes[2].positions[0].x == 0.0f);
+                REQUIRE(meshes[2].baseColorTextureIndex == 1);
+            }
+
+            THEN("the removed meshes and their bytes are counted")
+            {
+                const std::uint64_t meshBytes = 3 * sizeof(glm::vec3) + 3 * sizeof(glm::vec3) +
+                                                3 * sizeof(glm::vec2) + 3 * sizeof(std::uint32_t);
+                REQUIRE(deduplication.numDuplicateMeshes == 2);
+                REQUIRE(deduplication.duplicateMeshBytes == 2 * meshBytes);
+                REQUIRE(deduplication.numDuplicateImages == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("Loading a glTF file decodes its images deterministically", "[gltf]")
+{
+    GIVEN("a glTF file whose meshes use different images")
+    {
+        const fs::path directory = "gltf-test";
+        fs::create_directories(directory);
+        const fs::path                               gltfPath = directory / "images.gltf";
+        const std::array<std::size_t, 6>             meshImages{3, 0, 5, 1, 4, 2};
+        const std::vector<std::vector<std::uint8_t>> images =
+            writeMultiImageGltf(gltfPath, meshImages);
+
+        WHEN("it is loaded twice with a slow decoder, which finishes the images in a different "
+             "order each time")
+        {
+            std::mutex                mutex;
+            std::set<std::thread::id> decodingThreads;
+            // The images which start decoding first take the longest with one decoder, and the
+            // shortest with the other.
+            const int  numImages = static_cast<int>(meshImages.size());
+            const auto slowDecoder = [&mutex, &decodingThreads, numImages](
+                                         const bool firstIsSlowest) -> nlrs::ImageDecoder {
+                auto numCalls = std::make_shared<std::atomic<int>>(0);
+                return [&mutex, &decodingThreads, numImages, firstIsSlowest, numCalls](
+                           const std::span<const std::uint8_t> data) -> nlrs::Texture {
+                    {
+                        const std::lock_guard lock(mutex);
+                        decodingThreads.insert(std::this_thread::get_id());
+                    }
+                    const int callIdx = (*numCalls)++;
+                    std::this_thread::sleep_for(
+                        5 * std::chrono::milliseconds(
+                                firstIsSlowest ? numImages - callIdx : callIdx));
+                    return nlrs::Texture::fromMemory(data);
+                };
+            };
+            const nlrs::GltfModel first(gltfPath, slowDecoder(true), 4);
+            const nlrs::GltfModel second(gltfPath, slowDecoder(false), 4);
+
+            THEN("the images were decoded on several threads")
+            {
+                REQUIRE(decodingThreads.size() > 1);
+            }
+
+            THEN("the texture order, the texture indices and the pixels are identical")
+            {
+                REQUIRE(first.baseColorTextures.size() == meshImages.size());
+                REQUIRE(first.baseColorTextures == second.baseColorTextures);
+                REQUIRE(first.meshes.size() == meshImages.size());
+                REQUIRE(second.meshes.size() == meshImages.size());
+                for (std::size_t i = 0; i < meshImages.size(); ++i)
+                {
+                    REQUIRE(
+                        first.meshes[i].baseColorTextureIndex ==
+                        second.meshes[i].baseColorTextureIndex);
+                    REQUIRE(
+                        first.baseColorTextures[first.meshes[i].baseColorTextureIndex] ==
+                        nlrs::Texture::fromMemory(images[meshImages[i]]));
+                }
+            }
+        }
+
+        fs::remove_all(directory);
+    }
+}
@@ -0,0 +1,150 @@
+#include <common/buffer_stream.hpp>
+#include <common/extent.hpp>
+#include <common/file_stream.hpp>
+#include <pt-cpu/image_writer.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace nlrs;
+namespace fs = std::filesystem;
+
+namespace
+{
+std::vector<std::uint8_t> readAll(InputStream& stream)
+{
+    std::vector<std::uint8_t> bytes;
+    char                      buffer[4096];
+    std::size_t               numRead = 0;
+    while ((numRead = stream.read(buffer, sizeof(buffer))) > 0)
+    {
+        bytes.insert(bytes.end(), buffer, buffer + numRead);
+    }
+    return bytes;
+}
+
+// Decodes an image with stb_image, as 8-bit channels for PNG and float channels for HDR.
+template<typename T>
+std::vector<T> decodeImage(const std::vector<std::uint8_t>& bytes, const Extent2u& imageSize)
+{
+    int   width = 0;
+    int   height = 0;
+    int   numChannels = 0;
+    void* pixels = nullptr;
+    if constexpr (sizeof(T) == 1)
+    {
+        pixels = stbi_load_from_memory(
+            bytes.data(), static_cast<int>(bytes.size()), &width, &height, &numChannels, 3);
+    }
+    else
+    {
+        pixels = stbi_loadf_from_memory(
+            bytes.data(), static_cast<int>(bytes.size()), &width, &height, &numChannels, 3);
+    }
+    REQUIRE(pixels != nullptr);
+    REQUIRE(width == static_cast<int>(imageSize.x));
+    REQUIRE(height == static_cast<int>(imageSize.y));
+
+    const T*       begin = static_cast<const T*>(pixels);
+    std::vector<T> result(begin, begin + 3 * area(imageSize));
+    stbi_image_free(pixels);
+    return result;
+}
+
+// Writes the image a few rows at a time with ScanlineImageWriter, and in one go with writeImage.
+void writeBothWays(
+    const fs::path&               path,
+    const Extent2u&               imageSize,
+    const std::vector<glm::vec3>& image,
+    std::vector<std::uint8_t>&    streamedBytes,
+    std::vector<std::uint8_t>&    writtenBytes)
+{
+    BufferStream        stream;
+    ScanlineImageWriter writer(stream, imageFormatFromPath(path), imageSize, 2);
+    const std::size_t   numRowsPerWrite = 2;
+    for (std::size_t row = 0; row < imageSize.y; row += numRowsPerWrite)
+    {
+        const std::size_t numRows = std::min<std::size_t>(numRowsPerWrite, imageSize.y - row);
+        writer.writeRows(
+            std::span<const glm::vec3>(image).subspan(row * imageSize.x, numRows * imageSize.x));
+    }
+    writer.finish();
+    streamedBytes = readAll(stream);
+
+    writeImage(path, imageSize, image, 2);
+    {
+        InputFileStream file(path);
+        writtenBytes = readAll(file);
+    }
+    fs::remove(path);
+}
+} // namespace
+
+SCENARIO("ScanlineImageWriter writes the same pixels as writeImage", "[image_writer]")
+{
+    GIVEN("An image with both smooth and constant regions")
+    {
+        // Wide enough for run-length encoded HDR scanlines.
+        const Extent2u         imageSize(37, 5);
+        std::vector<glm::vec3> image;
+        for (std::uint32_t y = 0; y < imageSize.y; ++y)
+        {
+            for (std::uint32_t x = 0; x < imageSize.x; ++x)
+            {
+                image.push_back(
+                    x < 20 ? glm::vec3(0.25f * x, 0.1f * y, 1.0f / (x + 1)) : glm::vec3(3.0f));
+            }
+        }
+
+        WHEN("writing a PNG image")
+        {
+            std::vector<std::uint8_t> streamedBytes;
+            std::vector<std::uint8_t> writtenBytes;
+            writeBothWays(
+                "scanline_image_writer.png", imageSize, image, streamedBytes, writtenBytes);
+
+            THEN("the decoded pixels are identical")
+            {
+                REQUIRE(
+                    decodeImage<std::uint8_t>(streamedBytes, imageSize) ==
+                    decodeImage<std::uint8_t>(writtenBytes, imageSize));
+            }
+        }
+
+        WHEN("writing an HDR image")
+        {
+            std::vector<std::uint8_t> streamedBytes;
+            std::vector<std::uint8_t> writtenBytes;
+            writeBothWays(
+                "scanline_image_writer.hdr", imageSize, image, streamedBytes, writtenBytes);
+
+            THEN("the decoded pixels are identical")
+            {
+                REQUIRE(
+                    decodeImage<float>(streamedBytes, imageSize) ==
+                    decodeImage<float>(writtenBytes, imageSize));
+            }
+        }
+    }
+
+    GIVEN("A writer which has not received every row")
+    {
+        BufferStream        stream;
+        ScanlineImageWriter writer(stream, ImageFormat::Png, Extent2u(4, 4), 0);
+        writer.writeRows(std::vector<glm::vec3>(4, glm::vec3(1.0f)));
+
+        THEN("finishing should throw")
+        {
+            REQUIRE_THROWS_WITH(writer.finish(), "Image is incomplete: 1 of 4 rows were written.");
+        }
+    }
+}
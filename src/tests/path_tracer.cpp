@@ -0,0 +1,376 @@
+#include <common/buffer_stream.hpp>
+#include <common/bvh.hpp>
+#include <common/camera.hpp>
+#include <common/extent.hpp>
+#include <common/sampling_params.hpp>
+#include <common/sky.hpp>
+#include <common/texture.hpp>
+#include <common/thread_pool.hpp>
+#include <common/triangle_attributes.hpp>
+#include <common/units/angle.hpp>
+#include <common/virtual_texture.hpp>
+#include <pt-cpu/accumulation.hpp>
+#include <pt-cpu/path_tracer.hpp>
+#include <pt-format/vertex_attributes.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// A box without a lid. Light enters through the open top, and paths bounce around the inside of
+// the box many times before escaping.
+struct OpenBoxScene
+{
+    std::vector<BvhNode>          bvhNodes;
+    std::vector<Positions>        positions;
+    std::vector<VertexAttributes> vertexAttributes;
+    std::vector<Texture>          textures;
+
+    OpenBoxScene()
+    {
+        std::vector<Positions>        trianglePositions;
+        std::vector<VertexAttributes> triangleAttributes;
+
+        auto addQuad = [&](const glm::vec3& p0,
+                           const glm::vec3& p1,
+                           const glm::vec3& p2,
+                           const glm::vec3& p3,
+                           const glm::vec3& n) -> void {
+            const glm::vec2 uv(0.5f);
+            const auto      attributes = VertexAttributes{
+                     .n0 = n,
+                     .pad0 = 0.0f,
+                     .n1 = n,
+                     .pad1 = 0.0f,
+                     .n2 = n,
+                     .pad2 = 0.0f,
+                     .uv0 = uv,
+                     .uv1 = uv,
+                     .uv2 = uv,
+                     .textureIdx = 0,
+                     .pad3 = 0};
+            trianglePositions.push_back(Positions{.v0 = p0, .v1 = p1, .v2 = p2});
+            triangleAttributes.push_back(attributes);
+            trianglePositions.push_back(Positions{.v0 = p0, .v1 = p2, .v2 = p3});
+            triangleAttributes.push_back(attributes);
+        };
+
+        // floor
+        addQuad(
+            glm::vec3(-1.0f, 0.0f, -1.0f),
+            glm::vec3(1.0f, 0.0f, -1.0f),
+            glm::vec3(1.0f, 0.0f, 1.0f),
+            glm::vec3(-1.0f, 0.0f, 1.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f));
+        // walls
+        addQuad(
+            glm::vec3(-1.0f, 0.0f, -1.0f),
+            glm::vec3(-1.0f, 2.0f, -1.0f),
+            glm::vec3(-1.0f, 2.0f, 1.0f),
+            glm::vec3(-1.0f, 0.0f, 1.0f),
+            glm::vec3(1.0f, 0.0f, 0.0f));
+        addQuad(
+            glm::vec3(1.0f, 0.0f, -1.0f),
+            glm::vec3(1.0f, 2.0f, -1.0f),
+            glm::vec3(1.0f, 2.0f, 1.0f),
+            glm::vec3(1.0f, 0.0f, 1.0f),
+            glm::vec3(-1.0f, 0.0f, 0.0f));
+        addQuad(
+            glm::vec3(-1.0f, 0.0f, -1.0f),
+            glm::vec3(1.0f, 0.0f, -1.0f),
+            glm::vec3(1.0f, 2.0f, -1.0f),
+            glm::vec3(-1.0f, 2.0f, -1.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f));
+        addQuad(
+            glm::vec3(-1.0f, 0.0f, 1.0f),
+            glm::vec3(1.0f, 0.0f, 1.0f),
+            glm::vec3(1.0f, 2.0f, 1.0f),
+            glm::vec3(-1.0f, 2.0f, 1.0f),
+            glm::vec3(0.0f, 0.0f, -1.0f));
+
+        Bvh bvh = buildBvh(trianglePositions);
+        bvhNodes = std::move(bvh.nodes);
+        positions =
+            reorderAttributes(std::span<const Positions>(trianglePositions), bvh.triangleIndices);
+        vertexAttributes = reorderAttributes(
+            std::span<const VertexAttributes>(triangleAttributes), bvh.triangleIndices);
+        textures.push_back(Texture::fromPixel(0.9f, 0.9f, 0.9f, 1.0f));
+    }
+
+    CpuScene scene() const
+    {
+        return CpuScene{
+            .bvhNodes = bvhNodes,
+            .positions = positions,
+            .vertexAttributes = vertexAttributes,
+            .baseColorTextures = textures,
+        };
+    }
+};
+
+struct Estimate
+{
+    double mean;
+    double standardError;
+};
+
+Estimate estimateImage(
+    const CpuPathTracer&  pathTracer,
+    const Camera&         camera,
+    const Extent2u&       framebufferSize,
+    const std::uint32_t   numSamples,
+    const SamplingParams& samplingParams)
+{
+    double      sum = 0.0;
+    double      sumSquares = 0.0;
+    std::size_t count = 0;
+    for (std::uint32_t y = 0; y < framebufferSize.y; ++y)
+    {
+        for (std::uint32_t x = 0; x < framebufferSize.x; ++x)
+        {
+            for (std::uint32_t sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+            {
+                const glm::vec3 radiance = pathTracer.samplePixel(
+                    camera, framebufferSize, x, y, sampleIdx, samplingParams);
+                const double luminance = 0.2126 * radiance.r + 0.7152 * radiance.g +
+                                         0.0722 * radiance.b;
+                sum += luminance;
+                sumSquares += luminance * luminance;
+                ++count;
+            }
+        }
+    }
+    const double n = static_cast<double>(count);
+    const double mean = sum / n;
+    const double variance = (sumSquares / n - mean * mean) * n / (n - 1.0);
+    return Estimate{mean, std::sqrt(variance / n)};
+}
+} // namespace
+
+TEST_CASE("A ray cone samples the mip level matching its footprint", "[path_tracer]")
+{
+    // A right triangle with unit legs, which is mapped to half of a 256 by 256 texture, so that a
+    // texel has a width of 1/256.
+    const Positions        positions{
+        .v0 = glm::vec3(0.0f, 0.0f, 0.0f),
+        .v1 = glm::vec3(1.0f, 0.0f, 0.0f),
+        .v2 = glm::vec3(0.0f, 1.0f, 0.0f)};
+    const VertexAttributes attributes{
+        .n0 = glm::vec3(0.0f, 0.0f, 1.0f),
+        .pad0 = 0.0f,
+        .n1 = glm::vec3(0.0f, 0.0f, 1.0f),
+        .pad1 = 0.0f,
+        .n2 = glm::vec3(0.0f, 0.0f, 1.0f),
+        .pad2 = 0.0f,
+        .uv0 = glm::vec2(0.0f, 0.0f),
+        .uv1 = glm::vec2(1.0f, 0.0f),
+        .uv2 = glm::vec2(0.0f, 1.0f),
+        .textureIdx = 0,
+        .pad3 = 0};
+    const Texture::Dimensions dimensions{256, 256};
+    const glm::vec3           headOn(0.0f, 0.0f, -1.0f);
+    // 60 degrees from the normal, so that the footprint is twice as long.
+    const glm::vec3           grazing(0.0f, std::sqrt(3.0f) / 2.0f, -0.5f);
+
+    const auto lod = [&](const glm::vec3& direction, const float texels) {
+        return rayConeTextureLod(positions, attributes, dimensions, direction, texels / 256.0f);
+    };
+    REQUIRE(std::abs(lod(headOn, 1.0f)) < 1e-4f);
+    REQUIRE(std::abs(lod(headOn, 4.0f) - 2.0f) < 1e-4f);
+    REQUIRE(std::abs(lod(grazing, 4.0f) - 3.0f) < 1e-4f);
+    REQUIRE(lod(headOn, 0.0f) == 0.0f);
+
+    VertexAttributes constantUv = attributes;
+    constantUv.uv1 = constantUv.uv0;
+    REQUIRE(rayConeTextureLod(positions, constantUv, dimensions, headOn, 1.0f) == 0.0f);
+}
+
+TEST_CASE("Russian roulette does not change the expected radiance", "[path_tracer]")
+{
+    const OpenBoxScene  box;
+    const CpuPathTracer pathTracer(box.scene(), Sky{});
+    const Camera        camera = createCamera(
+        glm::vec3(0.0f, 1.5f, 0.0f),
+        glm::vec3(0.5f, 0.0f, 0.2f),
+        0.0f,
+        1.0f,
+        Angle::degrees(80.0f),
+        1.0f);
+    const Extent2u      framebufferSize(8, 8);
+    const std::uint32_t numSamples = 4096;
+
+    const SamplingParams fullPaths{
+        .numSamplesPerPixel = numSamples,
+        .numBounces = 8,
+        .russianRoulette = false,
+        .minBounces = 0};
+    const SamplingParams russianRoulette{
+        .numSamplesPerPixel = numSamples,
+        .numBounces = 8,
+        .russianRoulette = true,
+        .minBounces = 1};
+
+    const Estimate reference =
+        estimateImage(pathTracer, camera, framebufferSize, numSamples, fullPaths);
+    const Estimate estimate =
+        estimateImage(pathTracer, camera, framebufferSize, numSamples, russianRoulette);
+
+    REQUIRE(reference.mean > 0.0);
+    const double tolerance = 4.0 * std::sqrt(
+                                       reference.standardError * reference.standardError +
+                                       estimate.standardError * estimate.standardError);
+    REQUIRE(std::abs(reference.mean - estimate.mean) < tolerance);
+}
+
+TEST_CASE("Russian roulette is not applied before the minimum bounce count", "[path_tracer]")
+{
+    const OpenBoxScene  box;
+    const CpuPathTracer pathTracer(box.scene(), Sky{});
+    const Camera        camera = createCamera(
+        glm::vec3(0.0f, 1.5f, 0.0f),
+        glm::vec3(0.5f, 0.0f, 0.2f),
+        0.0f,
+        1.0f,
+        Angle::degrees(80.0f),
+        1.0f);
+    const Extent2u framebufferSize(4, 4);
+
+    const SamplingParams fullPaths{
+        .numSamplesPerPixel = 16, .numBounces = 4, .russianRoulette = false, .minBounces = 0};
+    const SamplingParams russianRoulette{
+        .numSamplesPerPixel = 16, .numBounces = 4, .russianRoulette = true, .minBounces = 4};
+
+    for (std::uint32_t y = 0; y < framebufferSize.y; ++y)
+    {
+        for (std::uint32_t x = 0; x < framebufferSize.x; ++x)
+        {
+            for (std::uint32_t sampleIdx = 0; sampleIdx < 16; ++sampleIdx)
+            {
+                const glm::vec3 expected =
+                    pathTracer.samplePixel(camera, framebufferSize, x, y, sampleIdx, fullPaths);
+                const glm::vec3 actual = pathTracer.samplePixel(
+                    camera, framebufferSize, x, y, sampleIdx, russianRoulette);
+                REQUIRE(expected == actual);
+            }
+        }
+    }
+}
+
+TEST_CASE("A render resumed from a checkpoint matches an uninterrupted render", "[path_tracer]")
+{
+    const OpenBoxScene  box;
+    const CpuPathTracer pathTracer(box.scene(), Sky{});
+    const Extent2u      framebufferSize(12, 10);
+    const Camera        camera = createCamera(
+        glm::vec3(0.0f, 1.5f, 0.0f),
+        glm::vec3(0.5f, 0.0f, 0.2f),
+        0.0f,
+        1.0f,
+        Angle::degrees(80.0f),
+        aspectRatio(framebufferSize));
+    const SamplingParams samplingParams{};
+
+    Accumulation uninterrupted(framebufferSize, 8, "box", 0);
+    for (std::uint32_t tileIdx = 0; tileIdx < uninterrupted.tileCount(); ++tileIdx)
+    {
+        pathTracer.accumulateTile(camera, samplingParams, tileIdx, 6, uninterrupted);
+    }
+
+    Accumulation resumed;
+    {
+        Accumulation partial(framebufferSize, 8, "box", 0);
+        for (std::uint32_t tileIdx = 0; tileIdx < partial.tileCount(); ++tileIdx)
+        {
+            // Tiles may have been interrupted after different numbers of samples.
+            pathTracer.accumulateTile(camera, samplingParams, tileIdx, 1 + tileIdx, partial);
+        }
+
+        BufferStream checkpoint;
+        serialize(checkpoint, partial);
+        deserialize(checkpoint, resumed);
+    }
+    for (std::uint32_t tileIdx = 0; tileIdx < resumed.tileCount(); ++tileIdx)
+    {
+        pathTracer.accumulateTile(
+            camera, samplingParams, tileIdx, 6 - resumed.tileSampleEnd(tileIdx), resumed);
+    }
+
+    REQUIRE(resumed == uninterrupted);
+}
+
+TEST_CASE("Virtual textures are sampled like the textures they were paged from", "[path_tracer]")
+{
+    const OpenBoxScene  box;
+    ThreadPool          threadPool(1);
+    const PagedTextures paged = pageTextures(box.textures, threadPool);
+    // Room for the least detailed level of the texture only, which is always resident.
+    const VirtualTextureCache cache(
+        VirtualTexturePages{.descriptors = paged.descriptors, .pages = paged.pages}, 1);
+
+    CpuScene virtualScene = box.scene();
+    virtualScene.baseColorTextures = {};
+    virtualScene.virtualBaseColorTextures = &cache;
+
+    const CpuPathTracer pathTracer(box.scene(), Sky{});
+    const CpuPathTracer virtualPathTracer(virtualScene, Sky{});
+    const Extent2u      framebufferSize(4, 4);
+    const Camera        camera = createCamera(
+        glm::vec3(0.0f, 1.5f, 0.0f),
+        glm::vec3(0.5f, 0.0f, 0.2f),
+        0.0f,
+        1.0f,
+        Angle::degrees(80.0f),
+        aspectRatio(framebufferSize));
+    const SamplingParams samplingParams{};
+
+    for (std::uint32_t y = 0; y < framebufferSize.y; ++y)
+    {
+        for (std::uint32_t x = 0; x < framebufferSize.x; ++x)
+        {
+            REQUIRE(
+                pathTracer.samplePixel(camera, framebufferSize, x, y, 0, samplingParams) ==
+                virtualPathTracer.samplePixel(camera, framebufferSize, x, y, 0, samplingParams));
+        }
+    }
+}
+
+TEST_CASE("The features of a row match the features of its pixels", "[path_tracer]")
+{
+    const OpenBoxScene  box;
+    const CpuPathTracer pathTracer(box.scene(), Sky{});
+    // Not a multiple of the texture sample batch size, so that the last batch of a row is partial.
+    const Extent2u      framebufferSize(11, 5);
+    // Looks out of the open top of the box, so that rows see both the walls and the sky.
+    const Camera        camera = createCamera(
+        glm::vec3(0.0f, 1.0f, 0.0f),
+        glm::vec3(0.0f, 2.0f, 0.9f),
+        0.0f,
+        1.0f,
+        Angle::degrees(80.0f),
+        aspectRatio(framebufferSize));
+
+    std::size_t                numSkyPixels = 0;
+    std::vector<PixelFeatures> row(framebufferSize.x);
+    for (std::uint32_t y = 0; y < framebufferSize.y; ++y)
+    {
+        pathTracer.pixelFeatures(camera, framebufferSize, y, row);
+        for (std::uint32_t x = 0; x < framebufferSize.x; ++x)
+        {
+            const PixelFeatures expected = pathTracer.pixelFeatures(camera, framebufferSize, x, y);
+            // The batched sampler may contract multiplies and adds differently.
+            REQUIRE(glm::distance(row[x].albedo, expected.albedo) < 1e-5f);
+            REQUIRE(row[x].normal == expected.normal);
+            REQUIRE(row[x].depth == expected.depth);
+            numSkyPixels += std::isinf(expected.depth) ? 1 : 0;
+        }
+    }
+    REQUIRE(numSkyPixels > 0);
+    REQUIRE(numSkyPixels < framebufferSize.x * framebufferSize.y);
+}
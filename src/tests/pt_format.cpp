@@ -1,5 +1,10 @@
 #include <common/buffer_stream.hpp>
 #include <common/file_stream.hpp>
+#include <common/gltf_model.hpp>
+#include <common/texture_compression.hpp>
+#include <common/thread_pool.hpp>
+#include <common/virtual_texture.hpp>
+#include <pt-format/conversion_cache.hpp>
 #include <pt-format/pt_format.hpp>
 
 #include <catch2/benchmark/catch_benchmark.hpp>
@@ -8,9 +13,19 @@
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace fs = std::filesystem;
 using namespace nlrs;
@@ -177,6 +192,901 @@ SCENARIO("Serialize and deserialize PtFormat", "[pt-format]")
     }
 }
 
+namespace
+{
+template<typename T>
+bool bytesEqual(const std::span<const T> lhs, const std::span<const T> rhs)
+{
+    return lhs.size() == rhs.size() && std::memcmp(lhs.data(), rhs.data(), lhs.size_bytes()) == 0;
+}
+
+template<typename T>
+bool isAligned(const std::span<const T> data)
+{
+    return reinterpret_cast<std::uintptr_t>(data.data()) % 16 == 0;
+}
+
+// A small scene with data in every section, which does not require loading a glTF file.
+PtFormat makePtFormat()
+{
+    PtFormat format;
+    format.bvhNodes = {
+        BvhNode{
+            .aabb = Aabb(glm::vec3(-1.0f), glm::vec3(1.0f)),
+            .trianglesOffset = 0,
+            .secondChildOffset = 0,
+            .triangleCount = 2,
+            .splitAxis = 1}};
+    format.bvhPositionAttributes = {
+        Positions{glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)},
+        Positions{glm::vec3(1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)}};
+    format.trianglePositionAttributes = {
+        PositionAttribute{.p0 = glm::vec3(0.0f), .p1 = glm::vec3(1.0f), .p2 = glm::vec3(2.0f)},
+        PositionAttribute{.p0 = glm::vec3(3.0f), .p1 = glm::vec3(4.0f), .p2 = glm::vec3(5.0f)}};
+    format.triangleVertexAttributes = {
+        VertexAttributes{.uv0 = glm::vec2(0.5f), .textureIdx = 0},
+        VertexAttributes{.uv1 = glm::vec2(0.25f), .textureIdx = 1}};
+    format.vertexPositions = {
+        glm::vec4(0.0f), glm::vec4(1.0f), glm::vec4(2.0f), glm::vec4(3.0f), glm::vec4(4.0f)};
+    format.vertexNormals = {
+        glm::vec4(0.0f), glm::vec4(-1.0f), glm::vec4(-2.0f), glm::vec4(-3.0f), glm::vec4(-4.0f)};
+    format.vertexTexCoords = {
+        glm::vec2(0.0f), glm::vec2(0.1f), glm::vec2(0.2f), glm::vec2(0.3f), glm::vec2(0.4f)};
+    format.vertexIndices = {0, 1, 2, 0, 1, 2, 1};
+    format.modelVertexPositions = {
+        std::span<const glm::vec4>(format.vertexPositions).subspan(0, 3),
+        std::span<const glm::vec4>(format.vertexPositions).subspan(3, 2)};
+    format.modelVertexNormals = {
+        std::span<const glm::vec4>(format.vertexNormals).subspan(0, 3),
+        std::span<const glm::vec4>(format.vertexNormals).subspan(3, 2)};
+    format.modelVertexTexCoords = {
+        std::span<const glm::vec2>(format.vertexTexCoords).subspan(0, 3),
+        std::span<const glm::vec2>(format.vertexTexCoords).subspan(3, 2)};
+    format.modelVertexIndices = {
+        std::span<const std::uint32_t>(format.vertexIndices).subspan(0, 3),
+        std::span<const std::uint32_t>(format.vertexIndices).subspan(3, 4)};
+    format.modelBaseColorTextureIndices = {0, 1};
+    format.baseColorTextures.push_back(Texture::fromPixel(0.25f, 0.5f, 0.75f, 1.0f));
+    format.baseColorTextures.push_back(Texture(
+        std::vector<Texture::BgraPixel>{0xff000000, 0xff0000ff, 0xff00ff00, 0xffff0000, 0, 1},
+        Texture::Dimensions{3, 2}));
+    return format;
+}
+
+template<typename T>
+bool spansEqual(
+    const std::vector<std::span<const T>>& lhs,
+    const std::vector<std::span<const T>>& rhs)
+{
+    return std::equal(
+        lhs.begin(),
+        lhs.end(),
+        rhs.begin(),
+        rhs.end(),
+        [](const std::span<const T> l, const std::span<const T> r) -> bool {
+            return bytesEqual(l, r);
+        });
+}
+
+// A grid of `size` by `size` quads, with a distinct normal and texture coordinate per vertex.
+GltfMesh makeGridMesh(const std::uint32_t size, const std::size_t baseColorTextureIndex)
+{
+    std::vector<glm::vec3>     positions;
+    std::vector<glm::vec3>     normals;
+    std::vector<glm::vec2>     texCoords;
+    std::vector<std::uint32_t> indices;
+    for (std::uint32_t y = 0; y <= size; ++y)
+    {
+        for (std::uint32_t x = 0; x <= size; ++x)
+        {
+            const glm::vec2 uv = glm::vec2(x, y) / static_cast<float>(size);
+            positions.emplace_back(uv.x, 0.1f * std::sin(10.0f * uv.x * uv.y), uv.y);
+            normals.push_back(glm::normalize(glm::vec3(uv.x - 0.5f, 1.0f, uv.y - 0.5f)));
+            texCoords.push_back(uv);
+        }
+    }
+    for (std::uint32_t y = 0; y < size; ++y)
+    {
+        for (std::uint32_t x = 0; x < size; ++x)
+        {
+            const std::uint32_t i = y * (size + 1) + x;
+            const std::uint32_t j = i + size + 1;
+            indices.insert(indices.end(), {i, i + 1, j, i + 1, j + 1, j});
+        }
+    }
+    return GltfMesh(
+        std::move(positions),
+        std::move(normals),
+        std::move(texCoords),
+        std::move(indices),
+        baseColorTextureIndex);
+}
+
+// A model with more triangles than are converted at a time by convertGltf.
+GltfModel makeGltfModel()
+{
+    std::vector<GltfMesh> meshes;
+    meshes.push_back(makeGridMesh(192, 1));
+    meshes.push_back(makeGridMesh(3, 0));
+    std::vector<Texture> textures;
+    textures.push_back(Texture::fromPixel(0.25f, 0.5f, 0.75f, 1.0f));
+    textures.push_back(Texture(
+        std::vector<Texture::BgraPixel>{0xff000000, 0xff0000ff, 0xff00ff00, 0xffff0000},
+        Texture::Dimensions{2, 2}));
+    return GltfModel(std::move(meshes), std::move(textures));
+}
+
+std::string readFile(const fs::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// The std::fstream based streams which InputFileStream and OutputFileStream replaced, for
+// comparison.
+class StdInputFileStream : public InputStream
+{
+public:
+    explicit StdInputFileStream(const fs::path& path)
+        : mStream(path, std::ios::binary)
+    {
+    }
+
+    std::size_t read(char* data, std::size_t numBytes) override
+    {
+        mStream.read(data, static_cast<std::streamsize>(numBytes));
+        return static_cast<std::size_t>(mStream.gcount());
+    }
+
+private:
+    std::ifstream mStream;
+};
+
+class StdOutputFileStream : public OutputStream
+{
+public:
+    explicit StdOutputFileStream(const fs::path& path)
+        : mStream(path, std::ios::binary)
+    {
+    }
+
+    void write(const char* data, std::size_t numBytes) override
+    {
+        mStream.write(data, static_cast<std::streamsize>(numBytes));
+    }
+
+private:
+    std::ofstream mStream;
+};
+} // namespace
+
+SCENARIO("Memory map a PtFormat file", "[pt-format]")
+{
+    GIVEN("A pt format file")
+    {
+        const PtFormat ptFormat = makePtFormat();
+        const fs::path path = "mapped.pt";
+        {
+            OutputFileStream file(path);
+            serialize(file, ptFormat);
+        }
+
+        WHEN("mapping the file")
+        {
+            const MappedPtFormat mappedPtFormat(path);
+
+            THEN("the arrays are equal to the serialized ones")
+            {
+                REQUIRE(bytesEqual<BvhNode>(ptFormat.bvhNodes, mappedPtFormat.bvhNodes));
+                REQUIRE(bytesEqual<Positions>(
+                    ptFormat.bvhPositionAttributes, mappedPtFormat.bvhPositionAttributes));
+                REQUIRE(bytesEqual<PositionAttribute>(
+                    ptFormat.trianglePositionAttributes,
+                    mappedPtFormat.trianglePositionAttributes));
+                REQUIRE(bytesEqual<VertexAttributes>(
+                    ptFormat.triangleVertexAttributes, mappedPtFormat.triangleVertexAttributes));
+                REQUIRE(bytesEqual<glm::vec4>(
+                    ptFormat.vertexPositions, mappedPtFormat.vertexPositions));
+                REQUIRE(
+                    bytesEqual<glm::vec4>(ptFormat.vertexNormals, mappedPtFormat.vertexNormals));
+                REQUIRE(bytesEqual<glm::vec2>(
+                    ptFormat.vertexTexCoords, mappedPtFormat.vertexTexCoords));
+                REQUIRE(bytesEqual<std::uint32_t>(
+                    ptFormat.vertexIndices, mappedPtFormat.vertexIndices));
+                REQUIRE(bytesEqual<std::uint32_t>(
+                    ptFormat.modelBaseColorTextureIndices,
+                    mappedPtFormat.modelBaseColorTextureIndices));
+
+                REQUIRE(
+                    ptFormat.modelVertexIndices.size() == mappedPtFormat.modelVertexIndices.size());
+                for (std::size_t i = 0; i < ptFormat.modelVertexIndices.size(); ++i)
+                {
+                    REQUIRE(bytesEqual(
+                        ptFormat.modelVertexPositions[i], mappedPtFormat.modelVertexPositions[i]));
+                    REQUIRE(bytesEqual(
+                        ptFormat.modelVertexIndices[i], mappedPtFormat.modelVertexIndices[i]));
+                }
+
+                REQUIRE(
+                    ptFormat.baseColorTextures.size() == mappedPtFormat.baseColorTextures.size());
+                for (std::size_t i = 0; i < ptFormat.baseColorTextures.size(); ++i)
+                {
+                    REQUIRE(ptFormat.baseColorTextures[i] == mappedPtFormat.baseColorTextures[i]);
+                }
+            }
+
+            THEN("the arrays refer to the mapping, with 16-byte alignment")
+            {
+                const std::span<const std::byte> bytes = mappedPtFormat.file.bytes();
+                const auto isInFile = [&bytes](const auto data) -> bool {
+                    const auto* const begin = reinterpret_cast<const std::byte*>(data.data());
+                    return begin >= bytes.data() &&
+                           begin + data.size_bytes() <= bytes.data() + bytes.size();
+                };
+                REQUIRE(isInFile(mappedPtFormat.bvhNodes));
+                REQUIRE(isAligned(mappedPtFormat.bvhNodes));
+                REQUIRE(isInFile(mappedPtFormat.vertexPositions));
+                REQUIRE(isAligned(mappedPtFormat.vertexPositions));
+                for (const Texture& texture : mappedPtFormat.baseColorTextures)
+                {
+                    REQUIRE(isInFile(texture.pixels()));
+                    REQUIRE(isAligned(texture.pixels()));
+                }
+            }
+        }
+
+        WHEN("mapping a truncated file")
+        {
+            fs::resize_file(path, fs::file_size(path) - 1);
+
+            THEN("mapping should throw")
+            {
+                REQUIRE_THROWS_WITH(
+                    MappedPtFormat(path),
+                    "Invalid PtFormat file: section TriangleVertexAttributes is out of bounds.");
+            }
+        }
+
+        fs::remove(path);
+    }
+}
+
+SCENARIO("Read sections of a PtFormat file", "[pt-format]")
+{
+    GIVEN("A pt format file")
+    {
+        const PtFormat ptFormat = makePtFormat();
+        const fs::path path = "sections.pt";
+        {
+            OutputFileStream file(path);
+            serialize(file, ptFormat);
+        }
+
+        WHEN("reading the table of contents")
+        {
+            const PtFormatFile file(path);
+
+            THEN("it contains every section, aligned and within the file")
+            {
+                REQUIRE(file.sections().size() == 14);
+                for (const PtFormatSectionEntry& entry : file.sections())
+                {
+                    REQUIRE(entry.offset % entry.alignment == 0);
+                    REQUIRE(entry.offset + entry.size <= file.bytes().size());
+                    REQUIRE_NOTHROW(file.validate(entry.section));
+                }
+            }
+
+            THEN("individual sections can be read")
+            {
+                REQUIRE(bytesEqual<BvhNode>(
+                    ptFormat.bvhNodes, file.array<BvhNode>(PtFormatSection::BvhNodes)));
+                REQUIRE(bytesEqual<Positions>(
+                    ptFormat.bvhPositionAttributes,
+                    file.array<Positions>(PtFormatSection::BvhPositionAttributes)));
+
+                const auto indices = file.array<std::uint32_t>(PtFormatSection::VertexIndices);
+                REQUIRE(spansEqual(
+                    ptFormat.modelVertexIndices,
+                    file.slices(PtFormatSection::ModelVertexIndices, indices)));
+
+                const std::vector<Texture> textures =
+                    file.textures(PtFormatSection::BaseColorTextures);
+                REQUIRE(textures == ptFormat.baseColorTextures);
+            }
+
+            THEN("reading a section as the wrong type throws")
+            {
+                REQUIRE_THROWS_WITH(
+                    file.array<VertexAttributes>(PtFormatSection::BvhNodes),
+                    "Invalid PtFormat file: the size of section BvhNodes is not a multiple of 80 "
+                    "bytes.");
+            }
+        }
+
+        WHEN("a byte in a section is corrupted")
+        {
+            std::uint64_t offset = 0;
+            {
+                const PtFormatFile file(path);
+                for (const PtFormatSectionEntry& entry : file.sections())
+                {
+                    if (entry.section == PtFormatSection::VertexIndices)
+                    {
+                        offset = entry.offset;
+                    }
+                }
+            }
+            {
+                std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+                file.seekp(static_cast<std::streamoff>(offset));
+                file.put('\x7f');
+            }
+
+            THEN("validating the section throws")
+            {
+                const PtFormatFile file(path);
+                REQUIRE_NOTHROW(file.validate(PtFormatSection::BvhNodes));
+                REQUIRE_THROWS_WITH(
+                    file.validate(PtFormatSection::VertexIndices),
+                    "Invalid PtFormat file: checksum mismatch in section VertexIndices.");
+            }
+
+            THEN("deserializing throws")
+            {
+                InputFileStream file(path);
+                PtFormat        format;
+                REQUIRE_THROWS_WITH(
+                    deserialize(file, format),
+                    "Invalid PtFormat file: checksum mismatch in section VertexIndices.");
+            }
+        }
+
+        fs::remove(path);
+    }
+
+    GIVEN("A pt format in a buffer stream")
+    {
+        const PtFormat ptFormat = makePtFormat();
+        BufferStream   stream;
+        serialize(stream, ptFormat);
+
+        THEN("deserializing yields the same arrays")
+        {
+            PtFormat format;
+            deserialize(stream, format);
+            REQUIRE(bytesEqual<BvhNode>(ptFormat.bvhNodes, format.bvhNodes));
+            REQUIRE(bytesEqual<VertexAttributes>(
+                ptFormat.triangleVertexAttributes, format.triangleVertexAttributes));
+            REQUIRE(bytesEqual<glm::vec4>(ptFormat.vertexNormals, format.vertexNormals));
+            REQUIRE(spansEqual(ptFormat.modelVertexNormals, format.modelVertexNormals));
+            REQUIRE(spansEqual(ptFormat.modelVertexTexCoords, format.modelVertexTexCoords));
+            REQUIRE(format.modelBaseColorTextureIndices == ptFormat.modelBaseColorTextureIndices);
+            REQUIRE(format.baseColorTextures == ptFormat.baseColorTextures);
+        }
+    }
+}
+
+SCENARIO("Compress the geometry of a PtFormat file", "[pt-format]")
+{
+    GIVEN("a losslessly compressed pt format file")
+    {
+        const PtFormat ptFormat = makePtFormat();
+        const fs::path path = "lossless.pt";
+        {
+            OutputFileStream stream(path);
+            serialize(stream, ptFormat, GeometryCompression::Lossless);
+        }
+
+        WHEN("mapping the file")
+        {
+            const MappedPtFormat mapped(path);
+
+            THEN("the geometry sections are compressed")
+            {
+                for (const PtFormatSectionEntry& entry : mapped.file.sections())
+                {
+                    const bool isModelSection =
+                        entry.section >= PtFormatSection::ModelVertexPositions;
+                    REQUIRE(
+                        entry.encoding ==
+                        (isModelSection ? SectionEncoding::Raw : SectionEncoding::Filtered));
+                }
+            }
+
+            THEN("the arrays are identical to the original")
+            {
+                REQUIRE(bytesEqual<BvhNode>(ptFormat.bvhNodes, mapped.bvhNodes));
+                REQUIRE(bytesEqual<Positions>(
+                    ptFormat.bvhPositionAttributes, mapped.bvhPositionAttributes));
+                REQUIRE(bytesEqual<VertexAttributes>(
+                    ptFormat.triangleVertexAttributes, mapped.triangleVertexAttributes));
+                REQUIRE(bytesEqual<glm::vec4>(ptFormat.vertexNormals, mapped.vertexNormals));
+                REQUIRE(bytesEqual<glm::vec2>(ptFormat.vertexTexCoords, mapped.vertexTexCoords));
+                REQUIRE(bytesEqual<std::uint32_t>(ptFormat.vertexIndices, mapped.vertexIndices));
+                REQUIRE(spansEqual(ptFormat.modelVertexPositions, mapped.modelVertexPositions));
+                REQUIRE(isAligned(mapped.bvhNodes));
+            }
+
+            THEN("the decoded arrays remain valid after moving")
+            {
+                MappedPtFormat original(path);
+                MappedPtFormat moved(std::move(original));
+                REQUIRE(bytesEqual<std::uint32_t>(ptFormat.vertexIndices, moved.vertexIndices));
+            }
+        }
+
+        WHEN("mapping the file while reporting progress")
+        {
+            std::vector<LoadStage> stages;
+            std::vector<float>     fractions;
+            const MappedPtFormat   mapped(
+                path, [&stages, &fractions](const LoadStage stage, const float fraction) -> void {
+                    stages.push_back(stage);
+                    fractions.push_back(fraction);
+                });
+
+            THEN("the fraction of the decoded sections increases to 1")
+            {
+                REQUIRE_FALSE(fractions.empty());
+                REQUIRE(std::ranges::all_of(stages, [](const LoadStage stage) -> bool {
+                    return stage == LoadStage::DecodingSections;
+                }));
+                REQUIRE(std::ranges::is_sorted(fractions));
+                REQUIRE(fractions.back() == 1.0f);
+            }
+        }
+
+        WHEN("deserializing the file from a stream")
+        {
+            PtFormat format;
+            {
+                InputFileStream stream(path);
+                deserialize(stream, format);
+            }
+
+            THEN("the arrays are identical to the original")
+            {
+                REQUIRE(bytesEqual<BvhNode>(ptFormat.bvhNodes, format.bvhNodes));
+                REQUIRE(bytesEqual<PositionAttribute>(
+                    ptFormat.trianglePositionAttributes, format.trianglePositionAttributes));
+                REQUIRE(bytesEqual<glm::vec4>(ptFormat.vertexPositions, format.vertexPositions));
+                REQUIRE(spansEqual(ptFormat.modelVertexIndices, format.modelVertexIndices));
+                REQUIRE(format.baseColorTextures == ptFormat.baseColorTextures);
+            }
+        }
+
+        fs::remove(path);
+    }
+
+    GIVEN("a lossy compressed pt format in a buffer stream")
+    {
+        PtFormat ptFormat = makePtFormat();
+        ptFormat.vertexNormals = {
+            glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+            glm::vec4(0.0f, -1.0f, 0.0f, 0.0f),
+            glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+            glm::vec4(0.0f, 0.0f, -1.0f, 0.0f),
+            glm::vec4(0.6f, 0.0f, -0.8f, 0.0f)};
+        BufferStream stream;
+        serialize(stream, ptFormat, GeometryCompression::Lossy);
+
+        THEN("positions and indices are exact, and normals and texture coordinates are close")
+        {
+            PtFormat format;
+            deserialize(stream, format);
+            REQUIRE(bytesEqual<BvhNode>(ptFormat.bvhNodes, format.bvhNodes));
+            REQUIRE(bytesEqual<Positions>(
+                ptFormat.bvhPositionAttributes, format.bvhPositionAttributes));
+            REQUIRE(bytesEqual<glm::vec4>(ptFormat.vertexPositions, format.vertexPositions));
+            REQUIRE(format.vertexIndices == ptFormat.vertexIndices);
+            REQUIRE(format.vertexNormals.size() == ptFormat.vertexNormals.size());
+            for (std::size_t i = 0; i < format.vertexNormals.size(); ++i)
+            {
+                REQUIRE(glm::length(format.vertexNormals[i] - ptFormat.vertexNormals[i]) < 1e-4f);
+                REQUIRE(
+                    glm::length(format.vertexTexCoords[i] - ptFormat.vertexTexCoords[i]) < 1e-3f);
+            }
+            for (std::size_t i = 0; i < format.triangleVertexAttributes.size(); ++i)
+            {
+                REQUIRE(
+                    format.triangleVertexAttributes[i].textureIdx ==
+                    ptFormat.triangleVertexAttributes[i].textureIdx);
+            }
+        }
+    }
+}
+
+SCENARIO("Block compress the textures of a PtFormat file", "[pt-format]")
+{
+    GIVEN("a pt format file with BC7 compressed textures")
+    {
+        PtFormat ptFormat = makePtFormat();
+        {
+            ThreadPool threadPool(1);
+            for (const Texture& texture : ptFormat.baseColorTextures)
+            {
+                ptFormat.compressedBaseColorTextures.push_back(compressTexture(
+                    texture, TextureCompression::Bc7, TextureCompressionQuality::Fast, threadPool));
+            }
+        }
+        const fs::path path = "bc7.pt";
+        {
+            OutputFileStream stream(path);
+            serialize(stream, ptFormat);
+        }
+
+        WHEN("mapping the file while reporting progress")
+        {
+            std::vector<float>   fractions;
+            const MappedPtFormat mapped(
+                path, [&fractions](const LoadStage stage, const float fraction) -> void {
+                    if (stage == LoadStage::DecompressingTextures)
+                    {
+                        fractions.push_back(fraction);
+                    }
+                });
+
+            THEN("the fraction of the decompressed textures increases to 1")
+            {
+                REQUIRE(fractions.size() == ptFormat.compressedBaseColorTextures.size());
+                REQUIRE(std::ranges::is_sorted(fractions));
+                REQUIRE(fractions.back() == 1.0f);
+            }
+        }
+
+        WHEN("mapping the file")
+        {
+            const MappedPtFormat mapped(path);
+
+            THEN("only the compressed texture section is stored")
+            {
+                REQUIRE(mapped.file.hasSection(PtFormatSection::CompressedBaseColorTextures));
+                REQUIRE_FALSE(mapped.file.hasSection(PtFormatSection::BaseColorTextures));
+            }
+
+            THEN("the compressed textures refer to the mapping, and are decompressed")
+            {
+                REQUIRE(
+                    mapped.compressedBaseColorTextures.size() ==
+                    ptFormat.compressedBaseColorTextures.size());
+                REQUIRE(mapped.baseColorTextures.size() == ptFormat.baseColorTextures.size());
+                const std::span<const std::byte> bytes = mapped.file.bytes();
+                for (std::size_t i = 0; i < mapped.compressedBaseColorTextures.size(); ++i)
+                {
+                    const CompressedTexture& texture = mapped.compressedBaseColorTextures[i];
+                    REQUIRE(texture == ptFormat.compressedBaseColorTextures[i]);
+                    const auto* const begin =
+                        reinterpret_cast<const std::byte*>(texture.mipChain().data());
+                    REQUIRE(begin >= bytes.data());
+                    REQUIRE(begin + texture.mipChain().size() <= bytes.data() + bytes.size());
+                    REQUIRE(mapped.baseColorTextures[i] == texture.decompress());
+                }
+            }
+        }
+
+        WHEN("deserializing the file from a stream")
+        {
+            PtFormat format;
+            {
+                InputFileStream stream(path);
+                deserialize(stream, format);
+            }
+
+            THEN("the compressed textures are identical, and are decompressed")
+            {
+                REQUIRE(format.compressedBaseColorTextures == ptFormat.compressedBaseColorTextures);
+                REQUIRE(format.baseColorTextures.size() == ptFormat.baseColorTextures.size());
+                for (std::size_t i = 0; i < format.baseColorTextures.size(); ++i)
+                {
+                    REQUIRE(
+                        format.baseColorTextures[i] ==
+                        ptFormat.compressedBaseColorTextures[i].decompress());
+                }
+            }
+        }
+
+        fs::remove(path);
+    }
+}
+
+SCENARIO("Page the textures of a PtFormat file", "[pt-format]")
+{
+    GIVEN("a pt format file with paged textures")
+    {
+        PtFormat ptFormat = makePtFormat();
+        {
+            ThreadPool threadPool(1);
+            ptFormat.pagedBaseColorTextures = pageTextures(ptFormat.baseColorTextures, threadPool);
+        }
+        const fs::path path = "paged.pt";
+        {
+            OutputFileStream stream(path);
+            serialize(stream, ptFormat);
+        }
+
+        WHEN("mapping the file")
+        {
+            const MappedPtFormat mapped(path);
+
+            THEN("only the paged texture section is stored, and the pages refer to the mapping")
+            {
+                REQUIRE(mapped.file.hasSection(PtFormatSection::PagedBaseColorTextures));
+                REQUIRE_FALSE(mapped.file.hasSection(PtFormatSection::BaseColorTextures));
+                REQUIRE(mapped.baseColorTextures.empty());
+
+                const VirtualTexturePages pages = mapped.pagedBaseColorTextures;
+                REQUIRE(std::ranges::equal(
+                    std::as_bytes(pages.descriptors),
+                    std::as_bytes(std::span(ptFormat.pagedBaseColorTextures.descriptors))));
+                REQUIRE(std::ranges::equal(pages.pages, ptFormat.pagedBaseColorTextures.pages));
+                const std::span<const std::byte> bytes = mapped.file.bytes();
+                const auto* const begin = reinterpret_cast<const std::byte*>(pages.pages.data());
+                REQUIRE(begin >= bytes.data());
+                REQUIRE(begin + pages.pages.size_bytes() <= bytes.data() + bytes.size());
+            }
+        }
+
+        WHEN("deserializing the file from a stream")
+        {
+            PtFormat format;
+            {
+                InputFileStream stream(path);
+                deserialize(stream, format);
+            }
+
+            THEN("the pages are identical, and are reassembled into the textures")
+            {
+                REQUIRE(
+                    format.pagedBaseColorTextures.pages == ptFormat.pagedBaseColorTextures.pages);
+                REQUIRE(format.baseColorTextures.size() == ptFormat.baseColorTextures.size());
+                for (std::size_t i = 0; i < format.baseColorTextures.size(); ++i)
+                {
+                    REQUIRE(
+                        format.baseColorTextures[i] ==
+                        ptFormat.baseColorTextures[i].withChannelOrder(
+                            Texture::ChannelOrder::Bgra));
+                }
+            }
+        }
+
+        WHEN("a descriptor refers to pages outside of the section")
+        {
+            ptFormat.pagedBaseColorTextures.descriptors[0].firstPage += 1;
+            {
+                OutputFileStream stream(path);
+                serialize(stream, ptFormat);
+            }
+
+            THEN("mapping the file throws")
+            {
+                REQUIRE_THROWS_AS(MappedPtFormat(path), std::runtime_error);
+            }
+        }
+
+        fs::remove(path);
+    }
+}
+
+SCENARIO("Deserialize a PtFormat file on several threads", "[pt-format]")
+{
+    GIVEN("a compressed pt format with sections larger than a checksum chunk")
+    {
+        PtFormat ptFormat = makePtFormat();
+        ptFormat.vertexIndices.resize(1 << 19);
+        for (std::size_t i = 0; i < ptFormat.vertexIndices.size(); ++i)
+        {
+            ptFormat.vertexIndices[i] = static_cast<std::uint32_t>(i * 7 % 1031);
+        }
+        ptFormat.modelVertexIndices = {std::span<const std::uint32_t>(ptFormat.vertexIndices)};
+        std::vector<Texture::BgraPixel> pixels(1024 * 1024);
+        for (std::size_t i = 0; i < pixels.size(); ++i)
+        {
+            pixels[i] = static_cast<Texture::BgraPixel>(i * 2654435761u);
+        }
+        ptFormat.baseColorTextures.push_back(
+            Texture(std::move(pixels), Texture::Dimensions{1024, 1024}));
+
+        BufferStream stream;
+        serialize(stream, ptFormat, GeometryCompression::Lossless);
+        std::string bytes;
+        {
+            char        buffer[4096];
+            std::size_t numRead = 0;
+            while ((numRead = stream.read(buffer, sizeof(buffer))) > 0)
+            {
+                bytes.append(buffer, numRead);
+            }
+        }
+
+        const auto deserializeBytes = [](const std::string& data, const std::uint32_t numThreads) {
+            BufferStream dataStream;
+            dataStream.write(data.data(), data.size());
+            PtFormat format;
+            deserialize(dataStream, format, numThreads);
+            return format;
+        };
+
+        THEN("deserializing on one and on several threads yields identical arrays")
+        {
+            const PtFormat serial = deserializeBytes(bytes, 1);
+            const PtFormat parallel = deserializeBytes(bytes, 4);
+            REQUIRE(bytesEqual<BvhNode>(serial.bvhNodes, parallel.bvhNodes));
+            REQUIRE(bytesEqual<VertexAttributes>(
+                serial.triangleVertexAttributes, parallel.triangleVertexAttributes));
+            REQUIRE(serial.vertexIndices == ptFormat.vertexIndices);
+            REQUIRE(parallel.vertexIndices == ptFormat.vertexIndices);
+            REQUIRE(spansEqual(serial.modelVertexIndices, parallel.modelVertexIndices));
+            REQUIRE(serial.baseColorTextures == ptFormat.baseColorTextures);
+            REQUIRE(parallel.baseColorTextures == ptFormat.baseColorTextures);
+        }
+
+        THEN("a corrupt byte in the texture is detected on several threads")
+        {
+            bytes[1 << 21] ^= 1;
+            REQUIRE_THROWS_WITH(
+                deserializeBytes(bytes, 4),
+                "Invalid PtFormat file: checksum mismatch in section BaseColorTextures.");
+        }
+    }
+}
+
+SCENARIO("Convert a glTF model to a PtFormat file section by section", "[pt-format]")
+{
+    GIVEN("a glTF model")
+    {
+        const auto isIdenticalToSerialized = [](const GeometryCompression compression) -> bool {
+            const fs::path convertedPath = "converted.pt";
+            const fs::path serializedPath = "serialized.pt";
+            convertGltf(makeGltfModel(), convertedPath, {.compression = compression});
+            {
+                OutputFileStream file(serializedPath);
+                serialize(file, PtFormat(makeGltfModel()), compression);
+            }
+            const bool isIdentical = readFile(convertedPath) == readFile(serializedPath);
+            fs::remove(convertedPath);
+            fs::remove(serializedPath);
+            return isIdentical;
+        };
+
+        THEN("converting the model yields the same file as serializing a PtFormat")
+        {
+            REQUIRE(isIdenticalToSerialized(GeometryCompression::None));
+        }
+
+        THEN("converting with compression yields the same file as serializing a PtFormat")
+        {
+            REQUIRE(isIdenticalToSerialized(GeometryCompression::Lossy));
+        }
+
+        THEN("converting with virtual textures yields the same file as serializing their pages")
+        {
+            const fs::path convertedPath = "converted-paged.pt";
+            const fs::path serializedPath = "serialized-paged.pt";
+            convertGltf(makeGltfModel(), convertedPath, {.virtualTextures = true});
+            {
+                PtFormat   format(makeGltfModel());
+                ThreadPool threadPool(1);
+                format.pagedBaseColorTextures = pageTextures(format.baseColorTextures, threadPool);
+                OutputFileStream file(serializedPath);
+                serialize(file, format);
+            }
+            REQUIRE(readFile(convertedPath) == readFile(serializedPath));
+            fs::remove(convertedPath);
+            fs::remove(serializedPath);
+        }
+    }
+
+    GIVEN("a conversion cache")
+    {
+        const fs::path        cacheDir = "conversion-cache";
+        const ConversionCache cache(cacheDir);
+        const auto            convert = [&cache](const fs::path& path) -> void {
+            convertGltf(makeGltfModel(), path, {.cache = &cache});
+        };
+
+        WHEN("converting the model twice")
+        {
+            convert("cold.pt");
+            const auto numEntries = std::distance(
+                fs::directory_iterator(cacheDir), fs::directory_iterator());
+            convert("warm.pt");
+
+            THEN("the BVH is cached, and both files are identical to an uncached conversion")
+            {
+                convertGltf(makeGltfModel(), "uncached.pt");
+                REQUIRE(numEntries == 1);
+                REQUIRE(readFile("cold.pt") == readFile("uncached.pt"));
+                REQUIRE(readFile("warm.pt") == readFile("uncached.pt"));
+                fs::remove("uncached.pt");
+            }
+
+            fs::remove("cold.pt");
+            fs::remove("warm.pt");
+        }
+
+        fs::remove_all(cacheDir);
+    }
+
+    GIVEN("a section written in pieces")
+    {
+        const fs::path             path = "pieces.pt";
+        std::vector<std::uint32_t> indices(100'000);
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            indices[i] = static_cast<std::uint32_t>(i * 7 % 1031);
+        }
+        {
+            PtFormatFileWriter writer(path, 2, GeometryCompression::Lossless);
+            writer.writeArray<std::uint32_t>(PtFormatSection::ModelBaseColorTextureIndices, {});
+            writer.beginSection(PtFormatSection::VertexIndices, sizeof(std::uint32_t));
+            for (std::size_t i = 0; i < indices.size(); i += 30'000)
+            {
+                const std::size_t count = std::min<std::size_t>(30'000, indices.size() - i);
+                writer.append(std::as_bytes(std::span(indices).subspan(i, count)));
+            }
+            writer.endSection();
+            writer.finish();
+        }
+
+        THEN("reading the section yields the concatenated pieces")
+        {
+            const PtFormatFile file(path);
+            REQUIRE(file.sections().size() == 2);
+            REQUIRE(file.sections()[1].encoding == SectionEncoding::Filtered);
+            REQUIRE_NOTHROW(file.validate(PtFormatSection::VertexIndices));
+            REQUIRE(bytesEqual<std::uint32_t>(
+                file.array<std::uint32_t>(PtFormatSection::VertexIndices), indices));
+            REQUIRE(file.array<std::uint32_t>(PtFormatSection::ModelBaseColorTextureIndices)
+                        .empty());
+        }
+
+        fs::remove(path);
+    }
+}
+
+SCENARIO("Record the source hash of a converted glTF file", "[pt-format]")
+{
+    GIVEN("a glTF file converted to a pt format file")
+    {
+        const fs::path ptPath = "Duck.pt";
+        convertGltf("Duck.glb", ptPath);
+
+        THEN("the file contains the source hash of the glTF file")
+        {
+            const std::uint64_t hash = gltfSourceHash("Duck.glb", ConversionOptions{});
+            REQUIRE(readSourceHash(ptPath) == hash);
+            REQUIRE(gltfSourceHash("Duck.glb", ConversionOptions{}) == hash);
+            REQUIRE(
+                gltfSourceHash(
+                    "Duck.glb", ConversionOptions{.compression = GeometryCompression::Lossy}) !=
+                hash);
+            REQUIRE(
+                gltfSourceHash(
+                    "Duck.glb",
+                    ConversionOptions{.textureCompression = TextureCompression::Bc7}) != hash);
+            REQUIRE(
+                gltfSourceHash("Duck.glb", ConversionOptions{.virtualTextures = true}) != hash);
+        }
+
+        THEN("a file without a source hash has none")
+        {
+            {
+                OutputFileStream file(ptPath);
+                serialize(file, makePtFormat());
+            }
+            REQUIRE_FALSE(readSourceHash(ptPath).has_value());
+        }
+
+        THEN("a file which does not exist has no source hash")
+        {
+            REQUIRE_FALSE(readSourceHash("missing.pt").has_value());
+        }
+
+        fs::remove(ptPath);
+    }
+}
+
 SCENARIO("invalid magic bytes", "[pt-format]")
 {
     GIVEN("mismatching magic bytes")
@@ -192,7 +1102,7 @@ SCENARIO("invalid magic bytes", "[pt-format]")
             REQUIRE_THROWS_WITH(
                 deserialize(stream, format),
                 "Mismatching PtFormat file version. Invalid version in magic bytes: expected "
-                "'PTFORMAT3', got 'PTFORMAT0'.");
+                "'PTFORMAT8', got 'PTFORMAT0'.");
         }
     }
 
@@ -211,3 +1121,41 @@ SCENARIO("invalid magic bytes", "[pt-format]")
         }
     }
 }
+
+TEST_CASE("PtFormat file throughput", "[pt-format][.benchmark]")
+{
+    std::vector<GltfMesh> meshes;
+    meshes.push_back(makeGridMesh(512, 0));
+    std::vector<Texture> textures;
+    textures.push_back(Texture::fromPixel(0.25f, 0.5f, 0.75f, 1.0f));
+    const PtFormat ptFormat(GltfModel(std::move(meshes), std::move(textures)));
+    const fs::path path = "throughput.pt";
+
+    BENCHMARK("save with OutputFileStream")
+    {
+        OutputFileStream file(path);
+        serialize(file, ptFormat);
+        file.close();
+    };
+    BENCHMARK("save with std::ofstream")
+    {
+        StdOutputFileStream file(path);
+        serialize(file, ptFormat);
+    };
+    BENCHMARK("load with InputFileStream")
+    {
+        InputFileStream file(path, FileStreamOptions{.numThreads = 4});
+        PtFormat        format;
+        deserialize(file, format);
+        return format.vertexIndices.size();
+    };
+    BENCHMARK("load with std::ifstream")
+    {
+        StdInputFileStream file(path);
+        PtFormat           format;
+        deserialize(file, format);
+        return format.vertexIndices.size();
+    };
+
+    fs::remove(path);
+}
@@ -8,11 +8,90 @@
 #include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <filesystem>
+#include <span>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 using namespace nlrs;
 namespace fs = std::filesystem;
 
+namespace
+{
+// The std::stringstream based implementation which BufferStream replaced, for comparison.
+class StringBufferStream : public InputStream, public OutputStream
+{
+public:
+    std::size_t read(char* data, std::size_t numBytes) override
+    {
+        mStream.read(data, static_cast<std::streamsize>(numBytes));
+        return static_cast<std::size_t>(mStream.gcount());
+    }
+
+    void write(const char* data, std::size_t numBytes) override
+    {
+        mStream.write(data, static_cast<std::streamsize>(numBytes));
+    }
+
+private:
+    std::stringstream mStream;
+};
+
+// Writes `data` in pieces of `pieceSize` bytes, and reads it back in the same pieces.
+template<typename Stream>
+std::size_t writeAndRead(const std::vector<char>& data, const std::size_t pieceSize)
+{
+    Stream            stream;
+    std::vector<char> buffer(pieceSize);
+    std::size_t       numRead = 0;
+    for (std::size_t offset = 0; offset < data.size(); offset += pieceSize)
+    {
+        stream.write(data.data() + offset, std::min(pieceSize, data.size() - offset));
+    }
+    while (const std::size_t n = stream.read(buffer.data(), buffer.size()))
+    {
+        numRead += n;
+    }
+    return numRead;
+}
+
+// Sizes which are smaller than, larger than, and not multiples of a block.
+constexpr std::size_t PIECE_SIZES[] = {1, 100, 40'000, 7, 16'384, 3};
+
+void writeInPieces(OutputStream& stream, const std::vector<char>& data)
+{
+    for (std::size_t offset = 0, i = 0; offset < data.size(); ++i)
+    {
+        const std::size_t size =
+            std::min(PIECE_SIZES[i % std::size(PIECE_SIZES)], data.size() - offset);
+        stream.write(data.data() + offset, size);
+        offset += size;
+    }
+}
+
+std::vector<char> readInPieces(InputStream& stream)
+{
+    std::vector<char> data;
+    for (std::size_t i = 0;; ++i)
+    {
+        const std::size_t size = PIECE_SIZES[(i + 2) % std::size(PIECE_SIZES)];
+        const std::size_t offset = data.size();
+        data.resize(offset + size);
+        const std::size_t numRead = stream.read(data.data() + offset, size);
+        data.resize(offset + numRead);
+        if (numRead < size)
+        {
+            return data;
+        }
+    }
+}
+} // namespace
+
 void serialize(OutputStream& ostream, const Bvh& bvh)
 {
     {
@@ -120,3 +199,193 @@ SCENARIO("Serialize and deserialize a bvh", "[stream]")
         }
     }
 }
+
+SCENARIO("Read and write files in blocks", "[stream]")
+{
+    const fs::path    path = fs::current_path() / fs::path("blocks.testbin");
+    std::vector<char> data(20 * 4096 + 123);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i * 2654435761u >> 24);
+    }
+
+    GIVEN("a file written in uneven pieces")
+    {
+        {
+            OutputFileStream file(path, FileStreamOptions{.blockSize = 16'384});
+            writeInPieces(file, data);
+            file.close();
+        }
+        REQUIRE(fs::file_size(path) == data.size());
+
+        THEN("reading it in uneven pieces yields the written bytes")
+        {
+            InputFileStream file(path, FileStreamOptions{.blockSize = 8192});
+            REQUIRE(readInPieces(file) == data);
+            char byte;
+            REQUIRE(file.read(&byte, 1) == 0);
+        }
+
+        THEN("reading it at once on several threads yields the written bytes")
+        {
+            InputFileStream   file(path, FileStreamOptions{.blockSize = 4096, .numThreads = 4});
+            std::vector<char> bytes(data.size() + 1);
+            REQUIRE(file.read(bytes.data(), bytes.size()) == data.size());
+            bytes.pop_back();
+            REQUIRE(bytes == data);
+        }
+    }
+
+    GIVEN("a file written with direct I/O")
+    {
+        const FileStreamOptions options{.blockSize = 16'384, .directIo = true, .numThreads = 2};
+        {
+            OutputFileStream file(path, options);
+            writeInPieces(file, data);
+        }
+        REQUIRE(fs::file_size(path) == data.size());
+
+        THEN("reading it with direct I/O yields the written bytes")
+        {
+            InputFileStream file(path, options);
+            REQUIRE(readInPieces(file) == data);
+        }
+    }
+
+    GIVEN("bytes which are overwritten after the rest of the file has been written")
+    {
+        const std::vector<char> header(100, 'h');
+        std::vector<char>       expected = data;
+        std::copy(header.begin(), header.end(), expected.begin() + 8000);
+        std::copy(header.begin(), header.end(), expected.end() - header.size());
+
+        const auto writeFile = [&](const FileStreamOptions options) -> void {
+            OutputFileStream file(path, options);
+            writeInPieces(file, data);
+            // The first bytes are already in the file, and the last bytes still in the buffer.
+            file.overwrite(8000, header.data(), header.size());
+            file.overwrite(data.size() - header.size(), header.data(), header.size());
+            file.close();
+        };
+
+        THEN("reading the file yields the overwritten bytes")
+        {
+            writeFile(FileStreamOptions{.blockSize = 16'384});
+            InputFileStream file(path);
+            REQUIRE(readInPieces(file) == expected);
+        }
+
+        THEN("with direct I/O, reading the file yields the overwritten bytes")
+        {
+            writeFile(FileStreamOptions{.blockSize = 16'384, .directIo = true});
+            InputFileStream file(path);
+            REQUIRE(readInPieces(file) == expected);
+        }
+    }
+
+    GIVEN("a file which does not exist")
+    {
+        THEN("opening it throws")
+        {
+            REQUIRE_THROWS_WITH(
+                InputFileStream(fs::current_path() / fs::path("missing.testbin")),
+                "Failed to open file: " +
+                    (fs::current_path() / fs::path("missing.testbin")).string());
+        }
+    }
+
+    fs::remove(path);
+}
+
+SCENARIO("Read and write a BufferStream", "[stream]")
+{
+    GIVEN("a buffer stream with some bytes written to it")
+    {
+        const std::vector<char> data{'a', 'b', 'c', 'd', 'e', 'f', 'g'};
+        BufferStream            stream;
+        stream.write(data.data(), 3);
+        stream.write(data.data() + 3, data.size() - 3);
+        REQUIRE(stream.numUnreadBytes() == data.size());
+
+        THEN("reading returns the bytes in order, and then returns zero bytes")
+        {
+            std::vector<char> bytes(5);
+            REQUIRE(stream.read(bytes.data(), bytes.size()) == 5);
+            REQUIRE(std::equal(bytes.begin(), bytes.end(), data.begin()));
+            REQUIRE(stream.read(bytes.data(), bytes.size()) == 2);
+            REQUIRE(bytes[0] == 'f');
+            REQUIRE(bytes[1] == 'g');
+            REQUIRE(stream.read(bytes.data(), bytes.size()) == 0);
+        }
+
+        THEN("readSpan returns the unread bytes in place")
+        {
+            const std::byte* const unread = stream.unreadBytes().data();
+            const std::span<const std::byte> first = stream.readSpan(2);
+            REQUIRE(first.data() == unread);
+            REQUIRE(first.size() == 2);
+            REQUIRE(stream.unreadBytes().data() == unread + 2);
+
+            const std::span<const std::byte> rest = stream.readSpan(100);
+            REQUIRE(rest.size() == data.size() - 2);
+            REQUIRE(static_cast<char>(rest[0]) == 'c');
+            REQUIRE(stream.numUnreadBytes() == 0);
+        }
+
+        THEN("releasing the buffer returns the unread bytes and leaves the stream empty")
+        {
+            char first;
+            stream.read(&first, 1);
+            const std::vector<std::byte> bytes = stream.release();
+            REQUIRE(bytes.size() == data.size() - 1);
+            REQUIRE(static_cast<char>(bytes.front()) == 'b');
+            REQUIRE(stream.numUnreadBytes() == 0);
+
+            AND_THEN("a stream adopting the bytes reads them back")
+            {
+                BufferStream      adopted(std::move(bytes));
+                std::vector<char> read(data.size());
+                REQUIRE(adopted.read(read.data(), read.size()) == data.size() - 1);
+                REQUIRE(read[0] == 'b');
+            }
+        }
+    }
+
+    GIVEN("a buffer stream with reserved capacity")
+    {
+        BufferStream stream;
+        stream.reserve(1024);
+        REQUIRE(stream.capacity() >= 1024);
+
+        THEN("writing within the capacity does not move the buffer")
+        {
+            const std::vector<char> data(1024, 'x');
+            stream.write(data.data(), 1);
+            const std::byte* const begin = stream.unreadBytes().data();
+            stream.write(data.data(), data.size() - 1);
+            REQUIRE(stream.unreadBytes().data() == begin);
+            REQUIRE(stream.numUnreadBytes() == data.size());
+        }
+    }
+}
+
+TEST_CASE("BufferStream throughput", "[stream][.benchmark]")
+{
+    std::vector<char> data(16 << 20);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i * 2654435761u >> 24);
+    }
+
+    for (const std::size_t pieceSize : {std::size_t(64), std::size_t(64 << 10)})
+    {
+        BENCHMARK("BufferStream, " + std::to_string(pieceSize) + " byte pieces")
+        {
+            return writeAndRead<BufferStream>(data, pieceSize);
+        };
+        BENCHMARK("std::stringstream, " + std::to_string(pieceSize) + " byte pieces")
+        {
+            return writeAndRead<StringBufferStream>(data, pieceSize);
+        };
+    }
+}
@@ -0,0 +1,47 @@
+#include <common/texel_layout.hpp>
+#include <common/texture.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace nlrs;
+
+SCENARIO("Tiled texel indices", "[texel-layout]")
+{
+    GIVEN("an image whose dimensions are not multiples of the tile size")
+    {
+        const Texture::Dimensions dimensions{21, 10};
+        const std::size_t         size = texelLayoutSize(TexelLayout::Tiled, dimensions);
+
+        THEN("the image is padded to whole tiles")
+        {
+            REQUIRE(size == 3 * 2 * TEXEL_TILE_SIZE * TEXEL_TILE_SIZE);
+        }
+
+        THEN("every texel has a distinct index within the padded image")
+        {
+            std::vector<bool> used(size, false);
+            for (std::uint32_t y = 0; y < dimensions.height; ++y)
+            {
+                for (std::uint32_t x = 0; x < dimensions.width; ++x)
+                {
+                    const std::size_t idx = texelIndex(TexelLayout::Tiled, dimensions, x, y);
+                    REQUIRE(idx < size);
+                    REQUIRE(!used[idx]);
+                    used[idx] = true;
+                }
+            }
+        }
+
+        THEN("the texels of a 2x2 block are adjacent")
+        {
+            REQUIRE(texelIndex(TexelLayout::Tiled, dimensions, 2, 4) == 36);
+            REQUIRE(texelIndex(TexelLayout::Tiled, dimensions, 3, 4) == 37);
+            REQUIRE(texelIndex(TexelLayout::Tiled, dimensions, 2, 5) == 38);
+            REQUIRE(texelIndex(TexelLayout::Tiled, dimensions, 3, 5) == 39);
+        }
+    }
+}
@@ -0,0 +1,410 @@
+#include <common/texture.hpp>
+#include <common/texture_sampling.hpp>
+#include <common/thread_pool.hpp>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <thread>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// An RGBA image with every channel varying, including alpha.
+std::vector<std::uint32_t> makeRgbaPixels(const std::uint32_t width, const std::uint32_t height)
+{
+    std::vector<std::uint32_t> pixels;
+    for (std::uint32_t i = 0; i < width * height; ++i)
+    {
+        pixels.push_back(i * 2654435761u);
+    }
+    return pixels;
+}
+
+std::vector<std::uint8_t> encodePng(
+    const std::vector<std::uint32_t>& rgbaPixels,
+    const std::uint32_t               width,
+    const std::uint32_t               height)
+{
+    std::vector<std::uint8_t> png;
+    const int                 result = stbi_write_png_to_func(
+        [](void* const context, void* const data, const int size) {
+            const auto* const bytes = static_cast<const std::uint8_t*>(data);
+            static_cast<std::vector<std::uint8_t>*>(context)->insert(
+                static_cast<std::vector<std::uint8_t>*>(context)->end(), bytes, bytes + size);
+        },
+        &png,
+        static_cast<int>(width),
+        static_cast<int>(height),
+        4,
+        rgbaPixels.data(),
+        static_cast<int>(width * 4));
+    REQUIRE(result != 0);
+    return png;
+}
+
+std::uint32_t rgbaToOpaqueBgra(const std::uint32_t px)
+{
+    const std::uint32_t r = px & 0xffu;
+    const std::uint32_t g = (px >> 8) & 0xffu;
+    const std::uint32_t b = (px >> 16) & 0xffu;
+    return b | (g << 8) | (r << 16) | (255u << 24);
+}
+
+// Texture::fromMemory before the pixels were converted in place: stb_image's pixels are copied and
+// converted to BGRA one pixel at a time.
+Texture fromMemoryByCopy(const std::span<const std::uint8_t> data)
+{
+    int                  width;
+    int                  height;
+    int                  sourceChannels;
+    unsigned char* const pixelPtr = stbi_load_from_memory(
+        data.data(), static_cast<int>(data.size()), &width, &height, &sourceChannels, 4);
+
+    const auto numPixels = static_cast<std::size_t>(width * height);
+    const auto pixelData =
+        std::span<const std::uint32_t>(reinterpret_cast<const std::uint32_t*>(pixelPtr), numPixels);
+    std::vector<Texture::BgraPixel> pixels;
+    pixels.reserve(numPixels);
+    std::transform(
+        pixelData.begin(), pixelData.end(), std::back_inserter(pixels), rgbaToOpaqueBgra);
+
+    stbi_image_free(pixelPtr);
+
+    return Texture(
+        std::move(pixels),
+        Texture::Dimensions{static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)});
+}
+// Builds a mip chain with the samplers' gamma curve in double precision, with each level stored as
+// four linear channels per pixel.
+std::vector<std::vector<std::array<double, 4>>> referenceMipChain(const Texture& texture)
+{
+    const auto toLinear = [](const double c) { return std::pow(c, double{SRGB_GAMMA}); };
+
+    std::vector<std::vector<std::array<double, 4>>> levels(1);
+    for (const std::uint32_t px : texture.pixels())
+    {
+        levels[0].push_back(std::array<double, 4>{
+            toLinear(static_cast<double>(px & 0xffu) / 255.0),
+            toLinear(static_cast<double>((px >> 8) & 0xffu) / 255.0),
+            toLinear(static_cast<double>((px >> 16) & 0xffu) / 255.0),
+            static_cast<double>(px >> 24) / 255.0});
+    }
+
+    for (std::uint32_t level = 1; level < Texture::maxMipLevels(texture.dimensions()); ++level)
+    {
+        const Texture::Dimensions          src = texture.mipLevelDimensions(level - 1);
+        const Texture::Dimensions          dst = texture.mipLevelDimensions(level);
+        const auto&                        srcPixels = levels[level - 1];
+        std::vector<std::array<double, 4>> dstPixels;
+        for (std::uint32_t y = 0; y < dst.height; ++y)
+        {
+            for (std::uint32_t x = 0; x < dst.width; ++x)
+            {
+                // The last pixel of a row or column also covers the last source pixel of an odd
+                // sized source.
+                const std::uint32_t   xEnd = x + 1 == dst.width ? src.width : 2 * x + 2;
+                const std::uint32_t   yEnd = y + 1 == dst.height ? src.height : 2 * y + 2;
+                std::array<double, 4> average{};
+                for (std::uint32_t sy = 2 * y; sy < yEnd; ++sy)
+                {
+                    for (std::uint32_t sx = 2 * x; sx < xEnd; ++sx)
+                    {
+                        for (std::size_t c = 0; c < 4; ++c)
+                        {
+                            average[c] += srcPixels[sy * src.width + sx][c] /
+                                          static_cast<double>((xEnd - 2 * x) * (yEnd - 2 * y));
+                        }
+                    }
+                }
+                dstPixels.push_back(average);
+            }
+        }
+        levels.push_back(std::move(dstPixels));
+    }
+    return levels;
+}
+
+std::uint32_t encodeSrgb(const std::array<double, 4>& linear)
+{
+    const auto toSrgb = [](const double c) { return std::pow(c, 1.0 / double{SRGB_GAMMA}); };
+    const auto toByte = [](const double c) {
+        return static_cast<std::uint32_t>(std::lround(c * 255.0));
+    };
+    return toByte(toSrgb(linear[0])) | (toByte(toSrgb(linear[1])) << 8) |
+           (toByte(toSrgb(linear[2])) << 16) | (toByte(linear[3]) << 24);
+}
+
+bool channelsWithinOne(const std::uint32_t a, const std::uint32_t b)
+{
+    for (std::uint32_t shift = 0; shift < 32; shift += 8)
+    {
+        const int ca = static_cast<int>((a >> shift) & 0xffu);
+        const int cb = static_cast<int>((b >> shift) & 0xffu);
+        if (std::abs(ca - cb) > 1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+SCENARIO("Decode a texture in either channel order", "[texture]")
+{
+    GIVEN("a PNG image whose size is not a multiple of the vector width")
+    {
+        const std::uint32_t              width = 37;
+        const std::uint32_t              height = 19;
+        const std::vector<std::uint32_t> rgbaPixels = makeRgbaPixels(width, height);
+        const std::vector<std::uint8_t>  png = encodePng(rgbaPixels, width, height);
+
+        WHEN("decoding the image as BGRA")
+        {
+            const Texture texture = Texture::fromMemory(png);
+
+            THEN("the pixels are identical to converting one pixel at a time")
+            {
+                REQUIRE(texture.channelOrder() == Texture::ChannelOrder::Bgra);
+                REQUIRE(texture.dimensions() == Texture::Dimensions{width, height});
+                REQUIRE(texture == fromMemoryByCopy(png));
+            }
+
+            THEN("converting the texture to RGBA yields the opaque source pixels")
+            {
+                const Texture rgba = texture.withChannelOrder(Texture::ChannelOrder::Rgba);
+                REQUIRE(rgba.channelOrder() == Texture::ChannelOrder::Rgba);
+                for (std::size_t i = 0; i < rgbaPixels.size(); ++i)
+                {
+                    REQUIRE(rgba.pixels()[i] == (rgbaPixels[i] | 0xff000000u));
+                }
+            }
+        }
+
+        WHEN("decoding the image as RGBA")
+        {
+            const Texture texture = Texture::fromMemory(png, Texture::ChannelOrder::Rgba);
+
+            THEN("the pixels are the opaque source pixels")
+            {
+                REQUIRE(texture.channelOrder() == Texture::ChannelOrder::Rgba);
+                for (std::size_t i = 0; i < rgbaPixels.size(); ++i)
+                {
+                    REQUIRE(texture.pixels()[i] == (rgbaPixels[i] | 0xff000000u));
+                }
+            }
+
+            THEN("the texture differs from the BGRA texture only in its channel order")
+            {
+                REQUIRE(texture != Texture::fromMemory(png));
+                REQUIRE(
+                    texture.withChannelOrder(Texture::ChannelOrder::Bgra) ==
+                    Texture::fromMemory(png));
+            }
+        }
+    }
+}
+
+SCENARIO("Swizzle pixels in place", "[texture]")
+{
+    GIVEN("pixel arrays of every length up to several vector widths")
+    {
+        for (std::uint32_t count = 0; count < 20; ++count)
+        {
+            const std::vector<std::uint32_t> rgbaPixels = makeRgbaPixels(count, 1);
+
+            THEN("swapping red and blue, and making the pixels opaque, matches the scalar code")
+            {
+                std::vector<std::uint32_t> pixels = rgbaPixels;
+                swizzlePixels(
+                    pixels, Texture::ChannelOrder::Rgba, Texture::ChannelOrder::Bgra, true);
+                for (std::size_t i = 0; i < pixels.size(); ++i)
+                {
+                    REQUIRE(pixels[i] == rgbaToOpaqueBgra(rgbaPixels[i]));
+                }
+            }
+
+            THEN("swapping red and blue twice yields the original pixels")
+            {
+                std::vector<std::uint32_t> pixels = rgbaPixels;
+                swizzlePixels(
+                    pixels, Texture::ChannelOrder::Rgba, Texture::ChannelOrder::Bgra, false);
+                swizzlePixels(
+                    pixels, Texture::ChannelOrder::Bgra, Texture::ChannelOrder::Rgba, false);
+                REQUIRE(pixels == rgbaPixels);
+            }
+        }
+    }
+}
+
+SCENARIO("Generate a mip chain", "[texture]")
+{
+    GIVEN("a texture whose dimensions are odd and not powers of two")
+    {
+        const std::uint32_t width = 37;
+        const std::uint32_t height = 19;
+        const Texture       texture(
+            makeRgbaPixels(width, height), Texture::Dimensions{width, height});
+
+        WHEN("generating the mip chain")
+        {
+            ThreadPool    threadPool(3);
+            const Texture mipmapped = texture.withMipmaps(threadPool);
+
+            THEN("the chain halves the dimensions down to a single pixel")
+            {
+                REQUIRE(mipmapped.numMipLevels() == 6);
+                REQUIRE(mipmapped.mipLevelDimensions(1) == Texture::Dimensions{18, 9});
+                REQUIRE(mipmapped.mipLevelDimensions(3) == Texture::Dimensions{4, 2});
+                REQUIRE(mipmapped.mipLevelDimensions(5) == Texture::Dimensions{1, 1});
+                REQUIRE(
+                    mipmapped.mipChain().size() ==
+                    Texture::mipChainSize(texture.dimensions(), mipmapped.numMipLevels()));
+            }
+
+            THEN("level 0 is the original texture")
+            {
+                REQUIRE(std::ranges::equal(mipmapped.mipLevel(0), texture.pixels()));
+                REQUIRE(std::ranges::equal(mipmapped.pixels(), texture.pixels()));
+                REQUIRE(mipmapped != texture);
+            }
+
+            THEN("each level is within one of averaging in linear space in double precision")
+            {
+                const auto reference = referenceMipChain(texture);
+                for (std::uint32_t level = 1; level < mipmapped.numMipLevels(); ++level)
+                {
+                    const std::span<const std::uint32_t> pixels = mipmapped.mipLevel(level);
+                    REQUIRE(pixels.size() == reference[level].size());
+                    for (std::size_t i = 0; i < pixels.size(); ++i)
+                    {
+                        REQUIRE(channelsWithinOne(pixels[i], encodeSrgb(reference[level][i])));
+                    }
+                }
+            }
+
+            THEN("generating the chain on the calling thread yields an identical texture")
+            {
+                ThreadPool callingThread(0);
+                REQUIRE(texture.withMipmaps(callingThread) == mipmapped);
+            }
+        }
+    }
+
+    GIVEN("a 5x3 texture whose last column and row are white, and whose other pixels are black")
+    {
+        std::vector<std::uint32_t> pixels(5 * 3, 0xff000000u);
+        for (std::uint32_t y = 0; y < 3; ++y)
+        {
+            for (std::uint32_t x = 0; x < 5; ++x)
+            {
+                if (x == 4 || y == 2)
+                {
+                    pixels[y * 5 + x] = 0xffffffffu;
+                }
+            }
+        }
+        const Texture texture(std::move(pixels), Texture::Dimensions{5, 3});
+
+        WHEN("generating the mip chain")
+        {
+            ThreadPool    threadPool(2);
+            const Texture mipmapped = texture.withMipmaps(threadPool);
+
+            THEN("the last column and row are folded into the edge pixels of level 1")
+            {
+                // The 2x1 level averages a 2x3 and a 3x3 footprint, with 2 and 5 white pixels.
+                const auto reference = referenceMipChain(texture);
+                REQUIRE(mipmapped.mipLevelDimensions(1) == Texture::Dimensions{2, 1});
+                REQUIRE(reference[1][0][0] == Catch::Approx(2.0 / 6.0));
+                REQUIRE(reference[1][1][0] == Catch::Approx(5.0 / 9.0));
+                for (std::uint32_t level = 1; level < mipmapped.numMipLevels(); ++level)
+                {
+                    const std::span<const std::uint32_t> levelPixels = mipmapped.mipLevel(level);
+                    for (std::size_t i = 0; i < levelPixels.size(); ++i)
+                    {
+                        REQUIRE(
+                            channelsWithinOne(levelPixels[i], encodeSrgb(reference[level][i])));
+                    }
+                }
+            }
+
+            THEN("generating the chain on the calling thread yields an identical texture")
+            {
+                ThreadPool callingThread(0);
+                REQUIRE(texture.withMipmaps(callingThread) == mipmapped);
+            }
+        }
+    }
+
+    GIVEN("a texture of a constant color")
+    {
+        const Texture texture(
+            std::vector<std::uint32_t>(64 * 16, 0x80ff3c01u), Texture::Dimensions{64, 16});
+
+        THEN("every level has the same color")
+        {
+            ThreadPool    threadPool(2);
+            const Texture mipmapped = texture.withMipmaps(threadPool);
+            REQUIRE(mipmapped.numMipLevels() == 7);
+            REQUIRE(std::ranges::all_of(
+                mipmapped.mipChain(), [](const std::uint32_t px) { return px == 0x80ff3c01u; }));
+        }
+    }
+
+    GIVEN("a single pixel texture")
+    {
+        const Texture texture = Texture::fromPixel(1.0f, 0.5f, 0.25f, 1.0f);
+
+        THEN("the chain consists of level 0 only")
+        {
+            ThreadPool threadPool(1);
+            REQUIRE(texture.withMipmaps(threadPool) == texture);
+        }
+    }
+}
+
+TEST_CASE("Texture decoding throughput", "[texture][.benchmark]")
+{
+    // A smooth image, so that decoding the PNG does not dominate converting the pixels.
+    const std::uint32_t        size = 2048;
+    std::vector<std::uint32_t> rgbaPixels;
+    for (std::uint32_t y = 0; y < size; ++y)
+    {
+        for (std::uint32_t x = 0; x < size; ++x)
+        {
+            rgbaPixels.push_back((x & 0xffu) | ((y & 0xffu) << 8) | (((x + y) & 0xffu) << 16));
+        }
+    }
+    const std::vector<std::uint8_t> png = encodePng(rgbaPixels, size, size);
+
+    BENCHMARK("Texture::fromMemory") { return Texture::fromMemory(png); };
+    BENCHMARK("copy and convert per pixel") { return fromMemoryByCopy(png); };
+}
+
+TEST_CASE("Mip chain generation throughput", "[texture][.benchmark]")
+{
+    const std::uint32_t size = 2048;
+    const Texture       texture(makeRgbaPixels(size, size), Texture::Dimensions{size, size});
+
+    ThreadPool callingThread(0);
+    ThreadPool threadPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+    BENCHMARK("Texture::withMipmaps, calling thread")
+    {
+        return texture.withMipmaps(callingThread);
+    };
+    BENCHMARK("Texture::withMipmaps, thread pool") { return texture.withMipmaps(threadPool); };
+}
@@ -0,0 +1,250 @@
+#include <common/texel_layout.hpp>
+#include <common/texture.hpp>
+#include <common/texture_atlas.hpp>
+#include <common/thread_pool.hpp>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+std::vector<std::uint32_t> makePixels(const std::uint32_t width, const std::uint32_t height)
+{
+    std::vector<std::uint32_t> pixels;
+    for (std::uint32_t i = 0; i < width * height; ++i)
+    {
+        pixels.push_back(i * 2654435761u);
+    }
+    return pixels;
+}
+
+std::vector<Texture> makeTextures()
+{
+    ThreadPool           threadPool(1);
+    std::vector<Texture> textures;
+    textures.push_back(Texture(makePixels(37, 19), Texture::Dimensions{37, 19})
+                           .withMipmaps(threadPool));
+    textures.push_back(Texture::fromPixel(0.25f, 0.5f, 0.75f, 1.0f));
+    textures.push_back(Texture(makePixels(64, 16), Texture::Dimensions{64, 16})
+                           .withMipmaps(threadPool));
+    textures.push_back(Texture(makePixels(5, 70), Texture::Dimensions{5, 70})
+                           .withMipmaps(threadPool));
+    return textures;
+}
+
+// Requires that sampling each texel of `numMipLevels` levels from `baseLevel` of `texture` in the
+// atlas yields the texture's pixel.
+void requireAtlasTexelsMatch(
+    const TextureAtlas&           atlas,
+    const TextureAtlasDescriptor& descriptor,
+    const Texture&                texture,
+    const std::uint32_t           baseLevel)
+{
+    for (std::uint32_t level = 0; level < descriptor.numMipLevels; ++level)
+    {
+        const Texture::Dimensions dimensions = texture.mipLevelDimensions(baseLevel + level);
+        const std::span<const std::uint32_t> pixels = texture.mipLevel(baseLevel + level);
+        for (std::uint32_t y = 0; y < dimensions.height; ++y)
+        {
+            for (std::uint32_t x = 0; x < dimensions.width; ++x)
+            {
+                const glm::vec2 uv(
+                    (static_cast<float>(x) + 0.5f) / dimensions.width,
+                    (static_cast<float>(y) + 0.5f) / dimensions.height);
+                REQUIRE(
+                    sampleTextureAtlas(atlas.texels, descriptor, uv, static_cast<float>(level)) ==
+                    pixels[y * dimensions.width + x]);
+            }
+        }
+    }
+}
+
+// A xorshift generator, for sampling positions which do not depend on the standard library.
+std::uint32_t nextRandom(std::uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+} // namespace
+
+SCENARIO("Pack textures into an atlas", "[texture-atlas]")
+{
+    GIVEN("textures with mip chains")
+    {
+        const std::vector<Texture> textures = makeTextures();
+
+        for (const TexelLayout layout : {TexelLayout::RowMajor, TexelLayout::Tiled})
+        {
+            const TextureAtlas atlas = buildTextureAtlas(textures, layout, 1 << 20);
+
+            THEN("sampling each texel of each mip level yields the texture's pixel")
+            {
+                REQUIRE(atlas.descriptors.size() == textures.size());
+                REQUIRE(atlas.stats.hasMipChains);
+                REQUIRE(atlas.stats.numDownscaledTextures == 0);
+                for (std::size_t i = 0; i < textures.size(); ++i)
+                {
+                    const TextureAtlasDescriptor& descriptor = atlas.descriptors[i];
+                    REQUIRE(descriptor.numMipLevels == textures[i].numMipLevels());
+                    REQUIRE(descriptor.layout == layout);
+                    requireAtlasTexelsMatch(atlas, descriptor, textures[i], 0);
+                }
+            }
+
+            THEN("the regions are aligned to tiles and do not overlap")
+            {
+                const Texture::Dimensions  dimensions = atlas.stats.dimensions;
+                std::vector<std::uint32_t> owners(
+                    static_cast<std::size_t>(dimensions.width) * dimensions.height, 0);
+                for (std::size_t i = 0; i < atlas.descriptors.size(); ++i)
+                {
+                    const TextureAtlasDescriptor& descriptor = atlas.descriptors[i];
+                    REQUIRE(descriptor.x % TEXEL_TILE_SIZE == 0);
+                    REQUIRE(descriptor.y % TEXEL_TILE_SIZE == 0);
+                    REQUIRE(descriptor.atlasWidth == dimensions.width);
+
+                    const Texture::Dimensions region = textureAtlasRegionDimensions(
+                        Texture::Dimensions{descriptor.width, descriptor.height},
+                        descriptor.numMipLevels);
+                    REQUIRE(descriptor.x + region.width <= dimensions.width);
+                    REQUIRE(descriptor.y + region.height <= dimensions.height);
+                    for (std::uint32_t y = 0; y < region.height; ++y)
+                    {
+                        for (std::uint32_t x = 0; x < region.width; ++x)
+                        {
+                            std::uint32_t& owner = owners
+                                [(descriptor.y + y) * dimensions.width + descriptor.x + x];
+                            REQUIRE(owner == 0);
+                            owner = static_cast<std::uint32_t>(i + 1);
+                        }
+                    }
+                }
+            }
+
+            THEN("the occupancy is the fraction of the atlas covered by texels")
+            {
+                std::size_t numTexels = 0;
+                for (const Texture& texture : textures)
+                {
+                    numTexels += texture.mipChain().size();
+                }
+                const float occupancy =
+                    static_cast<float>(numTexels) / static_cast<float>(atlas.texels.size());
+                REQUIRE(atlas.stats.occupancy == occupancy);
+                REQUIRE(atlas.stats.occupancy <= 1.0f);
+            }
+        }
+
+        WHEN("the budget is smaller than the mip chains")
+        {
+            const TextureAtlas atlas = buildTextureAtlas(textures, TexelLayout::Tiled, 4 * 9000);
+
+            THEN("only level 0 of each texture is packed")
+            {
+                REQUIRE(!atlas.stats.hasMipChains);
+                REQUIRE(atlas.stats.numDownscaledTextures == 0);
+                REQUIRE(atlas.texels.size() * sizeof(Texture::BgraPixel) <= 4 * 9000);
+                for (std::size_t i = 0; i < textures.size(); ++i)
+                {
+                    REQUIRE(atlas.descriptors[i].numMipLevels == 1);
+                    requireAtlasTexelsMatch(atlas, atlas.descriptors[i], textures[i], 0);
+                }
+            }
+        }
+
+        WHEN("the budget is smaller than level 0 of the textures")
+        {
+            const TextureAtlas atlas = buildTextureAtlas(textures, TexelLayout::Tiled, 4 * 2048);
+
+            THEN("the largest textures are replaced by a lower mip level")
+            {
+                REQUIRE(atlas.stats.numDownscaledTextures > 0);
+                REQUIRE(atlas.texels.size() * sizeof(Texture::BgraPixel) <= 4 * 2048);
+                for (std::size_t i = 0; i < textures.size(); ++i)
+                {
+                    const TextureAtlasDescriptor& descriptor = atlas.descriptors[i];
+                    // The base level is the level with the descriptor's dimensions.
+                    std::uint32_t baseLevel = 0;
+                    while (textures[i].mipLevelDimensions(baseLevel).width != descriptor.width ||
+                           textures[i].mipLevelDimensions(baseLevel).height != descriptor.height)
+                    {
+                        ++baseLevel;
+                        REQUIRE(baseLevel < textures[i].numMipLevels());
+                    }
+                    requireAtlasTexelsMatch(atlas, descriptor, textures[i], baseLevel);
+                }
+            }
+        }
+
+        WHEN("the budget is too small for the smallest mip levels")
+        {
+            THEN("building the atlas throws")
+            {
+                REQUIRE_THROWS_AS(
+                    buildTextureAtlas(textures, TexelLayout::Tiled, 64), std::runtime_error);
+            }
+        }
+    }
+
+    GIVEN("a texture in RGBA channel order")
+    {
+        const Texture rgba(
+            std::vector<std::uint32_t>{0x11223344u, 0x55667788u},
+            Texture::Dimensions{2, 1},
+            Texture::ChannelOrder::Rgba);
+
+        THEN("the atlas texels are BGRA")
+        {
+            const TextureAtlas atlas =
+                buildTextureAtlas(std::span(&rgba, 1), TexelLayout::RowMajor, 1 << 20);
+            REQUIRE(atlas.texels[0] == 0x11443322u);
+            REQUIRE(atlas.texels[1] == 0x55887766u);
+        }
+    }
+}
+
+TEST_CASE("Texture atlas sampling throughput", "[texture-atlas][.benchmark]")
+{
+    // Larger than the caches. Each path samples texels near the previous sample, like neighbouring
+    // incoherent rays hitting the same surface.
+    const std::uint32_t  size = 4096;
+    std::vector<Texture> textures;
+    textures.push_back(Texture(makePixels(size, size), Texture::Dimensions{size, size}));
+    const TextureAtlas rowMajor = buildTextureAtlas(textures, TexelLayout::RowMajor, 1ull << 30);
+    const TextureAtlas tiled = buildTextureAtlas(textures, TexelLayout::Tiled, 1ull << 30);
+
+    const auto samplePaths = [](const TextureAtlas& atlas) {
+        std::uint32_t state = 0x9e3779b9u;
+        std::uint32_t sum = 0;
+        for (std::uint32_t path = 0; path < 4096; ++path)
+        {
+            glm::vec2 uv(
+                static_cast<float>(nextRandom(state)) / 4294967296.0f,
+                static_cast<float>(nextRandom(state)) / 4294967296.0f);
+            for (std::uint32_t i = 0; i < 64; ++i)
+            {
+                const std::uint32_t r = nextRandom(state);
+                uv += glm::vec2(
+                          static_cast<float>(r & 0xffu) - 127.5f,
+                          static_cast<float>((r >> 8) & 0xffu) - 127.5f) /
+                      (16.0f * size);
+                sum += sampleTextureAtlas(atlas.texels, atlas.descriptors[0], uv, 0.0f);
+            }
+        }
+        return sum;
+    };
+
+    BENCHMARK("row-major layout") { return samplePaths(rowMajor); };
+    BENCHMARK("tiled layout") { return samplePaths(tiled); };
+}
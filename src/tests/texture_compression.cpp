@@ -0,0 +1,230 @@
+#include <common/texture.hpp>
+#include <common/texture_compression.hpp>
+#include <common/thread_pool.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <span>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+std::uint32_t channel(const Texture::BgraPixel pixel, const std::uint32_t ch)
+{
+    return (pixel >> (8 * ch)) & 0xffu;
+}
+
+// The largest difference of any channel of any texel.
+std::uint32_t maxChannelError(
+    const std::span<const Texture::BgraPixel> lhs,
+    const std::span<const Texture::BgraPixel> rhs)
+{
+    REQUIRE(lhs.size() == rhs.size());
+    std::uint32_t error = 0;
+    for (std::size_t i = 0; i < lhs.size(); ++i)
+    {
+        for (std::uint32_t ch = 0; ch < 4; ++ch)
+        {
+            error = std::max(
+                error,
+                static_cast<std::uint32_t>(std::abs(
+                    static_cast<int>(channel(lhs[i], ch)) - static_cast<int>(channel(rhs[i], ch)))));
+        }
+    }
+    return error;
+}
+
+double squaredError(
+    const std::span<const Texture::BgraPixel> lhs,
+    const std::span<const Texture::BgraPixel> rhs)
+{
+    double error = 0.0;
+    for (std::size_t i = 0; i < lhs.size(); ++i)
+    {
+        for (std::uint32_t ch = 0; ch < 4; ++ch)
+        {
+            const double d = static_cast<double>(channel(lhs[i], ch)) - channel(rhs[i], ch);
+            error += d * d;
+        }
+    }
+    return error;
+}
+
+// An opaque texture with a smooth gradient and some noise.
+Texture makeTexture(const std::uint32_t width, const std::uint32_t height)
+{
+    std::vector<Texture::BgraPixel> pixels;
+    std::uint32_t                   state = 0x9e3779b9u;
+    for (std::uint32_t y = 0; y < height; ++y)
+    {
+        for (std::uint32_t x = 0; x < width; ++x)
+        {
+            state = state * 1664525u + 1013904223u;
+            const std::uint32_t noise = state >> 29;
+            const std::uint32_t r = (x + y) * 4;
+            const std::uint32_t g = 200 - (x + y) * 3;
+            const std::uint32_t b = 128 + noise;
+            pixels.push_back(b | (g << 8) | (r << 16) | (0xffu << 24));
+        }
+    }
+    return Texture(std::move(pixels), Texture::Dimensions{width, height});
+}
+
+TextureBlock makeBlock(const Texture::BgraPixel c0, const Texture::BgraPixel c1)
+{
+    TextureBlock block;
+    for (std::size_t i = 0; i < block.size(); ++i)
+    {
+        block[i] = (i % 3 == 0) ? c0 : c1;
+    }
+    return block;
+}
+} // namespace
+
+SCENARIO("Compress textures into blocks", "[texture-compression]")
+{
+    ThreadPool threadPool(2);
+
+    GIVEN("a texture whose dimensions are not multiples of the block size, with a mip chain")
+    {
+        const Texture texture = makeTexture(37, 19).withMipmaps(threadPool);
+
+        for (const TextureCompression compression :
+             {TextureCompression::Bc1, TextureCompression::Bc7})
+        {
+            const CompressedTexture fast = compressTexture(
+                texture, compression, TextureCompressionQuality::Fast, threadPool);
+            const CompressedTexture high = compressTexture(
+                texture, compression, TextureCompressionQuality::High, threadPool);
+
+            THEN("each mip level is stored in whole blocks")
+            {
+                REQUIRE(fast.numMipLevels() == texture.numMipLevels());
+                REQUIRE(fast.dimensions() == texture.dimensions());
+                REQUIRE(
+                    fast.mipChain().size() ==
+                    CompressedTexture::mipChainNumBytes(
+                        texture.dimensions(), compression, texture.numMipLevels()));
+                REQUIRE(fast.mipLevel(0).size() == 10 * 5 * compressedBlockNumBytes(compression));
+                REQUIRE(
+                    fast.mipLevel(fast.numMipLevels() - 1).size() ==
+                    compressedBlockNumBytes(compression));
+            }
+
+            THEN("the decompressed texture is close to the source texture")
+            {
+                const Texture decompressed = fast.decompress();
+                REQUIRE(decompressed.dimensions() == texture.dimensions());
+                REQUIRE(decompressed.numMipLevels() == texture.numMipLevels());
+                // BC1 stores four colors per block, and the small mip levels are steep gradients,
+                // whose eight texels per block are spread over more than 128 levels of red.
+                const std::uint32_t maxError = compression == TextureCompression::Bc1 ? 24 : 16;
+                REQUIRE(maxChannelError(decompressed.mipLevel(0), texture.mipLevel(0)) <= 16);
+                REQUIRE(
+                    maxChannelError(decompressed.mipChain(), texture.mipChain()) <= maxError);
+            }
+
+            THEN("the high quality fit has no more error than the fast fit")
+            {
+                REQUIRE(
+                    squaredError(high.decompress().mipChain(), texture.mipChain()) <=
+                    squaredError(fast.decompress().mipChain(), texture.mipChain()));
+            }
+
+            THEN("the borrowed blocks decompress to the same texture")
+            {
+                const CompressedTexture borrowed = CompressedTexture::fromBorrowedBlocks(
+                    fast.mipChain(), fast.dimensions(), compression, fast.numMipLevels());
+                REQUIRE(borrowed == fast);
+                REQUIRE(borrowed.decompress() == fast.decompress());
+            }
+        }
+    }
+
+    GIVEN("a texture in RGBA channel order")
+    {
+        const Texture bgra = makeTexture(8, 8);
+        const Texture rgba = bgra.withChannelOrder(Texture::ChannelOrder::Rgba);
+
+        THEN("it compresses to the same blocks as the BGRA texture")
+        {
+            REQUIRE(
+                compressTexture(
+                    rgba, TextureCompression::Bc7, TextureCompressionQuality::Fast, threadPool) ==
+                compressTexture(
+                    bgra, TextureCompression::Bc7, TextureCompressionQuality::Fast, threadPool));
+        }
+    }
+}
+
+SCENARIO("Encode and decode single blocks", "[texture-compression]")
+{
+    GIVEN("a block with two colors")
+    {
+        const TextureBlock texels = makeBlock(0xff000000u, 0xffffffffu);
+
+        THEN("BC1 decodes the high quality block exactly")
+        {
+            std::array<std::uint8_t, 8> block;
+            encodeBc1Block(texels, TextureCompressionQuality::High, block);
+            REQUIRE(decodeBc1Block(block) == texels);
+            encodeBc1Block(texels, TextureCompressionQuality::Fast, block);
+            REQUIRE(maxChannelError(decodeBc1Block(block), texels) <= 16);
+        }
+
+        THEN("BC7 decodes the high quality block exactly")
+        {
+            // The channels of a BC7 mode 6 endpoint share their least significant bit.
+            const TextureBlock           oddTexels = makeBlock(0xff010101u, 0xffffffffu);
+            std::array<std::uint8_t, 16> block;
+            encodeBc7Block(oddTexels, TextureCompressionQuality::High, block);
+            REQUIRE(decodeBc7Block(block) == oddTexels);
+            encodeBc7Block(texels, TextureCompressionQuality::Fast, block);
+            REQUIRE(maxChannelError(decodeBc7Block(block), texels) <= 8);
+        }
+    }
+
+    GIVEN("a block with translucent texels")
+    {
+        const TextureBlock texels = makeBlock(0x20406080u, 0xe0c0a090u);
+
+        THEN("BC7 preserves the alpha channel")
+        {
+            std::array<std::uint8_t, 16> block;
+            encodeBc7Block(texels, TextureCompressionQuality::High, block);
+            REQUIRE(maxChannelError(decodeBc7Block(block), texels) <= 2);
+        }
+
+        THEN("BC1 decodes opaque texels")
+        {
+            std::array<std::uint8_t, 8> block;
+            encodeBc1Block(texels, TextureCompressionQuality::High, block);
+            for (const Texture::BgraPixel texel : decodeBc1Block(block))
+            {
+                REQUIRE(texel >> 24 == 0xffu);
+            }
+        }
+    }
+
+    GIVEN("a BC7 block which is not in mode 6")
+    {
+        std::array<std::uint8_t, 16> block{};
+        block[0] = 0x01u;
+
+        THEN("it decodes to transparent black")
+        {
+            for (const Texture::BgraPixel texel : decodeBc7Block(block))
+            {
+                REQUIRE(texel == 0);
+            }
+        }
+    }
+}
@@ -0,0 +1,350 @@
+#include <common/texture.hpp>
+#include <common/texture_sampling.hpp>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+Texture::BgraPixel bgra(const std::uint32_t r, const std::uint32_t g, const std::uint32_t b)
+{
+    return 0xff000000u | (r << 16) | (g << 8) | b;
+}
+
+// A texture with a unique value in every texel of every mip level.
+Texture makeTexture(const Texture::Dimensions dimensions, const std::uint32_t numMipLevels)
+{
+    std::vector<Texture::Pixel> pixels(Texture::mipChainSize(dimensions, numMipLevels));
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = static_cast<Texture::Pixel>(i * 2654435761u);
+    }
+    return Texture(std::move(pixels), dimensions, Texture::ChannelOrder::Bgra, numMipLevels);
+}
+
+// The texel which `textureLookup` in the shaders returns.
+Texture::Pixel nearestTexel(const Texture& texture, const glm::vec2 uv, const float lod)
+{
+    const std::uint32_t level = static_cast<std::uint32_t>(std::clamp(
+        std::floor(lod + 0.5f), 0.0f, static_cast<float>(texture.numMipLevels() - 1)));
+    const Texture::Dimensions dims = texture.mipLevelDimensions(level);
+    const float               u = uv.x - std::floor(uv.x);
+    const float               v = uv.y - std::floor(uv.y);
+    const std::uint32_t       x =
+        std::min(static_cast<std::uint32_t>(u * dims.width), dims.width - 1);
+    const std::uint32_t       y =
+        std::min(static_cast<std::uint32_t>(v * dims.height), dims.height - 1);
+    return texture.mipLevel(level)[static_cast<std::size_t>(y) * dims.width + x];
+}
+
+Texture::Pixel levelTexel(
+    const Texture&      texture,
+    const std::uint32_t level,
+    const std::uint32_t x,
+    const std::uint32_t y)
+{
+    return texture.mipLevel(level)[y * texture.mipLevelDimensions(level).width + x];
+}
+
+bool approxEqual(const glm::vec3& a, const glm::vec3& b)
+{
+    const float margin = 1e-6f;
+    return a.r == Catch::Approx(b.r).margin(margin) && a.g == Catch::Approx(b.g).margin(margin) &&
+           a.b == Catch::Approx(b.b).margin(margin);
+}
+
+// A deterministic sequence of coordinates in [minValue, maxValue).
+float sequence(const std::size_t i, const float minValue, const float maxValue)
+{
+    const float t = std::fmod(0.6180339887f * static_cast<float>(i + 1), 1.0f);
+    return minValue + t * (maxValue - minValue);
+}
+} // namespace
+
+SCENARIO("Decode sRGB texels with a lookup table", "[texture-sampling]")
+{
+    GIVEN("the lookup table")
+    {
+        const std::array<float, 256>& table = srgbToLinearTable();
+
+        THEN("each entry is the value of the shaders' gamma curve")
+        {
+            for (std::size_t i = 0; i < table.size(); ++i)
+            {
+                REQUIRE(table[i] == std::pow(static_cast<float>(i) / 255.0f, 2.2f));
+            }
+        }
+
+        THEN("texels decode each color channel, and ignore alpha")
+        {
+            REQUIRE(
+                decodeTexel(bgra(10, 128, 255) & 0x00ffffffu) ==
+                glm::vec3(table[10], table[128], table[255]));
+        }
+    }
+}
+
+SCENARIO("Sample textures with filtering and wrapping", "[texture-sampling]")
+{
+    GIVEN("a texture with a mip chain")
+    {
+        const Texture texture = makeTexture(Texture::Dimensions{8, 4}, 4);
+
+        WHEN("sampling with the default sampler")
+        {
+            const TextureSampler sampler;
+
+            THEN("the texel of the shaders' textureLookup is returned")
+            {
+                for (std::size_t i = 0; i < 256; ++i)
+                {
+                    const glm::vec2 uv{sequence(i, -2.0f, 3.0f), sequence(i + 1000, -2.0f, 3.0f)};
+                    const float     lod = sequence(i + 2000, -1.0f, 4.0f);
+                    REQUIRE(
+                        sampleTexture(texture, uv, lod, sampler) ==
+                        decodeTexel(nearestTexel(texture, uv, lod)));
+                }
+            }
+        }
+
+        WHEN("sampling with bilinear filtering")
+        {
+            const TextureSampler sampler{.filter = TextureFilter::Bilinear};
+
+            THEN("sampling a texel center returns the texel")
+            {
+                REQUIRE(
+                    sampleTexture(texture, glm::vec2{2.5f / 8.0f, 1.5f / 4.0f}, 0.0f, sampler) ==
+                    decodeTexel(levelTexel(texture, 0, 2, 1)));
+                REQUIRE(
+                    sampleTexture(texture, glm::vec2{0.5f / 4.0f, 0.5f / 2.0f}, 1.0f, sampler) ==
+                    decodeTexel(levelTexel(texture, 1, 0, 0)));
+            }
+
+            THEN("sampling between two texels averages them")
+            {
+                const glm::vec3 expected = 0.5f * (decodeTexel(levelTexel(texture, 0, 2, 1)) +
+                                                   decodeTexel(levelTexel(texture, 0, 3, 1)));
+                REQUIRE(approxEqual(
+                    sampleTexture(texture, glm::vec2{3.0f / 8.0f, 1.5f / 4.0f}, 0.0f, sampler),
+                    expected));
+            }
+        }
+
+        WHEN("sampling the edge of a texture with bilinear filtering")
+        {
+            const glm::vec2 uv{0.0f, 1.5f / 4.0f};
+            const glm::vec3 firstColumn = decodeTexel(levelTexel(texture, 0, 0, 1));
+            const glm::vec3 lastColumn = decodeTexel(levelTexel(texture, 0, 7, 1));
+
+            THEN("repeating blends the first and last columns")
+            {
+                const TextureSampler sampler{
+                    .filter = TextureFilter::Bilinear, .wrap = TextureWrap::Repeat};
+                REQUIRE(approxEqual(
+                    sampleTexture(texture, uv, 0.0f, sampler), 0.5f * (firstColumn + lastColumn)));
+            }
+
+            THEN("clamping returns the first column")
+            {
+                const TextureSampler sampler{
+                    .filter = TextureFilter::Bilinear, .wrap = TextureWrap::ClampToEdge};
+                REQUIRE(sampleTexture(texture, uv, 0.0f, sampler) == firstColumn);
+                REQUIRE(
+                    sampleTexture(texture, uv - glm::vec2{1.5f, 0.0f}, 0.0f, sampler) ==
+                    firstColumn);
+            }
+
+            THEN("mirroring returns the first column and reflects uvs")
+            {
+                const TextureSampler sampler{
+                    .filter = TextureFilter::Bilinear, .wrap = TextureWrap::MirroredRepeat};
+                REQUIRE(sampleTexture(texture, uv, 0.0f, sampler) == firstColumn);
+                REQUIRE(
+                    sampleTexture(texture, glm::vec2{-0.25f, 0.75f}, 0.0f, sampler) ==
+                    sampleTexture(texture, glm::vec2{0.25f, 0.75f}, 0.0f, sampler));
+                REQUIRE(
+                    sampleTexture(texture, glm::vec2{1.25f, 0.75f}, 0.0f, sampler) ==
+                    sampleTexture(texture, glm::vec2{0.75f, 0.75f}, 0.0f, sampler));
+            }
+        }
+
+        WHEN("sampling with trilinear filtering")
+        {
+            const TextureSampler trilinear{.filter = TextureFilter::Trilinear};
+            const TextureSampler bilinear{.filter = TextureFilter::Bilinear};
+            const glm::vec2      uv{0.3f, 0.6f};
+
+            THEN("an integer lod samples a single level")
+            {
+                REQUIRE(
+                    sampleTexture(texture, uv, 1.0f, trilinear) ==
+                    sampleTexture(texture, uv, 1.0f, bilinear));
+            }
+
+            THEN("a fractional lod blends the two levels around it")
+            {
+                const glm::vec3 level1 = sampleTexture(texture, uv, 1.0f, bilinear);
+                const glm::vec3 level2 = sampleTexture(texture, uv, 2.0f, bilinear);
+                REQUIRE(approxEqual(
+                    sampleTexture(texture, uv, 1.25f, trilinear),
+                    level1 + 0.25f * (level2 - level1)));
+            }
+
+            THEN("lods past the mip chain sample the least detailed level")
+            {
+                REQUIRE(
+                    sampleTexture(texture, uv, 7.5f, trilinear) ==
+                    decodeTexel(levelTexel(texture, 3, 0, 0)));
+            }
+        }
+    }
+}
+
+SCENARIO("Sample textures in batches", "[texture-sampling]")
+{
+    GIVEN("textures of different sizes")
+    {
+        std::vector<Texture> textures;
+        textures.push_back(makeTexture(Texture::Dimensions{8, 4}, 4));
+        textures.push_back(makeTexture(Texture::Dimensions{5, 7}, 3));
+        textures.push_back(makeTexture(Texture::Dimensions{1, 1}, 1));
+
+        THEN("each lookup of a batch matches sampleTexture")
+        {
+            for (const TextureFilter filter :
+                 {TextureFilter::Nearest, TextureFilter::Bilinear, TextureFilter::Trilinear})
+            {
+                for (const TextureWrap wrap :
+                     {TextureWrap::Repeat, TextureWrap::ClampToEdge, TextureWrap::MirroredRepeat})
+                {
+                    const TextureSampler sampler{.filter = filter, .wrap = wrap};
+                    for (std::size_t first = 0; first < 256; first += TEXTURE_SAMPLE_BATCH_SIZE)
+                    {
+                        TextureSampleBatch batch;
+                        for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+                        {
+                            const std::size_t i = first + lane;
+                            batch.textureIndices[lane] =
+                                static_cast<std::uint32_t>(i % textures.size());
+                            batch.u[lane] = sequence(i, -2.0f, 3.0f);
+                            batch.v[lane] = sequence(i + 1000, -2.0f, 3.0f);
+                            batch.lod[lane] = sequence(i + 2000, -1.0f, 4.0f);
+                        }
+
+                        const LinearColorBatch colors =
+                            sampleTextureBatch(textures, batch, sampler);
+                        for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+                        {
+                            const glm::vec3 expected = sampleTexture(
+                                textures[batch.textureIndices[lane]],
+                                glm::vec2{batch.u[lane], batch.v[lane]},
+                                batch.lod[lane],
+                                sampler);
+                            REQUIRE(approxEqual(
+                                glm::vec3(colors.r[lane], colors.g[lane], colors.b[lane]),
+                                expected));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("sRGB decode throughput", "[texture-sampling][.benchmark]")
+{
+    std::vector<Texture::BgraPixel> texels(1 << 20);
+    for (std::size_t i = 0; i < texels.size(); ++i)
+    {
+        texels[i] = static_cast<Texture::BgraPixel>(i * 2654435761u);
+    }
+
+    BENCHMARK("pow per texel")
+    {
+        glm::vec3 sum(0.0f);
+        for (const Texture::BgraPixel texel : texels)
+        {
+            const glm::vec3 srgb = glm::vec3(
+                                       static_cast<float>((texel >> 16) & 0xffu),
+                                       static_cast<float>((texel >> 8) & 0xffu),
+                                       static_cast<float>(texel & 0xffu)) /
+                                   255.0f;
+            sum += glm::pow(srgb, glm::vec3(2.2f));
+        }
+        return sum;
+    };
+    BENCHMARK("lookup table")
+    {
+        glm::vec3 sum(0.0f);
+        for (const Texture::BgraPixel texel : texels)
+        {
+            sum += decodeTexel(texel);
+        }
+        return sum;
+    };
+}
+
+TEST_CASE("Texture sampling throughput", "[texture-sampling][.benchmark]")
+{
+    std::vector<Texture> textures;
+    textures.push_back(makeTexture(Texture::Dimensions{1024, 1024}, 11));
+    textures.push_back(makeTexture(Texture::Dimensions{512, 256}, 10));
+
+    std::vector<TextureSampleBatch> batches(1 << 14);
+    for (std::size_t b = 0; b < batches.size(); ++b)
+    {
+        for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+        {
+            const std::size_t i = b * TEXTURE_SAMPLE_BATCH_SIZE + lane;
+            batches[b].textureIndices[lane] = static_cast<std::uint32_t>(i % textures.size());
+            batches[b].u[lane] = sequence(i, -1.0f, 2.0f);
+            batches[b].v[lane] = sequence(i + batches.size(), -1.0f, 2.0f);
+            batches[b].lod[lane] = sequence(i + 2 * batches.size(), 0.0f, 4.0f);
+        }
+    }
+
+    const TextureSampler sampler{.filter = TextureFilter::Trilinear};
+
+    BENCHMARK("sampleTexture")
+    {
+        float sum = 0.0f;
+        for (const TextureSampleBatch& batch : batches)
+        {
+            for (std::size_t lane = 0; lane < TEXTURE_SAMPLE_BATCH_SIZE; ++lane)
+            {
+                sum += sampleTexture(
+                           textures[batch.textureIndices[lane]],
+                           glm::vec2{batch.u[lane], batch.v[lane]},
+                           batch.lod[lane],
+                           sampler)
+                           .r;
+            }
+        }
+        return sum;
+    };
+    BENCHMARK("sampleTextureBatch")
+    {
+        float sum = 0.0f;
+        for (const TextureSampleBatch& batch : batches)
+        {
+            const LinearColorBatch colors = sampleTextureBatch(textures, batch, sampler);
+            for (const float r : colors.r)
+            {
+                sum += r;
+            }
+        }
+        return sum;
+    };
+}
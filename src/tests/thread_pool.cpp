@@ -0,0 +1,97 @@
+#include <common/thread_pool.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using namespace nlrs;
+
+SCENARIO("Run tasks on a ThreadPool", "[thread_pool]")
+{
+    GIVEN("a thread pool with four threads")
+    {
+        ThreadPool threadPool(4);
+
+        THEN("every pushed task runs before wait returns")
+        {
+            std::vector<int> results(1000, 0);
+            for (std::size_t i = 0; i < results.size(); ++i)
+            {
+                threadPool.push([&results, i]() { results[i] = static_cast<int>(i) * 2; });
+            }
+            threadPool.wait();
+
+            for (std::size_t i = 0; i < results.size(); ++i)
+            {
+                REQUIRE(results[i] == static_cast<int>(i) * 2);
+            }
+        }
+
+        THEN("tasks pushed by tasks also run before wait returns")
+        {
+            std::atomic<int> count = 0;
+            for (int i = 0; i < 10; ++i)
+            {
+                threadPool.push([&]() {
+                    for (int j = 0; j < 10; ++j)
+                    {
+                        threadPool.push([&count]() { ++count; });
+                    }
+                });
+            }
+            threadPool.wait();
+            REQUIRE(count == 100);
+        }
+
+        THEN("an exception thrown by a task is rethrown by wait")
+        {
+            threadPool.push([]() { throw std::runtime_error("task failed"); });
+            REQUIRE_THROWS_WITH(threadPool.wait(), "task failed");
+
+            AND_THEN("the pool can be used again")
+            {
+                std::atomic<int> count = 0;
+                threadPool.push([&count]() { ++count; });
+                threadPool.wait();
+                REQUIRE(count == 1);
+            }
+        }
+    }
+
+    GIVEN("a thread pool without threads")
+    {
+        ThreadPool threadPool(0);
+
+        THEN("wait runs the tasks on the calling thread")
+        {
+            int count = 0;
+            for (int i = 0; i < 10; ++i)
+            {
+                threadPool.push([&count]() { ++count; });
+            }
+            threadPool.wait();
+            REQUIRE(count == 10);
+        }
+    }
+
+    GIVEN("a thread pool without threads, with queued tasks")
+    {
+        int count = 0;
+        {
+            ThreadPool threadPool(0);
+            for (int i = 0; i < 10; ++i)
+            {
+                threadPool.push([&count]() { ++count; });
+            }
+            threadPool.push([]() { throw std::runtime_error("task failed"); });
+        }
+
+        THEN("destroying the pool without waiting runs the tasks")
+        {
+            REQUIRE(count == 10);
+        }
+    }
+}
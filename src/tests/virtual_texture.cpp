@@ -0,0 +1,190 @@
+#include <common/texture.hpp>
+#include <common/thread_pool.hpp>
+#include <common/virtual_texture.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using namespace nlrs;
+
+namespace
+{
+// A texture with a unique value in every texel of every mip level.
+Texture makeTexture(const Texture::Dimensions dimensions, const std::uint32_t numMipLevels)
+{
+    std::vector<Texture::Pixel> pixels(Texture::mipChainSize(dimensions, numMipLevels));
+    for (std::size_t i = 0; i < pixels.size(); ++i)
+    {
+        pixels[i] = static_cast<Texture::Pixel>(i * 2654435761u);
+    }
+    return Texture(std::move(pixels), dimensions, Texture::ChannelOrder::Bgra, numMipLevels);
+}
+
+// The texel of `level` which VirtualTextureCache::sample returns for `uv`.
+Texture::Pixel texel(const Texture& texture, const std::uint32_t level, const glm::vec2 uv)
+{
+    const Texture::Dimensions dims = texture.mipLevelDimensions(level);
+    const std::uint32_t       x =
+        std::min(static_cast<std::uint32_t>(uv.x * dims.width), dims.width - 1);
+    const std::uint32_t       y =
+        std::min(static_cast<std::uint32_t>(uv.y * dims.height), dims.height - 1);
+    return texture.mipLevel(level)[static_cast<std::size_t>(y) * dims.width + x];
+}
+} // namespace
+
+SCENARIO("Split textures into pages", "[virtual-texture]")
+{
+    GIVEN("textures whose levels are not multiples of the page size")
+    {
+        ThreadPool                 threadPool(4);
+        std::vector<Texture>       textures;
+        textures.push_back(makeTexture(Texture::Dimensions{200, 70}, 4));
+        textures.push_back(makeTexture(Texture::Dimensions{1, 1}, 1));
+        textures.push_back(makeTexture(Texture::Dimensions{64, 64}, 7));
+
+        WHEN("the textures are paged")
+        {
+            const PagedTextures paged = pageTextures(textures, threadPool);
+
+            THEN("each level occupies whole pages")
+            {
+                REQUIRE(paged.descriptors.size() == 3);
+                // The levels of the first texture are 4x2, 2x1, 1x1 and 1x1 pages.
+                REQUIRE(paged.descriptors[0].firstPage == 0);
+                REQUIRE(paged.descriptors[1].firstPage == 12);
+                REQUIRE(paged.descriptors[2].firstPage == 13);
+                REQUIRE(paged.pages.size() == 20 * VIRTUAL_TEXTURE_PAGE_NUM_TEXELS);
+            }
+
+            THEN("the pages reassemble into the textures")
+            {
+                const std::vector<Texture> unpaged = unpageTextures(VirtualTexturePages{
+                    .descriptors = paged.descriptors, .pages = paged.pages});
+                REQUIRE(unpaged == textures);
+            }
+        }
+    }
+}
+
+SCENARIO("Sample textures through a page cache", "[virtual-texture]")
+{
+    ThreadPool           threadPool(4);
+    std::vector<Texture> textures;
+    textures.push_back(makeTexture(Texture::Dimensions{256, 128}, 3));
+    textures.push_back(makeTexture(Texture::Dimensions{32, 32}, 2));
+    const PagedTextures       paged = pageTextures(textures, threadPool);
+    const VirtualTexturePages pages{.descriptors = paged.descriptors, .pages = paged.pages};
+
+    const glm::vec2 uv{0.8f, 0.3f};
+
+    GIVEN("a cache with room for every page")
+    {
+        VirtualTextureCache cache(pages, 16);
+
+        THEN("only the least detailed levels are resident initially")
+        {
+            // Level 2 of the first texture and level 1 of the second texture.
+            REQUIRE(cache.sample(0, uv, 0.0f) == texel(textures[0], 2, uv));
+            REQUIRE(cache.sample(1, uv, 0.0f) == texel(textures[1], 1, uv));
+        }
+
+        WHEN("the cache is updated after sampling")
+        {
+            cache.sample(0, uv, 0.0f);
+            const VirtualTextureUpdate update = cache.update(threadPool);
+
+            THEN("the requested pages are loaded")
+            {
+                // The sample fell back from level 0 to level 1 to level 2.
+                REQUIRE(update.numTouchedPages == 3);
+                REQUIRE(update.numRequestedPages == 2);
+                REQUIRE(update.numLoadedPages == 2);
+                REQUIRE(update.numEvictedPages == 0);
+                REQUIRE(cache.sample(0, uv, 0.0f) == texel(textures[0], 0, uv));
+                REQUIRE(cache.sample(0, uv, 1.0f) == texel(textures[0], 1, uv));
+            }
+        }
+
+        WHEN("the textures are sampled everywhere")
+        {
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                for (float v = 0.0f; v < 1.0f; v += 1.0f / 64.0f)
+                {
+                    for (float u = 0.0f; u < 1.0f; u += 1.0f / 64.0f)
+                    {
+                        cache.sample(0, glm::vec2{u, v}, 0.0f);
+                    }
+                }
+                cache.update(threadPool);
+            }
+
+            THEN("the samples match the textures")
+            {
+                for (float v = 0.0f; v < 1.0f; v += 1.0f / 16.0f)
+                {
+                    for (float u = 0.0f; u < 1.0f; u += 1.0f / 16.0f)
+                    {
+                        const glm::vec2 sampleUv{u, v};
+                        REQUIRE(
+                            cache.sample(0, sampleUv, 0.0f) == texel(textures[0], 0, sampleUv));
+                    }
+                }
+            }
+
+            THEN("uvs outside of [0, 1] repeat the texture")
+            {
+                REQUIRE(
+                    cache.sample(0, uv + glm::vec2{2.0f, -1.0f}, 0.0f) ==
+                    texel(textures[0], 0, uv));
+            }
+        }
+    }
+
+    GIVEN("a cache with room for the least detailed levels and one more page")
+    {
+        VirtualTextureCache cache(pages, 3);
+
+        WHEN("two pages are used in turn")
+        {
+            const glm::vec2 otherUv{0.1f, 0.9f};
+            cache.sample(0, uv, 1.0f);
+            cache.update(threadPool);
+            cache.sample(0, otherUv, 1.0f);
+            const VirtualTextureUpdate update = cache.update(threadPool);
+
+            THEN("the least recently used page is evicted")
+            {
+                REQUIRE(update.numEvictedPages == 1);
+                REQUIRE(cache.sample(0, otherUv, 1.0f) == texel(textures[0], 1, otherUv));
+                REQUIRE(cache.sample(0, uv, 1.0f) == texel(textures[0], 2, uv));
+            }
+        }
+
+        WHEN("more pages are requested than fit")
+        {
+            cache.sample(0, uv, 0.0f);
+            const VirtualTextureUpdate update = cache.update(threadPool);
+
+            THEN("the less detailed level is loaded first")
+            {
+                REQUIRE(update.numRequestedPages == 2);
+                REQUIRE(update.numLoadedPages == 1);
+                REQUIRE(cache.sample(0, uv, 0.0f) == texel(textures[0], 1, uv));
+            }
+        }
+    }
+
+    GIVEN("a cache without room for the least detailed levels")
+    {
+        THEN("constructing it throws")
+        {
+            REQUIRE_THROWS_AS(VirtualTextureCache(pages, 1), std::runtime_error);
+        }
+    }
+}